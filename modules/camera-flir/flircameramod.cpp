@@ -149,7 +149,9 @@ public:
         statusMessage(QStringLiteral("Recording (max %1 FPS)").arg(qRound(actualFramerate), 4));
         const auto clockSyncPtr = clockSync.get();
         m_camera->setStartTime(m_syTimer->startTime());
+        const auto traceName = traceIntern(name());
         while (m_running) {
+            SY_TRACE_SPAN("camera-flir:acquireFrame", traceName);
             Frame frame;
             if (!m_camera->acquireFrame(frame, clockSyncPtr)) {
                 m_running = false;
@@ -76,7 +76,8 @@ public:
     {
         return ModuleFeature::REALTIME |
                ModuleFeature::CORE_AFFINITY |
-               ModuleFeature::SHOW_SETTINGS;
+               ModuleFeature::SHOW_SETTINGS |
+               ModuleFeature::PREPARE_CONCURRENT;
     }
 
     bool prepare(const TestSubject &) override
@@ -91,10 +92,17 @@ public:
             raiseError(QStringLiteral("Unable to connect camera: %1").arg(m_camera->lastError()));
             return false;
         }
-        m_camera->setResolution(m_camSettingsWindow->resolution());
 
-        m_camSettingsWindow->setRunning(true);
-        m_fps = m_camSettingsWindow->framerate();
+        // we may be prepared in a worker thread, so talk to our UI in the main thread
+        cv::Size resolution;
+        QString clockDomain;
+        runInMainThread([&]() {
+            resolution = m_camSettingsWindow->resolution();
+            clockDomain = m_camSettingsWindow->clockDomain();
+            m_fps = m_camSettingsWindow->framerate();
+            m_camSettingsWindow->setRunning(true);
+        });
+        m_camera->setResolution(resolution);
         m_camera->setFramerate(m_fps);
 
         // set the required stream metadata for video capture
@@ -106,7 +114,7 @@ public:
         m_outStream->start();
 
         // set up clock synchronizer
-        m_clockSync = initClockSynchronizer(m_fps);
+        m_clockSync = initClockSynchronizer(clockDomain, m_fps);
         m_clockSync->setStrategies(TimeSyncStrategy::SHIFT_TIMESTAMPS_FWD | TimeSyncStrategy::SHIFT_TIMESTAMPS_BWD);
 
         // start the synchronizer
@@ -135,10 +143,13 @@ public:
         auto frameRecordFailedCount = 0;
         m_stopped = false;
 
+        const auto traceName = traceIntern(name());
+
         // wait until we actually start acquiring data
         waitCondition->wait(this);
 
         while (m_running) {
+            SY_TRACE_SPAN("camera-generic:acquireFrame", traceName);
             const auto cycleStartTime = currentTimePoint();
 
             Frame frame;
@@ -195,6 +206,7 @@ public:
         settings.insert("saturation", m_camera->saturation());
         settings.insert("hue", m_camera->hue());
         settings.insert("gain", m_camera->gain());
+        settings.insert("clock_domain", m_camSettingsWindow->clockDomain());
     }
 
     bool loadSettings(const QString &, const QVariantHash &settings, const QByteArray &) override
@@ -208,6 +220,7 @@ public:
         m_camera->setHue(settings.value("hue").toDouble());
         m_camera->setGain(settings.value("gain").toDouble());
         m_camSettingsWindow->setFramerate(settings.value("fps").toInt());
+        m_camSettingsWindow->setClockDomain(settings.value("clock_domain").toString());
 
         m_camSettingsWindow->updateValues();
         return true;
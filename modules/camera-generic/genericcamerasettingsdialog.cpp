@@ -61,6 +61,16 @@ void GenericCameraSettingsDialog::setFramerate(int fps)
     ui->fpsSpinBox->setValue(fps);
 }
 
+QString GenericCameraSettingsDialog::clockDomain() const
+{
+    return ui->clockDomainEdit->text().trimmed();
+}
+
+void GenericCameraSettingsDialog::setClockDomain(const QString &domain)
+{
+    ui->clockDomainEdit->setText(domain);
+}
+
 void GenericCameraSettingsDialog::setRunning(bool running)
 {
     ui->cameraGroupBox->setEnabled(!running);
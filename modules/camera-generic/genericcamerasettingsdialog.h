@@ -41,6 +41,9 @@ public:
     int framerate() const;
     void setFramerate(int fps);
 
+    QString clockDomain() const;
+    void setClockDomain(const QString &domain);
+
     void setRunning(bool running);
 
     void updateValues();
@@ -256,6 +256,8 @@ public:
         const auto appsink = GST_APP_SINK(m_camera->getCaptureSink());
         gst_app_sink_set_max_buffers (appsink, 1);
 
+        const auto traceName = traceIntern(name());
+
         // wait until we actually start acquiring data
         waitCondition->wait(this);
 
@@ -266,6 +268,7 @@ public:
 
         statusMessage("");
         while (m_running) {
+            SY_TRACE_SPAN("camera-tis:acquireFrame", traceName);
             g_autoptr(GstSample) sample = nullptr;
             auto frameRecvTime = MTIMER_FUNC_TIMESTAMP(sample = gst_app_sink_pull_sample(appsink));
             if (sample == nullptr) {
@@ -315,7 +318,7 @@ public:
                     if (m_firstTimestamp)
                         clockSync->setStrategies(TimeSyncStrategy::NONE);
                 }
-                frame.time = usecToMsec(frameRecvTime);
+                frame.time = frameRecvTime;
                 m_firstTimestamp = false;
 
                 m_outStream->push(frame);
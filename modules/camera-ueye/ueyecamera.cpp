@@ -237,7 +237,7 @@ cv::Mat UEyeCamera::getFrame(time_t *time)
 
     auto res = is_GetImageInfo (m_hCam, m_camBufId, &imgInfo, sizeof(imgInfo));
     if (res == IS_SUCCESS) {
-        (*time) = imgInfo.u64TimestampDevice / 10000; // 0.1µs resolution, but we want ms
+        (*time) = imgInfo.u64TimestampDevice / 10; // 0.1µs resolution, but we want µs
         if ((*time) == m_lastFrameTime) {
             // we don't want to fetch the same frame twice
             return frame;
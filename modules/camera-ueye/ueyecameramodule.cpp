@@ -106,10 +106,13 @@ public:
         time_t startTime = 0;
         auto frameRecordFailedCount = 0;
 
+        const auto traceName = traceIntern(name());
+
         // wait until we are actually started
         startWaitCondition->wait(this);
 
         while (m_running) {
+            SY_TRACE_SPAN("camera-ueye:acquireFrame", traceName);
             const auto cycleStartTime = currentTimePoint();
 
             time_t time;
@@ -128,9 +131,9 @@ public:
                 firstFrame = false;
                 startTime = time;
             }
-            auto timestampMsec = std::chrono::milliseconds(time - startTime);
+            const auto timestamp = microseconds_t(time - startTime);
 
-            m_outStream->push(Frame(mat, timestampMsec));
+            m_outStream->push(Frame(mat, timestamp));
 
             // wait a bit if necessary, to keep the right framerate
             const auto cycleTime = timeDiffToNowMsec(cycleStartTime);
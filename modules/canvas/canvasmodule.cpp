@@ -164,7 +164,7 @@ public:
         // get all timing info and show the image
         const auto frame = maybeFrame.value();
         m_cvView->showImage(frame.mat);
-        const auto frameTime = frame.time.count();
+        const auto frameTime = usecToMsec(frame.time).count();
 
         if (m_expectedFps == 0) {
             m_cvView->setStatusText(QTime::fromMSecsSinceStartOfDay(frameTime).toString("hh:mm:ss.zzz"));
@@ -52,6 +52,7 @@ private:
 
     struct timespec m_interval;
     bool m_stopped;
+    long m_index;
 
 public:
     explicit ClockModule(QObject *parent = nullptr)
@@ -80,7 +81,11 @@ public:
 
     ModuleDriverKind driver() const override
     {
-        return ModuleDriverKind::THREAD_DEDICATED;
+        // a dedicated thread may run with realtime priority, otherwise
+        // we are driven by a precise timer in an event thread
+        if (m_settingsDlg->highPriorityThread())
+            return ModuleDriverKind::THREAD_DEDICATED;
+        return ModuleDriverKind::EVENTS_DEDICATED;
     }
 
     bool prepare(const TestSubject &) override
@@ -97,6 +102,9 @@ public:
         const long long interval_ns = m_settingsDlg->pulseIntervalUs() * 1000;
         m_interval.tv_sec = interval_ns / NSEC_IN_SEC;
         m_interval.tv_nsec = interval_ns % NSEC_IN_SEC;
+        m_index = 0;
+        if (!m_settingsDlg->highPriorityThread())
+            registerPreciseTimedEvent(&ClockModule::onPulseTimer, microseconds_t(m_settingsDlg->pulseIntervalUs()));
 
         // prepare pulse info writer
         m_tsWriter.close();
@@ -122,17 +130,17 @@ public:
         return true;
     }
 
+    void onPulseTimer(microseconds_t &, const PreciseTimerTick &tick)
+    {
+        // keep counting intervals, even if we could not emit a pulse for some of them
+        m_index += static_cast<long>(tick.missedTicks);
+        emitPulse();
+    }
+
     void runThread(OptionalWaitCondition *startWaitCondition) override
     {
         struct timespec ts;
         int r;
-        long index;
-
-        ControlCommand cmd;
-        cmd.kind = ControlCommandKind::STEP;
-
-        QStringList row;
-        row.append(QString());
 
         startWaitCondition->wait(this);
 
@@ -145,7 +153,6 @@ public:
         ts = timespecAdd(ts, m_interval);
 
         m_stopped = false;
-        index = 0;
         while (m_running) {
             r = clock_nanosleep(CLOCK_MONOTONIC,
                                 TIMER_ABSTIME,
@@ -175,12 +182,7 @@ public:
             // set future expected clock time
             ts = timespecAdd(ts, m_interval);
 
-            const auto tsUsec = m_syTimer->timeSinceStartUsec().count();
-
-            m_ctlOut->push(cmd);
-            row[0] = QString::number(tsUsec);
-            m_tabOut->push(row);
-            m_tsWriter.writeTimes(++index, tsUsec);
+            emitPulse();
         }
 
         m_stopped = true;
@@ -207,7 +209,16 @@ public:
     }
 
 private:
+    void emitPulse()
+    {
+        ControlCommand cmd;
+        cmd.kind = ControlCommandKind::STEP;
 
+        const auto tsUsec = m_syTimer->timeSinceStartUsec().count();
+        m_ctlOut->push(cmd);
+        m_tabOut->push(QStringList() << QString::number(tsUsec));
+        m_tsWriter.writeTimes(++m_index, tsUsec);
+    }
 };
 
 QString DevelClockModuleInfo::id() const
@@ -119,7 +119,7 @@ private:
                     cv::FONT_HERSHEY_COMPLEX,
                     1.5,
                     cv::Scalar(255,255,255));
-        frame.time = m_syTimer->timeSinceStartMsec();
+        frame.time = m_syTimer->timeSinceStartUsec();
 
         std::this_thread::sleep_for(std::chrono::microseconds(5000) - timeDiffUsec(currentTimePoint(), startTime));
         return frame;
@@ -22,10 +22,13 @@
 #include <QMetaEnum>
 #include <QDebug>
 
+using namespace Syntalos;
+
 struct SerialFirmata::Private {
     QScopedPointer<QSerialPort> port;
     QString device;
     int baudRate;
+    symaster_timepoint lastReadTime;
 
     Private()
     : baudRate(57600)
@@ -57,7 +60,7 @@ bool SerialFirmata::setDevice(const QString &device)
             setStatusText(QStringLiteral("Device not set"));
 
         } else {
-            d->port.reset(new QSerialPort(device));
+            d->port.reset(new QSerialPort(device, this));
             d->port->setBaudRate(d->baudRate);
             connect(
                 d->port.data(),
@@ -95,6 +98,11 @@ bool SerialFirmata::setDevice(const QString &device)
     return success;
 }
 
+symaster_timepoint SerialFirmata::lastReadTime() const
+{
+    return d->lastReadTime;
+}
+
 int SerialFirmata::baudRate() const
 {
     return d->baudRate;
@@ -136,7 +144,9 @@ void SerialFirmata::onReadyRead()
 
     do {
         len = d->port->read(buffer, sizeof(buffer));
-        if(len>0)
+        if(len>0) {
+            d->lastReadTime = currentTimePoint();
             bytesRead(buffer, len);
+        }
     } while(len>0);
 }
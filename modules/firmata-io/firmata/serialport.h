@@ -21,6 +21,7 @@
 #include "backend.h"
 
 #include <cstdint>
+#include "syclock.h"
 
 //! A serial port based Firmata backend
 
@@ -53,6 +54,9 @@ public:
 
     bool isReady();
 
+    //! Time at which the data that is currently being processed was read
+    Syntalos::symaster_timepoint lastReadTime() const;
+
 signals:
     void deviceChanged(const QString &device);
     void baudRateChanged(int baudRate);
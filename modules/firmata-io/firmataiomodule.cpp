@@ -20,8 +20,16 @@
 #include "firmataiomodule.h"
 
 #include <QDebug>
-#include <QTimer>
 #include <QThread>
+#include <QEventLoop>
+#include <QSocketNotifier>
+#include <QAbstractEventDispatcher>
+#include <queue>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <sys/timerfd.h>
+#include <unistd.h>
 #include "firmatasettingsdialog.h"
 #include "firmata/serialport.h"
 
@@ -41,6 +49,116 @@ struct FmPin
     uint8_t id;
 };
 
+/**
+ * @brief Schedules the end of digital pulses
+ *
+ * Pulses never block the I/O thread: We set the pin high right away, and this
+ * scheduler arms a timerfd to wake us up when the earliest pending pulse has to end.
+ * Any number of pulses can be in flight at the same time, a new pulse on a pin
+ * that is still high extends the current pulse.
+ */
+class PulseScheduler
+{
+public:
+    PulseScheduler()
+    {
+        m_timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (m_timerFd < 0)
+            qCritical("Unable to create timerfd for pulse scheduling: %s", std::strerror(errno));
+        m_pinDeadline.fill(0);
+    }
+
+    ~PulseScheduler()
+    {
+        if (m_timerFd >= 0)
+            close(m_timerFd);
+    }
+
+    int fd() const
+    {
+        return m_timerFd;
+    }
+
+    void schedule(uint8_t pinId, const microseconds_t &width)
+    {
+        const auto deadline = monotonicNowNsec() + width.count() * 1000;
+        m_pinDeadline[pinId] = deadline;
+        m_queue.push(std::make_pair(deadline, pinId));
+        rearm();
+    }
+
+    /**
+     * Call @endPulseFn for every pin whose pulse has ended.
+     */
+    template<typename Fn>
+    void dispatchDue(Fn endPulseFn)
+    {
+        uint64_t expirations;
+        if (read(m_timerFd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+            qWarning("Unable to read pulse timerfd: %s", std::strerror(errno));
+
+        const auto now = monotonicNowNsec();
+        while (!m_queue.empty() && m_queue.top().first <= now) {
+            const auto entry = m_queue.top();
+            m_queue.pop();
+
+            // ignore entries of pulses that were extended later
+            if (m_pinDeadline[entry.second] != entry.first)
+                continue;
+            m_pinDeadline[entry.second] = 0;
+            endPulseFn(entry.second);
+        }
+        rearm();
+    }
+
+    /**
+     * End all pulses that are still active immediately.
+     */
+    template<typename Fn>
+    void finishAll(Fn endPulseFn)
+    {
+        for (size_t i = 0; i < m_pinDeadline.size(); i++) {
+            if (m_pinDeadline[i] != 0)
+                endPulseFn(static_cast<uint8_t>(i));
+        }
+        clear();
+    }
+
+    void clear()
+    {
+        m_queue = decltype(m_queue)();
+        m_pinDeadline.fill(0);
+        rearm();
+    }
+
+private:
+    int m_timerFd;
+    std::priority_queue<std::pair<int64_t, uint8_t>,
+                        std::vector<std::pair<int64_t, uint8_t>>,
+                        std::greater<std::pair<int64_t, uint8_t>>> m_queue;
+    std::array<int64_t, 256> m_pinDeadline;
+
+    static int64_t monotonicNowNsec()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 * 1000 * 1000 + ts.tv_nsec;
+    }
+
+    void rearm()
+    {
+        struct itimerspec its = {};
+        if (!m_queue.empty()) {
+            // an all-zero value would disarm the timer, so we never set an exact zero here
+            const auto deadline = std::max<int64_t>(m_queue.top().first, 1);
+            its.it_value.tv_sec = deadline / (1000 * 1000 * 1000);
+            its.it_value.tv_nsec = deadline % (1000 * 1000 * 1000);
+        }
+        if (timerfd_settime(m_timerFd, TFD_TIMER_ABSTIME, &its, nullptr) < 0)
+            qWarning("Unable to arm pulse timer: %s", std::strerror(errno));
+    }
+};
+
 class FirmataIOModule : public AbstractModule
 {
     Q_OBJECT
@@ -52,36 +170,44 @@ private:
     QHash<QString, FmPin> m_namePinMap;
     QHash<int, QString> m_pinNameMap;
 
-    QTimer *m_evTimer;
     std::shared_ptr<StreamInputPort<FirmataControl>> m_inFmCtl;
     std::shared_ptr<DataStream<FirmataData>> m_fmStream;
     std::shared_ptr<StreamSubscription<FirmataControl>> m_fmCtlSub;
 
+    PulseScheduler m_pulses;
+    microseconds_t m_defaultPulseWidth;
+    std::atomic<QAbstractEventDispatcher*> m_ioDispatcher;
+
 public:
     explicit FirmataIOModule(QObject *parent = nullptr)
         : AbstractModule(parent),
-          m_settingsDialog(nullptr)
+          m_settingsDialog(nullptr),
+          m_firmata(nullptr),
+          m_ioDispatcher(nullptr)
     {
-        m_firmata = new SerialFirmata(this);
         m_settingsDialog = new FirmataSettingsDialog;
         addSettingsWindow(m_settingsDialog);
         m_settingsDialog->setWindowTitle(QStringLiteral("%1 - Settings").arg(name()));
 
-        m_evTimer = new QTimer(this);
-        m_evTimer->setInterval(0);
-        connect(m_evTimer, &QTimer::timeout, this, &FirmataIOModule::checkControlCommands);
-
         m_inFmCtl = registerInputPort<FirmataControl>(QStringLiteral("fmctl"), QStringLiteral("Firmata Control"));
         m_fmStream = registerOutputPort<FirmataData>(QStringLiteral("fmdata"), QStringLiteral("Firmata Data"));
     }
 
     ~FirmataIOModule() override
     {
+        // the Firmata interface has no parent, as it is moved between threads
+        delete m_firmata;
     }
 
     ModuleFeatures features() const override
     {
-        return ModuleFeature::SHOW_SETTINGS;
+        return ModuleFeature::SHOW_SETTINGS |
+               ModuleFeature::REALTIME;
+    }
+
+    ModuleDriverKind driver() const override
+    {
+        return ModuleDriverKind::THREAD_DEDICATED;
     }
 
     bool prepare(const TestSubject &) override
@@ -89,11 +215,17 @@ public:
         // cleanup
         m_namePinMap.clear();
         m_pinNameMap.clear();
+        m_pulses.clear();
+        m_defaultPulseWidth = microseconds_t(m_settingsDialog->defaultPulseWidthUsec());
 
+        // the previous interface was left without thread affinity by our I/O thread,
+        // so we can safely delete it from here
         delete m_firmata;
-        m_firmata = new SerialFirmata(this);
-        connect(m_firmata, &SerialFirmata::digitalRead, this, &FirmataIOModule::recvDigitalRead);
-        connect(m_firmata, &SerialFirmata::digitalPinRead, this, &FirmataIOModule::recvDigitalPinRead);
+        m_firmata = new SerialFirmata;
+
+        // our I/O thread handles all serial data, so our slots are called directly from there
+        connect(m_firmata, &SerialFirmata::digitalRead, this, &FirmataIOModule::recvDigitalRead, Qt::DirectConnection);
+        connect(m_firmata, &SerialFirmata::digitalPinRead, this, &FirmataIOModule::recvDigitalPinRead, Qt::DirectConnection);
 
         auto serialDevice = m_settingsDialog->serialPort();
         if (serialDevice.isEmpty()) {
@@ -127,26 +259,75 @@ public:
         if (m_inFmCtl->hasSubscription())
             m_fmCtlSub = m_inFmCtl->subscription();
 
+        // release the interface, so our I/O thread can take it over
+        m_firmata->moveToThread(nullptr);
+
+        setStateReady();
         return true;
     }
 
-    void start() override
+    void runThread(OptionalWaitCondition *startWaitCondition) override
     {
+        m_firmata->moveToThread(QThread::currentThread());
+        QEventLoop loop;
+        m_ioDispatcher = QAbstractEventDispatcher::instance();
+
+        // end pulses exactly when they are due
+        QSocketNotifier pulseNotifier(m_pulses.fd(), QSocketNotifier::Read);
+        connect(&pulseNotifier, &QSocketNotifier::activated, [&]() {
+            m_pulses.dispatchDue([&](uint8_t pinId) { pinSetValue(pinId, false); });
+        });
+
+        // react to control commands as soon as they arrive
+        std::unique_ptr<QSocketNotifier> ctlNotifier;
+        if (m_fmCtlSub.get() != nullptr) {
+            const auto efd = m_fmCtlSub->enableNotify();
+            ctlNotifier.reset(new QSocketNotifier(efd, QSocketNotifier::Read));
+            connect(ctlNotifier.get(), &QSocketNotifier::activated, [&]() {
+                m_fmCtlSub->acknowledgeNotify();
+                processControlCommands();
+            });
+        }
+
+        startWaitCondition->wait(this);
+
+        // handle commands that were sent before we started
         if (m_fmCtlSub.get() != nullptr)
-            m_evTimer->start();
+            processControlCommands();
+
+        while (m_running)
+            loop.processEvents(QEventLoop::WaitForMoreEvents);
+
+        // don't leave any pins high that are still pulsing
+        m_pulses.finishAll([&](uint8_t pinId) { pinSetValue(pinId, false); });
+
+        m_ioDispatcher = nullptr;
+        ctlNotifier.reset();
+        m_firmata->moveToThread(nullptr);
     }
 
     void stop() override
     {
-        m_evTimer->stop();
+        AbstractModule::stop();
+
+        // wake up our I/O thread, so it notices that we have stopped
+        auto dispatcher = m_ioDispatcher.load();
+        if (dispatcher != nullptr)
+            dispatcher->wakeUp();
     }
 
-    void checkControlCommands()
+    void processControlCommands()
+    {
+        while (true) {
+            const auto maybeCtl = m_fmCtlSub->peekNext();
+            if (!maybeCtl.has_value())
+                return;
+            handleControlCommand(maybeCtl.value());
+        }
+    }
+
+    void handleControlCommand(const FirmataControl &ctl)
     {
-        const auto maybeCtl = m_fmCtlSub->peekNext();
-        if (!maybeCtl.has_value())
-            return;
-        const auto ctl = maybeCtl.value();
         switch (ctl.command) {
         case FirmataCommandKind::NEW_DIG_PIN:
             newDigitalPin(ctl.pinId, ctl.pinName, ctl.isOutput, ctl.isPullUp);
@@ -161,12 +342,19 @@ public:
             else
                 pinSetValue(ctl.pinName, ctl.value);
             break;
-        case FirmataCommandKind::WRITE_DIGITAL_PULSE:
+        case FirmataCommandKind::WRITE_DIGITAL_PULSE: {
+            auto width = ctl.value > 0? microseconds_t(ctl.value) : m_defaultPulseWidth;
+            if (width.count() > FIRMATA_MAX_PULSE_WIDTH_USEC) {
+                qWarning().noquote() << "Firmata: Requested pulse width of" << width.count()
+                                     << "µs is too long, limiting it to" << FIRMATA_MAX_PULSE_WIDTH_USEC << "µs";
+                width = microseconds_t(FIRMATA_MAX_PULSE_WIDTH_USEC);
+            }
             if (ctl.pinName.isEmpty())
-                pinSignalPulse(ctl.pinId);
+                pinSignalPulse(ctl.pinId, width);
             else
-                pinSignalPulse(ctl.pinName);
+                pinSignalPulse(ctl.pinName, width);
             break;
+        }
         default:
             qWarning() << "Received not-implemented Firmata instruction of type" << QString::number(static_cast<int>(ctl.command));
             break;
@@ -176,11 +364,13 @@ public:
     void serializeSettings(const QString &, QVariantHash &settings, QByteArray &) override
     {
         settings.insert("serial_port", m_settingsDialog->serialPort());
+        settings.insert("pulse_width_usec", m_settingsDialog->defaultPulseWidthUsec());
     }
 
     bool loadSettings(const QString &, const QVariantHash &settings, const QByteArray &) override
     {
         m_settingsDialog->setSerialPort(settings.value("serial_port").toString());
+        m_settingsDialog->setDefaultPulseWidthUsec(settings.value("pulse_width_usec", 50 * 1000).toInt());
         return true;
     }
 
@@ -232,18 +422,20 @@ public:
         pinSetValue(pin.id, value);
     }
 
-    void pinSignalPulse(int pinId)
+    void pinSignalPulse(int pinId, const microseconds_t &width)
     {
         pinSetValue(pinId, true);
-        QThread::usleep(50 * 1000); // sleep 50msec
-        pinSetValue(pinId, false);
+        m_pulses.schedule(static_cast<uint8_t>(pinId), width);
     }
 
-    void pinSignalPulse(const QString &pinName)
+    void pinSignalPulse(const QString &pinName, const microseconds_t &width)
     {
-        pinSetValue(pinName, true);
-        QThread::usleep(50 * 1000); // sleep 50msec
-        pinSetValue(pinName, false);
+        auto pin = m_namePinMap.value(pinName);
+        if (pin.kind == PinKind::Unknown) {
+            qCritical() << QStringLiteral("Unable to deliver message to pin '%1' (pin does not exist, it needs to be registered first)").arg(pinName);
+            return;
+        }
+        pinSignalPulse(pin.id, width);
     }
 
 private slots:
@@ -252,7 +444,7 @@ private slots:
         // value of a digital port changed: 8 possible pin changes
         const int first = port * 8;
         const int last = first + 7;
-        const auto timestamp = m_syTimer->timeSinceStartMsec();
+        const auto timestamp = timeDiffMsec(m_firmata->lastReadTime(), m_syTimer->startTime());
 
         qDebug("Firmata: Digital port read: %d (%d - %d)", value, first, last);
         for (const FmPin p : m_namePinMap.values()) {
@@ -274,7 +466,7 @@ private slots:
     void recvDigitalPinRead(uint8_t pin, bool value)
     {
         FirmataData fdata;
-        fdata.time = m_syTimer->timeSinceStartMsec();
+        fdata.time = timeDiffMsec(m_firmata->lastReadTime(), m_syTimer->startTime());
         fdata.isDigital = true;
         fdata.pinId = pin;
         fdata.pinName = m_pinNameMap.value(pin);
@@ -28,6 +28,7 @@ FirmataSettingsDialog::FirmataSettingsDialog(QWidget *parent) :
 {
     ui->setupUi(this);
     setWindowIcon(QIcon(":/icons/generic-config"));
+    ui->pulseWidthSpinBox->setMaximum(FIRMATA_MAX_PULSE_WIDTH_USEC);
 
     // Arduino / Firmata I/O
     auto allPorts = QSerialPortInfo::availablePorts();
@@ -44,6 +45,7 @@ FirmataSettingsDialog::~FirmataSettingsDialog()
 void FirmataSettingsDialog::setRunning(bool running)
 {
     ui->portsComboBox->setEnabled(!running);
+    ui->pulseWidthSpinBox->setEnabled(!running);
 }
 
 QString FirmataSettingsDialog::serialPort() const
@@ -61,3 +63,13 @@ void FirmataSettingsDialog::setSerialPort(QString port)
         }
     }
 }
+
+int FirmataSettingsDialog::defaultPulseWidthUsec() const
+{
+    return ui->pulseWidthSpinBox->value();
+}
+
+void FirmataSettingsDialog::setDefaultPulseWidthUsec(int usec)
+{
+    ui->pulseWidthSpinBox->setValue(qBound(1, usec, FIRMATA_MAX_PULSE_WIDTH_USEC));
+}
@@ -22,6 +22,11 @@
 
 #include <QDialog>
 
+/**
+ * Longest digital pulse we accept, in microseconds
+ */
+static const int FIRMATA_MAX_PULSE_WIDTH_USEC = 60 * 1000 * 1000;
+
 namespace Ui {
 class FirmataSettingsDialog;
 }
@@ -39,6 +44,9 @@ public:
     QString serialPort() const;
     void setSerialPort(QString port);
 
+    int defaultPulseWidthUsec() const;
+    void setDefaultPulseWidthUsec(int usec);
+
 private:
     Ui::FirmataSettingsDialog *ui;
 };
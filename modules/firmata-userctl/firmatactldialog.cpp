@@ -111,7 +111,7 @@ FirmataOutputWidget::FirmataOutputWidget(std::shared_ptr<DataStream<FirmataContr
         FirmataControl ctl;
         ctl.pinId = m_sbPinId->value();
         ctl.command = FirmataCommandKind::WRITE_DIGITAL_PULSE;
-        ctl.value = 1;
+        ctl.value = 0; // use the default pulse width of the I/O module
         m_fmCtlStream->push(ctl);
     });
 
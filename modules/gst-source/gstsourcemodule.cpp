@@ -0,0 +1,406 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gstsourcemodule.h"
+
+#include <unistd.h>
+#include <gst/app/gstappsink.h>
+#include "streams/frametype.h"
+
+#include "gstsourcesettingsdlg.h"
+#include "gstvideomat.h"
+
+SYNTALOS_MODULE(GstSourceModule)
+
+namespace Syntalos {
+    Q_LOGGING_CATEGORY(logGstSource, "mod.gstsource")
+}
+
+class GstSourceModule : public AbstractModule
+{
+    Q_OBJECT
+private:
+    GstSourceSettingsDlg *m_settingsDlg;
+    std::shared_ptr<DataStream<Frame>> m_outStream;
+
+    GstElement *m_pipeline;
+    GstAppSink *m_appsink;
+    GstVideoInfo m_videoInfo;
+    bool m_isLive;
+    bool m_dropStale;
+    uint m_maxBuffers;
+
+    std::atomic_bool m_stopped;
+    std::atomic<uint64_t> m_arrivedCount;
+    std::unique_ptr<SecondaryClockSynchronizer> m_clockSync;
+
+public:
+    explicit GstSourceModule(QObject *parent = nullptr)
+        : AbstractModule(parent),
+          m_pipeline(nullptr),
+          m_appsink(nullptr),
+          m_isLive(false),
+          m_dropStale(false),
+          m_maxBuffers(4),
+          m_stopped(true),
+          m_arrivedCount(0)
+    {
+        m_outStream = registerOutputPort<Frame>(QStringLiteral("video"), QStringLiteral("Video"));
+
+        m_settingsDlg = new GstSourceSettingsDlg;
+        addSettingsWindow(m_settingsDlg);
+        gst_video_info_init(&m_videoInfo);
+
+        setName(name());
+    }
+
+    ~GstSourceModule() override
+    {
+        destroyPipeline();
+    }
+
+    void setName(const QString &name) override
+    {
+        AbstractModule::setName(name);
+        m_settingsDlg->setWindowTitle(QStringLiteral("Settings for %1").arg(name));
+    }
+
+    ModuleDriverKind driver() const override
+    {
+        return ModuleDriverKind::THREAD_DEDICATED;
+    }
+
+    ModuleFeatures features() const override
+    {
+        return ModuleFeature::REALTIME |
+               ModuleFeature::CORE_AFFINITY |
+               ModuleFeature::SHOW_SETTINGS;
+    }
+
+    void destroyPipeline()
+    {
+        if (m_appsink != nullptr) {
+            gst_object_unref(m_appsink);
+            m_appsink = nullptr;
+        }
+        if (m_pipeline != nullptr) {
+            gst_element_set_state(m_pipeline, GST_STATE_NULL);
+            gst_object_unref(m_pipeline);
+            m_pipeline = nullptr;
+        }
+    }
+
+    /**
+     * Fetch the first error message the pipeline has posted, if there is one.
+     */
+    QString pipelineError()
+    {
+        if (m_pipeline == nullptr)
+            return QString();
+
+        g_autoptr(GstBus) bus = gst_element_get_bus(m_pipeline);
+        g_autoptr(GstMessage) msg = gst_bus_pop_filtered(bus, GST_MESSAGE_ERROR);
+        if (msg == nullptr)
+            return QString();
+
+        g_autoptr(GError) error = nullptr;
+        g_autofree gchar *debugInfo = nullptr;
+        gst_message_parse_error(msg, &error, &debugInfo);
+        qCDebug(logGstSource).noquote() << "Pipeline error details:" << debugInfo;
+        return QString::fromUtf8(error->message);
+    }
+
+    static GstPadProbeReturn onAppsinkBuffer(GstPad *, GstPadProbeInfo *, gpointer udata)
+    {
+        auto self = static_cast<GstSourceModule*>(udata);
+        self->m_arrivedCount++;
+        return GST_PAD_PROBE_OK;
+    }
+
+    bool createPipeline(const QString &description)
+    {
+        destroyPipeline();
+
+        // we always add the sink ourselves. If the upstream video already has a format
+        // we can wrap directly, videoconvert works in passthrough mode and won't copy.
+        const auto fullDescription = QStringLiteral("%1 ! videoconvert ! appsink name=syntalos_sink").arg(description);
+        g_autoptr(GError) error = nullptr;
+        m_pipeline = gst_parse_launch(qPrintable(fullDescription), &error);
+        if (error != nullptr) {
+            if (m_pipeline != nullptr)
+                gst_object_unref(m_pipeline);
+            m_pipeline = nullptr;
+            raiseError(QStringLiteral("Unable to create pipeline: %1").arg(QString::fromUtf8(error->message)));
+            return false;
+        }
+
+        m_appsink = GST_APP_SINK(gst_bin_get_by_name(GST_BIN(m_pipeline), "syntalos_sink"));
+        g_autoptr(GstCaps) caps = gst_caps_from_string(GST_VIDEO_MAT_CAPS);
+        gst_app_sink_set_caps(m_appsink, caps);
+
+        // We never let the appsink drop buffers silently. If we can't keep up, upstream
+        // will be blocked and we drop stale frames ourselves, so we can account for them.
+        gst_app_sink_set_max_buffers(m_appsink, m_maxBuffers);
+        gst_app_sink_set_drop(m_appsink, false);
+
+        m_arrivedCount = 0;
+        g_autoptr(GstPad) sinkPad = gst_element_get_static_pad(GST_ELEMENT(m_appsink), "sink");
+        gst_pad_add_probe(sinkPad, GST_PAD_PROBE_TYPE_BUFFER, &GstSourceModule::onAppsinkBuffer, this, nullptr);
+
+        return true;
+    }
+
+    bool prepare(const TestSubject &) override
+    {
+        const auto description = m_settingsDlg->pipeline();
+        if (description.isEmpty()) {
+            raiseError(QStringLiteral("No GStreamer pipeline was set."));
+            return false;
+        }
+        m_maxBuffers = static_cast<uint>(m_settingsDlg->maxBuffers());
+        m_dropStale = m_settingsDlg->dropStale();
+
+        if (!createPipeline(description))
+            return false;
+
+        // we need to know the negotiated video format before we can set up our output stream,
+        // so bring the pipeline up and wait for the first frame
+        const auto ret = gst_element_set_state(m_pipeline, GST_STATE_PAUSED);
+        if (ret == GST_STATE_CHANGE_FAILURE) {
+            raiseError(QStringLiteral("Unable to start pipeline: %1").arg(pipelineError()));
+            destroyPipeline();
+            return false;
+        }
+        m_isLive = ret == GST_STATE_CHANGE_NO_PREROLL;
+
+        g_autoptr(GstSample) sample = nullptr;
+        if (m_isLive) {
+            // live sources only produce data when playing
+            gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
+            sample = gst_app_sink_try_pull_sample(m_appsink, 10 * GST_SECOND);
+        } else {
+            sample = gst_app_sink_try_pull_preroll(m_appsink, 10 * GST_SECOND);
+        }
+        if (sample == nullptr) {
+            const auto error = pipelineError();
+            raiseError(QStringLiteral("Pipeline did not produce any video: %1")
+                       .arg(error.isEmpty()? QStringLiteral("Timed out waiting for the first frame.") : error));
+            destroyPipeline();
+            return false;
+        }
+
+        if (!gst_video_info_from_caps(&m_videoInfo, gst_sample_get_caps(sample))) {
+            raiseError(QStringLiteral("Unable to read video format of the pipeline output."));
+            destroyPipeline();
+            return false;
+        }
+        const auto fps = GST_VIDEO_INFO_FPS_N(&m_videoInfo) / static_cast<double>(GST_VIDEO_INFO_FPS_D(&m_videoInfo));
+        if (fps <= 0) {
+            raiseError(QStringLiteral("The pipeline produces video with a variable framerate. "
+                                      "Please add a `videorate ! video/x-raw, framerate=N/1` to its end."));
+            destroyPipeline();
+            return false;
+        }
+
+        // set the required stream metadata for video capture
+        const auto format = GST_VIDEO_INFO_FORMAT(&m_videoInfo);
+        m_outStream->setMetadataValue("size", QSize(GST_VIDEO_INFO_WIDTH(&m_videoInfo),
+                                                    GST_VIDEO_INFO_HEIGHT(&m_videoInfo)));
+        m_outStream->setMetadataValue("framerate", fps);
+        m_outStream->setMetadataValue("has_color", !GST_VIDEO_FORMAT_INFO_IS_GRAY(GST_VIDEO_INFO_FORMAT_INFO(&m_videoInfo)));
+        if (format == GST_VIDEO_FORMAT_GRAY16_LE)
+            m_outStream->setMetadataValue("depth", CV_16U);
+
+        // start the stream
+        m_outStream->start();
+
+        // set up clock synchronizer
+        m_clockSync = initClockSynchronizer(m_settingsDlg->clockDomain(), fps);
+        m_clockSync->setStrategies(TimeSyncStrategy::SHIFT_TIMESTAMPS_FWD | TimeSyncStrategy::SHIFT_TIMESTAMPS_BWD);
+
+        // start the synchronizer
+        if (!m_clockSync->start()) {
+            raiseError(QStringLiteral("Unable to set up clock synchronizer!"));
+            destroyPipeline();
+            return false;
+        }
+
+        m_settingsDlg->setRunning(true);
+        setStatusMessage(QStringLiteral("Waiting."));
+        setStateReady();
+        return true;
+    }
+
+    void runThread(OptionalWaitCondition *waitCondition) override
+    {
+        m_stopped = false;
+        bool havePts = true;
+        uint64_t pulledCount = 0;
+        uint64_t droppedCount = 0;
+        size_t frameIndex = 0;
+
+        const auto traceName = traceIntern(name());
+
+        // wait until we actually start acquiring data
+        waitCondition->wait(this);
+
+        if (m_isLive) {
+            // frames we received while waiting for the run to start are stale now
+            while (true) {
+                g_autoptr(GstSample) sample = gst_app_sink_try_pull_sample(m_appsink, 0);
+                if (sample == nullptr)
+                    break;
+            }
+            pulledCount = m_arrivedCount;
+        } else {
+            gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
+        }
+
+        setStatusMessage(QStringLiteral("Acquiring frames..."));
+        auto lastStatusTime = currentTimePoint();
+        while (m_running) {
+            SY_TRACE_SPAN("gst-source:acquireFrame", traceName);
+            GstSample *sample = nullptr;
+            auto frameRecvTime = MTIMER_FUNC_TIMESTAMP(sample = gst_app_sink_pull_sample(m_appsink));
+            if (sample == nullptr) {
+                if (gst_app_sink_is_eos(m_appsink)) {
+                    if (m_running) {
+                        setStatusMessage(QStringLiteral("End of stream."));
+                        setStateIdle();
+                    }
+                } else if (m_running) {
+                    raiseError(QStringLiteral("Pipeline failed: %1").arg(pipelineError()));
+                }
+                break;
+            }
+            pulledCount++;
+
+            // skip frames which queued up while we were busy, if requested
+            if (m_dropStale) {
+                while (m_arrivedCount > pulledCount) {
+                    auto newerSample = gst_app_sink_try_pull_sample(m_appsink, 0);
+                    if (newerSample == nullptr)
+                        break;
+                    gst_sample_unref(sample);
+                    sample = newerSample;
+                    frameRecvTime = m_syTimer->timeSinceStartUsec();
+                    pulledCount++;
+                    droppedCount++;
+                }
+            }
+
+            // the frame holds a reference on the buffer, so we can drop the sample right away
+            const auto buffer = gst_sample_get_buffer(sample);
+            Frame frame(frameIndex, gstBufferToMat(buffer, &m_videoInfo), frameRecvTime);
+            const auto pts = GST_BUFFER_PTS(buffer);
+            gst_sample_unref(sample);
+            if (frame.mat.empty()) {
+                qCDebug(logGstSource).noquote() << "Received buffer which could not be mapped, skipping it.";
+                continue;
+            }
+
+            // only do time adjustment if we have valid timestamps
+            if (pts != GST_CLOCK_TIME_NONE) {
+                m_clockSync->processTimestamp(frame.time, std::chrono::duration_cast<microseconds_t>(nanoseconds_t(pts)));
+            } else if (havePts) {
+                havePts = false;
+                m_clockSync->setStrategies(TimeSyncStrategy::NONE);
+            }
+
+            m_outStream->push(frame);
+            frameIndex++;
+
+            const auto now = currentTimePoint();
+            if (timeDiffMsec(now, lastStatusTime).count() > 1000) {
+                lastStatusTime = now;
+                const auto queued = (m_arrivedCount > pulledCount)? m_arrivedCount - pulledCount : 0;
+                setStatusMessage(QStringLiteral("Acquiring frames... (queued: %1/%2, dropped: %3)")
+                                 .arg(queued)
+                                 .arg(m_maxBuffers)
+                                 .arg(droppedCount));
+            }
+        }
+
+        m_stopped = true;
+    }
+
+    void stop() override
+    {
+        AbstractModule::stop();
+
+        // we may still be blocking on the buffer pull, stopping the pipeline
+        // will make it return
+        if (m_pipeline != nullptr)
+            gst_element_set_state(m_pipeline, GST_STATE_NULL);
+        while (!m_stopped) { usleep(1000); }
+
+        destroyPipeline();
+        safeStopSynchronizer(m_clockSync);
+        m_settingsDlg->setRunning(false);
+    }
+
+    void serializeSettings(const QString &, QVariantHash &settings, QByteArray &) override
+    {
+        settings.insert("pipeline", m_settingsDlg->pipeline());
+        settings.insert("max_buffers", m_settingsDlg->maxBuffers());
+        settings.insert("drop_stale", m_settingsDlg->dropStale());
+        settings.insert("clock_domain", m_settingsDlg->clockDomain());
+    }
+
+    bool loadSettings(const QString &, const QVariantHash &settings, const QByteArray &) override
+    {
+        m_settingsDlg->setPipeline(settings.value("pipeline").toString());
+        m_settingsDlg->setMaxBuffers(settings.value("max_buffers", 4).toInt());
+        m_settingsDlg->setDropStale(settings.value("drop_stale", false).toBool());
+        m_settingsDlg->setClockDomain(settings.value("clock_domain").toString());
+        return true;
+    }
+};
+
+QString GstSourceModuleInfo::id() const
+{
+    return QStringLiteral("gst-source");
+}
+
+QString GstSourceModuleInfo::name() const
+{
+    return QStringLiteral("GStreamer Source");
+}
+
+QString GstSourceModuleInfo::description() const
+{
+    return QStringLiteral("Acquire video from an arbitrary GStreamer pipeline, e.g. from V4L devices, network cameras or files.");
+}
+
+QIcon GstSourceModuleInfo::icon() const
+{
+    return QIcon(":/module/camera-generic");
+}
+
+QColor GstSourceModuleInfo::color() const
+{
+    return QColor::fromRgba(qRgba(29, 158, 246, 180)).darker();
+}
+
+AbstractModule *GstSourceModuleInfo::createModule(QObject *parent)
+{
+    return new GstSourceModule(parent);
+}
+
+#include "gstsourcemodule.moc"
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gstsourcesettingsdlg.h"
+#include "ui_gstsourcesettingsdlg.h"
+
+#include <QIcon>
+
+GstSourceSettingsDlg::GstSourceSettingsDlg(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::GstSourceSettingsDlg)
+{
+    ui->setupUi(this);
+    setWindowIcon(QIcon(":/icons/generic-config"));
+}
+
+GstSourceSettingsDlg::~GstSourceSettingsDlg()
+{
+    delete ui;
+}
+
+QString GstSourceSettingsDlg::pipeline() const
+{
+    return ui->pipelineEdit->toPlainText().simplified();
+}
+
+void GstSourceSettingsDlg::setPipeline(const QString &pipeline)
+{
+    ui->pipelineEdit->setPlainText(pipeline);
+}
+
+int GstSourceSettingsDlg::maxBuffers() const
+{
+    return ui->maxBuffersSpinBox->value();
+}
+
+void GstSourceSettingsDlg::setMaxBuffers(int count)
+{
+    ui->maxBuffersSpinBox->setValue(count);
+}
+
+bool GstSourceSettingsDlg::dropStale() const
+{
+    return ui->dropStaleCheckBox->isChecked();
+}
+
+void GstSourceSettingsDlg::setDropStale(bool drop)
+{
+    ui->dropStaleCheckBox->setChecked(drop);
+}
+
+QString GstSourceSettingsDlg::clockDomain() const
+{
+    return ui->clockDomainEdit->text().trimmed();
+}
+
+void GstSourceSettingsDlg::setClockDomain(const QString &domain)
+{
+    ui->clockDomainEdit->setText(domain);
+}
+
+void GstSourceSettingsDlg::setRunning(bool running)
+{
+    ui->pipelineEdit->setReadOnly(running);
+    ui->maxBuffersSpinBox->setEnabled(!running);
+    ui->dropStaleCheckBox->setEnabled(!running);
+    ui->clockDomainEdit->setEnabled(!running);
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "gstvideomat.h"
+
+const char *GST_VIDEO_MAT_CAPS = "video/x-raw, format=(string){ BGR, BGRx, BGRA, GRAY8, GRAY16_LE }";
+
+/**
+ * @brief Allocator for matrices referencing mapped GStreamer video frames
+ *
+ * Instead of freeing memory, it unmaps the video frame and drops our buffer
+ * reference once the last matrix referencing the frame is gone.
+ * Any new allocations are delegated to OpenCV's default allocator.
+ */
+class GstVideoFrameAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData *wrap(GstVideoFrame *vframe, int rows, size_t step) const
+    {
+        auto u = new cv::UMatData(this);
+        u->data = u->origdata = static_cast<uchar*>(GST_VIDEO_FRAME_PLANE_DATA(vframe, 0));
+        u->size = step * static_cast<size_t>(rows);
+        u->userdata = vframe;
+        return u;
+    }
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data,
+                           size_t *step, cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(cv::UMatData *u, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return cv::Mat::getStdAllocator()->allocate(u, accessFlags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *u) const override
+    {
+        if (u == nullptr)
+            return;
+        CV_Assert(u->urefcount >= 0);
+        CV_Assert(u->refcount >= 0);
+        if (u->refcount != 0)
+            return;
+
+        auto vframe = static_cast<GstVideoFrame*>(u->userdata);
+        gst_video_frame_unmap(vframe);
+        delete vframe;
+        delete u;
+    }
+};
+
+static GstVideoFrameAllocator g_gstFrameAllocator;
+
+cv::Mat gstBufferToMat(GstBuffer *buffer, const GstVideoInfo *vinfo)
+{
+    int cvType;
+    switch (GST_VIDEO_INFO_FORMAT(vinfo)) {
+    case GST_VIDEO_FORMAT_BGR:
+        cvType = CV_8UC3;
+        break;
+    case GST_VIDEO_FORMAT_BGRx:
+    case GST_VIDEO_FORMAT_BGRA:
+        cvType = CV_8UC4;
+        break;
+    case GST_VIDEO_FORMAT_GRAY8:
+        cvType = CV_8UC1;
+        break;
+    case GST_VIDEO_FORMAT_GRAY16_LE:
+        cvType = CV_16UC1;
+        break;
+    default:
+        return cv::Mat();
+    }
+
+    // mapping the frame takes a reference on the buffer, which we only drop once
+    // the matrix is released again
+    auto vframe = new GstVideoFrame;
+    if (!gst_video_frame_map(vframe, const_cast<GstVideoInfo*>(vinfo), buffer, GST_MAP_READ)) {
+        delete vframe;
+        return cv::Mat();
+    }
+
+    const auto rows = GST_VIDEO_FRAME_HEIGHT(vframe);
+    const auto step = static_cast<size_t>(GST_VIDEO_FRAME_PLANE_STRIDE(vframe, 0));
+    cv::Mat mat(rows,
+                GST_VIDEO_FRAME_WIDTH(vframe),
+                cvType,
+                GST_VIDEO_FRAME_PLANE_DATA(vframe, 0),
+                step);
+    mat.u = g_gstFrameAllocator.wrap(vframe, rows, step);
+    mat.allocator = &g_gstFrameAllocator;
+    mat.addref();
+
+    return mat;
+}
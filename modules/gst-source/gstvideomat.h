@@ -0,0 +1,39 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <opencv2/core.hpp>
+
+/**
+ * Caps describing all raw video formats gstBufferToMat() is able to wrap.
+ */
+extern const char *GST_VIDEO_MAT_CAPS;
+
+/**
+ * @brief Wrap a GStreamer video buffer in a cv::Mat without copying its data
+ *
+ * The returned matrix keeps @buffer referenced and mapped for as long as the matrix
+ * or any shallow copy of it is alive. Consumers must treat its data as read-only.
+ * Returns an empty matrix if the buffer could not be mapped, or if its pixel
+ * format can not be represented as cv::Mat.
+ */
+cv::Mat gstBufferToMat(GstBuffer *buffer, const GstVideoInfo *vinfo);
@@ -91,7 +91,8 @@ public:
 
     ModuleFeatures features() const override
     {
-        return ModuleFeature::SHOW_SETTINGS;
+        return ModuleFeature::SHOW_SETTINGS |
+               ModuleFeature::PREPARE_CONCURRENT;
     }
 
     void setName(const QString &name) override
@@ -141,8 +142,9 @@ public:
         }
 
         // re-apply previously adjusted control settings and disable
-        // controls we don't want changed
-        m_settingsDialog->setRunning(true);
+        // controls we don't want changed (we may be prepared in a worker thread,
+        // so this needs to happen in the main thread)
+        runInMainThread([&]() { m_settingsDialog->setRunning(true); });
 
         // we need to set the framerate-related stuff after the miniscope has been started, so
         // we will get the right, final FPS value
@@ -207,7 +209,7 @@ public:
         if (mat.empty())
             return;
 
-        self->m_rawOut->push(Frame(mat, frameTime));
+        self->m_rawOut->push(Frame(mat, updatedFrameTime));
     }
 
     static void on_newDisplayFrame(const cv::Mat &mat, const milliseconds_t &time, void *udata)
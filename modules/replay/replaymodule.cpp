@@ -0,0 +1,244 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replaymodule.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "replaysettingsdialog.h"
+#include "replaysources.h"
+
+SYNTALOS_MODULE(ReplayModule)
+
+/**
+ * Time we sleep at most at once while pacing output,
+ * so we react to the run being stopped quickly.
+ */
+static const auto MAX_PACING_SLEEP = microseconds_t(10 * 1000);
+
+/**
+ * Amount of elements we allow to be pending in any output stream
+ * when replaying as fast as possible, before we wait for consumers.
+ */
+static const size_t MAX_PENDING_ELEMENTS = 64;
+
+class ReplayModule : public AbstractModule
+{
+    Q_OBJECT
+
+private:
+    ReplaySettingsDialog *m_settingsDlg;
+    QList<std::shared_ptr<ReplaySource>> m_sources;
+
+public:
+    explicit ReplayModule(QObject *parent = nullptr)
+        : AbstractModule(parent)
+    {
+        m_settingsDlg = new ReplaySettingsDialog;
+        addSettingsWindow(m_settingsDlg);
+
+        connect(m_settingsDlg, &ReplaySettingsDialog::collectionDirChanged,
+                this, &ReplayModule::scanCollection);
+    }
+
+    ~ReplayModule() override
+    {}
+
+    ModuleDriverKind driver() const override
+    {
+        return ModuleDriverKind::THREAD_DEDICATED;
+    }
+
+    ModuleFeatures features() const override
+    {
+        return ModuleFeature::SHOW_SETTINGS;
+    }
+
+    void scanCollection(const QString &collectionDir)
+    {
+        // the ports depend on the recorded data, so we need to recreate them
+        clearOutPorts();
+        m_sources.clear();
+
+        QStringList warnings;
+        QStringList datasetNames;
+        if (!collectionDir.isEmpty()) {
+            for (auto &src : findReplaySources(collectionDir, warnings)) {
+                if (!src->registerPorts(this)) {
+                    warnings.append(QStringLiteral("%1: %2").arg(src->name(), src->lastError()));
+                    continue;
+                }
+                datasetNames.append(QStringLiteral("%1 (%2)").arg(src->name(), src->kindName()));
+                m_sources.append(src);
+            }
+        }
+
+        m_settingsDlg->setDatasetInfo(datasetNames, warnings);
+        if (m_sources.isEmpty())
+            setStatusMessage(QStringLiteral("No data to replay."));
+        else
+            setStatusMessage(QStringLiteral("Found %1 dataset(s) to replay.").arg(m_sources.size()));
+    }
+
+    bool prepare(const TestSubject &) override
+    {
+        if (m_sources.isEmpty()) {
+            raiseError(QStringLiteral("No replayable data was found in the selected collection. Please select a different directory."));
+            return false;
+        }
+
+        for (auto &src : m_sources) {
+            if (!src->open()) {
+                raiseError(QStringLiteral("Unable to open dataset %1 for replay: %2").arg(src->name(), src->lastError()));
+                return false;
+            }
+        }
+
+        m_settingsDlg->setRunning(true);
+        setStateReady();
+        return true;
+    }
+
+    void runThread(OptionalWaitCondition *startWaitCondition) override
+    {
+        const auto speedMode = m_settingsDlg->speedMode();
+        const auto speedFactor = (speedMode == ReplaySpeedMode::REALTIME)? 1.0 : m_settingsDlg->speedFactor();
+        const auto traceName = traceIntern(name());
+
+        startWaitCondition->wait(this);
+        setStatusMessage(QStringLiteral("Replaying..."));
+
+        const auto replayStartTime = currentTimePoint();
+        auto lastStatusTime = replayStartTime;
+        std::optional<microseconds_t> firstTime;
+        while (m_running) {
+            // find the source with the oldest pending element, so all sources are
+            // replayed in the order their data was originally recorded
+            std::shared_ptr<ReplaySource> nextSrc;
+            microseconds_t nextTime(0);
+            for (auto &src : m_sources) {
+                const auto time = src->nextTime();
+                if (!time.has_value()) {
+                    if (!src->lastError().isEmpty()) {
+                        raiseError(QStringLiteral("Unable to read data of %1: %2").arg(src->name(), src->lastError()));
+                        return;
+                    }
+                    continue;
+                }
+                if (!nextSrc || time.value() < nextTime) {
+                    nextSrc = src;
+                    nextTime = time.value();
+                }
+            }
+
+            // all data was emitted
+            if (!nextSrc)
+                break;
+            if (!firstTime.has_value())
+                firstTime = nextTime;
+
+            if (speedMode == ReplaySpeedMode::UNLIMITED) {
+                // don't outrun our consumers, or we may exhaust memory on large recordings
+                while (m_running && nextSrc->maxPendingCount() > MAX_PENDING_ELEMENTS)
+                    std::this_thread::sleep_for(microseconds_t(500));
+            } else {
+                const auto targetOffset = microseconds_t(static_cast<microseconds_t::rep>((nextTime - firstTime.value()).count() / speedFactor));
+                while (m_running) {
+                    const auto remaining = targetOffset - timeDiffUsec(currentTimePoint(), replayStartTime);
+                    if (remaining.count() <= 0)
+                        break;
+                    std::this_thread::sleep_for(std::min(remaining, MAX_PACING_SLEEP));
+                }
+            }
+            if (!m_running)
+                break;
+
+            SY_TRACE_SPAN("replay:emitNext", traceName);
+            if (!nextSrc->emitNext()) {
+                raiseError(QStringLiteral("Unable to replay data of %1: %2").arg(nextSrc->name(), nextSrc->lastError()));
+                return;
+            }
+
+            const auto now = currentTimePoint();
+            if (timeDiffMsec(now, lastStatusTime).count() > 1000) {
+                lastStatusTime = now;
+                setStatusMessage(QStringLiteral("Replaying... (at %1 sec)")
+                                 .arg((nextTime - firstTime.value()).count() / 1000.0 / 1000.0, 0, 'f', 1));
+            }
+        }
+
+        if (m_running) {
+            setStatusMessage(QStringLiteral("Replay finished."));
+            setStateIdle();
+        }
+    }
+
+    void stop() override
+    {
+        for (auto &src : m_sources)
+            src->close();
+        m_settingsDlg->setRunning(false);
+    }
+
+    void serializeSettings(const QString &, QVariantHash &settings, QByteArray &) override
+    {
+        settings.insert("collection_dir", m_settingsDlg->collectionDir());
+        settings.insert("speed_mode", static_cast<int>(m_settingsDlg->speedMode()));
+        settings.insert("speed_factor", m_settingsDlg->speedFactor());
+    }
+
+    bool loadSettings(const QString &, const QVariantHash &settings, const QByteArray &) override
+    {
+        m_settingsDlg->setCollectionDir(settings.value("collection_dir").toString());
+        m_settingsDlg->setSpeedMode(static_cast<ReplaySpeedMode>(settings.value("speed_mode", 0).toInt()));
+        m_settingsDlg->setSpeedFactor(settings.value("speed_factor", 2.0).toDouble());
+
+        // restore our output ports, so connections to them can be recreated
+        scanCollection(m_settingsDlg->collectionDir());
+        return true;
+    }
+};
+
+QString ReplayModuleInfo::id() const
+{
+    return QStringLiteral("replay");
+}
+
+QString ReplayModuleInfo::name() const
+{
+    return QStringLiteral("Replay Recording");
+}
+
+QString ReplayModuleInfo::description() const
+{
+    return QStringLiteral("Replay data of a previously recorded EDL collection, with its original timing.");
+}
+
+QIcon ReplayModuleInfo::icon() const
+{
+    return QIcon(":/module/generic");
+}
+
+AbstractModule *ReplayModuleInfo::createModule(QObject *parent)
+{
+    return new ReplayModule(parent);
+}
+
+#include "replaymodule.moc"
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replaysettingsdialog.h"
+#include "ui_replaysettingsdialog.h"
+
+#include <QFileDialog>
+#include <QIcon>
+
+ReplaySettingsDialog::ReplaySettingsDialog(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::ReplaySettingsDialog)
+{
+    ui->setupUi(this);
+    setWindowIcon(QIcon(":/icons/generic-config"));
+
+    ui->speedModeComboBox->addItem(QStringLiteral("Real time"), static_cast<int>(ReplaySpeedMode::REALTIME));
+    ui->speedModeComboBox->addItem(QStringLiteral("Speed factor"), static_cast<int>(ReplaySpeedMode::FACTOR));
+    ui->speedModeComboBox->addItem(QStringLiteral("As fast as possible"), static_cast<int>(ReplaySpeedMode::UNLIMITED));
+    ui->speedModeComboBox->setCurrentIndex(0);
+    ui->speedFactorSpinBox->setEnabled(false);
+}
+
+ReplaySettingsDialog::~ReplaySettingsDialog()
+{
+    delete ui;
+}
+
+QString ReplaySettingsDialog::collectionDir() const
+{
+    return ui->collectionDirLineEdit->text();
+}
+
+void ReplaySettingsDialog::setCollectionDir(const QString &dir)
+{
+    ui->collectionDirLineEdit->setText(dir);
+}
+
+ReplaySpeedMode ReplaySettingsDialog::speedMode() const
+{
+    return static_cast<ReplaySpeedMode>(ui->speedModeComboBox->currentData().toInt());
+}
+
+void ReplaySettingsDialog::setSpeedMode(ReplaySpeedMode mode)
+{
+    ui->speedModeComboBox->setCurrentIndex(ui->speedModeComboBox->findData(static_cast<int>(mode)));
+}
+
+double ReplaySettingsDialog::speedFactor() const
+{
+    return ui->speedFactorSpinBox->value();
+}
+
+void ReplaySettingsDialog::setSpeedFactor(double factor)
+{
+    ui->speedFactorSpinBox->setValue(factor);
+}
+
+void ReplaySettingsDialog::setDatasetInfo(const QStringList &datasets, const QStringList &warnings)
+{
+    ui->datasetListWidget->clear();
+    ui->datasetListWidget->addItems(datasets);
+    for (const auto &warning : warnings) {
+        auto item = new QListWidgetItem(QIcon::fromTheme(QStringLiteral("dialog-warning")), warning);
+        ui->datasetListWidget->addItem(item);
+    }
+}
+
+void ReplaySettingsDialog::setRunning(bool running)
+{
+    ui->collectionDirButton->setEnabled(!running);
+    ui->speedModeComboBox->setEnabled(!running);
+    ui->speedFactorSpinBox->setEnabled(!running && speedMode() == ReplaySpeedMode::FACTOR);
+}
+
+void ReplaySettingsDialog::on_collectionDirButton_clicked()
+{
+    const auto dir = QFileDialog::getExistingDirectory(this,
+                                                       QStringLiteral("Select EDL collection to replay"),
+                                                       collectionDir());
+    if (dir.isEmpty())
+        return;
+
+    setCollectionDir(dir);
+    emit collectionDirChanged(dir);
+}
+
+void ReplaySettingsDialog::on_speedModeComboBox_currentIndexChanged(int)
+{
+    ui->speedFactorSpinBox->setEnabled(speedMode() == ReplaySpeedMode::FACTOR);
+}
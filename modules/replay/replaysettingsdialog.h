@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QDialog>
+
+namespace Ui {
+class ReplaySettingsDialog;
+}
+
+/**
+ * @brief Speed at which recorded data is replayed
+ */
+enum class ReplaySpeedMode
+{
+    REALTIME,  /// Replay with the timing of the original recording
+    FACTOR,    /// Replay faster or slower than the original recording by a fixed factor
+    UNLIMITED  /// Replay as fast as the consumers of the data can process it
+};
+
+class ReplaySettingsDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ReplaySettingsDialog(QWidget *parent = nullptr);
+    ~ReplaySettingsDialog();
+
+    QString collectionDir() const;
+    void setCollectionDir(const QString &dir);
+
+    ReplaySpeedMode speedMode() const;
+    void setSpeedMode(ReplaySpeedMode mode);
+
+    double speedFactor() const;
+    void setSpeedFactor(double factor);
+
+    void setDatasetInfo(const QStringList &datasets, const QStringList &warnings);
+
+    void setRunning(bool running);
+
+signals:
+    void collectionDirChanged(const QString &dir);
+
+private slots:
+    void on_collectionDirButton_clicked();
+    void on_speedModeComboBox_currentIndexChanged(int index);
+
+private:
+    Ui::ReplaySettingsDialog *ui;
+};
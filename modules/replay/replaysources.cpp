@@ -0,0 +1,740 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replaysources.h"
+
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QDebug>
+#include <cmath>
+#include <algorithm>
+
+#include "utils/tomlutils.h"
+
+using namespace Syntalos;
+
+ReplaySource::ReplaySource(const QString &id, const QString &name,
+                           const QStringList &dataFiles, const QStringList &auxFiles)
+    : m_id(id),
+      m_name(name),
+      m_dataFiles(dataFiles),
+      m_auxFiles(auxFiles)
+{
+}
+
+ReplaySource::~ReplaySource()
+{
+}
+
+QString ReplaySource::id() const
+{
+    return m_id;
+}
+
+QString ReplaySource::name() const
+{
+    return m_name;
+}
+
+QString ReplaySource::lastError() const
+{
+    return m_lastError;
+}
+
+QStringList ReplaySource::warnings() const
+{
+    return m_warnings;
+}
+
+/**
+ * Find the tsync file belonging to the first stream of @dataFile, using the naming scheme
+ * of the video writer. Only videos with multiple streams have stream numbers in their
+ * timestamp file names.
+ */
+static QString findTSyncFileFor(const QString &dataFile, const QStringList &auxFiles, int streamCount = 1)
+{
+    const QFileInfo fi(dataFile);
+    const auto tsyncFname = (streamCount > 1)?
+                QStringLiteral("%1/%2_stream1_timestamps.tsync").arg(fi.absolutePath(), fi.completeBaseName()) :
+                QStringLiteral("%1/%2_timestamps.tsync").arg(fi.absolutePath(), fi.completeBaseName());
+    if (auxFiles.contains(tsyncFname))
+        return tsyncFname;
+    return QString();
+}
+
+/**
+ * Determine the amount of streams in the videos of a dataset, using the attributes the
+ * video recorder stored, or the timestamp files it wrote for every stream.
+ */
+static int videoStreamCount(const QStringList &dataFiles, const QStringList &auxFiles)
+{
+    const QFileInfo fi(dataFiles.first());
+    const auto attrFname = QStringLiteral("%1/attributes.toml").arg(fi.absolutePath());
+    if (QFileInfo::exists(attrFname)) {
+        QString errorMsg;
+        const auto attrs = parseTomlFile(attrFname, errorMsg);
+        const auto streams = attrs.value(QStringLiteral("video_streams")).toList();
+        if (errorMsg.isEmpty() && !streams.isEmpty())
+            return streams.size();
+    }
+
+    int count = 1;
+    while (auxFiles.contains(QStringLiteral("%1/%2_stream%3_timestamps.tsync")
+                                 .arg(fi.absolutePath(), fi.completeBaseName())
+                                 .arg(count + 1)))
+        count++;
+    return count;
+}
+
+// ------------------
+// VideoReplaySource
+// ------------------
+
+VideoReplaySource::VideoReplaySource(const QString &id, const QString &name,
+                                     const QStringList &dataFiles, const QStringList &auxFiles)
+    : ReplaySource(id, name, dataFiles, auxFiles),
+      m_streamCount(1),
+      m_partIndex(-1),
+      m_partFrameIndex(0),
+      m_frameIndex(0),
+      m_framerate(0),
+      m_havePending(false)
+{
+    // we can only decode the first video stream
+    m_streamCount = videoStreamCount(dataFiles, auxFiles);
+    if (m_streamCount > 1)
+        m_warnings.append(QStringLiteral("The video contains %1 streams, only the first one is replayed.").arg(m_streamCount));
+
+    QStringList noTSyncFiles;
+    for (const auto &fname : dataFiles) {
+        if (findTSyncFileFor(fname, auxFiles, m_streamCount).isEmpty())
+            noTSyncFiles.append(QFileInfo(fname).fileName());
+    }
+    if (!noTSyncFiles.isEmpty())
+        m_warnings.append(QStringLiteral("No timestamps found for %1, assuming a constant framerate.")
+                          .arg(noTSyncFiles.join(QStringLiteral(", "))));
+}
+
+VideoReplaySource::~VideoReplaySource()
+{
+    close();
+}
+
+QString VideoReplaySource::kindName() const
+{
+    return QStringLiteral("video");
+}
+
+bool VideoReplaySource::registerPorts(AbstractModule *mod)
+{
+    m_frameOut = mod->registerOutputPort<Frame>(QStringLiteral("video-%1").arg(m_id), m_name);
+    return true;
+}
+
+bool VideoReplaySource::open()
+{
+    m_lastError.clear();
+    m_frameIndex = 0;
+    m_partTimeOffset = microseconds_t(0);
+    m_lastTime = microseconds_t(0);
+    m_havePending = false;
+    if (!openPart(0))
+        return false;
+
+    m_framerate = m_capture.get(cv::CAP_PROP_FPS);
+    const auto width = static_cast<int>(m_capture.get(cv::CAP_PROP_FRAME_WIDTH));
+    const auto height = static_cast<int>(m_capture.get(cv::CAP_PROP_FRAME_HEIGHT));
+    if (m_framerate <= 0)
+        m_framerate = 30;
+
+    m_frameOut->setMetadataValue(QStringLiteral("framerate"), m_framerate);
+    m_frameOut->setMetadataValue(QStringLiteral("size"), QSize(width, height));
+    m_frameOut->setSuggestedDataName(QStringLiteral("%1/%2").arg(m_name.section('/', -1),
+                                                                 QFileInfo(m_dataFiles.first()).completeBaseName()));
+    m_frameOut->start();
+
+    return true;
+}
+
+void VideoReplaySource::close()
+{
+    m_capture.release();
+    m_tsync.reset();
+    m_partIndex = -1;
+    m_havePending = false;
+}
+
+bool VideoReplaySource::openPart(int index)
+{
+    m_capture.release();
+    m_tsync.reset();
+    m_partIndex = index;
+    m_partFrameIndex = 0;
+    if (index >= m_dataFiles.length())
+        return false;
+
+    const auto fname = m_dataFiles.at(index);
+    if (!m_capture.open(fname.toStdString(), cv::CAP_FFMPEG)) {
+        m_lastError = QStringLiteral("Unable to open video file: %1").arg(fname);
+        return false;
+    }
+
+    const auto tsyncFname = findTSyncFileFor(fname, m_auxFiles, m_streamCount);
+    if (tsyncFname.isEmpty()) {
+        qWarning().noquote() << "No timestamps found for" << fname << "- assuming a constant framerate.";
+        return true;
+    }
+
+    m_tsync.reset(new ReplayTimestamps);
+    if (!m_tsync->open(tsyncFname, false)) {
+        m_lastError = QStringLiteral("Unable to read timestamps from %1: %2").arg(tsyncFname, m_tsync->lastError());
+        m_tsync.reset();
+        return false;
+    }
+
+    return true;
+}
+
+bool VideoReplaySource::fetchFrame()
+{
+    while (m_partIndex < m_dataFiles.length()) {
+        cv::Mat mat;
+        if (m_capture.isOpened() && m_capture.read(mat)) {
+            microseconds_t time;
+            if (m_tsync.get() != nullptr && m_partFrameIndex < m_tsync->count())
+                time = m_tsync->masterTimeAt(m_partFrameIndex);
+            else
+                time = m_partTimeOffset + microseconds_t(std::llround(m_partFrameIndex * 1000.0 * 1000.0 / m_framerate));
+
+            m_pending = Frame(m_frameIndex, mat, time);
+            m_lastTime = time;
+            m_partFrameIndex++;
+            m_frameIndex++;
+            m_havePending = true;
+            return true;
+        }
+
+        // continue with the next file, if there is one
+        m_partTimeOffset = m_lastTime + microseconds_t(std::llround(1000.0 * 1000.0 / m_framerate));
+        if (!openPart(m_partIndex + 1) && !m_lastError.isEmpty())
+            return false;
+    }
+
+    return false;
+}
+
+std::optional<microseconds_t> VideoReplaySource::nextTime()
+{
+    if (!m_havePending && !fetchFrame())
+        return std::nullopt;
+    return m_pending.time;
+}
+
+bool VideoReplaySource::emitNext()
+{
+    if (!m_havePending && !fetchFrame())
+        return m_lastError.isEmpty();
+
+    m_frameOut->push(m_pending);
+    m_havePending = false;
+    return true;
+}
+
+size_t VideoReplaySource::maxPendingCount() const
+{
+    return m_frameOut->maxPendingCount();
+}
+
+// ------------------
+// TableReplaySource
+// ------------------
+
+TableReplaySource::TableReplaySource(const QString &id, const QString &name,
+                                     const QStringList &dataFiles, const QStringList &auxFiles)
+    : ReplaySource(id, name, dataFiles, auxFiles),
+      m_partIndex(-1),
+      m_timeFactorUs(0),
+      m_havePending(false)
+{
+}
+
+TableReplaySource::~TableReplaySource()
+{
+    close();
+}
+
+QString TableReplaySource::kindName() const
+{
+    return QStringLiteral("table");
+}
+
+bool TableReplaySource::registerPorts(AbstractModule *mod)
+{
+    m_rowsOut = mod->registerOutputPort<TableRow>(QStringLiteral("table-%1").arg(m_id), m_name);
+    return true;
+}
+
+/**
+ * Split a row of a table written by the table module.
+ */
+TableRow TableReplaySource::parseRow(const QString &line)
+{
+    // the table module replaces semicolons in values with fullwidth semicolons
+    // (U+FF1B), so we can restore the original data here
+    auto row = line.split(QLatin1Char(';'));
+    return row.replaceInStrings(QStringLiteral("；"), QStringLiteral(";"));
+}
+
+bool TableReplaySource::open()
+{
+    m_lastError.clear();
+    m_lastTime = microseconds_t(0);
+    m_havePending = false;
+    if (!openPart(0))
+        return false;
+
+    // tables usually start with a header, which may tell us how the rows are timed
+    QStringList header;
+    const auto firstLine = m_stream->readLine();
+    if (!firstLine.isEmpty()) {
+        const auto firstRow = parseRow(firstLine);
+        bool isNumber = false;
+        firstRow.value(0).toDouble(&isNumber);
+        if (isNumber) {
+            // no header, we need to read this line as data again
+            m_stream->seek(0);
+        } else {
+            header = firstRow;
+        }
+    }
+
+    // If the first column contains times, we use them to pace the replay. The time unit
+    // is milliseconds, unless the header explicitly states something else.
+    // Rows of tables without time column are emitted at the time of the preceding row.
+    m_timeFactorUs = 0;
+    const auto timeCol = header.value(0).toLower();
+    if (timeCol.startsWith(QStringLiteral("time"))) {
+        if (timeCol.contains(QStringLiteral("µs")) || timeCol.contains(QStringLiteral("usec")))
+            m_timeFactorUs = 1;
+        else
+            m_timeFactorUs = 1000;
+    }
+
+    if (!header.isEmpty())
+        m_rowsOut->setMetadataValue(QStringLiteral("table_header"), header);
+    m_rowsOut->setSuggestedDataName(QStringLiteral("%1/%2").arg(m_name.section('/', -1),
+                                                                QFileInfo(m_dataFiles.first()).completeBaseName()));
+    m_rowsOut->start();
+
+    return true;
+}
+
+void TableReplaySource::close()
+{
+    m_stream.reset();
+    m_file.reset();
+    m_partIndex = -1;
+    m_havePending = false;
+}
+
+bool TableReplaySource::openPart(int index)
+{
+    m_stream.reset();
+    m_file.reset();
+    m_partIndex = index;
+    if (index >= m_dataFiles.length())
+        return false;
+
+    m_file.reset(new QFile(m_dataFiles.at(index)));
+    if (!m_file->open(QIODevice::ReadOnly | QIODevice::Text)) {
+        m_lastError = QStringLiteral("Unable to open table %1: %2").arg(m_file->fileName(), m_file->errorString());
+        m_file.reset();
+        return false;
+    }
+    m_stream.reset(new QTextStream(m_file.get()));
+    m_stream->setCodec("UTF-8");
+
+    return true;
+}
+
+bool TableReplaySource::fetchRow()
+{
+    while (m_partIndex < m_dataFiles.length()) {
+        if (m_stream.get() != nullptr && !m_stream->atEnd()) {
+            const auto line = m_stream->readLine();
+            if (line.isEmpty())
+                continue;
+
+            m_pendingRow = parseRow(line);
+            m_pendingTime = m_lastTime;
+            if (m_timeFactorUs > 0) {
+                bool ok = false;
+                const auto value = m_pendingRow.value(0).toDouble(&ok);
+                if (ok)
+                    m_pendingTime = microseconds_t(std::llround(value * m_timeFactorUs));
+            }
+            m_lastTime = m_pendingTime;
+            m_havePending = true;
+            return true;
+        }
+
+        if (!openPart(m_partIndex + 1) && !m_lastError.isEmpty())
+            return false;
+    }
+
+    return false;
+}
+
+std::optional<microseconds_t> TableReplaySource::nextTime()
+{
+    if (!m_havePending && !fetchRow())
+        return std::nullopt;
+    return m_pendingTime;
+}
+
+bool TableReplaySource::emitNext()
+{
+    if (!m_havePending && !fetchRow())
+        return m_lastError.isEmpty();
+
+    m_rowsOut->push(m_pendingRow);
+    m_havePending = false;
+    return true;
+}
+
+size_t TableReplaySource::maxPendingCount() const
+{
+    return m_rowsOut->maxPendingCount();
+}
+
+// ------------------
+// IntanReplaySource
+// ------------------
+
+IntanReplaySource::IntanReplaySource(const QString &id, const QString &name,
+                                     const QStringList &dataFiles, const QStringList &auxFiles)
+    : ReplaySource(id, name, dataFiles, auxFiles),
+      m_partIndex(-1),
+      m_sampleRate(0),
+      m_havePending(false)
+{
+}
+
+IntanReplaySource::~IntanReplaySource()
+{
+    close();
+}
+
+QString IntanReplaySource::kindName() const
+{
+    return QStringLiteral("intan");
+}
+
+bool IntanReplaySource::registerPorts(AbstractModule *mod)
+{
+    m_floatPorts.clear();
+    m_digInOut.reset();
+
+    // we need the channel layout of the recording to know which ports to create
+    RhdFileReader reader;
+    if (!reader.open(m_dataFiles.first())) {
+        m_lastError = QStringLiteral("Unable to read %1: %2").arg(m_dataFiles.first(), reader.lastError());
+        return false;
+    }
+
+    // Similar to the RHD2000 module, we emit data of up to 16 channels of
+    // the same signal group on one port.
+    const auto registerFloatPorts = [&](const QVector<RhdChannel> &channels, bool boardAdc) {
+        const auto groups = reader.signalGroups();
+        for (int g = 0; g < groups.size(); g++) {
+            const auto &group = groups[g];
+            std::vector<int> indices;
+            for (int i = 0; i < channels.size(); i++) {
+                if (channels[i].groupIndex == g)
+                    indices.push_back(i);
+            }
+            if (indices.empty())
+                continue;
+
+            const auto blockCount = static_cast<int>(std::ceil(indices.size() / 16.0));
+            for (int b = 0; b < blockCount; b++) {
+                FloatPort port;
+                port.boardAdc = boardAdc;
+                const auto first = indices.cbegin() + b * 16;
+                const auto last = (b == blockCount - 1)? indices.cend() : first + 16;
+                port.dataIndices.assign(first, last);
+
+                const auto portId = QStringLiteral("intan-%1-%2.%3_%4").arg(m_id).arg(g).arg(b).arg(group.prefix);
+                const auto firstChan = channels[port.dataIndices.front()];
+                const auto lastChan = channels[port.dataIndices.back()];
+                port.stream = mod->registerOutputPort<FloatSignalBlock>(portId,
+                                                                        QStringLiteral("%1 [%2..%3]").arg(group.name,
+                                                                                                          firstChan.nativeName,
+                                                                                                          lastChan.nativeName));
+                port.stream->setMetadataValue(QStringLiteral("channel_index_first"), firstChan.nativeNumber);
+                port.stream->setMetadataValue(QStringLiteral("channel_index_last"), lastChan.nativeNumber);
+
+                QStringList names;
+                for (const auto idx : port.dataIndices)
+                    names.append(channels[idx].customName);
+                port.stream->setMetadataValue(QStringLiteral("channel_names"), names);
+
+                m_floatPorts.push_back(port);
+            }
+        }
+    };
+
+    registerFloatPorts(reader.amplifierChannels(), false);
+    registerFloatPorts(reader.boardAdcChannels(), true);
+
+    if (reader.hasBoardDigIn()) {
+        m_digInOut = mod->registerOutputPort<IntSignalBlock>(QStringLiteral("intan-%1-din").arg(m_id),
+                                                             QStringLiteral("Board Digital Inputs"));
+        m_digInOut->setMetadataValue(QStringLiteral("channel_index_first"), 0);
+        m_digInOut->setMetadataValue(QStringLiteral("channel_index_last"), 15);
+    }
+
+    return true;
+}
+
+bool IntanReplaySource::open()
+{
+    m_lastError.clear();
+    m_havePending = false;
+    m_tsync.reset();
+
+    if (!openPart(0))
+        return false;
+    m_sampleRate = m_reader.sampleRate();
+
+    // the tsync file maps device time to master time for all parts of the recording
+    for (const auto &fname : m_auxFiles) {
+        if (!fname.endsWith(QStringLiteral(".tsync")))
+            continue;
+        m_tsync.reset(new ReplayTimestamps);
+        if (!m_tsync->open(fname, true)) {
+            m_lastError = QStringLiteral("Unable to read timestamps from %1: %2").arg(fname, m_tsync->lastError());
+            m_tsync.reset();
+            return false;
+        }
+        break;
+    }
+
+    for (auto &port : m_floatPorts) {
+        port.stream->setMetadataValue(QStringLiteral("samplingrate"), m_sampleRate);
+        port.stream->start();
+    }
+    if (m_digInOut) {
+        m_digInOut->setMetadataValue(QStringLiteral("samplingrate"), m_sampleRate);
+        m_digInOut->start();
+    }
+
+    return true;
+}
+
+void IntanReplaySource::close()
+{
+    m_reader.close();
+    m_tsync.reset();
+    m_partIndex = -1;
+    m_havePending = false;
+}
+
+bool IntanReplaySource::openPart(int index)
+{
+    m_reader.close();
+    m_partIndex = index;
+    if (index >= m_dataFiles.length())
+        return false;
+
+    const auto fname = m_dataFiles.at(index);
+    if (!m_reader.open(fname)) {
+        m_lastError = QStringLiteral("Unable to read %1: %2").arg(fname, m_reader.lastError());
+        return false;
+    }
+
+    return true;
+}
+
+bool IntanReplaySource::fetchBlock()
+{
+    while (m_partIndex < m_dataFiles.length()) {
+        if (m_reader.readBlock(m_pending)) {
+            m_havePending = true;
+            return true;
+        }
+        if (!m_reader.lastError().isEmpty()) {
+            m_lastError = m_reader.lastError();
+            return false;
+        }
+
+        if (!openPart(m_partIndex + 1) && !m_lastError.isEmpty())
+            return false;
+    }
+
+    return false;
+}
+
+std::optional<microseconds_t> IntanReplaySource::nextTime()
+{
+    if (!m_havePending && !fetchBlock())
+        return std::nullopt;
+
+    const auto deviceTime = microseconds_t(std::llround(m_pending.timestamps.front() * 1000.0 * 1000.0 / m_sampleRate));
+    if (m_tsync.get() != nullptr) {
+        const auto masterTime = m_tsync->deviceToMaster(deviceTime);
+        if (masterTime.has_value())
+            return masterTime.value();
+    }
+
+    return deviceTime;
+}
+
+bool IntanReplaySource::emitNext()
+{
+    if (!m_havePending && !fetchBlock())
+        return m_lastError.isEmpty();
+
+    const auto samples = m_pending.timestamps.size();
+    VectorXu timestamps(samples);
+    for (size_t t = 0; t < samples; t++)
+        timestamps[t] = static_cast<uint>(m_pending.timestamps[t]);
+
+    // scale the raw values the same way the RHD2000 module does
+    for (auto &port : m_floatPorts) {
+        FloatSignalBlock block(static_cast<uint>(samples));
+        block.timestamps = timestamps;
+        for (size_t c = 0; c < port.dataIndices.size(); c++) {
+            const auto idx = port.dataIndices[c];
+            if (port.boardAdc) {
+                const auto &raw = m_pending.boardAdc[idx];
+                for (size_t t = 0; t < samples; t++)
+                    block.data[c][t] = 0.000050354 * raw[t];
+            } else {
+                const auto &raw = m_pending.amplifier[idx];
+                for (size_t t = 0; t < samples; t++)
+                    block.data[c][t] = 0.195 * (raw[t] - 32768);
+            }
+        }
+        port.stream->push(block);
+    }
+
+    if (m_digInOut) {
+        IntSignalBlock block(static_cast<uint>(samples));
+        block.timestamps = timestamps;
+        for (int c = 0; c < SIGNAL_BLOCK_CHAN_COUNT; c++) {
+            for (size_t t = 0; t < samples; t++)
+                block.data[c][t] = (m_pending.boardDigIn[t] & (1 << c)) != 0;
+        }
+        m_digInOut->push(block);
+    }
+
+    m_havePending = false;
+    return true;
+}
+
+size_t IntanReplaySource::maxPendingCount() const
+{
+    size_t count = 0;
+    for (const auto &port : m_floatPorts)
+        count = std::max(count, port.stream->maxPendingCount());
+    if (m_digInOut)
+        count = std::max(count, m_digInOut->maxPendingCount());
+    return count;
+}
+
+// ------------------
+
+/**
+ * Sorted list of absolute paths of all parts of a data file section of a dataset manifest.
+ */
+static QStringList manifestDataParts(const QString &datasetDir, const QVariantHash &dataSection)
+{
+    QList<QPair<qint64, QString>> parts;
+    for (const auto &partVar : dataSection.value(QStringLiteral("parts")).toList()) {
+        const auto part = partVar.toHash();
+        parts.append(qMakePair(part.value(QStringLiteral("index")).toLongLong(),
+                               QDir(datasetDir).absoluteFilePath(part.value(QStringLiteral("fname")).toString())));
+    }
+    std::sort(parts.begin(), parts.end());
+
+    QStringList res;
+    for (const auto &part : parts)
+        res.append(part.second);
+    return res;
+}
+
+/**
+ * Find all datasets in the EDL collection at @collectionDir that we know how to replay.
+ * Datasets which can not be replayed are reported in @warnings.
+ */
+QList<std::shared_ptr<ReplaySource>> findReplaySources(const QString &collectionDir, QStringList &warnings)
+{
+    QList<std::shared_ptr<ReplaySource>> sources;
+    const QDir rootDir(collectionDir);
+
+    QStringList manifests;
+    QDirIterator it(collectionDir, QStringList() << QStringLiteral("manifest.toml"),
+                    QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        manifests.append(it.next());
+    manifests.sort();
+
+    for (const auto &manifestFname : manifests) {
+        QString errorMsg;
+        const auto manifest = parseTomlFile(manifestFname, errorMsg);
+        if (!errorMsg.isEmpty()) {
+            warnings.append(QStringLiteral("Unable to read %1: %2").arg(manifestFname, errorMsg));
+            continue;
+        }
+        if (manifest.value(QStringLiteral("type")).toString() != QStringLiteral("dataset"))
+            continue;
+
+        const auto datasetDir = QFileInfo(manifestFname).absolutePath();
+        const auto dataFiles = manifestDataParts(datasetDir, manifest.value(QStringLiteral("data")).toHash());
+        const auto auxFiles = manifestDataParts(datasetDir, manifest.value(QStringLiteral("data_aux")).toHash());
+        if (dataFiles.isEmpty())
+            continue;
+
+        const auto name = rootDir.relativeFilePath(datasetDir);
+        const auto id = QString(name).replace(QLatin1Char('/'), QLatin1Char('_'));
+        const auto suffix = QFileInfo(dataFiles.first()).suffix().toLower();
+
+        std::shared_ptr<ReplaySource> src;
+        if (suffix == QStringLiteral("mkv") || suffix == QStringLiteral("avi"))
+            src.reset(new VideoReplaySource(id, name, dataFiles, auxFiles));
+        else if (suffix == QStringLiteral("csv"))
+            src.reset(new TableReplaySource(id, name, dataFiles, auxFiles));
+        else if (suffix == QStringLiteral("rhd"))
+            src.reset(new IntanReplaySource(id, name, dataFiles, auxFiles));
+
+        if (src.get() == nullptr) {
+            warnings.append(QStringLiteral("Can not replay data of dataset %1 (unknown data type)").arg(name));
+            continue;
+        }
+        for (const auto &warning : src->warnings())
+            warnings.append(QStringLiteral("%1: %2").arg(name, warning));
+        sources.append(src);
+    }
+
+    return sources;
+}
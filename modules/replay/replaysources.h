@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <QString>
+#include <QStringList>
+#include <opencv2/videoio.hpp>
+
+#include "moduleapi.h"
+#include "streams/frametype.h"
+#include "replaytimestamps.h"
+#include "rhdfilereader.h"
+
+class QFile;
+class QTextStream;
+
+/**
+ * @brief A recorded dataset of an EDL collection that can be replayed
+ *
+ * Every source reads the data of one dataset and emits it on one or more
+ * output ports of the type the data was originally recorded from.
+ * All times are the original master clock times of the recording, in microseconds.
+ */
+class ReplaySource
+{
+public:
+    explicit ReplaySource(const QString &id, const QString &name,
+                          const QStringList &dataFiles, const QStringList &auxFiles);
+    virtual ~ReplaySource();
+
+    QString id() const;
+    QString name() const;
+    QString lastError() const;
+
+    /**
+     * Issues with the recorded data which do not prevent it from being replayed.
+     */
+    QStringList warnings() const;
+
+    virtual QString kindName() const = 0;
+
+    /**
+     * Register all output ports this source emits data on with @mod.
+     */
+    virtual bool registerPorts(AbstractModule *mod) = 0;
+
+    /**
+     * Open the data and start the output streams.
+     */
+    virtual bool open() = 0;
+    virtual void close() = 0;
+
+    /**
+     * Original timestamp of the next element, or std::nullopt if all data was emitted.
+     */
+    virtual std::optional<microseconds_t> nextTime() = 0;
+    virtual bool emitNext() = 0;
+
+    /**
+     * Largest amount of emitted elements which were not consumed yet.
+     */
+    virtual size_t maxPendingCount() const = 0;
+
+protected:
+    QString m_id;
+    QString m_name;
+    QStringList m_dataFiles;
+    QStringList m_auxFiles;
+    QString m_lastError;
+    QStringList m_warnings;
+};
+
+/**
+ * @brief Replays videos written by the video recorder, using their tsync timestamps
+ */
+class VideoReplaySource : public ReplaySource
+{
+public:
+    explicit VideoReplaySource(const QString &id, const QString &name,
+                               const QStringList &dataFiles, const QStringList &auxFiles);
+    ~VideoReplaySource() override;
+
+    QString kindName() const override;
+    bool registerPorts(AbstractModule *mod) override;
+    bool open() override;
+    void close() override;
+    std::optional<microseconds_t> nextTime() override;
+    bool emitNext() override;
+    size_t maxPendingCount() const override;
+
+private:
+    std::shared_ptr<DataStream<Frame>> m_frameOut;
+    cv::VideoCapture m_capture;
+    std::unique_ptr<ReplayTimestamps> m_tsync;
+    int m_streamCount;
+    int m_partIndex;
+    size_t m_partFrameIndex;
+    size_t m_frameIndex;
+    double m_framerate;
+    microseconds_t m_partTimeOffset;
+    microseconds_t m_lastTime;
+
+    bool m_havePending;
+    Frame m_pending;
+
+    bool openPart(int index);
+    bool fetchFrame();
+};
+
+/**
+ * @brief Replays tables written by the table module
+ */
+class TableReplaySource : public ReplaySource
+{
+public:
+    explicit TableReplaySource(const QString &id, const QString &name,
+                               const QStringList &dataFiles, const QStringList &auxFiles);
+    ~TableReplaySource() override;
+
+    QString kindName() const override;
+    bool registerPorts(AbstractModule *mod) override;
+    bool open() override;
+    void close() override;
+    std::optional<microseconds_t> nextTime() override;
+    bool emitNext() override;
+    size_t maxPendingCount() const override;
+
+private:
+    std::shared_ptr<DataStream<TableRow>> m_rowsOut;
+    std::unique_ptr<QFile> m_file;
+    std::unique_ptr<QTextStream> m_stream;
+    int m_partIndex;
+    int m_timeFactorUs;
+    microseconds_t m_lastTime;
+
+    bool m_havePending;
+    TableRow m_pendingRow;
+    microseconds_t m_pendingTime;
+
+    bool openPart(int index);
+    bool fetchRow();
+    static TableRow parseRow(const QString &line);
+};
+
+/**
+ * @brief Replays signal data recorded by the Intan RHD2000 module
+ */
+class IntanReplaySource : public ReplaySource
+{
+public:
+    explicit IntanReplaySource(const QString &id, const QString &name,
+                               const QStringList &dataFiles, const QStringList &auxFiles);
+    ~IntanReplaySource() override;
+
+    QString kindName() const override;
+    bool registerPorts(AbstractModule *mod) override;
+    bool open() override;
+    void close() override;
+    std::optional<microseconds_t> nextTime() override;
+    bool emitNext() override;
+    size_t maxPendingCount() const override;
+
+private:
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+    struct FloatPort
+    {
+        std::shared_ptr<DataStream<FloatSignalBlock>> stream;
+        std::vector<int> dataIndices;
+        bool boardAdc;
+    };
+#pragma GCC diagnostic pop
+
+    RhdFileReader m_reader;
+    std::unique_ptr<ReplayTimestamps> m_tsync;
+    std::vector<FloatPort> m_floatPorts;
+    std::shared_ptr<DataStream<IntSignalBlock>> m_digInOut;
+    int m_partIndex;
+    double m_sampleRate;
+
+    bool m_havePending;
+    RhdDataBlock m_pending;
+
+    bool openPart(int index);
+    bool fetchBlock();
+};
+
+QList<std::shared_ptr<ReplaySource>> findReplaySources(const QString &collectionDir, QStringList &warnings);
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "replaytimestamps.h"
+
+#include <cmath>
+
+using namespace Syntalos;
+
+/**
+ * Factor to multiply a time in @unit with to get microseconds,
+ * or zero if the unit can not be converted.
+ */
+static double timeUnitToUsecFactor(TSyncFileTimeUnit unit)
+{
+    switch (unit) {
+    case TSyncFileTimeUnit::NANOSECONDS:
+        return 1.0 / 1000.0;
+    case TSyncFileTimeUnit::MICROSECONDS:
+        return 1.0;
+    case TSyncFileTimeUnit::MILLISECONDS:
+        return 1000.0;
+    case TSyncFileTimeUnit::SECONDS:
+        return 1000.0 * 1000.0;
+    default:
+        return 0;
+    }
+}
+
+ReplayTimestamps::ReplayTimestamps()
+    : m_deviceToUsec(0),
+      m_masterToUsec(0)
+{
+}
+
+/**
+ * Open tsync file @fname. If @needDeviceTime is set, the device time column
+ * must have a unit of time as well, as it is used to map device timestamps
+ * to master time.
+ */
+bool ReplayTimestamps::open(const QString &fname, bool needDeviceTime)
+{
+    m_lastError.clear();
+    m_reader.reset(new TimeSyncFileReader);
+    if (!m_reader->open(fname)) {
+        m_lastError = m_reader->lastError();
+        m_reader.reset();
+        return false;
+    }
+
+    const auto units = m_reader->timeUnits();
+    m_deviceToUsec = timeUnitToUsecFactor(units.first);
+    m_masterToUsec = timeUnitToUsecFactor(units.second);
+    if (m_masterToUsec == 0 || (needDeviceTime && m_deviceToUsec == 0)) {
+        m_lastError = QStringLiteral("Unsupported time units in timestamp file: %1 / %2")
+                          .arg(tsyncFileTimeUnitToString(units.first),
+                               tsyncFileTimeUnitToString(units.second));
+        m_reader.reset();
+        return false;
+    }
+
+    return true;
+}
+
+QString ReplayTimestamps::lastError() const
+{
+    return m_lastError;
+}
+
+size_t ReplayTimestamps::count() const
+{
+    if (m_reader.get() == nullptr)
+        return 0;
+    return m_reader->count();
+}
+
+/**
+ * Master time of entry @index in microseconds.
+ */
+microseconds_t ReplayTimestamps::masterTimeAt(size_t index) const
+{
+    return microseconds_t(std::llround(m_reader->timeAt(index).second * m_masterToUsec));
+}
+
+/**
+ * Convert a device time in microseconds into master time in microseconds.
+ */
+std::optional<microseconds_t> ReplayTimestamps::deviceToMaster(const microseconds_t &deviceTime) const
+{
+    if (m_reader.get() == nullptr || m_deviceToUsec == 0)
+        return std::nullopt;
+
+    const auto fileDeviceTime = std::llround(deviceTime.count() / m_deviceToUsec);
+    const auto masterTime = m_reader->deviceToMaster(fileDeviceTime);
+    if (!masterTime.has_value())
+        return std::nullopt;
+    return microseconds_t(std::llround(masterTime.value() * m_masterToUsec));
+}
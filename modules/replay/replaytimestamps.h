@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <QString>
+
+#include "syclock.h"
+#include "tsyncfile.h"
+
+/**
+ * @brief Reads a tsync file and converts its times to microseconds
+ *
+ * Tsync files may store their time columns in any unit, e.g. older video
+ * recordings use milliseconds for their master timestamps. This class scales
+ * all values to and from the microseconds used throughout Syntalos.
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+class ReplayTimestamps
+{
+public:
+    explicit ReplayTimestamps();
+
+    bool open(const QString &fname, bool needDeviceTime);
+    QString lastError() const;
+
+    size_t count() const;
+    Syntalos::microseconds_t masterTimeAt(size_t index) const;
+    std::optional<Syntalos::microseconds_t> deviceToMaster(const Syntalos::microseconds_t &deviceTime) const;
+
+private:
+    std::unique_ptr<Syntalos::TimeSyncFileReader> m_reader;
+    QString m_lastError;
+    double m_deviceToUsec;
+    double m_masterToUsec;
+};
+#pragma GCC diagnostic pop
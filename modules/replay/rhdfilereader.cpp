@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rhdfilereader.h"
+
+#include <QFile>
+#include <QDataStream>
+#include <QDebug>
+#include <QtEndian>
+#include <algorithm>
+
+// these values need to match the ones the RHD2000 module writes
+static const quint32 RHD_FILE_MAGIC_NUMBER = 0xc6912702;
+static const int RHD_SAMPLES_PER_DATA_BLOCK = 60;
+
+RhdFileReader::RhdFileReader()
+    : m_sampleRate(0),
+      m_auxCount(0),
+      m_supplyCount(0),
+      m_tempCount(0),
+      m_haveDigIn(false),
+      m_haveDigOut(false),
+      m_blockBytes(0)
+{
+}
+
+RhdFileReader::~RhdFileReader()
+{
+    close();
+}
+
+bool RhdFileReader::open(const QString &fname)
+{
+    close();
+    m_file.reset(new QFile(fname));
+    if (!m_file->open(QIODevice::ReadOnly)) {
+        m_lastError = QStringLiteral("Unable to open file: %1").arg(m_file->errorString());
+        m_file.reset();
+        return false;
+    }
+
+    if (!readHeader()) {
+        m_file.reset();
+        return false;
+    }
+
+    return true;
+}
+
+void RhdFileReader::close()
+{
+    if (m_file.get() != nullptr)
+        m_file->close();
+    m_file.reset();
+    m_groups.clear();
+    m_ampChannels.clear();
+    m_adcChannels.clear();
+    m_blockBytes = 0;
+}
+
+QString RhdFileReader::lastError() const
+{
+    return m_lastError;
+}
+
+double RhdFileReader::sampleRate() const
+{
+    return m_sampleRate;
+}
+
+int RhdFileReader::samplesPerBlock() const
+{
+    return RHD_SAMPLES_PER_DATA_BLOCK;
+}
+
+QVector<RhdSignalGroup> RhdFileReader::signalGroups() const
+{
+    return m_groups;
+}
+
+/**
+ * Enabled amplifier channels, in the order their data is stored in.
+ */
+QVector<RhdChannel> RhdFileReader::amplifierChannels() const
+{
+    return m_ampChannels;
+}
+
+/**
+ * Enabled board ADC channels, in the order their data is stored in.
+ */
+QVector<RhdChannel> RhdFileReader::boardAdcChannels() const
+{
+    return m_adcChannels;
+}
+
+bool RhdFileReader::hasBoardDigIn() const
+{
+    return m_haveDigIn;
+}
+
+bool RhdFileReader::readHeader()
+{
+    QDataStream in(m_file.get());
+    in.setVersion(QDataStream::Qt_4_8);
+    in.setByteOrder(QDataStream::LittleEndian);
+    in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    quint32 magic;
+    qint16 versionMain, versionSecondary;
+    in >> magic >> versionMain >> versionSecondary;
+    if (magic != RHD_FILE_MAGIC_NUMBER) {
+        m_lastError = QStringLiteral("File is not an Intan RHD2000 data file.");
+        return false;
+    }
+
+    // we only support the format versions written by our own RHD2000 module
+    if (versionMain != 1 || versionSecondary < 3) {
+        m_lastError = QStringLiteral("Unsupported RHD2000 data file version: %1.%2").arg(versionMain).arg(versionSecondary);
+        return false;
+    }
+
+    double dvalue;
+    qint16 svalue;
+    QString note;
+
+    in >> m_sampleRate;
+    in >> svalue;  // DSP enabled
+    for (int i = 0; i < 6; i++)
+        in >> dvalue; // actual & desired DSP cutoff and bandwidths
+    in >> svalue;  // notch filter mode
+    in >> dvalue >> dvalue; // desired & actual impedance test frequency
+    in >> note >> note >> note;
+    in >> svalue;
+    m_tempCount = svalue;
+    in >> svalue;  // eval board mode
+
+    qint16 groupCount;
+    in >> groupCount;
+    for (int g = 0; g < groupCount; g++) {
+        RhdSignalGroup group;
+        qint16 channelCount, ampCount;
+
+        in >> group.name >> group.prefix;
+        in >> svalue;
+        group.enabled = svalue != 0;
+        in >> channelCount >> ampCount;
+
+        for (int c = 0; c < channelCount; c++) {
+            RhdChannel chan;
+            chan.groupIndex = g;
+            in >> chan.nativeName >> chan.customName;
+            in >> svalue;
+            chan.nativeNumber = svalue;
+            in >> svalue; // user order
+            in >> svalue;
+            chan.signalType = static_cast<SignalDataType>(svalue);
+            in >> svalue;
+            chan.enabled = svalue != 0;
+            in >> svalue;
+            chan.chipChannel = svalue;
+            in >> svalue;
+            chan.boardStream = svalue;
+            for (int i = 0; i < 4; i++)
+                in >> svalue; // trigger settings
+            in >> dvalue >> dvalue; // electrode impedance magnitude & phase
+
+            group.channels.append(chan);
+        }
+
+        m_groups.append(group);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        m_lastError = QStringLiteral("RHD2000 data file header is truncated or damaged.");
+        return false;
+    }
+
+    // build the save lists, in the same order the RHD2000 module writes data in
+    m_auxCount = 0;
+    m_supplyCount = 0;
+    m_haveDigIn = false;
+    m_haveDigOut = false;
+    for (const auto &group : m_groups) {
+        for (int n = 0; n < group.channels.size(); n++) {
+            const auto it = std::find_if(group.channels.cbegin(), group.channels.cend(),
+                                         [n](const RhdChannel &c) { return c.nativeNumber == n; });
+            if (it == group.channels.cend() || !it->enabled)
+                continue;
+
+            switch (it->signalType) {
+            case SignalDataType::Amplifier:
+                m_ampChannels.append(*it);
+                break;
+            case SignalDataType::AuxInput:
+                m_auxCount++;
+                break;
+            case SignalDataType::SupplyVoltage:
+                m_supplyCount++;
+                break;
+            case SignalDataType::BoardAdc:
+                m_adcChannels.append(*it);
+                break;
+            case SignalDataType::BoardDigIn:
+                m_haveDigIn = true;
+                break;
+            case SignalDataType::BoardDigOut:
+                m_haveDigOut = true;
+                break;
+            }
+        }
+    }
+
+    const size_t samples = RHD_SAMPLES_PER_DATA_BLOCK;
+    m_blockBytes = samples * sizeof(qint32)
+                   + samples * 2 * static_cast<size_t>(m_ampChannels.size())
+                   + (samples / 4) * 2 * static_cast<size_t>(m_auxCount)
+                   + 2 * static_cast<size_t>(m_supplyCount)
+                   + 2 * static_cast<size_t>(m_tempCount)
+                   + samples * 2 * static_cast<size_t>(m_adcChannels.size())
+                   + (m_haveDigIn? samples * 2 : 0)
+                   + (m_haveDigOut? samples * 2 : 0);
+    m_buffer.resize(m_blockBytes);
+
+    return true;
+}
+
+/**
+ * Read the next data block.
+ *
+ * @return false if no complete block is left in the file, in which case
+ * lastError() is set if the data could not be read at all.
+ */
+bool RhdFileReader::readBlock(RhdDataBlock &block)
+{
+    m_lastError.clear();
+    if (m_file.get() == nullptr)
+        return false;
+
+    const auto bytesRead = m_file->read(m_buffer.data(), static_cast<qint64>(m_blockBytes));
+    if (bytesRead < 0) {
+        m_lastError = QStringLiteral("Unable to read data: %1").arg(m_file->errorString());
+        return false;
+    }
+    if (static_cast<size_t>(bytesRead) < m_blockBytes) {
+        // a trailing partial block happens if a recording was not stopped cleanly
+        if (bytesRead > 0)
+            qWarning().noquote() << "Ignoring incomplete data block at the end of" << m_file->fileName();
+        return false;
+    }
+
+    const auto samples = RHD_SAMPLES_PER_DATA_BLOCK;
+    const char *pos = m_buffer.data();
+
+    block.timestamps.resize(samples);
+    for (int t = 0; t < samples; t++) {
+        block.timestamps[t] = qFromLittleEndian<qint32>(pos);
+        pos += sizeof(qint32);
+    }
+
+    block.amplifier.resize(m_ampChannels.size());
+    for (auto &data : block.amplifier) {
+        data.resize(samples);
+        for (int t = 0; t < samples; t++) {
+            data[t] = qFromLittleEndian<quint16>(pos);
+            pos += sizeof(quint16);
+        }
+    }
+
+    // skip auxiliary inputs, supply voltages and temperature sensors
+    pos += (samples / 4) * 2 * m_auxCount;
+    pos += 2 * m_supplyCount;
+    pos += 2 * m_tempCount;
+
+    block.boardAdc.resize(m_adcChannels.size());
+    for (auto &data : block.boardAdc) {
+        data.resize(samples);
+        for (int t = 0; t < samples; t++) {
+            data[t] = qFromLittleEndian<quint16>(pos);
+            pos += sizeof(quint16);
+        }
+    }
+
+    block.boardDigIn.resize(m_haveDigIn? samples : 0);
+    for (auto &value : block.boardDigIn) {
+        value = qFromLittleEndian<quint16>(pos);
+        pos += sizeof(quint16);
+    }
+
+    return true;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <QString>
+#include <QVector>
+
+#include "streams/datatypes.h"
+
+class QFile;
+
+/**
+ * @brief A channel stored in an Intan RHD2000 data file
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+class RhdChannel
+{
+public:
+    QString nativeName;
+    QString customName;
+    int nativeNumber;
+    SignalDataType signalType;
+    bool enabled;
+    int chipChannel;
+    int boardStream;
+    int groupIndex;
+};
+
+/**
+ * @brief A group of channels (usually one port of the interface board)
+ */
+class RhdSignalGroup
+{
+public:
+    QString name;
+    QString prefix;
+    bool enabled;
+    QVector<RhdChannel> channels;
+};
+
+/**
+ * @brief Raw data of one 60-sample block of an RHD2000 data file
+ *
+ * Data is stored in the order the respective channels appear in the save lists
+ * of the reader.
+ */
+class RhdDataBlock
+{
+public:
+    std::vector<qint32> timestamps;
+    std::vector<std::vector<quint16>> amplifier;
+    std::vector<std::vector<quint16>> boardAdc;
+    std::vector<quint16> boardDigIn;
+};
+#pragma GCC diagnostic pop
+
+/**
+ * @brief Read data files in the "traditional Intan" (.rhd) format
+ *
+ * This reads files written by the RHD2000 module in its default save format,
+ * which contain one header followed by a sequence of data blocks.
+ */
+class RhdFileReader
+{
+public:
+    explicit RhdFileReader();
+    ~RhdFileReader();
+
+    bool open(const QString &fname);
+    void close();
+    QString lastError() const;
+
+    double sampleRate() const;
+    int samplesPerBlock() const;
+    QVector<RhdSignalGroup> signalGroups() const;
+
+    QVector<RhdChannel> amplifierChannels() const;
+    QVector<RhdChannel> boardAdcChannels() const;
+    bool hasBoardDigIn() const;
+
+    bool readBlock(RhdDataBlock &block);
+
+private:
+    Q_DISABLE_COPY(RhdFileReader)
+
+    QString m_lastError;
+    std::unique_ptr<QFile> m_file;
+
+    double m_sampleRate;
+    QVector<RhdSignalGroup> m_groups;
+
+    QVector<RhdChannel> m_ampChannels;
+    QVector<RhdChannel> m_adcChannels;
+    int m_auxCount;
+    int m_supplyCount;
+    int m_tempCount;
+    bool m_haveDigIn;
+    bool m_haveDigOut;
+
+    size_t m_blockBytes;
+    std::vector<char> m_buffer;
+
+    bool readHeader();
+};
@@ -67,6 +67,7 @@ Rhd2000Module::Rhd2000Module(QObject *parent)
     : AbstractModule(parent),
       m_intanUi(new IntanUi(this)),
       m_evTimer(new QTimer(this)),
+      m_traceName(nullptr),
       m_prepared(false)
 {
     // set up Intan GUI and board
@@ -172,12 +173,14 @@ bool Rhd2000Module::prepare(const TestSubject &)
 
 void Rhd2000Module::start()
 {
+    m_traceName = traceIntern(name());
     m_intanUi->interfaceBoardStartRun();
     m_evTimer->start();
 }
 
 void Rhd2000Module::runBoardDAQ()
 {
+    SY_TRACE_SPAN("intan-rhd2000:runCycle", m_traceName);
     if (!m_intanUi->interfaceBoardRunCycle()) {
         raiseError(QStringLiteral("Intan data acquisition failed."));
         m_evTimer->stop();
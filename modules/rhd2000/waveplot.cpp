@@ -34,6 +34,10 @@
 #include "rhd2000datablock.h"
 #include "signalsources.h"
 #include "signalprocessor.h"
+#include "waverenderer.h"
+
+// maximum rate at which the display is refreshed, independent of the rate data arrives at
+static const int WAVEPLOT_MAX_FPS = 30;
 
 // The WavePlot widget displays multiple waveform plots in the Main Window.
 // Five types of waveforms may be displayed: amplifier, auxiliary input, supply
@@ -60,6 +64,21 @@ WavePlot::WavePlot(SignalProcessor *inSignalProcessor, SignalSources *inSignalSo
 
     impedanceLabels = false;
     pointPlotMode = false;
+
+    // Waveforms are drawn into the backing image by a separate thread,
+    // we only show the updated image at a limited rate.
+    renderer.reset(new WaveRenderer);
+    refreshTimer = new QTimer(this);
+    refreshTimer->setInterval(1000 / WAVEPLOT_MAX_FPS);
+    connect(refreshTimer, &QTimer::timeout, this, [this]() {
+        if (renderer->takeDirty())
+            update();
+    });
+    refreshTimer->start();
+}
+
+WavePlot::~WavePlot()
+{
 }
 
 // Initialize WavePlot object.
@@ -318,8 +337,9 @@ int WavePlot::getChannelCount(int port) const
 
 void WavePlot::paintEvent(QPaintEvent * /* event */)
 {
+    QMutexLocker locker(renderer->imageMutex());
     QStylePainter stylePainter(this);
-    stylePainter.drawPixmap(0, 0, pixmap);
+    stylePainter.drawImage(0, 0, *renderer->image());
 }
 
 // Returns the index of the closest waveform frame to a point on the screen.
@@ -410,7 +430,8 @@ void WavePlot::mouseMoveEvent(QMouseEvent *event)
 // Draw vertical line to indicate mouse drag location.
 void WavePlot::drawDragIndicator(int frameIndex, bool erase)
 {
-    QPainter painter(&pixmap);
+    QMutexLocker locker(renderer->imageMutex());
+    QPainter painter(renderer->image());
     painter.initFrom(this);
     QRect frame = frameList[numFramesIndex[selectedPort]][frameIndex];
     if (erase) {
@@ -588,7 +609,8 @@ int WavePlot::distanceSquared(QPoint a, QPoint b)
 void WavePlot::highlightFrame(int frameIndex, bool eraseOldFrame)
 {
     QRect frame;
-    QPainter painter(&pixmap);
+    QMutexLocker locker(renderer->imageMutex());
+    QPainter painter(renderer->image());
     painter.initFrom(this);
 
     painter.setPen(Qt::darkGray);
@@ -611,6 +633,8 @@ void WavePlot::highlightFrame(int frameIndex, bool eraseOldFrame)
     frame.adjust(-1, -1, 1, 1);
     painter.drawRect(frame);
 
+    painter.end();
+    locker.unlock();
     update();
 
     // Emit signal.
@@ -630,11 +654,12 @@ void WavePlot::highlightFrame(int frameIndex, bool eraseOldFrame)
 // Refresh pixel map used in double buffered graphics.
 void WavePlot::refreshPixmap()
 {
-    // Pixel map used for double buffering.
-    pixmap = QPixmap(size());
-    pixmap.fill();
+    // Image used for double buffering, this also drops waveform data
+    // which was not yet drawn into the old image.
+    renderer->resetImage(size(), palette().window().color());
 
-    QPainter painter(&pixmap);
+    QMutexLocker locker(renderer->imageMutex());
+    QPainter painter(renderer->image());
     painter.initFrom(this);
 
     // Clear old display.
@@ -652,6 +677,8 @@ void WavePlot::refreshPixmap()
     }
 
     tPosition = 0;
+    painter.end();
+    locker.unlock();
     update();
 }
 
@@ -701,30 +728,39 @@ SignalChannel* WavePlot::selectedChannel(int index)
 // Draw axis lines inside a frame.
 void WavePlot::drawAxisLines(QPainter &painter, int frameNumber)
 {
-    QRect frame = frameList[numFramesIndex[selectedPort]][frameNumber];
     painter.setPen(Qt::darkGray);
+    painter.drawLines(axisLines(frameNumber));
+}
+
+// Calculate axis lines inside a frame.
+QVector<QLine> WavePlot::axisLines(int frameNumber)
+{
+    QVector<QLine> lines;
+    QRect frame = frameList[numFramesIndex[selectedPort]][frameNumber];
 
     SignalType type = selectedChannel(frameNumber + topLeftFrame[selectedPort])->signalType;
     if (selectedChannel(frameNumber + topLeftFrame[selectedPort])->enabled) {
         if (type == AmplifierSignal) {
-            // Draw V = 0V axis line.
-            painter.drawLine(frame.left(), frame.center().y(), frame.right(), frame.center().y());
+            // V = 0V axis line.
+            lines.append(QLine(frame.left(), frame.center().y(), frame.right(), frame.center().y()));
         } else if (type == SupplyVoltageSignal) {
-            // Draw V = 3.6V axis line.
-            painter.drawLine(frame.left(), frame.top() - 0.266667 * (frame.top() - frame.bottom()) + 1,
-                             frame.right(), frame.top() - 0.266667 * (frame.top() - frame.bottom()) + 1);
-            // Draw V = 3.2V axis line.
-            painter.drawLine(frame.left(), frame.top() - 0.533333 * (frame.top() - frame.bottom()) + 1,
-                             frame.right(), frame.top() - 0.533333 * (frame.top() - frame.bottom()) + 1);
-            // Draw V = 2.9V axis line.
-            painter.drawLine(frame.left(), frame.top() - 0.733333 * (frame.top() - frame.bottom()) + 1,
-                             frame.right(), frame.top() - 0.733333 * (frame.top() - frame.bottom()) + 1);
+            // V = 3.6V axis line.
+            lines.append(QLine(frame.left(), frame.top() - 0.266667 * (frame.top() - frame.bottom()) + 1,
+                               frame.right(), frame.top() - 0.266667 * (frame.top() - frame.bottom()) + 1));
+            // V = 3.2V axis line.
+            lines.append(QLine(frame.left(), frame.top() - 0.533333 * (frame.top() - frame.bottom()) + 1,
+                               frame.right(), frame.top() - 0.533333 * (frame.top() - frame.bottom()) + 1));
+            // V = 2.9V axis line.
+            lines.append(QLine(frame.left(), frame.top() - 0.733333 * (frame.top() - frame.bottom()) + 1,
+                               frame.right(), frame.top() - 0.733333 * (frame.top() - frame.bottom()) + 1));
         }
     } else {
-        // Draw X showing channel is disabled.
-        painter.drawLine(frame.left(), frame.top(), frame.right(), frame.bottom());
-        painter.drawLine(frame.left(), frame.bottom(), frame.right(), frame.top());
+        // X showing channel is disabled.
+        lines.append(QLine(frame.left(), frame.top(), frame.right(), frame.bottom()));
+        lines.append(QLine(frame.left(), frame.bottom(), frame.right(), frame.top()));
     }
+
+    return lines;
 }
 
 // Draw text labels around axes of a frame.
@@ -846,255 +882,138 @@ bool WavePlot::isPortEnabled(int port) const
 }
 
 // Plot waveforms on screen.
+// The new data of every frame is reduced to one min/max envelope per pixel column
+// here, and then drawn into the backing image by the render thread.
 void WavePlot::drawWaveforms()
 {
-    int i, j, xOffset, yOffset, stream, channel;
+    int j, xOffset, stream, channel;
     double yAxisLength, tAxisLength;
     QRect adjustedFrame, eraseBlock;
     SignalType type;
-    double tStepMsec, xScaleFactor, yScaleFactor;
-    QPainter painter(&pixmap);
-    painter.initFrom(this);
+    double tStepMsec;
 
     int length = Rhd2000DataBlock::getSamplesPerDataBlock() * numUsbBlocksToPlot;
 
-    QPointF *polyline = new QPointF[length + 1];
-
     // Assume all frames are the same size.
     yAxisLength = (frameList[numFramesIndex[selectedPort]][0].height() - 2) / 2.0;
     tAxisLength = frameList[numFramesIndex[selectedPort]][0].width() - 1;
 
+    std::vector<WaveSegment> segments;
+    segments.reserve(frameList[numFramesIndex[selectedPort]].size());
+
     for (j = 0; j < frameList[numFramesIndex[selectedPort]].size(); ++j) {
         stream = selectedChannel(j + topLeftFrame[selectedPort])->boardStream;
         channel = selectedChannel(j + topLeftFrame[selectedPort])->chipChannel;
         type = selectedChannel(j + topLeftFrame[selectedPort])->signalType;
 
-        if (selectedChannel(j + topLeftFrame[selectedPort])->enabled) {
-            xOffset = frameList[numFramesIndex[selectedPort]][j].left() + 1;
-            xOffset += tPosition * tAxisLength / tScale;
-
-            // Set clipping region
-            adjustedFrame = frameList[numFramesIndex[selectedPort]][j];
-            adjustedFrame.adjust(0, 1, 0, 0);
-            painter.setClipRect(adjustedFrame);
-
-            // Erase segment of old wavefrom
-            eraseBlock = adjustedFrame;
-            eraseBlock.setLeft(xOffset);
-            eraseBlock.setRight((tAxisLength * (1000.0 / sampleRate) / tScale) * (length - 1) + xOffset);
-            painter.eraseRect(eraseBlock);
-
-            // Redraw y = 0 axis
-            drawAxisLines(painter, j);
-
-            if (type == AmplifierSignal) {
-                // Plot RHD2000 amplifier waveform
-
-                tStepMsec = 1000.0 / sampleRate;
-                xScaleFactor = tAxisLength * tStepMsec / tScale;
-                yScaleFactor = -yAxisLength / yScale;
-                yOffset = frameList[numFramesIndex[selectedPort]][j].center().y();
-
-                // build waveform
-                for (i = 0; i < length; ++i) {
-                    polyline[i+1] =
-                            QPointF(xScaleFactor * i + xOffset,
-                                    yScaleFactor * signalProcessor->amplifierPostFilter.at(stream).at(channel).at(i) + yOffset);
-                }
-
-                // join to old waveform
-                if (tPosition == 0.0) {
-                    polyline[0] = polyline[1];
-                } else {
-                    polyline[0] =
-                            QPointF(xScaleFactor * -1 + xOffset,
-                                    yScaleFactor * plotDataOld.at(j + topLeftFrame[selectedPort]) + yOffset);
-                }
-
-                // save last point in waveform to join to next segment
-                plotDataOld[j + topLeftFrame[selectedPort]] =
-                        signalProcessor->amplifierPostFilter.at(stream).at(channel).at(length - 1);
-
-                // draw waveform
-                painter.setPen(Qt::blue);
-                if (pointPlotMode) {
-                    painter.drawPoints(polyline, length + 1);
-                } else {
-                    painter.drawPolyline(polyline, length + 1);
-                }
-
-            } else if (type == AuxInputSignal) {
-                // Plot RHD2000 auxiliary input signal
-
-                tStepMsec = 1000.0 / (sampleRate / 4);
-                xScaleFactor = tAxisLength * tStepMsec / tScale;
-                yScaleFactor = -(2.0 * yAxisLength) / 2.5;
-                yOffset = frameList[numFramesIndex[selectedPort]][j].bottom();
-
-                // build waveform
-                for (i = 0; i < (length / 4); ++i) {
-                    polyline[i+1] =
-                            QPointF(xScaleFactor * i + xOffset,
-                                    yScaleFactor * signalProcessor->auxChannel.at(stream).at(channel).at(i) + yOffset);
-                }
-
-                // join to old waveform
-                if (tPosition == 0.0) {
-                    polyline[0] = polyline[1];
-                } else {
-                    polyline[0] =
-                            QPointF(xScaleFactor * -1 + xOffset,
-                                    yScaleFactor * plotDataOld.at(j + topLeftFrame[selectedPort]) + yOffset);
-                }
-
-                // save last point in waveform to join to next segment
-                plotDataOld[j + topLeftFrame[selectedPort]] =
-                        signalProcessor->auxChannel.at(stream).at(channel).at((length / 4) - 1);
-
-                // draw waveform
-                QPen pen;
-                pen.setColor(QColor(200, 50, 50));
-                painter.setPen(pen);
-                if (pointPlotMode) {
-                    painter.drawPoints(polyline, (length / 4) + 1);
-                } else {
-                    painter.drawPolyline(polyline, (length / 4) + 1);
-                }
-
-            } else if (type == SupplyVoltageSignal) {
-                // Plot RHD2000 supply voltage signal
-
-                tStepMsec = 1000.0 / (sampleRate / 60.0);
-                xScaleFactor = tAxisLength * tStepMsec / tScale;
-                yScaleFactor = -(2.0 * yAxisLength) / 1.5;
-                yOffset = frameList[numFramesIndex[selectedPort]][j].bottom();
-
-                bool voltageLow = false;
-                bool voltageOutOfRange = false;
-                double voltage;
-
-                // build waveform
-                for (i = 0; i < (length / 60); ++i) {
-                    voltage = signalProcessor->supplyVoltage.at(stream).at(i);
-                    polyline[i+1] =
-                            QPointF(xScaleFactor * i + xOffset,
-                                    yScaleFactor * (voltage - 2.5) + yOffset);
-                    if (voltage < 2.9 || voltage > 3.6) {
-                        voltageOutOfRange = true;
-                    } else if (voltage < 3.2) {
-                        voltageLow = true;
-                    }
-                }
-
-                // join to old waveform
-                if (tPosition == 0.0) {
-                    polyline[0] = polyline[1];
-                } else {
-                    polyline[0] =
-                            QPointF(xScaleFactor * -1 + xOffset,
-                                    yScaleFactor * (plotDataOld.at(j + topLeftFrame[selectedPort]) - 2.5) + yOffset);
-                }
-
-                // save last point in waveform to join to next segment
-                plotDataOld[j + topLeftFrame[selectedPort]] =
-                        signalProcessor->supplyVoltage.at(stream).at((length / 60) - 1);
-
-                // draw waveform
-                painter.setPen(Qt::green);
-                if (voltageLow) painter.setPen(Qt::yellow);
-                if (voltageOutOfRange) painter.setPen(Qt::red);
-                if (pointPlotMode) {
-                    painter.drawPoints(polyline, (length / 60) + 1);
-                } else {
-                    painter.drawPolyline(polyline, (length / 60) + 1);
-                }
-
-            } else if (type == BoardAdcSignal) {
-                // Plot USB interface board ADC input signal
-
-                tStepMsec = 1000.0 / sampleRate;
-                xScaleFactor = tAxisLength * tStepMsec / tScale;
-                yScaleFactor = -(2.0 * yAxisLength) / 3.3;
-                yOffset = frameList[numFramesIndex[selectedPort]][j].bottom();
-
-                // build waveform
-                for (i = 0; i < length; ++i) {
-                    polyline[i+1] =
-                            QPointF(xScaleFactor * i + xOffset,
-                                    yScaleFactor * signalProcessor->boardAdc.at(channel).at(i) + yOffset);
-                }
-
-                // join to old waveform
-                if (tPosition == 0.0) {
-                    polyline[0] = polyline[1];
-                } else {
-                    polyline[0] =
-                            QPointF(xScaleFactor * -1 + xOffset,
-                                    yScaleFactor * plotDataOld.at(j + topLeftFrame[selectedPort]) + yOffset);
-                }
-
-                // save last point in waveform to join to next segment
-                plotDataOld[j + topLeftFrame[selectedPort]] =
-                        signalProcessor->boardAdc.at(channel).at(length - 1);
-
-                // draw waveform
-                painter.setPen(Qt::darkGreen);
-                if (pointPlotMode) {
-                    painter.drawPoints(polyline, length + 1);
-                } else {
-                    painter.drawPolyline(polyline, length + 1);
-                }
-
-            } else if (type == BoardDigInSignal) {
-                // Plot USB interface board digital input signal
-
-                tStepMsec = 1000.0 / sampleRate;
-                xScaleFactor = tAxisLength * tStepMsec / tScale;
-                yScaleFactor = -(2.0 * yAxisLength) / 2.0;
-                yOffset = (frameList[numFramesIndex[selectedPort]][j].bottom() +
-                           frameList[numFramesIndex[selectedPort]][j].center().y()) / 2.0;
-
-                // build waveform
-                for (i = 0; i < length; ++i) {
-                    polyline[i+1] =
-                            QPointF(xScaleFactor * i + xOffset,
-                                    yScaleFactor * signalProcessor->boardDigIn.at(channel).at(i) + yOffset);
-                }
+        if (!selectedChannel(j + topLeftFrame[selectedPort])->enabled)
+            continue;
+
+        xOffset = frameList[numFramesIndex[selectedPort]][j].left() + 1;
+        xOffset += tPosition * tAxisLength / tScale;
+
+        // Set clipping region
+        adjustedFrame = frameList[numFramesIndex[selectedPort]][j];
+        adjustedFrame.adjust(0, 1, 0, 0);
+
+        // Erase segment of old wavefrom
+        eraseBlock = adjustedFrame;
+        eraseBlock.setLeft(xOffset);
+        eraseBlock.setRight((tAxisLength * (1000.0 / sampleRate) / tScale) * (length - 1) + xOffset);
+
+        WaveSegment seg;
+        seg.clipRect = adjustedFrame;
+        seg.eraseRect = eraseBlock;
+        seg.axisLines = axisLines(j);
+        seg.pointMode = pointPlotMode;
+        seg.joinPrevious = false;
+
+        // build the envelope of a waveform with @count samples
+        auto buildWaveform = [&](const auto *data, int count, double tStep, double yScaleFactor, double yOffset) {
+            const double xScaleFactor = tAxisLength * tStep / tScale;
+            computeWaveEnvelope(data, count, xScaleFactor, xOffset, yScaleFactor, yOffset, seg.columns);
+
+            // join to old waveform
+            if (tPosition != 0.0) {
+                seg.joinPrevious = true;
+                seg.previous = QPointF(xScaleFactor * -1 + xOffset,
+                                       yScaleFactor * plotDataOld.at(j + topLeftFrame[selectedPort]) + yOffset);
+            }
 
-                // join to old waveform
-                if (tPosition == 0.0) {
-                    polyline[0] = polyline[1];
-                } else {
-                    polyline[0] =
-                            QPointF(xScaleFactor * -1 + xOffset,
-                                    yScaleFactor * plotDataOld.at(j + topLeftFrame[selectedPort]) + yOffset);
-                }
+            // save last point in waveform to join to next segment
+            plotDataOld[j + topLeftFrame[selectedPort]] = data[count - 1];
+        };
 
-                // save last point in waveform to join to next segment
-                plotDataOld[j + topLeftFrame[selectedPort]] =
-                        signalProcessor->boardDigIn.at(channel).at(length - 1);
+        if (type == AmplifierSignal) {
+            // Plot RHD2000 amplifier waveform
+            seg.color = Qt::blue;
+            buildWaveform(signalProcessor->amplifierPostFilter.at(stream).at(channel).constData(), length,
+                          1000.0 / sampleRate,
+                          -yAxisLength / yScale,
+                          frameList[numFramesIndex[selectedPort]][j].center().y());
+
+        } else if (type == AuxInputSignal) {
+            // Plot RHD2000 auxiliary input signal
+            seg.color = QColor(200, 50, 50);
+            buildWaveform(signalProcessor->auxChannel.at(stream).at(channel).constData(), length / 4,
+                          1000.0 / (sampleRate / 4),
+                          -(2.0 * yAxisLength) / 2.5,
+                          frameList[numFramesIndex[selectedPort]][j].bottom());
 
-                // draw waveform
-                QPen pen;
-                pen.setColor(QColor(200, 50, 200));
-                painter.setPen(pen);
-                if (pointPlotMode) {
-                    painter.drawPoints(polyline, length + 1);
-                } else {
-                    painter.drawPolyline(polyline, length + 1);
+        } else if (type == SupplyVoltageSignal) {
+            // Plot RHD2000 supply voltage signal
+            const auto &voltages = signalProcessor->supplyVoltage.at(stream);
+            bool voltageLow = false;
+            bool voltageOutOfRange = false;
+            for (int i = 0; i < (length / 60); ++i) {
+                if (voltages.at(i) < 2.9 || voltages.at(i) > 3.6) {
+                    voltageOutOfRange = true;
+                } else if (voltages.at(i) < 3.2) {
+                    voltageLow = true;
                 }
             }
-            painter.setClipping(false);
+
+            seg.color = Qt::green;
+            if (voltageLow) seg.color = Qt::yellow;
+            if (voltageOutOfRange) seg.color = Qt::red;
+
+            // the waveform is shown relative to 2.5V
+            const double yScaleFactor = -(2.0 * yAxisLength) / 1.5;
+            buildWaveform(voltages.constData(), length / 60,
+                          1000.0 / (sampleRate / 60.0),
+                          yScaleFactor,
+                          frameList[numFramesIndex[selectedPort]][j].bottom() - 2.5 * yScaleFactor);
+
+        } else if (type == BoardAdcSignal) {
+            // Plot USB interface board ADC input signal
+            seg.color = Qt::darkGreen;
+            buildWaveform(signalProcessor->boardAdc.at(channel).constData(), length,
+                          1000.0 / sampleRate,
+                          -(2.0 * yAxisLength) / 3.3,
+                          frameList[numFramesIndex[selectedPort]][j].bottom());
+
+        } else if (type == BoardDigInSignal) {
+            // Plot USB interface board digital input signal
+            seg.color = QColor(200, 50, 200);
+            buildWaveform(signalProcessor->boardDigIn.at(channel).constData(), length,
+                          1000.0 / sampleRate,
+                          -(2.0 * yAxisLength) / 2.0,
+                          static_cast<int>((frameList[numFramesIndex[selectedPort]][j].bottom() +
+                                           frameList[numFramesIndex[selectedPort]][j].center().y()) / 2.0));
+        } else {
+            continue;
         }
+
+        segments.push_back(std::move(seg));
     }
 
+    renderer->submit(segments);
+
     tStepMsec = 1000.0 / sampleRate;
     tPosition += length * tStepMsec;
     if (tPosition >= tScale) {
         tPosition = 0.0;
     }
-
-    delete [] polyline;
 }
 
 void WavePlot::refreshScreen()
@@ -1202,8 +1121,8 @@ void WavePlot::disableAllChannels()
 // Update display when new data is available.
 void WavePlot::passFilteredData()
 {
+    // the display is updated by our refresh timer once the data was drawn
     drawWaveforms();
-    update();
 }
 
 // Enable or disable electrode impedance labels on display.
@@ -23,6 +23,7 @@
 #define WAVEPLOT_H
 
 #include <QWidget>
+#include <memory>
 #include "signalgroup.h"
 
 using namespace std;
@@ -31,6 +32,8 @@ class Rhd2000DataBlock;
 class SignalProcessor;
 class SignalSources;
 class IntanUi;
+class WaveRenderer;
+class QTimer;
 
 class WavePlot : public QWidget
 {
@@ -39,6 +42,7 @@ class WavePlot : public QWidget
 public:
     WavePlot(SignalProcessor *inSignalProcessor, SignalSources *inSignalSources,
              IntanUi *inIntanUi, QWidget *parent = nullptr);
+    ~WavePlot() override;
 
     void initialize(int startingPort);
     void passFilteredData();
@@ -98,6 +102,7 @@ private:
     void refreshPixmap();
     void drawAxes(QPainter &painter, int frameNumber);
     void drawAxisLines(QPainter &painter, int frameNumber);
+    QVector<QLine> axisLines(int frameNumber);
     void drawAxisText(QPainter &painter, int frameNumber);
     void drawWaveforms();
     void highlightFrame(int frameIndex, bool eraseOldFrame);
@@ -121,7 +126,9 @@ private:
     SignalSources *signalSources;
     IntanUi *intanUi;
 
-    QPixmap pixmap;
+    // backing image, drawn to by the GUI and a render thread
+    std::unique_ptr<WaveRenderer> renderer;
+    QTimer *refreshTimer;
 
     QVector<double> plotDataOld;
     QVector<QVector<QRect> > frameList;
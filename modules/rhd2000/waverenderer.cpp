@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "waverenderer.h"
+
+#include <QPainter>
+
+WaveRenderer::WaveRenderer()
+    : m_generation(0),
+      m_dirty(false),
+      m_running(true)
+{
+    m_thread = std::thread(&WaveRenderer::renderThread, this);
+}
+
+WaveRenderer::~WaveRenderer()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_running = false;
+    }
+    m_queueCond.notify_all();
+    m_thread.join();
+}
+
+QMutex *WaveRenderer::imageMutex()
+{
+    return &m_imageMutex;
+}
+
+QImage *WaveRenderer::image()
+{
+    return &m_image;
+}
+
+/**
+ * Replace the backing image with a blank one of @size.
+ */
+void WaveRenderer::resetImage(const QSize &size, const QColor &background)
+{
+    QMutexLocker locker(&m_imageMutex);
+    m_image = QImage(size, QImage::Format_ARGB32_Premultiplied);
+    m_image.fill(Qt::white);
+    m_background = background;
+    m_generation++;
+
+    std::lock_guard<std::mutex> lock(m_queueMutex);
+    m_queue.clear();
+}
+
+/**
+ * Queue segments to be drawn into the current image. This takes ownership
+ * of the segments' data.
+ */
+void WaveRenderer::submit(std::vector<WaveSegment> &segments)
+{
+    SegmentBatch batch;
+    batch.generation = m_generation;
+    batch.segments.swap(segments);
+    {
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_queue.push_back(std::move(batch));
+    }
+    m_queueCond.notify_one();
+}
+
+/**
+ * Check whether the image has changed since the last call.
+ */
+bool WaveRenderer::takeDirty()
+{
+    return m_dirty.exchange(false);
+}
+
+void WaveRenderer::renderThread()
+{
+    pthread_setname_np(pthread_self(), "intan_waveplot");
+
+    std::vector<SegmentBatch> batches;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_queueMutex);
+            m_queueCond.wait(lock, [&]{ return !m_queue.empty() || !m_running; });
+            if (!m_running)
+                break;
+            batches.swap(m_queue);
+        }
+
+        {
+            QMutexLocker locker(&m_imageMutex);
+            if (m_image.isNull()) {
+                batches.clear();
+                continue;
+            }
+
+            QPainter painter(&m_image);
+            for (const auto &batch : batches) {
+                // skip data for an image which no longer exists
+                if (batch.generation != m_generation)
+                    continue;
+                for (const auto &seg : batch.segments)
+                    drawSegment(painter, seg);
+            }
+        }
+        batches.clear();
+        m_dirty = true;
+    }
+}
+
+void WaveRenderer::drawSegment(QPainter &painter, const WaveSegment &seg)
+{
+    painter.setClipRect(seg.clipRect);
+
+    // erase the part of the old waveform we are about to overwrite, and redraw its axes
+    painter.fillRect(seg.eraseRect, m_background);
+    painter.setPen(Qt::darkGray);
+    painter.drawLines(seg.axisLines);
+
+    // every column is a vertical line covering all of its samples, which is connected
+    // to the last sample of its predecessor
+    m_lines.clear();
+    m_lines.reserve(static_cast<int>(seg.columns.size()) * 2 + 1);
+    QPointF prev = seg.previous;
+    bool havePrev = seg.joinPrevious;
+    for (const auto &col : seg.columns) {
+        if (havePrev && !seg.pointMode)
+            m_lines.append(QLineF(prev, QPointF(col.x, col.yFirst)));
+        m_lines.append(QLineF(col.x, col.yMin, col.x, col.yMax));
+        prev = QPointF(col.x, col.yLast);
+        havePrev = true;
+    }
+
+    painter.setPen(seg.color);
+    painter.drawLines(m_lines);
+    painter.setClipping(false);
+}
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QImage>
+#include <QMutex>
+#include <QColor>
+#include <QRect>
+#include <QLine>
+#include <QVector>
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+/**
+ * @brief Envelope of all samples which fall into one pixel column
+ *
+ * All values are in screen coordinates.
+ */
+struct WaveColumn
+{
+    int x;
+    float yMin;
+    float yMax;
+    float yFirst;
+    float yLast;
+};
+
+/**
+ * @brief Newly acquired part of the waveform shown in a single frame
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+class WaveSegment
+{
+public:
+    QRect clipRect;
+    QRect eraseRect;
+    QVector<QLine> axisLines;
+    QColor color;
+    bool pointMode;
+
+    bool joinPrevious;
+    QPointF previous;
+
+    std::vector<WaveColumn> columns;
+};
+#pragma GCC diagnostic pop
+
+/**
+ * Reduce @count samples to their min/max envelope per pixel column, with sample
+ * i being located at x = xScale * i + xOffset and values being mapped
+ * to y = yScale * value + yOffset.
+ */
+template<typename T>
+void computeWaveEnvelope(const T *data, int count,
+                         double xScale, double xOffset,
+                         double yScale, double yOffset,
+                         std::vector<WaveColumn> &columns)
+{
+    columns.clear();
+    int i = 0;
+    while (i < count) {
+        const auto px = static_cast<int>(std::floor(xScale * i + xOffset));
+
+        // first sample which belongs to the next column
+        auto end = static_cast<int>(std::ceil((px + 1 - xOffset) / xScale));
+        if (end <= i)
+            end = i + 1;
+        if (end > count)
+            end = count;
+
+        // plain reductions, which the compiler turns into packed min/max instructions
+        T vMin = data[i];
+        T vMax = data[i];
+#pragma omp simd reduction(min:vMin) reduction(max:vMax)
+        for (int k = i + 1; k < end; ++k) {
+            vMin = (data[k] < vMin)? data[k] : vMin;
+            vMax = (data[k] > vMax)? data[k] : vMax;
+        }
+
+        WaveColumn col;
+        col.x = px;
+        col.yMin = static_cast<float>(yScale * vMin + yOffset);
+        col.yMax = static_cast<float>(yScale * vMax + yOffset);
+        col.yFirst = static_cast<float>(yScale * data[i] + yOffset);
+        col.yLast = static_cast<float>(yScale * data[end - 1] + yOffset);
+        columns.push_back(col);
+
+        i = end;
+    }
+}
+
+/**
+ * @brief Draws waveform segments into a backing image on a separate thread
+ *
+ * The image is shared with the GUI thread, which draws frames and labels into
+ * it and displays it. Any access to it must hold the image mutex.
+ * Resetting the image drops all segments which were submitted for the previous one.
+ */
+class WaveRenderer
+{
+public:
+    explicit WaveRenderer();
+    ~WaveRenderer();
+
+    QMutex *imageMutex();
+    QImage *image();
+    void resetImage(const QSize &size, const QColor &background);
+
+    void submit(std::vector<WaveSegment> &segments);
+    bool takeDirty();
+
+private:
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+    struct SegmentBatch
+    {
+        uint generation;
+        std::vector<WaveSegment> segments;
+    };
+#pragma GCC diagnostic pop
+
+    QMutex m_imageMutex;
+    QImage m_image;
+    QColor m_background;
+    std::atomic_uint m_generation;
+    std::atomic_bool m_dirty;
+
+    std::thread m_thread;
+    std::mutex m_queueMutex;
+    std::condition_variable m_queueCond;
+    std::vector<SegmentBatch> m_queue;
+    bool m_running;
+
+    QVector<QLineF> m_lines;
+
+    void renderThread();
+    void drawSegment(QPainter &painter, const WaveSegment &seg);
+};
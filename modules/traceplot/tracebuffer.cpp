@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tracebuffer.h"
+
+#include <algorithm>
+
+// amount of entries of a pyramid level which are combined into one entry of the next level
+static const uint PYRAMID_BASE = 8;
+
+static inline void mergeMinMax(TraceBuffer::MinMax &target, const TraceBuffer::MinMax &other)
+{
+    if (other.min < target.min)
+        target.min = other.min;
+    if (other.max > target.max)
+        target.max = other.max;
+}
+
+TraceBuffer::TraceBuffer(size_t capacity)
+    : m_count(0)
+{
+    if (capacity < PYRAMID_BASE)
+        capacity = PYRAMID_BASE;
+    m_samples.resize(capacity);
+
+    // every level keeps enough buckets to cover all samples of the ring buffer,
+    // plus one for the bucket the oldest samples may be part of
+    for (uint64_t bucketSize = PYRAMID_BASE; bucketSize <= capacity; bucketSize *= PYRAMID_BASE) {
+        Level level;
+        level.bucketSize = bucketSize;
+        level.buckets.resize(capacity / bucketSize + 1);
+        level.completed = 0;
+        level.pending = MinMax{0, 0};
+        level.pendingCount = 0;
+        m_levels.push_back(level);
+    }
+}
+
+void TraceBuffer::reset()
+{
+    m_count = 0;
+    for (auto &level : m_levels) {
+        level.completed = 0;
+        level.pendingCount = 0;
+    }
+}
+
+void TraceBuffer::append(float value)
+{
+    m_samples[m_count % m_samples.size()] = value;
+    m_count++;
+
+    // propagate the new value up the pyramid, until we hit a level
+    // where it doesn't complete a bucket
+    MinMax mm{value, value};
+    for (auto &level : m_levels) {
+        if (level.pendingCount == 0)
+            level.pending = mm;
+        else
+            mergeMinMax(level.pending, mm);
+        level.pendingCount++;
+        if (level.pendingCount < PYRAMID_BASE)
+            break;
+
+        level.buckets[level.completed % level.buckets.size()] = level.pending;
+        level.completed++;
+        level.pendingCount = 0;
+        mm = level.pending;
+    }
+}
+
+size_t TraceBuffer::capacity() const
+{
+    return m_samples.size();
+}
+
+/**
+ * Index of the oldest sample which is still available.
+ */
+uint64_t TraceBuffer::firstIndex() const
+{
+    return (m_count > m_samples.size())? m_count - m_samples.size() : 0;
+}
+
+/**
+ * Index past the newest sample.
+ */
+uint64_t TraceBuffer::endIndex() const
+{
+    return m_count;
+}
+
+float TraceBuffer::at(uint64_t index) const
+{
+    return m_samples[index % m_samples.size()];
+}
+
+/**
+ * Determine the minimum and maximum of all available samples in range [first, last).
+ * The range is covered using the largest complete pyramid buckets which fit into it,
+ * and only the unaligned edges are looked up in finer levels.
+ *
+ * @return false if no samples are available in the selected range.
+ */
+bool TraceBuffer::rangeMinMax(uint64_t first, uint64_t last, MinMax &result) const
+{
+    first = std::max(first, firstIndex());
+    last = std::min(last, endIndex());
+    if (first >= last)
+        return false;
+
+    result = MinMax{at(first), at(first)};
+    auto pos = first;
+    while (pos < last) {
+        bool found = false;
+        for (auto it = m_levels.crbegin(); it != m_levels.crend(); ++it) {
+            const auto &level = *it;
+            if ((pos % level.bucketSize != 0) || (pos + level.bucketSize > last))
+                continue;
+            const auto bucketIdx = pos / level.bucketSize;
+            if (bucketIdx >= level.completed)
+                continue;
+
+            mergeMinMax(result, level.buckets[bucketIdx % level.buckets.size()]);
+            pos += level.bucketSize;
+            found = true;
+            break;
+        }
+
+        if (!found) {
+            const auto value = at(pos);
+            mergeMinMax(result, MinMax{value, value});
+            pos++;
+        }
+    }
+
+    return true;
+}
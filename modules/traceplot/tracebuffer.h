@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * @brief Fixed-capacity sample history of a single trace
+ *
+ * Samples are kept in a ring buffer, so once the buffer is full the oldest
+ * samples are overwritten. Alongside the samples, a pyramid of min/max values of
+ * buckets of increasing size is updated incrementally as samples arrive, which
+ * allows determining the envelope of any range of samples by looking at only a
+ * few values per pyramid level.
+ *
+ * Samples are addressed by their absolute index since the last reset.
+ */
+class TraceBuffer
+{
+public:
+    struct MinMax
+    {
+        float min;
+        float max;
+    };
+
+    explicit TraceBuffer(size_t capacity = 1 << 20);
+
+    void reset();
+
+    void append(float value);
+    template<typename It>
+    void append(It first, It last)
+    {
+        for (; first != last; ++first)
+            append(static_cast<float>(*first));
+    }
+
+    size_t capacity() const;
+    uint64_t firstIndex() const;
+    uint64_t endIndex() const;
+    float at(uint64_t index) const;
+
+    bool rangeMinMax(uint64_t first, uint64_t last, MinMax &result) const;
+
+private:
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+    struct Level
+    {
+        uint64_t bucketSize;
+        std::vector<MinMax> buckets;
+        uint64_t completed;
+        MinMax pending;
+        uint32_t pendingCount;
+    };
+#pragma GCC diagnostic pop
+
+    std::vector<float> m_samples;
+    uint64_t m_count;
+    std::vector<Level> m_levels;
+};
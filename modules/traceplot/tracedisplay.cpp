@@ -20,11 +20,15 @@
 #include "tracedisplay.h"
 #include "ui_tracedisplay.h"
 
+#include <cmath>
+#include <algorithm>
 #include <QDebug>
 #include <QTimer>
 #include <QLineSeries>
+#include <QValueAxis>
 
 #include "traceplot.h"
+#include "tracebuffer.h"
 
 
 class PlotChannelData final : public QObject
@@ -33,38 +37,22 @@ class PlotChannelData final : public QObject
 public:
     explicit PlotChannelData(QObject *parent = nullptr)
         : QObject(parent),
+          series(nullptr),
           multiplier(1),
-          xPos(0),
-          storeOrig(false),
+          yShift(0),
           m_enabled(false)
-    {
-        data.reserve(60000);
-    }
+    {}
 
     void reset()
     {
-        xPos = 0;
-        dataPrev = data;
-        data.clear();
-        dataOrig.clear();
+        if (buffer)
+            buffer->reset();
     }
 
-    void addNewYValue(double xval)
+    template<typename It>
+    void addNewYValues(It first, It last)
     {
-        if ((multiplier > 1) || (yShift != 0)) {
-            if (multiplier <= 0)
-                multiplier = 1;
-
-            storeOrig = true;
-            data.append(QPointF(xPos, xval * multiplier + yShift));
-        } else {
-            data.append(QPointF(xPos, xval));
-        }
-
-        if (storeOrig)
-            dataOrig.append(QPointF(xPos, xval));
-
-        xPos += 1;
+        buffer->append(first, last);
     }
 
     void registerChannel(TracePlot *plot)
@@ -77,17 +65,12 @@ public:
         plot->addSeries(series);
         this->series = series;
 
-        plot->createDefaultAxes();
-
-        auto axisY = plot->axes(Qt::Vertical).back();
-        axisY->setMax(250);
-        axisY->setMin(-250);
-        axisY->setTitleText(QStringLiteral("µV"));
-        auto font = axisY->titleFont();
-        font.setPointSize(8);
-        axisY->setTitleFont(font);
+        // all series share the axes of the plot, which persist while channels come and go
+        for (auto axis : plot->axes())
+            series->attachAxis(axis);
 
-        this->series->points().reserve(60000);
+        // the sample history is only kept while the channel is displayed
+        this->buffer.reset(new TraceBuffer);
         this->m_enabled = true;
     }
 
@@ -97,6 +80,7 @@ public:
             return;
 
         plot->removeSeries(this->series);
+        this->buffer.reset();
         this->m_enabled = false;
     }
 
@@ -105,6 +89,46 @@ public:
         return m_enabled;
     }
 
+    /**
+     * Replace the points of our series with the samples in range [first, last).
+     * If there are more samples than pixel columns to display them in, the samples
+     * are reduced to their minimum and maximum per column.
+     */
+    void updateSeries(uint64_t first, uint64_t last, int columns)
+    {
+        m_points.clear();
+        first = std::max(first, buffer->firstIndex());
+        last = std::min(last, buffer->endIndex());
+        if ((first >= last) || (columns <= 0)) {
+            series->replace(m_points);
+            return;
+        }
+
+        const auto sampleCount = last - first;
+        if (sampleCount <= static_cast<uint64_t>(columns) * 2) {
+            for (auto i = first; i < last; i++)
+                m_points.append(QPointF(i, buffer->at(i) * multiplier + yShift));
+        } else {
+            for (int c = 0; c < columns; c++) {
+                const auto colFirst = first + sampleCount * c / columns;
+                const auto colLast = first + sampleCount * (c + 1) / columns;
+                TraceBuffer::MinMax mm;
+                if (!buffer->rangeMinMax(colFirst, colLast, mm))
+                    continue;
+
+                // alternate the order, so neighboring columns are joined by short segments
+                const auto low = QPointF(colFirst, mm.min * multiplier + yShift);
+                const auto high = QPointF(colFirst, mm.max * multiplier + yShift);
+                m_points.append((c % 2 == 0)? low : high);
+                m_points.append((c % 2 == 0)? high : low);
+            }
+        }
+
+        // replace is *much* faster than append(QPointF)
+        // see https://bugreports.qt.io/browse/QTBUG-55714
+        series->replace(m_points);
+    }
+
     QtCharts::QXYSeries *series;
     int chanId;
     int chanDataIndex;
@@ -112,15 +136,11 @@ public:
     double multiplier;
     double yShift;
 
-    QList<QPointF> data;
-    QList<QPointF> dataOrig;
-    QList<QPointF> dataPrev;
-
-    int xPos;
-    bool storeOrig;
+    std::unique_ptr<TraceBuffer> buffer;
 
 private:
     bool m_enabled;
+    QVector<QPointF> m_points;
 };
 
 TraceDisplay::TraceDisplay(QWidget *parent)
@@ -144,6 +164,22 @@ TraceDisplay::TraceDisplay(QWidget *parent)
     ui->traceView0->setChart(m_plot);
     ui->traceView0->setRenderHint(QPainter::Antialiasing);
 
+    auto axisX = new QValueAxis;
+    auto axisY = new QValueAxis;
+    axisY->setRange(-250, 250);
+    axisY->setTitleText(QStringLiteral("µV"));
+    auto font = axisY->titleFont();
+    font.setPointSize(8);
+    axisY->setTitleFont(font);
+    m_plot->addAxis(axisX, Qt::AlignBottom);
+    m_plot->addAxis(axisY, Qt::AlignLeft);
+
+    // re-render the visible window whenever it is moved or zoomed
+    connect(axisX, &QValueAxis::rangeChanged, this, [this](qreal, qreal) {
+        if (!m_timer->isActive())
+            m_timer->start();
+    });
+
     connect(ui->plotScrollBar, &QScrollBar::valueChanged, this, &TraceDisplay::plotMoveTo);
     ui->plotRefreshSpinBox->setValue(m_timer->interval());
 
@@ -231,8 +267,8 @@ static inline bool updateDataForActiveChannels(QList<QPair<std::shared_ptr<Strea
             if (!pcd->enabled())
                 continue;
 
-            for (size_t i = 0; i < sigBlock.data[pcd->chanDataIndex].size(); i++)
-                pcd->addNewYValue(sigBlock.data[pcd->chanDataIndex][i]);
+            const auto &chanData = sigBlock.data[pcd->chanDataIndex];
+            pcd->addNewYValues(chanData.cbegin(), chanData.cend());
 
             updated = true;
         }
@@ -305,23 +341,38 @@ void TraceDisplay::resetPlotConfig()
 
 void TraceDisplay::repaintPlot()
 {
+    // set & broadcast our maximum horizontal position first, as it may move the view
     for (const auto pair : m_portsChannels) {
         for (const auto pcd : pair.second) {
             if (!pcd->enabled())
                 continue;
-
-            // replace is *much* faster than append(QPointF)
-            // see https://bugreports.qt.io/browse/QTBUG-55714
-            pcd->series->replace(pcd->data);
-
-            // set & broadcast our maximum horizontal position
-            if (pcd->xPos > m_maxXVal) {
-                m_maxXVal = pcd->xPos;
+            const auto xPos = static_cast<int>(pcd->buffer->endIndex());
+            if (xPos > m_maxXVal) {
+                m_maxXVal = xPos;
                 ui->plotScrollBar->setMaximum(m_maxXVal);
                 ui->plotScrollBar->setValue(m_maxXVal);
             }
         }
     }
+
+    const auto hAxes = m_plot->axes(Qt::Horizontal);
+    if (hAxes.isEmpty())
+        return;
+    const auto axisX = qobject_cast<QValueAxis*>(hAxes.back());
+    if (axisX == nullptr)
+        return;
+
+    // only the visible samples are handed to the series, at the resolution we can actually display
+    const auto first = static_cast<uint64_t>(std::max(0.0, std::floor(axisX->min())));
+    const auto last = static_cast<uint64_t>(std::max(0.0, std::ceil(axisX->max()) + 1));
+    const auto columns = static_cast<int>(m_plot->plotArea().width());
+    for (const auto pair : m_portsChannels) {
+        for (const auto pcd : pair.second) {
+            if (!pcd->enabled())
+                continue;
+            pcd->updateSeries(first, last, columns);
+        }
+    }
 }
 
 void TraceDisplay::on_multiplierDoubleSpinBox_valueChanged(double arg1)
@@ -339,21 +390,11 @@ void TraceDisplay::on_plotApplyButton_clicked()
 {
     ui->plotApplyButton->setEnabled(false);
 
+    // multiplier and shift are applied when rendering, so we only need to repaint
     for (const auto pair : m_portsChannels) {
         for (const auto pcd : pair.second) {
-            if (!pcd->enabled())
-                continue;
-            if (pcd->dataOrig.size() == 0)
-                pcd->dataOrig = pcd->data;
-
             if (pcd->multiplier <= 0)
                 pcd->multiplier = 1;
-
-            pcd->storeOrig = true;
-
-            for (auto i = 0; i < pcd->dataOrig.size(); i++) {
-                pcd->data[i].setY(pcd->dataOrig[i].y() * pcd->multiplier + pcd->yShift);
-            }
         }
     }
 
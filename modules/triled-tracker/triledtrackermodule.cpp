@@ -97,6 +97,8 @@ public:
             return;
         }
 
+        const auto traceName = traceIntern(name());
+
         // wait until we actually start
         startWaitCondition->wait(this);
 
@@ -106,10 +108,11 @@ public:
             if (!mFrame.has_value())
                 break;
             const auto frame = mFrame.value();
+            SY_TRACE_SPAN("triled-tracker:analyzeFrame", traceName);
 
             cv::Mat infoMat;
             cv::Mat trackMat;
-            tracker->analyzeFrame(frame.mat, frame.time, &trackMat, &infoMat);
+            tracker->analyzeFrame(frame.mat, usecToMsec(frame.time), &trackMat, &infoMat);
 
             m_trackStream->push(Frame(trackMat, frame.time));
             m_animalStream->push(Frame(infoMat, frame.time));
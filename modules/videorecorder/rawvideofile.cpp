@@ -0,0 +1,664 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rawvideofile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <QFile>
+#include <QDataStream>
+
+#include "videowriter.h"
+#include "sytrace.h"
+
+// alignment of buffers, file offsets and write sizes for direct I/O
+static const size_t RAW_IO_ALIGN = 4096;
+
+// size of the header block at the start of every raw video file
+static const size_t RAW_HEADER_SIZE = RAW_IO_ALIGN;
+
+// minimum size of each of our two write buffers
+static const size_t RAW_MIN_BUFFER_SIZE = 16 * 1024 * 1024;
+
+// amount of disk space we reserve at once, to avoid fragmentation and
+// expensive metadata updates while writing
+static const off_t RAW_PREALLOC_CHUNK = 1024 * 1024 * 1024;
+
+static const char RAW_VIDEO_MAGIC[] = "SYRAWVID";
+static const char RAW_INDEX_MAGIC[] = "SYRAWIDX";
+static const quint32 RAW_FORMAT_VERSION = 1;
+
+static inline size_t alignUp(size_t value)
+{
+    return (value + RAW_IO_ALIGN - 1) & ~(RAW_IO_ALIGN - 1);
+}
+
+QString rawVideoIndexFilename(const QString &rawFname)
+{
+    return rawFname + QStringLiteral(".idx");
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+class RawVideoWriter::Private
+{
+public:
+    Private()
+        : initialized(false),
+          fd(-1),
+          directIO(false),
+          activeBuf(0),
+          bufferSize(0),
+          bufferFill(0),
+          submittedBytes(0),
+          preallocatedBytes(0),
+          ioRunning(false),
+          ioPending(false),
+          ioErrno(0),
+          ioLength(0),
+          ioOffset(0)
+    {
+        buffers[0] = nullptr;
+        buffers[1] = nullptr;
+    }
+
+    std::string lastError;
+    bool initialized;
+
+    QString fnameBase;
+    QString fname;
+    QStringList writtenFiles;
+
+    int width;
+    int height;
+    int fps;
+    int cvType;
+    size_t rowBytes;
+    size_t frameBytes;
+
+    int fd;
+    std::atomic_bool directIO;
+    QFile idxFile;
+    QDataStream idxStream;
+
+    uchar *buffers[2];
+    int activeBuf;
+    size_t bufferSize;
+    size_t bufferFill;
+    size_t submittedBytes;
+    off_t preallocatedBytes;
+
+    std::thread ioThread;
+    std::mutex ioMutex;
+    std::condition_variable ioCond;
+    bool ioRunning;
+    bool ioPending;
+    int ioErrno;
+    uchar *ioData;
+    size_t ioLength;
+    off_t ioOffset;
+};
+#pragma GCC diagnostic pop
+
+RawVideoWriter::RawVideoWriter()
+    : d(new RawVideoWriter::Private())
+{
+}
+
+RawVideoWriter::~RawVideoWriter()
+{
+    finalizeInternal();
+    free(d->buffers[0]);
+    free(d->buffers[1]);
+}
+
+void RawVideoWriter::initialize(const QString &fname, int width, int height, int fps, int cvType)
+{
+    if (d->initialized)
+        throw std::runtime_error("Tried to initialize an already initialized raw video writer.");
+    if ((width <= 0) || (height <= 0))
+        throw std::runtime_error("Tried to initialize a raw video writer with invalid frame dimensions.");
+
+    d->width = width;
+    d->height = height;
+    d->fps = fps;
+    d->cvType = cvType;
+    d->rowBytes = static_cast<size_t>(width) * CV_ELEM_SIZE(cvType);
+    d->frameBytes = d->rowBytes * static_cast<size_t>(height);
+    d->fnameBase = fname.endsWith(QStringLiteral(".syraw"))? fname.left(fname.length() - 6) : fname;
+    d->writtenFiles.clear();
+
+    // we need two buffers which are large enough for a couple of frames each
+    const auto bufferSize = alignUp(std::max(RAW_MIN_BUFFER_SIZE, d->frameBytes * 4));
+    if (bufferSize != d->bufferSize) {
+        for (auto &buf : d->buffers) {
+            free(buf);
+            buf = nullptr;
+            if (posix_memalign(reinterpret_cast<void**>(&buf), RAW_IO_ALIGN, bufferSize) != 0)
+                throw std::runtime_error("Unable to allocate aligned buffer for raw video recording.");
+        }
+        d->bufferSize = bufferSize;
+    }
+
+    initializeInternal();
+}
+
+void RawVideoWriter::initializeInternal()
+{
+    d->fname = d->fnameBase + QStringLiteral(".syraw");
+
+    d->directIO = true;
+    d->fd = open(qPrintable(d->fname), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT | O_CLOEXEC, 0644);
+    if ((d->fd < 0) && (errno == EINVAL)) {
+        // the filesystem does not support direct I/O, fall back to regular buffered writes
+        std::cerr << "Filesystem does not support direct I/O, raw video will be written with buffered I/O." << std::endl;
+        d->directIO = false;
+        d->fd = open(qPrintable(d->fname), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    }
+    if (d->fd < 0)
+        throw std::runtime_error(QStringLiteral("Unable to open raw video file %1: %2")
+                                 .arg(d->fname).arg(strerror(errno)).toStdString());
+
+    d->idxFile.setFileName(rawVideoIndexFilename(d->fname));
+    if (!d->idxFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        close(d->fd);
+        d->fd = -1;
+        throw std::runtime_error(QStringLiteral("Unable to open raw video index %1: %2")
+                                 .arg(d->idxFile.fileName()).arg(d->idxFile.errorString()).toStdString());
+    }
+    d->idxStream.setDevice(&d->idxFile);
+    d->idxStream.setByteOrder(QDataStream::LittleEndian);
+    d->idxStream.writeRawData(RAW_INDEX_MAGIC, 8);
+    d->idxStream << RAW_FORMAT_VERSION;
+
+    d->activeBuf = 0;
+    d->submittedBytes = 0;
+    d->preallocatedBytes = 0;
+    d->ioPending = false;
+    d->ioErrno = 0;
+
+    // the header occupies the first block of the file, frame data starts right after it
+    QByteArray header;
+    QDataStream hs(&header, QIODevice::WriteOnly);
+    hs.setByteOrder(QDataStream::LittleEndian);
+    hs.writeRawData(RAW_VIDEO_MAGIC, 8);
+    hs << RAW_FORMAT_VERSION
+       << static_cast<qint32>(d->width)
+       << static_cast<qint32>(d->height)
+       << static_cast<qint32>(d->fps)
+       << static_cast<qint32>(d->cvType)
+       << static_cast<quint64>(d->frameBytes);
+    memset(d->buffers[0], 0, RAW_HEADER_SIZE);
+    memcpy(d->buffers[0], header.constData(), static_cast<size_t>(header.size()));
+    d->bufferFill = RAW_HEADER_SIZE;
+
+    d->ioRunning = true;
+    d->ioThread = std::thread(&RawVideoWriter::ioThread, this);
+
+    d->writtenFiles.append(d->fname);
+    d->initialized = true;
+}
+
+void RawVideoWriter::finalize()
+{
+    finalizeInternal();
+}
+
+void RawVideoWriter::finalizeInternal()
+{
+    if (!d->initialized)
+        return;
+
+    // write the remaining data, padded to the block size direct I/O requires
+    const auto logicalSize = d->submittedBytes + d->bufferFill;
+    if (d->bufferFill > 0) {
+        const auto paddedLength = alignUp(d->bufferFill);
+        memset(d->buffers[d->activeBuf] + d->bufferFill, 0, paddedLength - d->bufferFill);
+        submitBuffer(paddedLength);
+    }
+    waitForIO();
+
+    {
+        std::lock_guard<std::mutex> lock(d->ioMutex);
+        d->ioRunning = false;
+    }
+    d->ioCond.notify_all();
+    d->ioThread.join();
+
+    // drop padding and unused preallocated space
+    if (ftruncate(d->fd, static_cast<off_t>(logicalSize)) != 0)
+        std::cerr << "Unable to truncate raw video file: " << strerror(errno) << std::endl;
+    close(d->fd);
+    d->fd = -1;
+
+    d->idxStream.setDevice(nullptr);
+    d->idxFile.close();
+
+    d->bufferFill = 0;
+    d->initialized = false;
+}
+
+bool RawVideoWriter::initialized() const
+{
+    return d->initialized;
+}
+
+bool RawVideoWriter::startNewSection(const QString &fname)
+{
+    if (!d->initialized) {
+        d->lastError = "Can not start a new section if we are not initialized.";
+        return false;
+    }
+
+    try {
+        finalizeInternal();
+        d->fnameBase = fname.endsWith(QStringLiteral(".syraw"))? fname.left(fname.length() - 6) : fname;
+        initializeInternal();
+    } catch (const std::exception &e) {
+        d->lastError = e.what();
+        return false;
+    }
+
+    return true;
+}
+
+bool RawVideoWriter::encodeFrame(const cv::Mat &frame, const std::chrono::microseconds &timestamp)
+{
+    SY_TRACE_SPAN("RawVideoWriter::encodeFrame");
+
+    if ((frame.cols != d->width) || (frame.rows != d->height) || (frame.type() != d->cvType)) {
+        d->lastError = QStringLiteral("Received frame (%1x%2, type %3) does not match the format of the raw video (%4x%5, type %6)")
+                            .arg(frame.cols).arg(frame.rows).arg(frame.type())
+                            .arg(d->width).arg(d->height).arg(d->cvType).toStdString();
+        return false;
+    }
+
+    const auto frameOffset = static_cast<quint64>(d->submittedBytes + d->bufferFill);
+
+    // copy the frame into our buffers row by row, as the matrix may not be continuous,
+    // and hand over every filled buffer to the I/O thread
+    const auto rowCount = frame.isContinuous()? 1 : frame.rows;
+    const auto rowLength = frame.isContinuous()? d->frameBytes : d->rowBytes;
+    for (int row = 0; row < rowCount; row++) {
+        auto src = frame.ptr<uchar>(row);
+        size_t remaining = rowLength;
+        while (remaining > 0) {
+            const auto n = std::min(remaining, d->bufferSize - d->bufferFill);
+            memcpy(d->buffers[d->activeBuf] + d->bufferFill, src, n);
+            d->bufferFill += n;
+            src += n;
+            remaining -= n;
+
+            if (d->bufferFill == d->bufferSize) {
+                if (!submitBuffer(d->bufferSize))
+                    return false;
+            }
+        }
+    }
+
+    d->idxStream << frameOffset
+                 << static_cast<qint64>(timestamp.count())
+                 << static_cast<quint32>(d->frameBytes);
+    if (d->idxStream.status() != QDataStream::Ok) {
+        d->lastError = QStringLiteral("Unable to write raw video index: %1").arg(d->idxFile.errorString()).toStdString();
+        return false;
+    }
+
+    return true;
+}
+
+bool RawVideoWriter::submitBuffer(size_t length)
+{
+    // the other buffer must have been written before we can reuse it
+    if (!waitForIO())
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(d->ioMutex);
+        d->ioData = d->buffers[d->activeBuf];
+        d->ioLength = length;
+        d->ioOffset = static_cast<off_t>(d->submittedBytes);
+        d->ioPending = true;
+    }
+    d->ioCond.notify_all();
+
+    d->submittedBytes += length;
+    d->activeBuf = d->activeBuf == 0? 1 : 0;
+    d->bufferFill = 0;
+    return true;
+}
+
+bool RawVideoWriter::waitForIO()
+{
+    std::unique_lock<std::mutex> lock(d->ioMutex);
+    d->ioCond.wait(lock, [&]{ return !d->ioPending; });
+    if (d->ioErrno != 0) {
+        d->lastError = QStringLiteral("Unable to write raw video data: %1").arg(strerror(d->ioErrno)).toStdString();
+        return false;
+    }
+
+    return true;
+}
+
+void RawVideoWriter::ioThread()
+{
+    std::unique_lock<std::mutex> lock(d->ioMutex);
+    while (true) {
+        d->ioCond.wait(lock, [&]{ return d->ioPending || !d->ioRunning; });
+        if (!d->ioPending)
+            break;
+
+        auto data = d->ioData;
+        auto length = d->ioLength;
+        auto offset = d->ioOffset;
+        lock.unlock();
+
+        int error = 0;
+        if (offset + static_cast<off_t>(length) > d->preallocatedBytes) {
+            // reserve the next chunk of disk space; failure is not fatal, the
+            // file will then just grow as we write to it
+            if (fallocate(d->fd, 0, d->preallocatedBytes, RAW_PREALLOC_CHUNK) == 0)
+                d->preallocatedBytes += RAW_PREALLOC_CHUNK;
+            else
+                d->preallocatedBytes = offset + static_cast<off_t>(length);
+        }
+
+        while (length > 0) {
+            const auto ret = pwrite(d->fd, data, length, offset);
+            if (ret < 0) {
+                if (errno == EINTR)
+                    continue;
+                if ((errno == EINVAL) && d->directIO) {
+                    // some filesystems accept O_DIRECT but refuse the actual write
+                    d->directIO = false;
+                    fcntl(d->fd, F_SETFL, fcntl(d->fd, F_GETFL) & ~O_DIRECT);
+                    continue;
+                }
+                error = errno;
+                break;
+            }
+            data += ret;
+            length -= static_cast<size_t>(ret);
+            offset += ret;
+        }
+
+        lock.lock();
+        d->ioErrno = error;
+        d->ioPending = false;
+        d->ioCond.notify_all();
+    }
+}
+
+int RawVideoWriter::width() const
+{
+    return d->width;
+}
+
+int RawVideoWriter::height() const
+{
+    return d->height;
+}
+
+int RawVideoWriter::fps() const
+{
+    return d->fps;
+}
+
+bool RawVideoWriter::directIO() const
+{
+    return d->directIO;
+}
+
+QStringList RawVideoWriter::writtenFiles() const
+{
+    return d->writtenFiles;
+}
+
+std::string RawVideoWriter::lastError() const
+{
+    return d->lastError;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+class RawVideoReader::Private
+{
+public:
+    Private()
+        : width(0),
+          height(0),
+          fps(0),
+          cvType(0),
+          frameBytes(0)
+    {}
+
+    std::string lastError;
+
+    QFile file;
+    int width;
+    int height;
+    int fps;
+    int cvType;
+    size_t frameBytes;
+
+    std::vector<quint64> offsets;
+    std::vector<qint64> timestamps;
+};
+#pragma GCC diagnostic pop
+
+RawVideoReader::RawVideoReader()
+    : d(new RawVideoReader::Private())
+{
+}
+
+RawVideoReader::~RawVideoReader()
+{
+    close();
+}
+
+bool RawVideoReader::open(const QString &fname)
+{
+    close();
+
+    d->file.setFileName(fname);
+    if (!d->file.open(QIODevice::ReadOnly)) {
+        d->lastError = QStringLiteral("Unable to open raw video %1: %2").arg(fname).arg(d->file.errorString()).toStdString();
+        return false;
+    }
+
+    QDataStream hs(&d->file);
+    hs.setByteOrder(QDataStream::LittleEndian);
+    char magic[8];
+    quint32 version;
+    qint32 width, height, fps, cvType;
+    quint64 frameBytes;
+    hs.readRawData(magic, 8);
+    hs >> version >> width >> height >> fps >> cvType >> frameBytes;
+    if ((hs.status() != QDataStream::Ok) || (memcmp(magic, RAW_VIDEO_MAGIC, 8) != 0)) {
+        d->lastError = QStringLiteral("File %1 is not a raw video").arg(fname).toStdString();
+        close();
+        return false;
+    }
+    if (version != RAW_FORMAT_VERSION) {
+        d->lastError = QStringLiteral("Raw video %1 has unsupported format version %2").arg(fname).arg(version).toStdString();
+        close();
+        return false;
+    }
+    d->width = width;
+    d->height = height;
+    d->fps = fps;
+    d->cvType = cvType;
+    d->frameBytes = frameBytes;
+
+    QFile idxFile(rawVideoIndexFilename(fname));
+    if (!idxFile.open(QIODevice::ReadOnly)) {
+        d->lastError = QStringLiteral("Unable to open index of raw video %1: %2").arg(fname).arg(idxFile.errorString()).toStdString();
+        close();
+        return false;
+    }
+    QDataStream is(&idxFile);
+    is.setByteOrder(QDataStream::LittleEndian);
+    is.readRawData(magic, 8);
+    is >> version;
+    if ((is.status() != QDataStream::Ok) || (memcmp(magic, RAW_INDEX_MAGIC, 8) != 0) || (version != RAW_FORMAT_VERSION)) {
+        d->lastError = QStringLiteral("Index of raw video %1 is invalid").arg(fname).toStdString();
+        close();
+        return false;
+    }
+
+    // a truncated final record (e.g. after a crash) is simply ignored
+    const auto fileSize = static_cast<quint64>(d->file.size());
+    while (!is.atEnd()) {
+        quint64 offset;
+        qint64 timestamp;
+        quint32 size;
+        is >> offset >> timestamp >> size;
+        if (is.status() != QDataStream::Ok)
+            break;
+        if ((size != d->frameBytes) || (offset + size > fileSize))
+            break;
+        d->offsets.push_back(offset);
+        d->timestamps.push_back(timestamp);
+    }
+
+    return true;
+}
+
+void RawVideoReader::close()
+{
+    d->file.close();
+    d->offsets.clear();
+    d->timestamps.clear();
+}
+
+int RawVideoReader::width() const
+{
+    return d->width;
+}
+
+int RawVideoReader::height() const
+{
+    return d->height;
+}
+
+int RawVideoReader::fps() const
+{
+    return d->fps;
+}
+
+int RawVideoReader::cvType() const
+{
+    return d->cvType;
+}
+
+size_t RawVideoReader::frameCount() const
+{
+    return d->offsets.size();
+}
+
+bool RawVideoReader::readFrame(size_t index, cv::Mat &frame, std::chrono::microseconds &timestamp)
+{
+    if (index >= d->offsets.size()) {
+        d->lastError = "Tried to read nonexistent frame from raw video.";
+        return false;
+    }
+
+    frame.create(d->height, d->width, d->cvType);
+    if (!d->file.seek(static_cast<qint64>(d->offsets[index])) ||
+        d->file.read(reinterpret_cast<char*>(frame.data), static_cast<qint64>(d->frameBytes)) != static_cast<qint64>(d->frameBytes)) {
+        d->lastError = QStringLiteral("Unable to read frame %1 from raw video: %2").arg(index).arg(d->file.errorString()).toStdString();
+        return false;
+    }
+    timestamp = std::chrono::microseconds(d->timestamps[index]);
+
+    return true;
+}
+
+std::string RawVideoReader::lastError() const
+{
+    return d->lastError;
+}
+
+bool transcodeRawVideo(const QString &rawFname,
+                       VideoWriter *writer,
+                       const QString &modName,
+                       const QUuid &collectionId,
+                       bool saveTimestamps,
+                       const std::atomic_bool *cancel,
+                       std::string &error)
+{
+    RawVideoReader reader;
+    if (!reader.open(rawFname)) {
+        error = reader.lastError();
+        return false;
+    }
+
+    const auto fnameBase = rawFname.endsWith(QStringLiteral(".syraw"))? rawFname.left(rawFname.length() - 6) : rawFname;
+    try {
+        writer->initialize(fnameBase,
+                           modName,
+                           collectionId,
+                           reader.width(),
+                           reader.height(),
+                           reader.fps(),
+                           CV_MAT_DEPTH(reader.cvType()),
+                           CV_MAT_CN(reader.cvType()) > 1,
+                           saveTimestamps);
+    } catch (const std::runtime_error &e) {
+        error = e.what();
+        return false;
+    }
+
+    cv::Mat frame;
+    std::chrono::microseconds timestamp;
+    for (size_t i = 0; i < reader.frameCount(); i++) {
+        if (cancel != nullptr && *cancel) {
+            error = "Encoding was cancelled.";
+            writer->finalize();
+            return false;
+        }
+        if (!reader.readFrame(i, frame, timestamp)) {
+            error = reader.lastError();
+            writer->finalize();
+            return false;
+        }
+        if (!writer->encodeFrame(frame, timestamp)) {
+            error = writer->lastError();
+            writer->finalize();
+            return false;
+        }
+    }
+    writer->finalize();
+    reader.close();
+
+    // the encoded video is complete, we don't need the raw data anymore
+    QFile::remove(rawVideoIndexFilename(rawFname));
+    QFile::remove(rawFname);
+
+    return true;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <QString>
+#include <QStringList>
+#include <QUuid>
+#include <opencv2/core.hpp>
+
+class VideoWriter;
+
+/**
+ * @brief Write uncompressed frames to disk as fast as the storage permits
+ *
+ * Frames are stored unmodified in a simple container: a 4 KiB header block
+ * followed by the packed pixel data of all frames. An index file next to it
+ * records offset, size and timestamp of every frame.
+ *
+ * Data is written with O_DIRECT from page-aligned buffers into a preallocated
+ * file, bypassing the page cache. A dedicated I/O thread writes out one buffer
+ * while the next one is being filled, so the caller only ever waits for the
+ * disk if it can not keep up with the incoming data at all.
+ */
+class RawVideoWriter
+{
+public:
+    explicit RawVideoWriter();
+    ~RawVideoWriter();
+
+    void initialize(const QString &fname,
+                    int width,
+                    int height,
+                    int fps,
+                    int cvType);
+    void finalize();
+    bool initialized() const;
+    bool startNewSection(const QString &fname);
+
+    bool encodeFrame(const cv::Mat &frame, const std::chrono::microseconds &timestamp);
+
+    int width() const;
+    int height() const;
+    int fps() const;
+
+    bool directIO() const;
+    QStringList writtenFiles() const;
+
+    std::string lastError() const;
+
+private:
+    class Private;
+    std::unique_ptr<Private> d;
+    Q_DISABLE_COPY(RawVideoWriter)
+
+    void initializeInternal();
+    void finalizeInternal();
+    bool submitBuffer(size_t length);
+    bool waitForIO();
+    void ioThread();
+};
+
+/**
+ * @brief Read frames written by RawVideoWriter
+ */
+class RawVideoReader
+{
+public:
+    explicit RawVideoReader();
+    ~RawVideoReader();
+
+    bool open(const QString &fname);
+    void close();
+
+    int width() const;
+    int height() const;
+    int fps() const;
+    int cvType() const;
+    size_t frameCount() const;
+
+    bool readFrame(size_t index, cv::Mat &frame, std::chrono::microseconds &timestamp);
+
+    std::string lastError() const;
+
+private:
+    class Private;
+    std::unique_ptr<Private> d;
+    Q_DISABLE_COPY(RawVideoReader)
+};
+
+/**
+ * Name of the index file belonging to raw video @rawFname.
+ */
+QString rawVideoIndexFilename(const QString &rawFname);
+
+/**
+ * @brief Encode a raw video into a compressed one
+ *
+ * Reads the raw video @rawFname and encodes it with @writer, which must already be
+ * configured with the desired codec, container and slicing settings. The output has the
+ * same base name as the raw file. Once the raw data was encoded successfully, the raw
+ * video and its index are deleted.
+ * Encoding stops early if @cancel is set, in which case the raw data is kept.
+ */
+bool transcodeRawVideo(const QString &rawFname,
+                       VideoWriter *writer,
+                       const QString &modName,
+                       const QUuid &collectionId,
+                       bool saveTimestamps,
+                       const std::atomic_bool *cancel,
+                       std::string &error);
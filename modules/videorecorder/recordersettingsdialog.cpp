@@ -59,6 +59,11 @@ RecorderSettingsDialog::RecorderSettingsDialog(QWidget *parent) :
 
     // no slicing warning by default
     ui->sliceWarnButton->setVisible(false);
+
+    ui->backlogPolicyComboBox->addItem("Queue frames", static_cast<int>(EncoderBacklogPolicy::NONE));
+    ui->backlogPolicyComboBox->addItem("Reduce quality", static_cast<int>(EncoderBacklogPolicy::REDUCE_QUALITY));
+    ui->backlogPolicyComboBox->addItem("Reduce quality & drop frames", static_cast<int>(EncoderBacklogPolicy::DROP_FRAMES));
+    ui->backlogPolicyComboBox->setCurrentIndex(0);
 }
 
 RecorderSettingsDialog::~RecorderSettingsDialog()
@@ -214,6 +219,36 @@ void RecorderSettingsDialog::setStartStopped(bool startStopped)
     ui->startStoppedCheckBox->setChecked(startStopped);
 }
 
+int RecorderSettingsDialog::inputCount() const
+{
+    return ui->inputCountSpinBox->value();
+}
+
+void RecorderSettingsDialog::setInputCount(int count)
+{
+    ui->inputCountSpinBox->setValue(count);
+}
+
+bool RecorderSettingsDialog::rawRecording() const
+{
+    return ui->rawRecordingCheckBox->isChecked();
+}
+
+void RecorderSettingsDialog::setRawRecording(bool enabled)
+{
+    ui->rawRecordingCheckBox->setChecked(enabled);
+}
+
+EncoderBacklogPolicy RecorderSettingsDialog::backlogPolicy() const
+{
+    return static_cast<EncoderBacklogPolicy>(ui->backlogPolicyComboBox->currentData().toInt());
+}
+
+void RecorderSettingsDialog::setBacklogPolicy(EncoderBacklogPolicy policy)
+{
+    ui->backlogPolicyComboBox->setCurrentIndex(ui->backlogPolicyComboBox->findData(static_cast<int>(policy)));
+}
+
 void RecorderSettingsDialog::on_nameLineEdit_textChanged(const QString &arg1)
 {
     m_videoName = simplifyStrForFileBasename(arg1);
@@ -302,3 +337,8 @@ void RecorderSettingsDialog::on_radioButtonBitrate_toggled(bool checked)
     else
         m_codecProps.setMode(CodecProperties::ConstantQuality);
 }
+
+void RecorderSettingsDialog::on_inputCountSpinBox_valueChanged(int value)
+{
+    emit inputCountChanged(value);
+}
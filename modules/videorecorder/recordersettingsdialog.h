@@ -29,6 +29,16 @@ namespace Ui {
 class RecorderSettingsDialog;
 }
 
+/**
+ * @brief Action taken when the encoder can not keep up with incoming frames
+ */
+enum class EncoderBacklogPolicy
+{
+    NONE,           /// Keep queueing frames until the encoder catches up
+    REDUCE_QUALITY, /// Lower encoder quality while frames queue up, if the codec permits
+    DROP_FRAMES     /// Lower quality and drop frames if the queue still grows too long
+};
+
 class RecorderSettingsDialog : public QDialog
 {
     Q_OBJECT
@@ -61,6 +71,18 @@ public:
     bool startStopped() const;
     void setStartStopped(bool startStopped);
 
+    int inputCount() const;
+    void setInputCount(int count);
+
+    bool rawRecording() const;
+    void setRawRecording(bool enabled);
+
+    EncoderBacklogPolicy backlogPolicy() const;
+    void setBacklogPolicy(EncoderBacklogPolicy policy);
+
+signals:
+    void inputCountChanged(int count);
+
 private slots:
     void on_codecComboBox_currentIndexChanged(int index);
     void on_nameLineEdit_textChanged(const QString &arg1);
@@ -74,6 +96,7 @@ private slots:
     void on_qualitySlider_valueChanged(int value);
     void on_bitrateSpinBox_valueChanged(int arg1);
     void on_radioButtonBitrate_toggled(bool checked);
+    void on_inputCountSpinBox_valueChanged(int value);
 
 private:
     Ui::RecorderSettingsDialog *ui;
@@ -23,9 +23,18 @@
 #include <QDebug>
 #include <QFileInfo>
 #include <QCoreApplication>
+#include <poll.h>
+#include <algorithm>
+#include <thread>
+#include <list>
+#include <atomic>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
 #include "streams/frametype.h"
 
 #include "videowriter.h"
+#include "rawvideofile.h"
 #include "recordersettingsdialog.h"
 
 SYNTALOS_MODULE(VideoRecorderModule)
@@ -49,11 +58,24 @@ private:
     std::shared_ptr<EDLDataset> m_vidDataset;
     std::unique_ptr<VideoWriter> m_videoWriter;
 
+    bool m_rawMode;
+    std::unique_ptr<RawVideoWriter> m_rawWriter;
+    std::list<std::pair<std::thread, std::shared_ptr<std::atomic_bool>>> m_transcodeJobs;
+    std::atomic_bool m_transcodeCancel;
+
     RecorderSettingsDialog *m_settingsDialog;
     CodecProperties m_activeCodecProps;
 
-    std::shared_ptr<StreamInputPort<Frame>> m_inPort;
-    std::shared_ptr<StreamSubscription<Frame>> m_inSub;
+    QList<std::shared_ptr<StreamInputPort<Frame>>> m_inPorts;
+    std::vector<std::shared_ptr<StreamSubscription<Frame>>> m_inSubs;
+    size_t m_nextSubIndex;
+    std::vector<struct pollfd> m_inPollFds;
+
+    EncoderBacklogPolicy m_backlogPolicy;
+    double m_totalFramerate;
+    double m_encodeTimeAvgUsec;
+    int m_framesSinceBacklogCheck;
+    std::vector<bool> m_streamDropping;
 
     std::shared_ptr<StreamInputPort<ControlCommand>> m_ctlPort;
     std::shared_ptr<StreamSubscription<ControlCommand>> m_ctlSub;
@@ -61,9 +83,11 @@ private:
 public:
     explicit VideoRecorderModule(QObject *parent = nullptr)
         : AbstractModule(parent),
+          m_rawMode(false),
+          m_transcodeCancel(false),
           m_settingsDialog(nullptr)
     {
-        m_inPort = registerInputPort<Frame>(QStringLiteral("frames-in"), QStringLiteral("Frames"));
+        m_inPorts.append(registerInputPort<Frame>(QStringLiteral("frames-in"), QStringLiteral("Frames")));
         m_ctlPort = registerInputPort<ControlCommand>(QStringLiteral("control-in"), QStringLiteral("Control"));
 
         m_settingsDialog = new RecorderSettingsDialog;
@@ -72,6 +96,152 @@ public:
         setName(name());
 
         m_settingsDialog->setVideoName(QStringLiteral("video"));
+        connect(m_settingsDialog, &RecorderSettingsDialog::inputCountChanged,
+                this, &VideoRecorderModule::updateInputPorts);
+    }
+
+    ~VideoRecorderModule() override
+    {
+        // don't hold up shutdown for videos that are still being encoded, their raw data is kept
+        m_transcodeCancel = true;
+        for (auto &job : m_transcodeJobs)
+            job.first.join();
+    }
+
+    void updateInputPorts(int count)
+    {
+        // every additional frame input is recorded as an additional video
+        // stream in the same container file
+        while (m_inPorts.size() < count) {
+            const auto n = m_inPorts.size() + 1;
+            m_inPorts.append(registerInputPort<Frame>(QStringLiteral("frames-in-%1").arg(n),
+                                                      QStringLiteral("Frames %1").arg(n)));
+        }
+        while (m_inPorts.size() > std::max(count, 1))
+            removeInPortById(m_inPorts.takeLast()->id());
+    }
+
+    void suspendInputs()
+    {
+        for (auto &sub : m_inSubs)
+            sub->suspend();
+    }
+
+    void resumeInputs()
+    {
+        for (auto &sub : m_inSubs)
+            sub->resume();
+    }
+
+    /**
+     * Fetch the next frame of any of our inputs, and the index of the stream
+     * it belongs to. Returns std::nullopt once all inputs have ended.
+     */
+    std::optional<Frame> nextFrame(int &streamIndex)
+    {
+        // with only one input, we can just block on it
+        if (m_inSubs.size() == 1) {
+            streamIndex = 0;
+            return m_inSubs[0]->next();
+        }
+
+        bool acknowledged = false;
+        while (m_running) {
+            // take turns between the inputs, so a fast source can't starve the others
+            bool anyActive = false;
+            for (size_t n = 0; n < m_inSubs.size(); n++) {
+                const auto i = (m_nextSubIndex + n) % m_inSubs.size();
+                auto frame = m_inSubs[i]->peekNext();
+                if (frame.has_value()) {
+                    streamIndex = static_cast<int>(i);
+                    m_nextSubIndex = i + 1;
+                    return frame;
+                }
+                if (m_inSubs[i]->active())
+                    anyActive = true;
+            }
+            if (!anyActive)
+                return std::nullopt;
+
+            // reset notifications and check all queues again before sleeping,
+            // so we don't miss elements which arrived in between
+            if (!acknowledged) {
+                for (auto &sub : m_inSubs)
+                    sub->acknowledgeNotify();
+                acknowledged = true;
+                continue;
+            }
+            poll(m_inPollFds.data(), m_inPollFds.size(), 100);
+            acknowledged = false;
+        }
+
+        return std::nullopt;
+    }
+
+    /**
+     * Adapt the encoder to the amount of frames queued up for the stream @streamIndex.
+     * Returns true if the current frame should be dropped instead of encoded.
+     */
+    bool checkEncoderBacklog(int streamIndex)
+    {
+        if (m_backlogPolicy == EncoderBacklogPolicy::NONE)
+            return false;
+
+        // watermarks are in seconds worth of frames of the respective stream
+        const auto idx = static_cast<size_t>(streamIndex);
+        const auto fps = std::max(m_videoWriter->fps(streamIndex), 1);
+        const auto pending = static_cast<double>(m_inSubs[idx]->approxPendingCount());
+        const auto streamName = (m_inSubs.size() > 1)? QStringLiteral(" (stream %1)").arg(streamIndex + 1) : QString();
+
+        if (m_backlogPolicy == EncoderBacklogPolicy::DROP_FRAMES) {
+            if (!m_streamDropping[idx] && (pending > fps * 5.0)) {
+                m_streamDropping[idx] = true;
+                statusMessage(QStringLiteral("Encoder can not keep up, dropping frames%1!").arg(streamName));
+            } else if (m_streamDropping[idx] && (pending <= fps * 0.5)) {
+                m_streamDropping[idx] = false;
+                statusMessage(QStringLiteral("Recording video (%1 frames dropped%2)...")
+                              .arg(m_videoWriter->droppedFrames(streamIndex)).arg(streamName));
+            }
+        }
+        const bool drop = m_streamDropping[idx];
+
+        // only reconsider the encoder quality about once per second, to give it time to settle
+        if (m_totalFramerate <= 0)
+            return drop;
+        if (++m_framesSinceBacklogCheck < static_cast<int>(m_totalFramerate))
+            return drop;
+        m_framesSinceBacklogCheck = 0;
+        if (!m_videoWriter->canReduceQuality())
+            return drop;
+
+        // all streams share one encoder thread, so we look at the stream which is furthest behind,
+        // and have to encode the frames of all inputs within one frame interval
+        double backlogSec = 0;
+        for (size_t i = 0; i < m_inSubs.size(); i++) {
+            const auto streamFps = std::max(m_videoWriter->fps(static_cast<int>(i)), 1);
+            backlogSec = std::max(backlogSec, static_cast<double>(m_inSubs[i]->approxPendingCount()) / streamFps);
+        }
+        const auto frameBudgetUsec = 1000.0 * 1000.0 / m_totalFramerate;
+
+        auto level = m_videoWriter->qualityReduction();
+        if ((backlogSec > 2.0) || (m_encodeTimeAvgUsec > frameBudgetUsec))
+            level++;
+        else if ((backlogSec < 0.5) && (m_encodeTimeAvgUsec < frameBudgetUsec * 0.7))
+            level--;
+        level = std::clamp(level, 0, VIDEO_MAX_QUALITY_REDUCTION);
+
+        if (level != m_videoWriter->qualityReduction()) {
+            m_videoWriter->setQualityReduction(level);
+            const auto anyDropping = std::find(m_streamDropping.cbegin(), m_streamDropping.cend(), true) != m_streamDropping.cend();
+            if (!anyDropping) {
+                if (level > 0)
+                    statusMessage(QStringLiteral("Encoder falling behind, quality reduced (level %1)").arg(level));
+                else
+                    statusMessage(QStringLiteral("Recording video..."));
+            }
+        }
+
+        return drop;
     }
 
     void setName(const QString &name) override
@@ -116,14 +286,55 @@ public:
         if (m_settingsDialog->slicingEnabled())
             m_videoWriter->setFileSliceInterval(m_settingsDialog->sliceInterval());
 
+        m_backlogPolicy = m_settingsDialog->backlogPolicy();
+        m_encodeTimeAvgUsec = 0;
+        m_framesSinceBacklogCheck = 0;
+        m_streamDropping.clear();
+        m_totalFramerate = 0;
+
         m_recording = false;
         m_initDone = false;
         m_recordingFinished = true;
         m_startStopped = m_settingsDialog->startStopped();
-        m_inSub.reset();
+        m_inSubs.clear();
+        m_nextSubIndex = 0;
         m_ctlSub.reset();
-        if (!m_inPort->hasSubscription())
+        for (auto &port : m_inPorts) {
+            if (port->hasSubscription())
+                m_inSubs.push_back(port->subscription());
+        }
+        if (m_inSubs.empty())
             return true;
+        m_streamDropping.assign(m_inSubs.size(), false);
+
+        if ((m_inSubs.size() > 1) && (m_settingsDialog->videoContainer() != VideoContainer::Matroska)) {
+            raiseError(QStringLiteral("Recording multiple video streams is only possible with the MKV container."));
+            return false;
+        }
+
+        // in raw mode, frames are only dumped to disk while we are running, and get
+        // encoded with the selected codec once the run is over
+        m_rawMode = m_settingsDialog->rawRecording();
+        m_rawWriter.reset();
+        if (m_rawMode) {
+            if (m_inSubs.size() > 1) {
+                raiseError(QStringLiteral("Raw pre-recording is only possible with a single video stream."));
+                return false;
+            }
+            m_rawWriter.reset(new RawVideoWriter);
+        }
+
+        // with multiple inputs, we sleep until any of them has new data
+        m_inPollFds.clear();
+        if (m_inSubs.size() > 1) {
+            for (auto &sub : m_inSubs) {
+                struct pollfd pfd;
+                pfd.fd = sub->enableNotify();
+                pfd.events = POLLIN;
+                pfd.revents = 0;
+                m_inPollFds.push_back(pfd);
+            }
+        }
 
         // get controller subscription, if we have any
         m_checkCommands = false;
@@ -132,7 +343,6 @@ public:
             m_checkCommands = true;
         }
 
-        m_inSub = m_inPort->subscription();
         m_recording = true;
         m_recordingFinished = false;
 
@@ -150,11 +360,11 @@ public:
         if (!m_recording && (state() != ModuleState::ERROR))
             setStateIdle();
 
-        if (m_inSub.get() == nullptr)
+        if (m_inSubs.empty())
             return;
 
         if (m_settingsDialog->videoNameFromSource())
-            m_vidDataset = getOrCreateDefaultDataset(name(), m_inSub->metadata());
+            m_vidDataset = getOrCreateDefaultDataset(name(), m_inSubs.front()->metadata());
         else
             m_vidDataset = getOrCreateDefaultDataset(m_settingsDialog->videoName());
     }
@@ -180,12 +390,14 @@ public:
         // requested to be stopped
         auto state = m_startStopped? RecordingState::STOPPED : RecordingState::RUNNING;
 
+        const auto traceName = traceIntern(name());
+
         // wait for the current run to actually launch
         startWaitCondition->wait(this);
 
         // immediately suspend our input subscription in case we are starting in STOPPED mode
         if (state != RecordingState::RUNNING) {
-            m_inSub->suspend();
+            suspendInputs();
             statusMessage(QStringLiteral("Waiting for start command."));
         }
 
@@ -208,7 +420,7 @@ public:
                     if (state == RecordingState::PAUSED) {
                         // hurray, we can just resume normal operation!
                         state = RecordingState::RUNNING;
-                        m_inSub->resume();
+                        resumeInputs();
                         continue;
                     } else if (state == RecordingState::STOPPED) {
                         // we were stopped before, so we will now have to create a new
@@ -221,7 +433,13 @@ public:
                         // be deferred to that point
                         if (m_initDone) {
                             // start our new section
-                            if (!m_videoWriter->startNewSection(QStringLiteral("%1%2").arg(vidSavePathBase).arg(currentSecSuffix))) {
+                            const auto secFnameBase = QStringLiteral("%1%2").arg(vidSavePathBase).arg(currentSecSuffix);
+                            if (m_rawMode) {
+                                if (!m_rawWriter->startNewSection(secFnameBase)) {
+                                    raiseError(QStringLiteral("Unable to initialize recording of a new section: %1").arg(QString::fromStdString(m_rawWriter->lastError())));
+                                    return;
+                                }
+                            } else if (!m_videoWriter->startNewSection(secFnameBase)) {
                                 raiseError(QStringLiteral("Unable to initialize recording of a new section: %1").arg(QString::fromStdString(m_videoWriter->lastError())));
                                 return;
                             }
@@ -229,7 +447,7 @@ public:
 
                         // resume normal operation
                         state = RecordingState::RUNNING;
-                        m_inSub->resume();
+                        resumeInputs();
                         statusMessage(QStringLiteral("Recording video %1...").arg(secCount));
                         continue;
                     }
@@ -240,12 +458,14 @@ public:
                 continue;
             }
 
-            const auto maybeFrame = m_inSub->next();
+            int streamIndex = 0;
+            const auto maybeFrame = nextFrame(streamIndex);
             // getting a nullopt means we can quit this thread, as the experiment has stopped or
             // the data source has completed delivering data and will not send any more
             if (!maybeFrame.has_value())
                 break;
             const auto frame = maybeFrame.value();
+            SY_TRACE_SPAN("videorecorder:recordFrame", traceName);
 
             if (m_checkCommands && m_ctlSub->hasPending()) {
                 // process control commands - we only do this when we also have got a frame,
@@ -259,14 +479,14 @@ public:
                         // switch to our paused state
                         state = RecordingState::PAUSED;
                         // stop receiving new data
-                        m_inSub->suspend();
+                        suspendInputs();
                         statusMessage(QStringLiteral("Recording paused."));
                         continue;
                     } else if (ctlCmd->kind == ControlCommandKind::STOP) {
                         // switch to our stopped state
                         state = RecordingState::STOPPED;
                         // stop receiving new data
-                        m_inSub->suspend();
+                        suspendInputs();
                         statusMessage(QStringLiteral("Recording stopped."));
                         continue;
                     }
@@ -274,28 +494,54 @@ public:
             }
 
             if (!m_initDone) {
-                const auto mdata = m_inSub->metadata();
-                auto frameSize = mdata.value("size", QSize()).toSize();
-                const auto framerate = mdata.value("framerate", 0).toDouble();
-                const auto depth = mdata.value("depth", CV_8U).toInt();
-                const auto useColor = mdata.value("has_color", frame.mat.channels() > 1).toBool();
-
-                if (!frameSize.isValid()) {
-                    // we didn't get the dimensions from metadata - let's see if the current frame can
-                    // be used to get dimensions.
-                    frameSize = QSize(frame.mat.cols, frame.mat.rows);
-                }
+                std::vector<VideoStreamFormat> formats;
+                QVariantList streamInfos;
+                m_totalFramerate = 0;
+                for (size_t i = 0; i < m_inSubs.size(); i++) {
+                    const auto isFrameStream = static_cast<int>(i) == streamIndex;
+                    const auto mdata = m_inSubs[i]->metadata();
+                    auto frameSize = mdata.value("size", QSize()).toSize();
+                    const auto framerate = mdata.value("framerate", 0).toDouble();
+                    const auto depth = mdata.value("depth", CV_8U).toInt();
+                    const auto useColor = mdata.value("has_color", isFrameStream? frame.mat.channels() > 1 : true).toBool();
+
+                    if (!frameSize.isValid() && isFrameStream) {
+                        // we didn't get the dimensions from metadata - let's see if the current frame can
+                        // be used to get dimensions.
+                        frameSize = QSize(frame.mat.cols, frame.mat.rows);
+                    }
 
-                if (!frameSize.isValid()) {
-                    raiseError(QStringLiteral("Frame source did not provide image dimensions!"));
-                    return;
-                }
-                if (framerate == 0) {
-                    raiseError(QStringLiteral("Frame source did not provide a framerate!"));
-                    return;
+                    if (!frameSize.isValid()) {
+                        raiseError(QStringLiteral("Frame source %1 did not provide image dimensions!").arg(i + 1));
+                        return;
+                    }
+                    if (framerate == 0) {
+                        raiseError(QStringLiteral("Frame source %1 did not provide a framerate!").arg(i + 1));
+                        return;
+                    }
+
+                    VideoStreamFormat format;
+                    format.width = frameSize.width();
+                    format.height = frameSize.height();
+                    format.fps = static_cast<int>(framerate);
+                    format.cvDepth = depth;
+                    format.hasColor = useColor;
+                    formats.push_back(format);
+                    m_totalFramerate += format.fps;
+
+                    // auxiliary information about the video we encoded
+                    // (this is useful to gather intel about the video without opening the video file)
+                    QVariantHash vInfo;
+                    vInfo.insert("frame_width", frameSize.width());
+                    vInfo.insert("frame_height", frameSize.height());
+                    vInfo.insert("framerate", framerate);
+                    vInfo.insert("colored", useColor);
+                    if (m_inSubs.size() > 1)
+                        vInfo.insert("source", m_inSubs[i]->metadataValue(CommonMetadataKey::SrcModName));
+                    streamInfos.append(vInfo);
                 }
 
-                const auto dataBasename = dataBasenameFromSubMetadata(m_inSub->metadata(), "video");
+                const auto dataBasename = dataBasenameFromSubMetadata(m_inSubs.front()->metadata(), "video");
                 vidSavePathBase = m_vidDataset->pathForDataBasename(dataBasename);
                 m_vidDataset->setDataScanPattern(QStringLiteral("%1*").arg(dataBasename));
                 m_vidDataset->setAuxDataScanPattern(QStringLiteral("%1*.tsync").arg(dataBasename));
@@ -305,38 +551,40 @@ public:
                     vidSecFnameBase = QStringLiteral("%1%2").arg(vidSecFnameBase).arg(currentSecSuffix);
 
                 try {
-                    m_videoWriter->initialize(vidSecFnameBase,
-                                              name(),
-                                              m_vidDataset->collectionId(),
-                                              frameSize.width(),
-                                              frameSize.height(),
-                                              framerate,
-                                              depth,
-                                              useColor,
-                                              m_settingsDialog->saveTimestamps());
+                    if (m_rawMode)
+                        m_rawWriter->initialize(vidSecFnameBase,
+                                                frame.mat.cols,
+                                                frame.mat.rows,
+                                                formats.front().fps,
+                                                frame.mat.type());
+                    else
+                        m_videoWriter->initialize(vidSecFnameBase,
+                                                  name(),
+                                                  m_vidDataset->collectionId(),
+                                                  formats,
+                                                  m_settingsDialog->saveTimestamps());
                 } catch (const std::runtime_error& e) {
                     raiseError(QStringLiteral("Unable to initialize recording: %1").arg(e.what()));
                     return;
                 }
 
-                // write info video info file with auxiliary information about the video we encoded
-                // (this is useful to gather intel about the video without opening the video file)
-                QVariantHash vInfo;
-                vInfo.insert("frame_width", frameSize.width());
-                vInfo.insert("frame_height", frameSize.height());
-                vInfo.insert("framerate", framerate);
-                vInfo.insert("colored", useColor);
-
                 QVariantHash encInfo;
                 encInfo.insert("lossless", m_activeCodecProps.isLossless());
                 encInfo.insert("thread_count", m_activeCodecProps.threadCount());
                 if (m_activeCodecProps.useVaapi())
                     encInfo.insert("vaapi_enabled", true);
+                if (m_rawMode)
+                    encInfo.insert("raw_prerecorded", true);
+                if (m_backlogPolicy != EncoderBacklogPolicy::NONE)
+                    encInfo.insert("backlog_policy", m_backlogPolicy == EncoderBacklogPolicy::DROP_FRAMES? "drop-frames" : "reduce-quality");
                 if (m_activeCodecProps.mode() == CodecProperties::ConstantBitrate)
                     encInfo.insert("target_bitrate_kbps", m_activeCodecProps.bitrateKbps());
                 else
                     encInfo.insert("target_quality", m_activeCodecProps.quality());
-                m_vidDataset->insertAttribute(QStringLiteral("video"), vInfo);
+                if (streamInfos.size() == 1)
+                    m_vidDataset->insertAttribute(QStringLiteral("video"), streamInfos.first());
+                else
+                    m_vidDataset->insertAttribute(QStringLiteral("video_streams"), streamInfos);
                 m_vidDataset->insertAttribute(QStringLiteral("encoder"), encInfo);
 
                 // signal that we are actually recording this session
@@ -347,8 +595,29 @@ public:
                     statusMessage(QStringLiteral("Recording video %1...").arg(secCount));
             }
 
+            // in raw mode, just store the current frame
+            if (m_rawMode) {
+                if (!m_rawWriter->encodeFrame(frame.mat, frame.time)) {
+                    raiseError(QString::fromStdString(m_rawWriter->lastError()));
+                    m_running = false;
+                    break;
+                }
+                continue;
+            }
+
+            // skip the current frame if we are too far behind, but keep a record of it
+            if (checkEncoderBacklog(streamIndex)) {
+                if (!m_videoWriter->recordDroppedFrame(streamIndex, frame.time)) {
+                    raiseError(QString::fromStdString(m_videoWriter->lastError()));
+                    m_running = false;
+                    break;
+                }
+                continue;
+            }
+
             // encode current frame
-            if (!m_videoWriter->encodeFrame(frame.mat, frame.time)) {
+            const auto encodeStartTime = currentTimePoint();
+            if (!m_videoWriter->encodeFrame(streamIndex, frame.mat, frame.time)) {
                 if (m_videoWriter->lastError().empty())
                     raiseError(QStringLiteral("Unable to encode frame"));
                 else
@@ -356,6 +625,8 @@ public:
                 m_running = false;
                 break;
             }
+            const auto encodeTimeUsec = static_cast<double>(timeDiffUsec(currentTimePoint(), encodeStartTime).count());
+            m_encodeTimeAvgUsec = (m_encodeTimeAvgUsec * 0.9) + (encodeTimeUsec * 0.1);
         }
 
         m_recordingFinished = true;
@@ -373,16 +644,89 @@ public:
             while (!m_recordingFinished) { QCoreApplication::processEvents(); }
 
             // now shut down the recorder
-            m_videoWriter->finalize();
+            if (m_rawMode)
+                m_rawWriter->finalize();
+            else
+                m_videoWriter->finalize();
         }
 
-        statusMessage(QStringLiteral("Recording stopped."));
+        // note any frames we had to drop, so they don't go unnoticed
+        size_t droppedCount = 0;
+        if (m_initDone && !m_rawMode && m_videoWriter.get() != nullptr) {
+            for (int i = 0; i < m_videoWriter->streamCount(); i++)
+                droppedCount += m_videoWriter->droppedFrames(i);
+        }
+        if (droppedCount > 0) {
+            m_vidDataset->insertAttribute(QStringLiteral("dropped_frames"), static_cast<qulonglong>(droppedCount));
+            statusMessage(QStringLiteral("Recording stopped, %1 frames were dropped.").arg(droppedCount));
+        } else {
+            statusMessage(QStringLiteral("Recording stopped."));
+        }
+        if (m_rawMode && m_rawWriter.get() != nullptr && !m_rawWriter->writtenFiles().isEmpty())
+            startTranscode(m_rawWriter->writtenFiles());
+        m_rawWriter.reset(nullptr);
         m_videoWriter.reset(nullptr);
 
         // permit settings canges again
         m_settingsDialog->setEnabled(true);
     }
 
+    /**
+     * Encode the raw videos of the last run in the background, with low priority
+     * so other modules running in the meantime are not disturbed.
+     */
+    void startTranscode(const QStringList &rawFiles)
+    {
+        auto writer = std::move(m_videoWriter);
+        const auto dataset = m_vidDataset;
+        const auto modName = name();
+        const auto saveTimestamps = m_settingsDialog->saveTimestamps();
+        // forget about jobs which have completed already; the videos of earlier runs
+        // belong to different datasets, so new runs don't have to wait for them
+        for (auto it = m_transcodeJobs.begin(); it != m_transcodeJobs.end();) {
+            if (*it->second) {
+                it->first.join();
+                it = m_transcodeJobs.erase(it);
+            } else {
+                it++;
+            }
+        }
+
+        statusMessage(QStringLiteral("Encoding recorded video..."));
+        auto done = std::make_shared<std::atomic_bool>(false);
+        std::thread thread([this, rawFiles, modName, dataset, saveTimestamps, done](std::unique_ptr<VideoWriter> writer) {
+            setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+
+            QStringList errors;
+            for (const auto &fname : rawFiles) {
+                std::string error;
+                if (!transcodeRawVideo(fname, writer.get(), modName, dataset->collectionId(),
+                                       saveTimestamps, &m_transcodeCancel, error))
+                    errors.append(QStringLiteral("%1: %2").arg(QFileInfo(fname).fileName(), QString::fromStdString(error)));
+            }
+            *done = true;
+            if (m_transcodeCancel)
+                return;
+
+            // the dataset manifest was written while the raw data was still around,
+            // so it has to be updated to list the encoded videos instead
+            QMetaObject::invokeMethod(this, [this, dataset, errors]() {
+                dataset->save();
+                if (errors.isEmpty()) {
+                    // don't overwrite the status of a run which is already active again
+                    if (!m_running)
+                        statusMessage(QStringLiteral("Recording stopped, video encoded."));
+                } else {
+                    QMessageBox::warning(m_settingsDialog,
+                                         QStringLiteral("Unable to encode video"),
+                                         QStringLiteral("Encoding the raw recording failed, the raw data was kept:\n%1").arg(errors.join("\n")));
+                    statusMessage(QStringLiteral("Encoding recorded video failed."));
+                }
+            }, Qt::QueuedConnection);
+        }, std::move(writer));
+        m_transcodeJobs.emplace_back(std::move(thread), done);
+    }
+
     void serializeSettings(const QString &, QVariantHash &settings, QByteArray &) override
     {
         const auto codecProps = m_settingsDialog->codecProps();
@@ -391,6 +735,9 @@ public:
         settings.insert("video_name", m_settingsDialog->videoName());
         settings.insert("save_timestamps", m_settingsDialog->saveTimestamps());
         settings.insert("start_stopped", m_settingsDialog->startStopped());
+        settings.insert("input_count", m_settingsDialog->inputCount());
+        settings.insert("raw_recording", m_settingsDialog->rawRecording());
+        settings.insert("backlog_policy", static_cast<int>(m_settingsDialog->backlogPolicy()));
 
         settings.insert("video_codec", static_cast<int>(codecProps.codec()));
         settings.insert("video_container", static_cast<int>(m_settingsDialog->videoContainer()));
@@ -420,6 +767,9 @@ public:
         m_settingsDialog->setVideoName(settings.value("video_name").toString());
         m_settingsDialog->setSaveTimestamps(settings.value("save_timestamps", true).toBool());
         m_settingsDialog->setStartStopped(settings.value("start_stopped", false).toBool());
+        m_settingsDialog->setInputCount(settings.value("input_count", 1).toInt());
+        m_settingsDialog->setRawRecording(settings.value("raw_recording", false).toBool());
+        m_settingsDialog->setBacklogPolicy(static_cast<EncoderBacklogPolicy>(settings.value("backlog_policy", 0).toInt()));
 
         m_settingsDialog->setVideoContainer(static_cast<VideoContainer>(settings.value("video_container").toInt()));
         m_settingsDialog->setSlicingEnabled(settings.value("slices_enabled").toBool());
@@ -20,6 +20,7 @@
 #include "videowriter.h"
 
 #include <string.h>
+#include <algorithm>
 #include <iostream>
 #include <atomic>
 #include <thread>
@@ -34,10 +35,12 @@ extern "C" {
 #include <libavutil/pixdesc.h>
 #include <libavutil/avconfig.h>
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
 #include <libswscale/swscale.h>
 }
 
 #include "tsyncfile.h"
+#include "sytrace.h"
 
 VideoCodec stringToVideoCodec(const std::string &str)
 {
@@ -365,21 +368,21 @@ void CodecProperties::setBitrateKbps(int bitrate)
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpadded"
-class VideoWriter::Private
+/**
+ * @brief Encoder state of a single video stream in the output container
+ */
+class VideoWriter::EncStream
 {
 public:
-    Private()
+    EncStream()
     {
-        initialized = false;
-        container = VideoContainer::Matroska;
-        fileSliceIntervalMin = 0;  // never slice our recording by default
-        captureStartTimestamp = std::chrono::milliseconds(0); //by default we assume the first frame was recorded at timepoint 0
-
         encFrame = nullptr;
         inputFrame = nullptr;
         alignedInput = nullptr;
+        framePts = 0;
+        dropsTsfOpen = false;
+        droppedN = 0;
 
-        octx = nullptr;
         vstrm = nullptr;
         cctx = nullptr;
         swsctx = nullptr;
@@ -390,42 +393,68 @@ public:
         hwFrame = nullptr;
     }
 
-    std::string lastError;
-
-    QString modName;
-    QUuid collectionId;
-    QString fnameBase;
-    uint fileSliceIntervalMin;
-    uint currentSliceNo;
-    CodecProperties codecProps;
-    VideoContainer container;
-
-    bool initialized;
     int width;
     int height;
     AVRational fps;
 
-    bool saveTimestamps;
     TimeSyncFileWriter tsfWriter;
-    std::chrono::milliseconds captureStartTimestamp;
+
+    // frames which were dropped instead of encoded are recorded separately,
+    // so the regular timestamp file keeps matching the video frames
+    QString dropsFname;
+    TimeSyncFileWriter dropsTsfWriter;
+    bool dropsTsfOpen;
+    size_t droppedN;
 
     AVFrame *encFrame;
     AVFrame *inputFrame;
     int64_t framePts;
     uchar *alignedInput;
 
-    AVFormatContext *octx;
     AVStream *vstrm;
     AVCodecContext *cctx;
     SwsContext *swsctx;
     AVPixelFormat inputPixFormat;
     AVPixelFormat encPixFormat;
 
-    size_t framesN;
-
     AVBufferRef *hwDevCtx;
     AVBufferRef *hwFrameCtx;
     AVFrame *hwFrame;
+};
+
+class VideoWriter::Private
+{
+public:
+    Private()
+    {
+        initialized = false;
+        container = VideoContainer::Matroska;
+        fileSliceIntervalMin = 0;  // never slice our recording by default
+        qualityReduction = 0;
+        captureStartTimestamp = std::chrono::microseconds(0); //by default we assume the first frame was recorded at timepoint 0
+
+        octx = nullptr;
+    }
+
+    std::string lastError;
+
+    QString modName;
+    QUuid collectionId;
+    QString fnameBase;
+    uint fileSliceIntervalMin;
+    uint currentSliceNo;
+    CodecProperties codecProps;
+    VideoContainer container;
+
+    bool initialized;
+    bool saveTimestamps;
+    std::chrono::microseconds captureStartTimestamp;
+
+    AVFormatContext *octx;
+    std::vector<std::unique_ptr<EncStream>> streams;
+
+    size_t framesN;
+    int qualityReduction;
     QString hwDevice;
 };
 #pragma GCC diagnostic pop
@@ -478,36 +507,36 @@ static AVFrame *vw_alloc_frame(int pix_fmt, int width, int height, bool allocate
     return aframe;
 }
 
-void VideoWriter::initializeHWAccell()
+void VideoWriter::initializeHWAccell(EncStream *es)
 {
-    int ret = av_hwdevice_ctx_create(&d->hwDevCtx,
+    int ret = av_hwdevice_ctx_create(&es->hwDevCtx,
                                      av_hwdevice_find_type_by_name("vaapi"),
                                      qPrintable(d->hwDevice), NULL, 0);
 
     if (ret != 0)
         throw std::runtime_error(QStringLiteral("Failed to create hw encoding device for %1: %2").arg(d->hwDevice).arg(ret).toStdString());
 
-    d->hwFrameCtx = av_hwframe_ctx_alloc(d->hwDevCtx);
-    if (!d->hwFrameCtx) {
-        av_buffer_unref(&d->hwDevCtx);
+    es->hwFrameCtx = av_hwframe_ctx_alloc(es->hwDevCtx);
+    if (!es->hwFrameCtx) {
+        av_buffer_unref(&es->hwDevCtx);
         throw std::runtime_error("Failed to initialize hw frame context");
     }
 
-    auto cst = av_hwdevice_get_hwframe_constraints(d->hwDevCtx, NULL);
+    auto cst = av_hwdevice_get_hwframe_constraints(es->hwDevCtx, NULL);
     if (!cst) {
-        av_buffer_unref(&d->hwDevCtx);
+        av_buffer_unref(&es->hwDevCtx);
         throw std::runtime_error("Failed to get hwframe constraints");
     }
 
-    auto ctx = (AVHWFramesContext*) d->hwFrameCtx->data;
-    ctx->width = d->width;
-    ctx->height = d->height;
+    auto ctx = (AVHWFramesContext*) es->hwFrameCtx->data;
+    ctx->width = es->width;
+    ctx->height = es->height;
     ctx->format = cst->valid_hw_formats[0];
     ctx->sw_format = AV_PIX_FMT_NV12;
 
-    if ((ret = av_hwframe_ctx_init(d->hwFrameCtx))) {
-        av_buffer_unref(&d->hwDevCtx);
-        av_buffer_unref(&d->hwFrameCtx);
+    if ((ret = av_hwframe_ctx_init(es->hwFrameCtx))) {
+        av_buffer_unref(&es->hwDevCtx);
+        av_buffer_unref(&es->hwFrameCtx);
         throw std::runtime_error(QStringLiteral("Failed to initialize hwframe context: %1").arg(ret).toStdString());
     }
 }
@@ -521,8 +550,8 @@ void VideoWriter::initializeInternal()
     else
         fname = d->fnameBase;
 
-    // prepare timestamp filename
-    auto timestampFname = fname + "_timestamps.tsync";
+    // prepare timestamp filename base
+    const auto timestampFnameBase = fname;
 
     // set container format
     switch (d->container) {
@@ -554,6 +583,54 @@ void VideoWriter::initializeInternal()
         throw std::runtime_error(QStringLiteral("Failed to open output I/O context: %1").arg(ret).toStdString());
     }
 
+    // add & configure encoders for all our streams
+    for (auto &es : d->streams)
+        initializeStreamInternal(es.get());
+
+    // write format header, after this we are ready to encode frames
+    ret = avformat_write_header(d->octx, nullptr);
+    if (ret < 0) {
+        finalizeInternal(false);
+        throw std::runtime_error(QStringLiteral("Failed to write format header: %1").arg(ret).toStdString());
+    }
+
+    for (size_t i = 0; i < d->streams.size(); i++) {
+        auto es = d->streams[i].get();
+        es->framePts = 0;
+        if (!d->saveTimestamps)
+            continue;
+
+        // every stream gets its own timestamp file, the first one keeps the name
+        // used for single-stream videos
+        QString timestampFname;
+        if (d->streams.size() == 1) {
+            timestampFname = timestampFnameBase + "_timestamps.tsync";
+            es->dropsFname = timestampFnameBase + "_dropped.tsync";
+        } else {
+            timestampFname = QStringLiteral("%1_stream%2_timestamps.tsync").arg(timestampFnameBase).arg(i + 1);
+            es->dropsFname = QStringLiteral("%1_stream%2_dropped.tsync").arg(timestampFnameBase).arg(i + 1);
+        }
+
+        es->tsfWriter.close(); // ensure file is closed
+        es->tsfWriter.setSyncMode(TSyncFileMode::CONTINUOUS);
+        es->tsfWriter.setTimeNames(QStringLiteral("frame-no"), QStringLiteral("master-time"));
+        es->tsfWriter.setTimeUnits(TSyncFileTimeUnit::INDEX, TSyncFileTimeUnit::MICROSECONDS);
+        es->tsfWriter.setTimeDataTypes(TSyncFileDataType::UINT32, TSyncFileDataType::UINT64);
+        es->tsfWriter.setChunkSize((es->fps.num / es->fps.den) * 60 * 1); // new chunk about every minute
+        es->tsfWriter.setAsyncWrites(true); // keep disk I/O out of the encoding thread
+        es->tsfWriter.setFileName(timestampFname);
+        if (!es->tsfWriter.open(d->modName, d->collectionId)) {
+            finalizeInternal(false);
+            throw std::runtime_error(QStringLiteral("Unable to initialize timesync file: %1").arg(es->tsfWriter.lastError()).toStdString());
+        }
+    }
+
+    d->initialized = true;
+}
+
+void VideoWriter::initializeStreamInternal(EncStream *es)
+{
+    int ret;
     auto codecId = AV_CODEC_ID_AV1;
     switch (d->codecProps.codec()) {
     case VideoCodec::Raw:
@@ -604,60 +681,62 @@ void VideoWriter::initializeInternal()
         // no hardware acceleration, proceed as usual
         vcodec = avcodec_find_encoder(codecId);
     }
-    d->cctx = avcodec_alloc_context3(vcodec);
+    es->cctx = avcodec_alloc_context3(vcodec);
 
     // create new video stream
-    d->vstrm = avformat_new_stream(d->octx, vcodec);
-    if (!d->vstrm)
+    es->vstrm = avformat_new_stream(d->octx, vcodec);
+    if (!es->vstrm)
         throw std::runtime_error("Failed to create new video stream.");
-    avcodec_parameters_to_context(d->cctx, d->vstrm->codecpar);
+    avcodec_parameters_to_context(es->cctx, es->vstrm->codecpar);
 
     // set codec parameters
-    d->encPixFormat = AV_PIX_FMT_YUV420P;
-    d->cctx->codec_id = codecId;
-    d->cctx->codec_type = AVMEDIA_TYPE_VIDEO;
+    es->encPixFormat = AV_PIX_FMT_YUV420P;
+    es->cctx->codec_id = codecId;
+    es->cctx->codec_type = AVMEDIA_TYPE_VIDEO;
     if (vcodec->pix_fmts != nullptr)
-        d->encPixFormat = vcodec->pix_fmts[0];
-    d->cctx->time_base = av_inv_q(d->fps);
-    d->cctx->width = d->width;
-    d->cctx->height = d->height;
-    d->cctx->framerate = d->fps;
-    d->cctx->workaround_bugs = FF_BUG_AUTODETECT;
-
+        es->encPixFormat = vcodec->pix_fmts[0];
+    es->cctx->time_base = av_inv_q(es->fps);
+    es->cctx->width = es->width;
+    es->cctx->height = es->height;
+    es->cctx->framerate = es->fps;
+    es->cctx->workaround_bugs = FF_BUG_AUTODETECT;
+
+    // all streams are encoded from the same thread, so they share the thread
+    // budget we were given instead of each spawning a full set of encoder threads
     if (d->codecProps.threadCount() > 0)
-        d->cctx->thread_count = d->codecProps.threadCount();
+        es->cctx->thread_count = std::max(1, d->codecProps.threadCount() / static_cast<int>(d->streams.size()));
 
     if (d->codecProps.codec() == VideoCodec::Raw)
-        d->encPixFormat = d->inputPixFormat == AV_PIX_FMT_GRAY8 ||
-                                d->inputPixFormat == AV_PIX_FMT_GRAY16LE ||
-                                d->inputPixFormat == AV_PIX_FMT_GRAY16BE ? d->inputPixFormat : AV_PIX_FMT_YUV420P;
+        es->encPixFormat = es->inputPixFormat == AV_PIX_FMT_GRAY8 ||
+                                es->inputPixFormat == AV_PIX_FMT_GRAY16LE ||
+                                es->inputPixFormat == AV_PIX_FMT_GRAY16BE ? es->inputPixFormat : AV_PIX_FMT_YUV420P;
 
     // enable experimental mode to encode AV1
     if (d->codecProps.codec() == VideoCodec::AV1)
-        d->cctx->strict_std_compliance = -2;
+        es->cctx->strict_std_compliance = -2;
 
     if (d->octx->oformat->flags & AVFMT_GLOBALHEADER)
-        d->cctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+        es->cctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
 
     // setup hardware acceleration, if requested
     if (d->codecProps.useVaapi()) {
-        initializeHWAccell();
-        d->cctx->hw_frames_ctx = av_buffer_ref(d->hwFrameCtx);
+        initializeHWAccell(es);
+        es->cctx->hw_frames_ctx = av_buffer_ref(es->hwFrameCtx);
 
         // the global header seems to cause troubles with pretty much all HW-accelerated codecs.
         // disable it for now.
-        d->cctx->flags &= ~(AV_CODEC_FLAG_GLOBAL_HEADER);
+        es->cctx->flags &= ~(AV_CODEC_FLAG_GLOBAL_HEADER);
     }
 
     AVDictionary *codecopts = nullptr;
 
     // set bitrate/crf
-    d->cctx->bit_rate = 0;
+    es->cctx->bit_rate = 0;
     av_dict_set_int(&codecopts, "crf", 0, 0);
     if (d->codecProps.mode() == CodecProperties::ConstantQuality)
         av_dict_set_int(&codecopts, "crf", d->codecProps.quality(), 0);
     else if (d->codecProps.mode() == CodecProperties::ConstantBitrate)
-        d->cctx->bit_rate = d->codecProps.bitrateKbps() * 1000;
+        es->cctx->bit_rate = d->codecProps.bitrateKbps() * 1000;
 
     if (d->codecProps.isLossless()) {
         // settings for lossless option
@@ -677,7 +756,7 @@ void VideoWriter::initializeInternal()
             break;
         case VideoCodec::H264:
         case VideoCodec::HEVC:
-            d->cctx->gop_size = 32;
+            es->cctx->gop_size = 32;
             av_dict_set_int(&codecopts, "crf", 0, 0);
             av_dict_set_int(&codecopts, "lossless", 1, 0);
             break;
@@ -692,7 +771,7 @@ void VideoWriter::initializeInternal()
         // not lossless
 
         if (d->codecProps.codec() == VideoCodec::HEVC) {
-            d->cctx->gop_size = 16;
+            es->cctx->gop_size = 16;
             av_dict_set(&codecopts, "preset", "veryfast", 0);
         }
     }
@@ -701,10 +780,10 @@ void VideoWriter::initializeInternal()
         // See https://developers.google.com/media/vp9/live-encoding
         // for more information on the settings.
 
-        d->cctx->gop_size = 90;
+        es->cctx->gop_size = 90;
         if (d->codecProps.mode() == CodecProperties::ConstantBitrate) {
-            d->cctx->qmin = 4;
-            d->cctx->qmax = 48;
+            es->cctx->qmin = 4;
+            es->cctx->qmax = 48;
             av_dict_set_int(&codecopts, "crf", 24, 0);
         }
 
@@ -722,7 +801,7 @@ void VideoWriter::initializeInternal()
 
     if (d->codecProps.codec() == VideoCodec::FFV1) {
         d->codecProps.setLossless(true); // this codec is always lossless
-        d->cctx->level = 3; // Ensure we use FFV1 v3
+        es->cctx->level = 3; // Ensure we use FFV1 v3
         av_dict_set_int(&codecopts, "slicecrc", 1, 0); // Add CRC information to each slice
         av_dict_set_int(&codecopts, "slices", 24, 0);  // Use 24 slices
         av_dict_set_int(&codecopts, "coder", 1, 0);    // Range coder
@@ -736,140 +815,136 @@ void VideoWriter::initializeInternal()
     // Adjust pixel color formats for selected video codecs
     switch (d->codecProps.codec()) {
     case VideoCodec::FFV1:
-        if (d->inputPixFormat == AV_PIX_FMT_GRAY8)
-            d->encPixFormat = AV_PIX_FMT_GRAY8;
-        if (d->inputPixFormat == AV_PIX_FMT_GRAY16LE)
-            d->encPixFormat = AV_PIX_FMT_GRAY8;
+        if (es->inputPixFormat == AV_PIX_FMT_GRAY8)
+            es->encPixFormat = AV_PIX_FMT_GRAY8;
+        if (es->inputPixFormat == AV_PIX_FMT_GRAY16LE)
+            es->encPixFormat = AV_PIX_FMT_GRAY8;
         break;
     default: break;
     }
 
     // set pixel format to encoder pixel format, unless we are in
     // VAAPI mode, in which case VAAPI is the "format" we need
-    if (d->hwDevCtx == nullptr) {
-        d->cctx->pix_fmt = d->encPixFormat;
+    if (es->hwDevCtx == nullptr) {
+        es->cctx->pix_fmt = es->encPixFormat;
     } else {
         // the codec format has to be VAAPI
-        d->cctx->pix_fmt = AV_PIX_FMT_VAAPI;
+        es->cctx->pix_fmt = AV_PIX_FMT_VAAPI;
         // only yuv420p seems to reliably work with HW acceleration
-        d->encPixFormat = AV_PIX_FMT_YUV420P;
+        es->encPixFormat = AV_PIX_FMT_YUV420P;
     }
 
     // open video encoder
-    ret = avcodec_open2(d->cctx, vcodec, &codecopts);
+    ret = avcodec_open2(es->cctx, vcodec, &codecopts);
     if (ret < 0) {
         finalizeInternal(false);
         av_dict_free(&codecopts);
         throw std::runtime_error(QStringLiteral("Failed to open video encoder: %1").arg(ret).toStdString());
     }
 
+    // keep quality reduced in case we are starting a new slice while the encoder is under pressure
+    if (d->qualityReduction > 0)
+        applyQualityReduction(es);
+
     // stream codec parameters must be set after opening the encoder
-    avcodec_parameters_from_context(d->vstrm->codecpar, d->cctx);
-    d->vstrm->r_frame_rate = d->vstrm->avg_frame_rate = d->fps;
+    avcodec_parameters_from_context(es->vstrm->codecpar, es->cctx);
+    es->vstrm->r_frame_rate = es->vstrm->avg_frame_rate = es->fps;
 
     // initialize sample scaler
-    d->swsctx = sws_getCachedContext(nullptr,
-                                     d->width,
-                                     d->height,
-                                     d->inputPixFormat,
-                                     d->width,
-                                     d->height,
-                                     d->encPixFormat,
-                                     SWS_BICUBIC,
-                                     nullptr,
-                                     nullptr,
-                                     nullptr);
-
-    if (!d->swsctx) {
+    es->swsctx = sws_getCachedContext(nullptr,
+                                      es->width,
+                                      es->height,
+                                      es->inputPixFormat,
+                                      es->width,
+                                      es->height,
+                                      es->encPixFormat,
+                                      SWS_BICUBIC,
+                                      nullptr,
+                                      nullptr,
+                                      nullptr);
+
+    if (!es->swsctx) {
         finalizeInternal(false);
         throw std::runtime_error("Failed to initialize sample scaler.");
     }
 
     // allocate frame buffer for encoding
-    d->encFrame = vw_alloc_frame(d->encPixFormat, d->width, d->height, true);
+    es->encFrame = vw_alloc_frame(es->encPixFormat, es->width, es->height, true);
 
     // allocate input buffer for color conversion
-    d->inputFrame = vw_alloc_frame(d->inputPixFormat, d->width, d->height, false);
+    es->inputFrame = vw_alloc_frame(es->inputPixFormat, es->width, es->height, false);
 
-    if (d->hwDevCtx != nullptr) {
+    if (es->hwDevCtx != nullptr) {
         // setup frame for hardware acceleration
 
-        d->hwFrame = av_frame_alloc();
-        auto frctx = (AVHWFramesContext*) d->hwFrameCtx->data;
-        d->hwFrame->format = frctx->format;
-        d->hwFrame->hw_frames_ctx = av_buffer_ref(d->hwFrameCtx);
-        d->hwFrame->width = d->width;
-        d->hwFrame->height = d->height;
+        es->hwFrame = av_frame_alloc();
+        auto frctx = (AVHWFramesContext*) es->hwFrameCtx->data;
+        es->hwFrame->format = frctx->format;
+        es->hwFrame->hw_frames_ctx = av_buffer_ref(es->hwFrameCtx);
+        es->hwFrame->width = es->width;
+        es->hwFrame->height = es->height;
 
-        if (av_hwframe_get_buffer(d->hwFrameCtx, d->hwFrame, 0)) {
+        if (av_hwframe_get_buffer(es->hwFrameCtx, es->hwFrame, 0)) {
             finalizeInternal(false);
             throw std::runtime_error("Failed to retrieve HW frame buffer.");
         }
     }
-
-    // write format header, after this we are ready to encode frames
-    ret = avformat_write_header(d->octx, nullptr);
-    if (ret < 0) {
-        finalizeInternal(false);
-        throw std::runtime_error(QStringLiteral("Failed to write format header: %1").arg(ret).toStdString());
-    }
-    d->framePts = 0;
-
-    if (d->saveTimestamps) {
-        d->tsfWriter.close(); // ensure file is closed
-        d->tsfWriter.setSyncMode(TSyncFileMode::CONTINUOUS);
-        d->tsfWriter.setTimeNames(QStringLiteral("frame-no"), QStringLiteral("master-time"));
-        d->tsfWriter.setTimeUnits(TSyncFileTimeUnit::INDEX, TSyncFileTimeUnit::MILLISECONDS);
-        d->tsfWriter.setTimeDataTypes(TSyncFileDataType::UINT32, TSyncFileDataType::UINT64);
-        d->tsfWriter.setChunkSize((d->fps.num / d->fps.den) * 60 * 1); // new chunk about every minute
-        d->tsfWriter.setFileName(timestampFname);
-        if (!d->tsfWriter.open(d->modName, d->collectionId)) {
-            finalizeInternal(false);
-            throw std::runtime_error(QStringLiteral("Unable to initialize timesync file: %1").arg(d->tsfWriter.lastError()).toStdString());
-        }
-    }
-
-    d->initialized = true;
 }
 
 void VideoWriter::finalizeInternal(bool writeTrailer)
 {
     if (d->initialized) {
-        if (d->vstrm != nullptr)
-            avcodec_send_frame(d->cctx, nullptr);
+        for (auto &es : d->streams) {
+            if (es->vstrm != nullptr)
+                avcodec_send_frame(es->cctx, nullptr);
+        }
 
         // write trailer
         if (writeTrailer && (d->octx != nullptr))
             av_write_trailer(d->octx);
     }
 
-    // ensure timestamps file is closed
-    if (d->saveTimestamps)
-        d->tsfWriter.close();
+    for (auto &es : d->streams) {
+        // ensure timestamps file is closed
+        if (d->saveTimestamps) {
+            es->tsfWriter.close();
+            es->dropsTsfWriter.close();
+            es->dropsTsfOpen = false;
+        }
 
-    // free all FFmpeg resources
-    if (d->encFrame != nullptr) {
-        av_frame_free(&d->encFrame);
-        d->encFrame = nullptr;
-    }
-    if (d->inputFrame != nullptr) {
-        av_frame_free(&d->inputFrame);
-        d->inputFrame = nullptr;
-    }
-    if (d->hwFrame != nullptr) {
-        av_frame_free(&d->hwFrame);
-        d->hwFrame = nullptr;
-    }
+        // free all FFmpeg resources
+        if (es->encFrame != nullptr) {
+            av_frame_free(&es->encFrame);
+            es->encFrame = nullptr;
+        }
+        if (es->inputFrame != nullptr) {
+            av_frame_free(&es->inputFrame);
+            es->inputFrame = nullptr;
+        }
+        if (es->hwFrame != nullptr) {
+            av_frame_free(&es->hwFrame);
+            es->hwFrame = nullptr;
+        }
 
-    if (d->hwDevCtx != nullptr)
-        av_buffer_unref(&d->hwDevCtx);
-    if (d->hwFrameCtx != nullptr)
-        av_buffer_unref(&d->hwDevCtx);
+        if (es->hwDevCtx != nullptr)
+            av_buffer_unref(&es->hwDevCtx);
+        if (es->hwFrameCtx != nullptr)
+            av_buffer_unref(&es->hwFrameCtx);
+
+        if (es->cctx != nullptr) {
+            avcodec_free_context(&es->cctx);
+            es->cctx = nullptr;
+        }
+        if (es->swsctx != nullptr) {
+            sws_freeContext(es->swsctx);
+            es->swsctx = nullptr;
+        }
+        es->vstrm = nullptr;
 
-    if (d->cctx != nullptr) {
-        avcodec_free_context(&d->cctx);
-        d->cctx = nullptr;
+        if (es->alignedInput != nullptr)
+            av_freep(&es->alignedInput);
     }
+
     if (d->octx != nullptr) {
         if (d->octx->pb != nullptr)
             avio_close(d->octx->pb);
@@ -877,9 +952,6 @@ void VideoWriter::finalizeInternal(bool writeTrailer)
         d->octx = nullptr;
     }
 
-    if (d->alignedInput != nullptr)
-        av_freep(&d->alignedInput);
-
     d->initialized = false;
 }
 
@@ -892,13 +964,30 @@ void VideoWriter::initialize(const QString &fname,
                              int cvDepth,
                              bool hasColor,
                              bool saveTimestamps)
+{
+    VideoStreamFormat format;
+    format.width = width;
+    format.height = height;
+    format.fps = fps;
+    format.cvDepth = cvDepth;
+    format.hasColor = hasColor;
+
+    initialize(fname, modName, collectionId, {format}, saveTimestamps);
+}
+
+void VideoWriter::initialize(const QString &fname,
+                             const QString &modName,
+                             const QUuid &collectionId,
+                             const std::vector<VideoStreamFormat> &formats,
+                             bool saveTimestamps)
 {
     if (d->initialized)
         throw std::runtime_error("Tried to initialize an already initialized video writer.");
+    if (formats.empty())
+        throw std::runtime_error("Tried to initialize a video writer without any video stream.");
+    if ((formats.size() > 1) && (d->container != VideoContainer::Matroska))
+        throw std::runtime_error("Multiple video streams can only be recorded into a Matroska container.");
 
-    d->width = width;
-    d->height = height;
-    d->fps = {fps, 1};
     d->framesN = 0;
     d->saveTimestamps = saveTimestamps;
     d->currentSliceNo = 1;
@@ -907,14 +996,23 @@ void VideoWriter::initialize(const QString &fname,
     else
         d->fnameBase = fname;
 
-    // select FFMpeg pixel format of OpenCV matrixes
-    if (hasColor) {
-        d->inputPixFormat = AV_PIX_FMT_BGR24;
-    } else {
-        if (cvDepth == CV_16U)
-            d->inputPixFormat = AV_PIX_FMT_GRAY16LE;
-        else
-            d->inputPixFormat = AV_PIX_FMT_GRAY8;
+    d->streams.clear();
+    for (const auto &format : formats) {
+        auto es = std::make_unique<EncStream>();
+        es->width = format.width;
+        es->height = format.height;
+        es->fps = {format.fps, 1};
+
+        // select FFMpeg pixel format of OpenCV matrixes
+        if (format.hasColor) {
+            es->inputPixFormat = AV_PIX_FMT_BGR24;
+        } else {
+            if (format.cvDepth == CV_16U)
+                es->inputPixFormat = AV_PIX_FMT_GRAY16LE;
+            else
+                es->inputPixFormat = AV_PIX_FMT_GRAY8;
+        }
+        d->streams.push_back(std::move(es));
     }
 
     d->modName = modName;
@@ -963,27 +1061,27 @@ bool VideoWriter::startNewSection(const QString &fname)
     return true;
 }
 
-std::chrono::milliseconds VideoWriter::captureStartTimestamp() const
+std::chrono::microseconds VideoWriter::captureStartTimestamp() const
 {
     return d->captureStartTimestamp;
 }
 
-void VideoWriter::setCaptureStartTimestamp(const std::chrono::milliseconds &startTimestamp)
+void VideoWriter::setCaptureStartTimestamp(const std::chrono::microseconds &startTimestamp)
 {
     d->captureStartTimestamp = startTimestamp;
 }
 
 inline
-bool VideoWriter::prepareFrame(const cv::Mat &inImage)
+bool VideoWriter::prepareFrame(EncStream *es, const cv::Mat &inImage)
 {
     auto image = inImage;
 
     // convert color formats around to match what was actually selected as
     // input pixel format
-    if (d->inputPixFormat == AV_PIX_FMT_GRAY8) {
+    if (es->inputPixFormat == AV_PIX_FMT_GRAY8) {
         if (image.channels() != 1)
             cv::cvtColor(inImage, image, cv::COLOR_BGR2GRAY);
-    } else if (d->inputPixFormat == AV_PIX_FMT_BGR24) {
+    } else if (es->inputPixFormat == AV_PIX_FMT_BGR24) {
         if (image.channels() == 4)
             cv::cvtColor(inImage, image, cv::COLOR_BGRA2BGR);
         else if (image.channels() == 1)
@@ -999,16 +1097,16 @@ bool VideoWriter::prepareFrame(const cv::Mat &inImage)
     const auto width = image.cols;
 
     // sanity checks
-    if ((static_cast<int>(height) > d->height) || (static_cast<int>(width) > d->width))
+    if ((static_cast<int>(height) > es->height) || (static_cast<int>(width) > es->width))
         throw std::runtime_error(QStringLiteral("Received bigger frame than we expected (%1x%2 instead of %3x%4)")
                                  .arg(width).arg(height)
-                                 .arg(d->width).arg(d->height)
+                                 .arg(es->width).arg(es->height)
                                  .toStdString());
-    if ((d->inputPixFormat == AV_PIX_FMT_BGR24) && (channels != 3)) {
+    if ((es->inputPixFormat == AV_PIX_FMT_BGR24) && (channels != 3)) {
         d->lastError = QStringLiteral("Expected BGR colored image, but received image has %1 channels").arg(channels).toStdString();
         return false;
     }
-    else if ((d->inputPixFormat == AV_PIX_FMT_GRAY8) && (channels != 1)) {
+    else if ((es->inputPixFormat == AV_PIX_FMT_GRAY8) && (channels != 1)) {
         d->lastError = QStringLiteral("Expected grayscale image, but received image has %1 channels").arg(channels).toStdString();
         return false;
     }
@@ -1021,44 +1119,56 @@ bool VideoWriter::prepareFrame(const cv::Mat &inImage)
     if (step % STEP_ALIGNMENT != 0) {
         auto aligned_step = (step + STEP_ALIGNMENT - 1) & -STEP_ALIGNMENT;
 
-        if (d->alignedInput == nullptr)
-            d->alignedInput = static_cast<uchar*>(av_mallocz(aligned_step * static_cast<size_t>(height)));
+        if (es->alignedInput == nullptr)
+            es->alignedInput = static_cast<uchar*>(av_mallocz(aligned_step * static_cast<size_t>(height)));
 
         for (size_t y = 0; y < static_cast<size_t>(height); y++)
-            memcpy(d->alignedInput + y*aligned_step, image.ptr() + y*step, step);
+            memcpy(es->alignedInput + y*aligned_step, image.ptr() + y*step, step);
 
-        data = d->alignedInput;
+        data = es->alignedInput;
         step = aligned_step;
     }
 
-    if (d->encPixFormat != d->inputPixFormat) {
+    if (es->encPixFormat != es->inputPixFormat) {
         // let input_picture point to the raw data buffer of 'image'
-        av_image_fill_arrays(d->inputFrame->data, d->inputFrame->linesize, static_cast<const uint8_t*>(data), d->inputPixFormat, width, height, 1);
-        d->inputFrame->linesize[0] = static_cast<int>(step);
+        av_image_fill_arrays(es->inputFrame->data, es->inputFrame->linesize, static_cast<const uint8_t*>(data), es->inputPixFormat, width, height, 1);
+        es->inputFrame->linesize[0] = static_cast<int>(step);
 
-        if (sws_scale(d->swsctx, d->inputFrame->data,
-                               d->inputFrame->linesize, 0,
-                               d->height,
-                               d->encFrame->data, d->encFrame->linesize) < 0) {
+        if (sws_scale(es->swsctx, es->inputFrame->data,
+                               es->inputFrame->linesize, 0,
+                               es->height,
+                               es->encFrame->data, es->encFrame->linesize) < 0) {
             d->lastError = "Unable to scale image in pixel format conversion.";
             return false;
         }
 
     } else {
-        av_image_fill_arrays(d->encFrame->data, d->encFrame->linesize, static_cast<const uint8_t*>(data), d->inputPixFormat, width, height, 1);
-        d->encFrame->linesize[0] = static_cast<int>(step);
+        av_image_fill_arrays(es->encFrame->data, es->encFrame->linesize, static_cast<const uint8_t*>(data), es->inputPixFormat, width, height, 1);
+        es->encFrame->linesize[0] = static_cast<int>(step);
     }
 
-    d->encFrame->pts = d->framePts++;
+    es->encFrame->pts = es->framePts++;
     return true;
 }
 
-bool VideoWriter::encodeFrame(const cv::Mat &frame, const std::chrono::milliseconds &timestamp)
+bool VideoWriter::encodeFrame(const cv::Mat &frame, const std::chrono::microseconds &timestamp)
 {
+    return encodeFrame(0, frame, timestamp);
+}
+
+bool VideoWriter::encodeFrame(int streamIndex, const cv::Mat &frame, const std::chrono::microseconds &timestamp)
+{
+    SY_TRACE_SPAN("VideoWriter::encodeFrame");
     int ret;
     bool success = false;
 
-    if (!prepareFrame(frame)) {
+    if ((streamIndex < 0) || (static_cast<size_t>(streamIndex) >= d->streams.size())) {
+        d->lastError = QStringLiteral("Tried to encode frame for nonexistent video stream %1").arg(streamIndex).toStdString();
+        return false;
+    }
+    auto es = d->streams[static_cast<size_t>(streamIndex)].get();
+
+    if (!prepareFrame(es, frame)) {
         std::cerr << "Unable to prepare frame. N: " << d->framesN + 1 << "(" << d->lastError << ")" << std::endl;
         return false;
     }
@@ -1069,34 +1179,34 @@ bool VideoWriter::encodeFrame(const cv::Mat &frame, const std::chrono::milliseco
     av_init_packet(&pkt);
 
     AVBufferRef *savedBuf0 = nullptr;
-    auto outputFrame = d->encFrame;
+    auto outputFrame = es->encFrame;
 
-    const auto tsMsec = timestamp.count();
+    const auto tsUsec = timestamp.count();
 
-    if (d->hwDevCtx == nullptr) {
+    if (es->hwDevCtx == nullptr) {
         // force FFmpeg to create a copy of the frame, if the codec needs it
-        savedBuf0 = d->encFrame->buf[0];
-        d->encFrame->buf[0] = nullptr;
+        savedBuf0 = es->encFrame->buf[0];
+        es->encFrame->buf[0] = nullptr;
     } else {
         // we are GPU accelerated! Copy frame to the GPU.
-        if (av_hwframe_transfer_data(d->hwFrame, d->encFrame, 0)) {
+        if (av_hwframe_transfer_data(es->hwFrame, es->encFrame, 0)) {
             d->lastError = QStringLiteral("Failed to upload data to the GPU").toStdString();
             std::cerr << d->lastError << std::endl;
             goto out;
         }
-        d->hwFrame->pts = d->encFrame->pts;
-        outputFrame = d->hwFrame;
+        es->hwFrame->pts = es->encFrame->pts;
+        outputFrame = es->hwFrame;
     }
 
     // encode video frame
-    ret = avcodec_send_frame(d->cctx, outputFrame);
+    ret = avcodec_send_frame(es->cctx, outputFrame);
     if (ret < 0) {
         d->lastError = QStringLiteral("Unable to send frame to encoder. N: %1").arg(d->framesN + 1).toStdString();
         std::cerr << d->lastError << std::endl;
         goto out;
     }
 
-    ret = avcodec_receive_packet(d->cctx, &pkt);
+    ret = avcodec_receive_packet(es->cctx, &pkt);
     if (ret != 0) {
         // some encoders need to be fed a few frames before they produce a useful result
         // ignore errors in that case for a little bit.
@@ -1112,20 +1222,32 @@ bool VideoWriter::encodeFrame(const cv::Mat &frame, const std::chrono::milliseco
 
     // rescale packet timestamp
     pkt.duration = 1;
-    av_packet_rescale_ts(&pkt, d->cctx->time_base, d->vstrm->time_base);
+    pkt.stream_index = es->vstrm->index;
+    av_packet_rescale_ts(&pkt, es->cctx->time_base, es->vstrm->time_base);
 
-    // write packet
-    av_write_frame(d->octx, &pkt);
+    // write packet - with multiple streams, the muxer has to interleave them for us
+    if (d->streams.size() == 1)
+        av_write_frame(d->octx, &pkt);
+    else
+        av_interleaved_write_frame(d->octx, &pkt);
     d->framesN++;
     av_packet_unref(&pkt);
 
     // store timestamp (if necessary)
     if (d->saveTimestamps)
-        d->tsfWriter.writeTimes(d->framePts, tsMsec);
+        es->tsfWriter.writeTimes(es->framePts, tsUsec);
 
     if (d->fileSliceIntervalMin != 0) {
-        const auto tsMin = static_cast<double>(tsMsec - d->captureStartTimestamp.count()) / 1000.0 / 60.0;
+        // all streams share one container, so the first stream to cross the boundary
+        // starts a new slice for all of them
+        const auto tsMin = static_cast<double>(tsUsec - d->captureStartTimestamp.count()) / 1000.0 / 1000.0 / 60.0;
         if (tsMin >= (d->fileSliceIntervalMin * d->currentSliceNo)) {
+            // restore frame buffer before we free it
+            if (savedBuf0) {
+                es->encFrame->buf[0] = savedBuf0;
+                savedBuf0 = nullptr;
+            }
+
             try {
                 // we need to start a new file now since the maximum time for this file has elapsed,
                 // so finalize this one
@@ -1146,11 +1268,88 @@ bool VideoWriter::encodeFrame(const cv::Mat &frame, const std::chrono::milliseco
 out:
     // restore frame buffer, so that it can be properly freed in the end
     if (savedBuf0)
-        d->encFrame->buf[0] = savedBuf0;
+        es->encFrame->buf[0] = savedBuf0;
 
     return success;
 }
 
+bool VideoWriter::recordDroppedFrame(int streamIndex, const std::chrono::microseconds &timestamp)
+{
+    if ((streamIndex < 0) || (static_cast<size_t>(streamIndex) >= d->streams.size())) {
+        d->lastError = QStringLiteral("Tried to drop frame of nonexistent video stream %1").arg(streamIndex).toStdString();
+        return false;
+    }
+    auto es = d->streams[static_cast<size_t>(streamIndex)].get();
+    es->droppedN++;
+    if (!d->saveTimestamps)
+        return true;
+
+    // the file is only created once we actually have to drop a frame
+    if (!es->dropsTsfOpen) {
+        es->dropsTsfWriter.setSyncMode(TSyncFileMode::SYNCPOINTS);
+        es->dropsTsfWriter.setTimeNames(QStringLiteral("last-frame-no"), QStringLiteral("master-time"));
+        es->dropsTsfWriter.setTimeUnits(TSyncFileTimeUnit::INDEX, TSyncFileTimeUnit::MICROSECONDS);
+        es->dropsTsfWriter.setTimeDataTypes(TSyncFileDataType::UINT32, TSyncFileDataType::UINT64);
+        es->dropsTsfWriter.setAsyncWrites(true);
+        es->dropsTsfWriter.setFileName(es->dropsFname);
+        if (!es->dropsTsfWriter.open(d->modName, d->collectionId)) {
+            d->lastError = QStringLiteral("Unable to initialize dropped frames file: %1").arg(es->dropsTsfWriter.lastError()).toStdString();
+            return false;
+        }
+        es->dropsTsfOpen = true;
+    }
+
+    // record the frame number of the last encoded frame before the gap, and the time of the lost frame
+    es->dropsTsfWriter.writeTimes(es->framePts, timestamp.count());
+    return true;
+}
+
+size_t VideoWriter::droppedFrames(int streamIndex) const
+{
+    return d->streams[static_cast<size_t>(streamIndex)]->droppedN;
+}
+
+bool VideoWriter::canReduceQuality() const
+{
+    // only few encoders accept new rate control settings while running, and we
+    // never touch the quality of lossless recordings
+    if (d->codecProps.codec() != VideoCodec::H264)
+        return false;
+    if (d->codecProps.useVaapi() || d->codecProps.isLossless())
+        return false;
+    return (d->codecProps.mode() == CodecProperties::ConstantQuality) ||
+           (d->codecProps.mode() == CodecProperties::ConstantBitrate);
+}
+
+int VideoWriter::qualityReduction() const
+{
+    return d->qualityReduction;
+}
+
+bool VideoWriter::setQualityReduction(int level)
+{
+    if (!canReduceQuality())
+        return false;
+
+    d->qualityReduction = std::clamp(level, 0, VIDEO_MAX_QUALITY_REDUCTION);
+    if (!d->initialized)
+        return true;
+    for (auto &es : d->streams)
+        applyQualityReduction(es.get());
+    return true;
+}
+
+void VideoWriter::applyQualityReduction(EncStream *es)
+{
+    // the encoder picks up the new values when it receives its next frame
+    if (d->codecProps.mode() == CodecProperties::ConstantBitrate) {
+        es->cctx->bit_rate = static_cast<int64_t>(d->codecProps.bitrateKbps()) * 1000 * (100 - 20 * d->qualityReduction) / 100;
+    } else {
+        const auto crf = std::min(d->codecProps.quality() + 4 * d->qualityReduction, d->codecProps.qualityMin());
+        av_opt_set_double(es->cctx->priv_data, "crf", crf, 0);
+    }
+}
+
 CodecProperties VideoWriter::codecProps() const
 {
     return d->codecProps;
@@ -1174,19 +1373,24 @@ VideoContainer VideoWriter::container() const
     return d->container;
 }
 
-int VideoWriter::width() const
+int VideoWriter::width(int streamIndex) const
+{
+    return d->streams[static_cast<size_t>(streamIndex)]->width;
+}
+
+int VideoWriter::height(int streamIndex) const
 {
-    return d->width;
+    return d->streams[static_cast<size_t>(streamIndex)]->height;
 }
 
-int VideoWriter::height() const
+int VideoWriter::fps(int streamIndex) const
 {
-    return d->height;
+    return d->streams[static_cast<size_t>(streamIndex)]->fps.num;
 }
 
-int VideoWriter::fps() const
+int VideoWriter::streamCount() const
 {
-    return d->fps.num;
+    return static_cast<int>(d->streams.size());
 }
 
 uint VideoWriter::fileSliceInterval() const
@@ -22,6 +22,7 @@
 
 #include <memory>
 #include <chrono>
+#include <vector>
 #include <opencv2/core.hpp>
 #include <QMetaType>
 
@@ -138,6 +139,28 @@ private:
 #endif
 };
 
+/**
+ * Highest amount of steps the encoder quality can be reduced by
+ * when the encoder can not keep up with incoming frames.
+ */
+static const int VIDEO_MAX_QUALITY_REDUCTION = 3;
+
+/**
+ * @brief Format of a single video stream written by VideoWriter
+ */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+class VideoStreamFormat
+{
+public:
+    int width;
+    int height;
+    int fps;
+    int cvDepth;
+    bool hasColor;
+};
+#pragma GCC diagnostic pop
+
 /**
  * @brief The VideoWriter class
  *
@@ -145,6 +168,12 @@ private:
  * with a pleasant but very simplified API and all the nasty video encoding
  * issues hidden away.
  * This class intentionally supports only few container/codec formats and options.
+ * Multiple video streams can be written into a single Matroska file, in which case
+ * they share one set of encoder threads and file slices, but each keep their own
+ * timestamp file.
+ * When frames arrive faster than they can be encoded, callers may lower the quality
+ * of codecs that support changing it on the fly, or drop frames. Dropped frames are
+ * logged in a separate timestamp file, so gaps in the video are documented.
  */
 class VideoWriter
 {
@@ -161,14 +190,27 @@ public:
                     int cvDepth,
                     bool hasColor,
                     bool saveTimestamps = true);
+    void initialize(const QString &fname,
+                    const QString &modName,
+                    const QUuid &collectionId,
+                    const std::vector<VideoStreamFormat> &formats,
+                    bool saveTimestamps = true);
     void finalize();
     bool initialized() const;
     bool startNewSection(const QString &fname);
 
-    std::chrono::milliseconds captureStartTimestamp() const;
-    void setCaptureStartTimestamp(const std::chrono::milliseconds& startTimestamp);
+    std::chrono::microseconds captureStartTimestamp() const;
+    void setCaptureStartTimestamp(const std::chrono::microseconds& startTimestamp);
+
+    bool encodeFrame(const cv::Mat& frame, const std::chrono::microseconds& timestamp);
+    bool encodeFrame(int streamIndex, const cv::Mat& frame, const std::chrono::microseconds& timestamp);
+
+    bool recordDroppedFrame(int streamIndex, const std::chrono::microseconds& timestamp);
+    size_t droppedFrames(int streamIndex = 0) const;
 
-    bool encodeFrame(const cv::Mat& frame, const std::chrono::milliseconds& timestamp);
+    bool canReduceQuality() const;
+    int qualityReduction() const;
+    bool setQualityReduction(int level);
 
     CodecProperties codecProps() const;
     void setCodec(VideoCodec codec);
@@ -177,9 +219,10 @@ public:
     VideoContainer container() const;
     void setContainer(VideoContainer container);
 
-    int width() const;
-    int height() const;
-    int fps() const;
+    int streamCount() const;
+    int width(int streamIndex = 0) const;
+    int height(int streamIndex = 0) const;
+    int fps(int streamIndex = 0) const;
 
     uint fileSliceInterval() const;
     void setFileSliceInterval(uint minutes);
@@ -188,13 +231,16 @@ public:
 
 private:
     class Private;
+    class EncStream;
     std::unique_ptr<Private> d;
     Q_DISABLE_COPY(VideoWriter)
 
-    void initializeHWAccell();
+    void initializeHWAccell(EncStream *es);
     void initializeInternal();
+    void initializeStreamInternal(EncStream *es);
     void finalizeInternal(bool writeTrailer);
-    bool prepareFrame(const cv::Mat &inImage);
+    bool prepareFrame(EncStream *es, const cv::Mat &inImage);
+    void applyQualityReduction(EncStream *es);
 };
 
 #endif // VIDEOWRITER_H
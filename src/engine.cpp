@@ -27,6 +27,7 @@
 #include <QStandardPaths>
 #include <QThread>
 #include <QVector>
+#include <QEventLoop>
 #include <QTemporaryDir>
 #include <QTimer>
 #include <QDBusInterface>
@@ -38,6 +39,9 @@
 #include "edlstorage.h"
 #include "modulelibrary.h"
 #include "moduleeventthread.h"
+#include "moduleeventpool.h"
+#include "enginetelemetry.h"
+#include "sytrace.h"
 #include "globalconfig.h"
 #include "sysinfo.h"
 #include "meminfo.h"
@@ -98,8 +102,10 @@ public:
     QString runFailedReason;
 
     bool saveInternal;
+    bool recordTraces;
     std::shared_ptr<EDLGroup> edlInternalData;
     QHash<QString, std::shared_ptr<TimeSyncFileWriter>> internalTSyncWriters;
+    std::unique_ptr<EngineTelemetry> telemetry;
 };
 #pragma GCC diagnostic pop
 
@@ -108,6 +114,7 @@ Engine::Engine(QWidget *parentWidget)
       d(new Engine::Private)
 {
     d->saveInternal = false;
+    d->recordTraces = false;
     d->gconf = new GlobalConfig(this);
     d->sysInfo = new SysInfo(this);
     d->exportDirIsValid = false;
@@ -369,6 +376,16 @@ void Engine::setSaveInternalDiagnostics(bool save)
     d->saveInternal = save;
 }
 
+bool Engine::recordEventTraces() const
+{
+    return d->recordTraces;
+}
+
+void Engine::setRecordEventTraces(bool enabled)
+{
+    d->recordTraces = enabled;
+}
+
 int Engine::obtainSleepShutdownIdleInhibitor()
 {
     QDBusInterface iface(QStringLiteral("org.freedesktop.login1"),
@@ -758,6 +775,132 @@ bool Engine::runEphemeral()
     return ret;
 }
 
+/**
+ * @brief Prepare all modules for a run
+ * @return true if all modules were prepared successfully
+ *
+ * Modules are prepared in waves: A module is only prepared once all modules it receives
+ * data from have been prepared, as it may need their stream metadata.
+ * Within a wave, modules which have the PREPARE_CONCURRENT feature are prepared in
+ * worker threads, while all other modules are prepared in the main thread.
+ */
+bool Engine::prepareModules(const QList<AbstractModule *> &orderedActiveModules)
+{
+    QList<AbstractModule*> pendingMods = orderedActiveModules;
+    QHash<AbstractModule*, milliseconds_t> prepareTimes;
+    const auto prepareStartTp = currentTimePoint();
+    bool success = true;
+
+    while (!pendingMods.isEmpty()) {
+        // select all modules that do not wait for upstream modules anymore
+        QList<AbstractModule*> waveMods;
+        for (const auto &mod : pendingMods) {
+            bool upstreamPending = false;
+            for (const auto &iport : mod->inPorts()) {
+                if (!iport->hasSubscription())
+                    continue;
+                const auto upstreamMod = iport->outPort()->owner();
+                if ((upstreamMod != mod) && pendingMods.contains(upstreamMod)) {
+                    upstreamPending = true;
+                    break;
+                }
+            }
+            if (!upstreamPending)
+                waveMods.append(mod);
+        }
+
+        // there is a cycle in the module graph, so we just continue in execution order
+        if (waveMods.isEmpty())
+            waveMods.append(pendingMods.first());
+        for (const auto &mod : waveMods)
+            pendingMods.removeOne(mod);
+
+        QStringList waveModNames;
+        for (const auto &mod : waveMods)
+            waveModNames.append(QStringLiteral("'%1'").arg(mod->name()));
+        emitStatusMessage(QStringLiteral("Preparing %1...").arg(waveModNames.join(QStringLiteral(", "))));
+
+        // results are written by index, so worker threads never touch the same element
+        struct PrepareResult {
+            bool ok;
+            milliseconds_t duration;
+        };
+        std::vector<PrepareResult> results(waveMods.size(), PrepareResult{false, milliseconds_t(0)});
+        const auto prepareModule = [&](int index) {
+            SY_TRACE_SPAN("prepare", traceIntern(waveMods.at(index)->name()));
+            const auto startTp = currentTimePoint();
+            results[index].ok = waveMods.at(index)->prepare(d->testSubject);
+            results[index].duration = timeDiffToNowMsec(startTp);
+        };
+
+        // launch concurrent preparations first, so they can do their work while
+        // the main thread is busy with the remaining modules
+        QEventLoop waitLoop;
+        int threadsRemaining = 0;
+        std::vector<std::thread> prepareThreads;
+        for (int i = 0; i < waveMods.size(); i++) {
+            if (!waveMods.at(i)->features().testFlag(ModuleFeature::PREPARE_CONCURRENT))
+                continue;
+            threadsRemaining++;
+            prepareThreads.emplace_back([&, i]() {
+                prepareModule(i);
+                QMetaObject::invokeMethod(this, [&]() {
+                    threadsRemaining--;
+                    if (threadsRemaining == 0)
+                        waitLoop.quit();
+                }, Qt::QueuedConnection);
+            });
+        }
+
+        for (int i = 0; i < waveMods.size(); i++) {
+            if (waveMods.at(i)->features().testFlag(ModuleFeature::PREPARE_CONCURRENT))
+                continue;
+            prepareModule(i);
+        }
+
+        // wait for the worker threads, while serving their requests to run code in the main thread
+        if (threadsRemaining > 0)
+            waitLoop.exec();
+        for (auto &thread : prepareThreads)
+            thread.join();
+
+        for (int i = 0; i < waveMods.size(); i++) {
+            const auto mod = waveMods.at(i);
+            prepareTimes[mod] = results[i].duration;
+            qCDebug(logEngine).noquote().nospace() << "Module '" << mod->name() << "' prepared in "
+                                                   << results[i].duration.count() << "msec"
+                                                   << (mod->features().testFlag(ModuleFeature::PREPARE_CONCURRENT)? " (concurrently)" : "");
+
+            if (!results[i].ok) {
+                // only report the first failure in execution order
+                if (success) {
+                    d->failed = true;
+                    d->runFailedReason = QStringLiteral("Prepare step failed for: %1(%2)").arg(mod->id()).arg(mod->name());
+                    emitStatusMessage(QStringLiteral("Module '%1' failed to prepare.").arg(mod->name()));
+                }
+                success = false;
+                continue;
+            }
+
+            // if the module hasn't set itself to ready yet, assume it is idle
+            if (mod->state() != ModuleState::READY)
+                mod->setState(ModuleState::IDLE);
+        }
+
+        if (!success)
+            return false;
+    }
+
+    milliseconds_t prepareTimeSum(0);
+    for (const auto &duration : prepareTimes)
+        prepareTimeSum += duration;
+    qCDebug(logEngine).noquote().nospace() << "Prepared " << prepareTimes.size() << " modules in "
+                                           << timeDiffToNowMsec(prepareStartTp).count() << "msec "
+                                           << "(" << prepareTimeSum.count() << "msec of module preparation time)";
+
+    return success;
+}
+
 /**
  * @brief Actually run an experiment module board
  * @return true on succees
@@ -817,8 +960,8 @@ bool Engine::runInternal(const QString &exportDirPath)
                                                                        .arg(QDateTime::currentDateTime().toString("yy-MM-dd+hh.mm"))));
     storageCollection->setPath(exportDirPath);
 
-    // if we should save internal diagnostic data, create a group for it!
-    if (d->saveInternal) {
+    // if we should save internal diagnostic data or traces, create a group for it!
+    if (d->saveInternal || d->recordTraces) {
         d->edlInternalData = std::make_shared<EDLGroup>();
         d->edlInternalData->setName("syntalos_internal");
         storageCollection->addChild(d->edlInternalData);
@@ -832,6 +975,11 @@ bool Engine::runInternal(const QString &exportDirPath)
     // create a new master timer for synchronization
     d->timer.reset(new SyncTimer);
 
+    // record performance telemetry alongside the internal data
+    d->telemetry.reset();
+    if (d->saveInternal)
+        d->telemetry.reset(new EngineTelemetry(d->timer));
+
     auto lastPhaseTimepoint = currentTimePoint();
     // assume success until a module actually fails
     bool initSuccessful = true;
@@ -876,6 +1024,11 @@ bool Engine::runInternal(const QString &exportDirPath)
     QHash<QString, QList<AbstractModule*>> eventModules;
     QHash<QString, std::shared_ptr<ModuleEventThread>> evThreads;
 
+    // alternatively, a work-stealing pool running all evented modules, and the CPU cores it may use
+    const auto useEventsPool = d->gconf->eventsWorkStealingPool();
+    std::unique_ptr<ModuleEventPool> evPool;
+    std::vector<uint> evPoolCPUs;
+
     // out-of-process modules need a thread to handle communication in the master application, so
     // we provide one here (and possibly more in future in case this doesn't scale well).
     QList<OOPModule*> oopModules;
@@ -904,13 +1057,16 @@ bool Engine::runInternal(const QString &exportDirPath)
 
     QCoreApplication::processEvents();
 
-    // prepare modules
-    for (auto &mod : orderedActiveModules) {
-        // Prepare module. At this point it should have a timer,
-        // the location where data is saved and be in the PREPARING state.
-        emitStatusMessage(QStringLiteral("Preparing '%1'...").arg(mod->name()));
-        lastPhaseTimepoint = currentTimePoint();
+    // start recording event traces from a clean state
+    if (d->recordTraces) {
+        traceReset();
+        traceSetEnabled(true);
+        qCDebug(logEngine).noquote().nospace() << "Recording event traces";
+    }
 
+    // set up modules for preparation. This touches module states and the storage collection,
+    // so we do it for all modules in the main thread before any module is prepared.
+    for (auto &mod : orderedActiveModules) {
         const auto modInfo = d->modLibrary->moduleInfo(mod->id());
 
         mod->setStatusMessage(QString());
@@ -929,21 +1085,12 @@ bool Engine::runInternal(const QString &exportDirPath)
         } else {
             mod->setStorageGroup(storageCollection);
         }
-
-        if (!mod->prepare(d->testSubject)) {
-            initSuccessful = false;
-            d->failed = true;
-            d->runFailedReason = QStringLiteral("Prepare step failed for: %1(%2)").arg(mod->id()).arg(mod->name());
-            emitStatusMessage(QStringLiteral("Module '%1' failed to prepare.").arg(mod->name()));
-            break;
-        }
-        // if the module hasn't set itself to ready yet, assume it is idle
-        if (mod->state() != ModuleState::READY)
-            mod->setState(ModuleState::IDLE);
-
-        qCDebug(logEngine).noquote().nospace() << "Module '" << mod->name() << "' prepared in " << timeDiffToNowMsec(lastPhaseTimepoint).count() << "msec";
     }
 
+    // prepare modules. At this point they all have a timer,
+    // the location where data is saved and are in the PREPARING state.
+    initSuccessful = prepareModules(orderedActiveModules);
+
     // wait condition for all threads to block them until we have actually started (or not block them, in case
     // the thread was really slow to initialize and we are already running)
     std::unique_ptr<OptionalWaitCondition> startWaitCondition(new OptionalWaitCondition());
@@ -977,6 +1124,10 @@ bool Engine::runInternal(const QString &exportDirPath)
                         availableCores--;
                     }
                 }
+
+                // the cores nobody claimed may be used by the event pool
+                for (uint i = availableCores; i > 0; i--)
+                    evPoolCPUs.push_back(i);
             } else {
                 // we don't have enough cores - in this case, prefer modules which requested to be run on a dedicated core
                 // OOP modules will get their own core if at all possible in a sensible way
@@ -1052,7 +1203,9 @@ bool Engine::runInternal(const QString &exportDirPath)
             }
 
             // the thread name shouldn't be longer than 16 chars (inlcuding NULL)
-            td.name = QStringLiteral("%1-%2").arg(mod->id().midRef(0, 12)).arg(i);
+            td.name = shortThreadName(mod->id(), i);
+            if (d->telemetry)
+                d->telemetry->addThread(td.name, mod->name());
             dThreads.push_back(std::thread(executeModuleThread,
                                            td,
                                            mod,
@@ -1111,6 +1264,8 @@ bool Engine::runInternal(const QString &exportDirPath)
             td.niceness = defaultThreadNice;
             td.allowedRTPriority = defaultRTPriority;
             td.name = QStringLiteral("oopc:shared");
+            if (d->telemetry)
+                d->telemetry->addThread(td.name, QStringLiteral("oop-relay"));
 
             if (modCPUMap.contains(oopModules[0])) {
                 td.cpuAffinity = modCPUMap[oopModules[0]];
@@ -1128,11 +1283,35 @@ bool Engine::runInternal(const QString &exportDirPath)
                                              std::ref(d->running)));
         }
 
+        // run all evented modules on a shared work-stealing pool, if requested
+        if (useEventsPool && !eventModules.isEmpty()) {
+            QList<AbstractModule*> poolModules;
+            for (auto &mod : orderedActiveModules) {
+                if ((mod->driver() == ModuleDriverKind::EVENTS_SHARED) ||
+                    (mod->driver() == ModuleDriverKind::EVENTS_DEDICATED))
+                    poolModules.append(mod);
+            }
+            eventModules.clear();
+
+            evPool.reset(new ModuleEventPool(std::max(potentialNoaffinityCPUCount, 1u), evPoolCPUs));
+            evPool->run(poolModules, startWaitCondition.get());
+            if (d->telemetry) {
+                for (const auto &threadName : evPool->threadNames())
+                    d->telemetry->addThread(threadName, QStringLiteral("events-pool"));
+            }
+            qCDebug(logEngine).noquote().nospace() << "Started event pool with " << evPool->threadNames().length() - 1
+                                                   << " workers for " << poolModules.length() << " participating modules";
+        }
+
         // run special threads with built-in event loops for modules that selected an event-based driver
+        int evThreadIdx = 0;
         for (const auto &evThreadKey : eventModules.keys()) {
-            std::shared_ptr<ModuleEventThread> evThread(new ModuleEventThread(evThreadKey));
+            const auto evThreadName = shortThreadName(QStringLiteral("ev:%1").arg(evThreadKey), evThreadIdx++);
+            std::shared_ptr<ModuleEventThread> evThread(new ModuleEventThread(evThreadName));
             evThread->run(eventModules[evThreadKey], startWaitCondition.get());
             evThreads[evThreadKey] = evThread;
+            if (d->telemetry)
+                d->telemetry->addThread(evThread->threadName(), QStringLiteral("events-%1").arg(evThreadKey));
             qCDebug(logEngine).noquote().nospace() << "Started event thread '" << evThreadKey << "' with " << eventModules[evThreadKey].length() << " participating modules";
         }
 
@@ -1229,6 +1408,8 @@ bool Engine::runInternal(const QString &exportDirPath)
                 if (!port->hasSubscription())
                     continue;
                 monitoredSubscriptions.push_back(port->subscriptionVar());
+                if (d->telemetry)
+                    d->telemetry->addSubscription(port->subscriptionVar(), QStringLiteral("%1/%2").arg(mod->name(), port->id()));
             }
         }
         bool subBufferWarningEmitted = false;
@@ -1258,6 +1439,14 @@ bool Engine::runInternal(const QString &exportDirPath)
         d->timer->start();
         d->running = true;
 
+        // sample telemetry as soon as we are running, all engine threads exist at this point
+        if (d->telemetry) {
+            for (auto &mod : oopModules)
+                d->telemetry->addProcess(mod->workerPid(), QStringLiteral("%1-worker").arg(mod->name()));
+            if (!d->telemetry->start(d->edlInternalData))
+                qCWarning(logEngine).noquote() << "Unable to record engine telemetry:" << d->telemetry->lastError();
+        }
+
         // first, launch all threaded and evented modules
         for (auto& mod : orderedActiveModules) {
             if ((mod->driver() != ModuleDriverKind::THREAD_DEDICATED) &&
@@ -1345,6 +1534,10 @@ bool Engine::runInternal(const QString &exportDirPath)
         emitStatusMessage(QStringLiteral("Waiting for event thread `%1`...").arg(evThread->threadName()));
         evThread->stop();
     }
+    if (evPool) {
+        emitStatusMessage(QStringLiteral("Waiting for event pool..."));
+        evPool->stop();
+    }
     qCDebug(logEngine).noquote().nospace() << "Waited " << timeDiffToNowMsec(lastPhaseTimepoint).count() << "msec for event threads to stop.";
 
     // send stop command to all modules
@@ -1424,8 +1617,20 @@ bool Engine::runInternal(const QString &exportDirPath)
     qCDebug(logEngine).noquote().nospace() << "All (non-event) engine threads joined in " << timeDiffToNowMsec(lastPhaseTimepoint).count() << "msec";
     lastPhaseTimepoint = d->timer->currentTimePoint();
 
+    if (d->recordTraces) {
+        traceSetEnabled(false);
+        emitStatusMessage(QStringLiteral("Writing event trace..."));
+        auto traceDSet = d->edlInternalData->datasetByName(QStringLiteral("event-trace"), true);
+        QString traceError;
+        if (!traceExportChromeJson(traceDSet->setDataFile(QStringLiteral("trace.json")), d->timer->startTime(), &traceError))
+            qCWarning(logEngine).noquote() << "Unable to write event trace:" << traceError;
+    }
+
     if (d->saveInternal) {
         emitStatusMessage(QStringLiteral("Finalizing internal dataset..."));
+        if (d->telemetry)
+            d->telemetry->stop();
+        d->telemetry.reset();
         for (auto &tsw : d->internalTSyncWriters.values())
             tsw->close();
     }
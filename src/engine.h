@@ -85,6 +85,9 @@ public:
     bool saveInternalDiagnostics() const;
     void setSaveInternalDiagnostics(bool save);
 
+    bool recordEventTraces() const;
+    void setRecordEventTraces(bool enabled);
+
 public slots:
     /**
      * @brief Run the current board, save all data
@@ -127,6 +130,7 @@ private:
 
     int obtainSleepShutdownIdleInhibitor();
     bool makeDirectory(const QString &dir);
+    bool prepareModules(const QList<AbstractModule*> &orderedActiveModules);
     bool runInternal(const QString &exportDirPath);
     void refreshExportDirPath();
     void emitStatusMessage(const QString &message);
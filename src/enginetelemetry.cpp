@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "enginetelemetry.h"
+
+#include <QFile>
+#include <QDir>
+#include <QDataStream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "streams/stream.h"
+
+namespace Syntalos {
+    Q_LOGGING_CATEGORY(logTelemetry, "engine.telemetry")
+}
+
+using namespace Syntalos;
+
+static const char TELEMETRY_FILE_MAGIC[8] = {'S', 'Y', 'T', 'L', 'M', 'T', 'R', 'Y'};
+static const quint16 TELEMETRY_FORMAT_VERSION = 1;
+
+// interval between samples - this is a tradeoff between resolution and the
+// amount of procfs reads we do while a run is active
+static const milliseconds_t TELEMETRY_SAMPLE_INTERVAL = milliseconds_t(250);
+
+// flush the data file to disk every N samples
+static const int TELEMETRY_FLUSH_SAMPLES = 20;
+
+/**
+ * Read a small procfs file into @buf, and ensure its contents are NUL-terminated.
+ */
+static bool readProcFile(const QByteArray &path, char *buf, size_t bufLen)
+{
+    const int fd = open(path.constData(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    const auto len = read(fd, buf, bufLen - 1);
+    close(fd);
+    if (len <= 0)
+        return false;
+    buf[len] = '\0';
+    return true;
+}
+
+/**
+ * Read the CPU time (user + system, in clock ticks) from a procfs stat file.
+ */
+static bool readStatCpuTicks(const QByteArray &path, unsigned long long &ticks)
+{
+    char buf[1024];
+    if (!readProcFile(path, buf, sizeof(buf)))
+        return false;
+
+    // the command name may contain spaces, so we start parsing after its closing bracket
+    const char *fields = strrchr(buf, ')');
+    if (fields == nullptr)
+        return false;
+    unsigned long long utime, stime;
+    if (sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+        return false;
+    ticks = utime + stime;
+    return true;
+}
+
+/**
+ * Find a "key: value" line in a procfs file and return its value.
+ * @key must contain the leading newline, so we don't accidentally match suffixes
+ * of other keys.
+ */
+static long long findProcValue(const char *buf, const char *key)
+{
+    const char *hit = strstr(buf, key);
+    if (hit == nullptr)
+        return -1;
+    return strtoll(hit + strlen(key), nullptr, 10);
+}
+
+/**
+ * Read the resident set size of a process in bytes.
+ */
+static long long readProcessRss(const QByteArray &statmPath)
+{
+    char buf[256];
+    if (!readProcFile(statmPath, buf, sizeof(buf)))
+        return -1;
+    unsigned long long residentPages;
+    if (sscanf(buf, "%*u %llu", &residentPages) != 1)
+        return -1;
+    return residentPages * sysconf(_SC_PAGESIZE);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+class TelemetryThread
+{
+public:
+    QString name;
+    QString label;
+    std::vector<pid_t> tids;
+
+    unsigned long long lastTicks = 0;
+    long long lastCtxSwVoluntary = 0;
+    long long lastCtxSwInvoluntary = 0;
+};
+
+class TelemetryProcess
+{
+public:
+    qint64 pid = 0;
+    QString label;
+    unsigned long long lastTicks = 0;
+};
+
+class TelemetrySubscription
+{
+public:
+    std::shared_ptr<VariantStreamSubscription> sub;
+    QString label;
+    size_t lastCount = 0;
+};
+
+class EngineTelemetry::Private
+{
+public:
+    Private() { }
+    ~Private() { }
+
+    QString lastError;
+    std::shared_ptr<SyncTimer> timer;
+    double clockTicksPerSec;
+
+    std::vector<TelemetryThread> threads;
+    std::vector<TelemetryProcess> processes;
+    std::vector<TelemetrySubscription> subscriptions;
+    long long lastWriteBytes;
+
+    QStringList columnNames;
+    QStringList columnUnits;
+
+    QFile *file;
+    QDataStream stream;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cond;
+    bool running;
+
+    void collect(float *values, double intervalSec);
+};
+#pragma GCC diagnostic pop
+
+EngineTelemetry::EngineTelemetry(std::shared_ptr<SyncTimer> timer)
+    : d(new EngineTelemetry::Private)
+{
+    d->timer = timer;
+    d->clockTicksPerSec = sysconf(_SC_CLK_TCK);
+    d->lastWriteBytes = 0;
+    d->file = new QFile;
+    d->running = false;
+
+    // the main thread's ID is our PID
+    TelemetryThread mainThread;
+    mainThread.label = QStringLiteral("main");
+    mainThread.tids.push_back(getpid());
+    d->threads.push_back(mainThread);
+}
+
+EngineTelemetry::~EngineTelemetry()
+{
+    stop();
+    delete d->file;
+}
+
+QString EngineTelemetry::lastError() const
+{
+    return d->lastError;
+}
+
+/**
+ * Add a thread to be monitored, identified by the name it sets for itself.
+ * If multiple threads have the same name, their values are accumulated.
+ */
+void EngineTelemetry::addThread(const QString &threadName, const QString &label)
+{
+    TelemetryThread thread;
+    // thread names are limited to 15 characters by the kernel
+    thread.name = threadName.mid(0, 15);
+    thread.label = label;
+    d->threads.push_back(thread);
+}
+
+/**
+ * Add an external process, such as an out-of-process worker, to be monitored.
+ */
+void EngineTelemetry::addProcess(qint64 pid, const QString &label)
+{
+    if (pid <= 0)
+        return;
+    TelemetryProcess proc;
+    proc.pid = pid;
+    proc.label = label;
+    d->processes.push_back(proc);
+}
+
+void EngineTelemetry::addSubscription(std::shared_ptr<VariantStreamSubscription> sub, const QString &label)
+{
+    TelemetrySubscription tsub;
+    tsub.sub = sub;
+    tsub.label = label;
+    d->subscriptions.push_back(tsub);
+}
+
+void EngineTelemetry::Private::collect(float *values, double intervalSec)
+{
+    int col = 0;
+    const auto perSec = [&](double delta) -> float {
+        return (intervalSec > 0)? delta / intervalSec : 0;
+    };
+
+    for (auto &thread : threads) {
+        unsigned long long ticks = 0;
+        long long ctxSwVol = 0;
+        long long ctxSwInvol = 0;
+        for (const auto &tid : thread.tids) {
+            unsigned long long tticks;
+            if (readStatCpuTicks(QByteArrayLiteral("/proc/self/task/") + QByteArray::number(tid) + QByteArrayLiteral("/stat"), tticks))
+                ticks += tticks;
+
+            char buf[4096];
+            if (!readProcFile(QByteArrayLiteral("/proc/self/task/") + QByteArray::number(tid) + QByteArrayLiteral("/status"), buf, sizeof(buf)))
+                continue;
+            ctxSwVol += std::max(findProcValue(buf, "\nvoluntary_ctxt_switches:"), 0LL);
+            ctxSwInvol += std::max(findProcValue(buf, "\nnonvoluntary_ctxt_switches:"), 0LL);
+        }
+
+        // threads which have exited already simply stop contributing
+        values[col++] = (ticks >= thread.lastTicks)? perSec((ticks - thread.lastTicks) / clockTicksPerSec) * 100 : 0;
+        values[col++] = perSec(std::max(ctxSwVol - thread.lastCtxSwVoluntary, 0LL));
+        values[col++] = perSec(std::max(ctxSwInvol - thread.lastCtxSwInvoluntary, 0LL));
+        thread.lastTicks = ticks;
+        thread.lastCtxSwVoluntary = ctxSwVol;
+        thread.lastCtxSwInvoluntary = ctxSwInvol;
+    }
+
+    for (auto &proc : processes) {
+        const auto procDir = QByteArrayLiteral("/proc/") + QByteArray::number(proc.pid);
+        unsigned long long ticks = 0;
+        if (!readStatCpuTicks(procDir + QByteArrayLiteral("/stat"), ticks))
+            ticks = proc.lastTicks;
+        const auto rss = readProcessRss(procDir + QByteArrayLiteral("/statm"));
+
+        values[col++] = (ticks >= proc.lastTicks)? perSec((ticks - proc.lastTicks) / clockTicksPerSec) * 100 : 0;
+        values[col++] = (rss > 0)? rss / 1024.0 / 1024.0 : 0;
+        proc.lastTicks = ticks;
+    }
+
+    for (auto &tsub : subscriptions) {
+        const auto count = tsub.sub->enqueuedCount();
+        values[col++] = tsub.sub->approxPendingCount();
+        values[col++] = (count >= tsub.lastCount)? perSec(count - tsub.lastCount) : 0;
+        tsub.lastCount = count;
+    }
+
+    const auto rss = readProcessRss(QByteArrayLiteral("/proc/self/statm"));
+    values[col++] = (rss > 0)? rss / 1024.0 / 1024.0 : 0;
+
+    char ioBuf[512];
+    // prepend a newline, so the first key can be found like all others
+    ioBuf[0] = '\n';
+    long long writeBytes = lastWriteBytes;
+    if (readProcFile(QByteArrayLiteral("/proc/self/io"), ioBuf + 1, sizeof(ioBuf) - 1))
+        writeBytes = std::max(findProcValue(ioBuf, "\nwrite_bytes:"), lastWriteBytes);
+    values[col++] = perSec((writeBytes - lastWriteBytes) / 1024.0 / 1024.0);
+    lastWriteBytes = writeBytes;
+
+    assert(col == columnNames.size());
+}
+
+/**
+ * Start sampling, writing all data into a new dataset in @group.
+ * Must be called after all threads which should be monitored have been launched
+ * and named, as we resolve the thread IDs here.
+ */
+bool EngineTelemetry::start(std::shared_ptr<EDLGroup> group)
+{
+    if (d->running)
+        return true;
+
+    // find the IDs of all threads we are interested in
+    QDir taskDir(QStringLiteral("/proc/self/task"));
+    for (const auto &tidStr : taskDir.entryList(QDir::Dirs | QDir::NoDotAndDotDot)) {
+        QFile commFile(QStringLiteral("/proc/self/task/%1/comm").arg(tidStr));
+        if (!commFile.open(QFile::ReadOnly))
+            continue;
+        const auto comm = QString::fromUtf8(commFile.readAll()).trimmed();
+        for (auto &thread : d->threads) {
+            if (!thread.name.isEmpty() && thread.name == comm)
+                thread.tids.push_back(tidStr.toInt());
+        }
+    }
+
+    d->columnNames.clear();
+    d->columnUnits.clear();
+    const auto addColumn = [&](const QString &name, const QString &unit) {
+        d->columnNames.append(name);
+        d->columnUnits.append(unit);
+    };
+    for (const auto &thread : d->threads) {
+        if (thread.tids.empty())
+            qCWarning(logTelemetry).noquote() << "Could not find thread" << thread.name << "for" << thread.label;
+        addColumn(QStringLiteral("thread:%1:cpu").arg(thread.label), QStringLiteral("%"));
+        addColumn(QStringLiteral("thread:%1:ctxsw-voluntary").arg(thread.label), QStringLiteral("1/s"));
+        addColumn(QStringLiteral("thread:%1:ctxsw-involuntary").arg(thread.label), QStringLiteral("1/s"));
+    }
+    for (const auto &proc : d->processes) {
+        addColumn(QStringLiteral("process:%1:cpu").arg(proc.label), QStringLiteral("%"));
+        addColumn(QStringLiteral("process:%1:rss").arg(proc.label), QStringLiteral("MiB"));
+    }
+    for (const auto &tsub : d->subscriptions) {
+        addColumn(QStringLiteral("subscription:%1:queue-depth").arg(tsub.label), QStringLiteral("items"));
+        addColumn(QStringLiteral("subscription:%1:throughput").arg(tsub.label), QStringLiteral("items/s"));
+    }
+    addColumn(QStringLiteral("syntalos:rss"), QStringLiteral("MiB"));
+    addColumn(QStringLiteral("syntalos:disk-write"), QStringLiteral("MiB/s"));
+
+    auto dset = group->datasetByName(QStringLiteral("engine-telemetry"), true);
+    if (dset.get() == nullptr) {
+        d->lastError = QStringLiteral("Unable to create telemetry dataset.");
+        return false;
+    }
+    QHash<QString, QVariant> attrs;
+    attrs.insert(QStringLiteral("sample_interval_us"), QVariant::fromValue(microseconds_t(TELEMETRY_SAMPLE_INTERVAL).count()));
+    attrs.insert(QStringLiteral("columns"), d->columnNames);
+    attrs.insert(QStringLiteral("units"), d->columnUnits);
+    dset->setAttributes(attrs);
+
+    d->file->setFileName(dset->setDataFile(QStringLiteral("telemetry.bin")));
+    if (!d->file->open(QFile::WriteOnly | QFile::Truncate)) {
+        d->lastError = QStringLiteral("Unable to open telemetry file for writing: %1").arg(d->file->errorString());
+        return false;
+    }
+
+    d->stream.setDevice(d->file);
+    d->stream.setVersion(QDataStream::Qt_5_12);
+    d->stream.setByteOrder(QDataStream::LittleEndian);
+    d->stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+
+    d->stream.writeRawData(TELEMETRY_FILE_MAGIC, sizeof(TELEMETRY_FILE_MAGIC));
+    d->stream << TELEMETRY_FORMAT_VERSION;
+    d->stream << (quint32) microseconds_t(TELEMETRY_SAMPLE_INTERVAL).count();
+    d->stream << (quint32) d->columnNames.size();
+    for (int i = 0; i < d->columnNames.size(); i++)
+        d->stream << d->columnNames[i] << d->columnUnits[i];
+
+    d->running = true;
+    d->thread = std::thread(&EngineTelemetry::samplerThreadFunc, this);
+    return true;
+}
+
+void EngineTelemetry::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(d->mutex);
+        if (!d->running)
+            return;
+        d->running = false;
+    }
+    d->cond.notify_all();
+    if (d->thread.joinable())
+        d->thread.join();
+
+    d->file->flush();
+    d->file->close();
+}
+
+void EngineTelemetry::samplerThreadFunc()
+{
+    pthread_setname_np(pthread_self(), "telemetry");
+
+    std::vector<float> values(d->columnNames.size());
+
+    // establish baselines for all counters
+    d->collect(values.data(), 0);
+    auto lastTp = currentTimePoint();
+
+    int samplesSinceFlush = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(d->mutex);
+            if (d->cond.wait_for(lock, TELEMETRY_SAMPLE_INTERVAL, [&]() { return !d->running; }))
+                break;
+        }
+
+        const auto timestamp = d->timer->timeSinceStartUsec();
+        const auto nowTp = currentTimePoint();
+        d->collect(values.data(), timeDiffUsec(nowTp, lastTp).count() / 1000000.0);
+        lastTp = nowTp;
+
+        d->stream << (qint64) timestamp.count();
+        for (const auto &value : values)
+            d->stream << value;
+
+        if (++samplesSinceFlush >= TELEMETRY_FLUSH_SAMPLES) {
+            d->file->flush();
+            samplesSinceFlush = 0;
+        }
+    }
+}
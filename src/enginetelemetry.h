@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <memory>
+#include <QString>
+#include <QScopedPointer>
+#include <QLoggingCategory>
+
+#include "syclock.h"
+#include "edlstorage.h"
+
+class VariantStreamSubscription;
+
+namespace Syntalos {
+
+Q_DECLARE_LOGGING_CATEGORY(logTelemetry)
+
+/**
+ * @brief Records performance telemetry of a running board
+ *
+ * While a run is active, this samples the CPU time and context switches of all
+ * engine-managed threads, the CPU time and memory of out-of-process workers, the queue
+ * depth and throughput of all stream subscriptions as well as our own memory usage and
+ * disk write throughput at a fixed rate in a background thread.
+ * All samples are written into a compact binary time series in the internal data group,
+ * so resource saturation can be examined after a run.
+ *
+ * The data file is a little-endian binary file starting with a header:
+ *  - the magic bytes "SYTLMTRY"
+ *  - u16 format version
+ *  - u32 sampling interval in µs
+ *  - u32 column count, followed by the name and unit of each column as QDataStream strings
+ *
+ * The header is followed by one fixed-size record per sample: an i64 master
+ * clock timestamp in µs, then one float32 value per column.
+ */
+class EngineTelemetry
+{
+public:
+    explicit EngineTelemetry(std::shared_ptr<SyncTimer> timer);
+    ~EngineTelemetry();
+
+    QString lastError() const;
+
+    void addThread(const QString &threadName, const QString &label);
+    void addProcess(qint64 pid, const QString &label);
+    void addSubscription(std::shared_ptr<VariantStreamSubscription> sub, const QString &label);
+
+    bool start(std::shared_ptr<EDLGroup> group);
+    void stop();
+
+private:
+    class Private;
+    Q_DISABLE_COPY(EngineTelemetry)
+    QScopedPointer<Private> d;
+
+    void samplerThreadFunc();
+};
+
+} // end of namespace
@@ -106,6 +106,26 @@ void GlobalConfig::setExplicitCoreAffinities(bool enabled)
     m_s->setValue("engine/explicit_core_affinities", enabled);
 }
 
+bool GlobalConfig::eventsWorkStealingPool() const
+{
+    return m_s->value("engine/events_work_stealing_pool", false).toBool();
+}
+
+void GlobalConfig::setEventsWorkStealingPool(bool enabled)
+{
+    m_s->setValue("engine/events_work_stealing_pool", enabled);
+}
+
+bool GlobalConfig::persistentOOPWorkers() const
+{
+    return m_s->value("engine/persistent_oop_workers", true).toBool();
+}
+
+void GlobalConfig::setPersistentOOPWorkers(bool enabled)
+{
+    m_s->setValue("engine/persistent_oop_workers", enabled);
+}
+
 bool GlobalConfig::showDevelModules() const
 {
     return m_s->value("devel/show_devel_modules", false).toBool();
@@ -126,6 +146,16 @@ void GlobalConfig::setSaveExperimentDiagnostics(bool enabled)
     m_s->setValue("devel/save_diagnostics", enabled);
 }
 
+bool GlobalConfig::recordEventTraces() const
+{
+    return m_s->value("devel/record_traces", false).toBool();
+}
+
+void GlobalConfig::setRecordEventTraces(bool enabled)
+{
+    m_s->setValue("devel/record_traces", enabled);
+}
+
 QString GlobalConfig::virtualenvDir() const
 {
     const auto dataDir = QStandardPaths::writableLocation(QStandardPaths::DataLocation);
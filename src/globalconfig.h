@@ -47,12 +47,21 @@ public:
     bool explicitCoreAffinities() const;
     void setExplicitCoreAffinities(bool enabled);
 
+    bool eventsWorkStealingPool() const;
+    void setEventsWorkStealingPool(bool enabled);
+
+    bool persistentOOPWorkers() const;
+    void setPersistentOOPWorkers(bool enabled);
+
     bool showDevelModules() const;
     void setShowDevelModules(bool enabled);
 
     bool saveExperimentDiagnostics() const;
     void setSaveExperimentDiagnostics(bool enabled);
 
+    bool recordEventTraces() const;
+    void setRecordEventTraces(bool enabled);
+
     QString virtualenvDir() const;
 
 private:
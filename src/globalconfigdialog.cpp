@@ -50,10 +50,13 @@ GlobalConfigDialog::GlobalConfigDialog(QWidget *parent) :
     ui->defaultRTPrioSpinBox->setValue(m_gc->defaultRTThreadPriority());
 
     ui->explicitCoreAffinitiesCheckBox->setChecked(m_gc->explicitCoreAffinities());
+    ui->eventsPoolCheckBox->setChecked(m_gc->eventsWorkStealingPool());
+    ui->persistentWorkersCheckBox->setChecked(m_gc->persistentOOPWorkers());
 
     // devel section
     ui->cbDisplayDevModules->setChecked(m_gc->showDevelModules());
     ui->cbSaveDiagnostic->setChecked(m_gc->saveExperimentDiagnostics());
+    ui->cbRecordTraces->setChecked(m_gc->recordEventTraces());
 
     // we can accept user changes now!
     m_acceptChanges = true;
@@ -79,6 +82,16 @@ void GlobalConfigDialog::on_explicitCoreAffinitiesCheckBox_toggled(bool checked)
     if (m_acceptChanges) m_gc->setExplicitCoreAffinities(checked);
 }
 
+void GlobalConfigDialog::on_eventsPoolCheckBox_toggled(bool checked)
+{
+    if (m_acceptChanges) m_gc->setEventsWorkStealingPool(checked);
+}
+
+void GlobalConfigDialog::on_persistentWorkersCheckBox_toggled(bool checked)
+{
+    if (m_acceptChanges) m_gc->setPersistentOOPWorkers(checked);
+}
+
 void GlobalConfigDialog::on_cbDisplayDevModules_toggled(bool checked)
 {
     if (m_acceptChanges) m_gc->setShowDevelModules(checked);
@@ -88,3 +101,8 @@ void GlobalConfigDialog::on_cbSaveDiagnostic_toggled(bool checked)
 {
     if (m_acceptChanges) m_gc->setSaveExperimentDiagnostics(checked);
 }
+
+void GlobalConfigDialog::on_cbRecordTraces_toggled(bool checked)
+{
+    if (m_acceptChanges) m_gc->setRecordEventTraces(checked);
+}
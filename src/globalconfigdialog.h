@@ -40,9 +40,12 @@ private slots:
     void on_defaultNicenessSpinBox_valueChanged(int arg1);
     void on_defaultRTPrioSpinBox_valueChanged(int arg1);
     void on_explicitCoreAffinitiesCheckBox_toggled(bool checked);
+    void on_eventsPoolCheckBox_toggled(bool checked);
+    void on_persistentWorkersCheckBox_toggled(bool checked);
 
     void on_cbDisplayDevModules_toggled(bool checked);
     void on_cbSaveDiagnostic_toggled(bool checked);
+    void on_cbRecordTraces_toggled(bool checked);
 
 private:
     Ui::GlobalConfigDialog *ui;
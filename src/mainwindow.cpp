@@ -392,6 +392,7 @@ void MainWindow::runActionTriggered()
     ui->runWarnWidget->setVisible(false);
 
     m_engine->setSaveInternalDiagnostics(m_gconf->saveExperimentDiagnostics());
+    m_engine->setRecordEventTraces(m_gconf->recordEventTraces());
     m_engine->setSimpleStorageNames(ui->cbSimpleStorageNames->isChecked());
     m_engine->run();
 
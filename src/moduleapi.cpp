@@ -24,6 +24,7 @@
 #include <QDir>
 #include <QMessageBox>
 #include <QStandardPaths>
+#include <QThread>
 
 #include "utils/misc.h"
 
@@ -577,6 +578,11 @@ QList<QPair<intervalEventFunc_t, int> > AbstractModule::intervalEventCallbacks()
     return m_intervalEventCBList;
 }
 
+QList<QPair<preciseIntervalEventFunc_t, microseconds_t>> AbstractModule::preciseIntervalEventCallbacks() const
+{
+    return m_preciseIntervalEventCBList;
+}
+
 QList<QPair<recvDataEventFunc_t, std::shared_ptr<VariantStreamSubscription>>>
 AbstractModule::recvDataEventCallbacks() const
 {
@@ -735,11 +741,39 @@ std::unique_ptr<SecondaryClockSynchronizer> AbstractModule::initClockSynchronize
     return synchronizer;
 }
 
+std::unique_ptr<SecondaryClockSynchronizer> AbstractModule::initClockSynchronizer(const QString &clockDomain, double expectedFrequencyHz)
+{
+    if (clockDomain.isEmpty())
+        return initClockSynchronizer(expectedFrequencyHz);
+    if ((d->state != ModuleState::PREPARING) && (d->state != ModuleState::READY) && (d->state != ModuleState::RUNNING))
+        return nullptr;
+
+    std::unique_ptr<SecondaryClockSynchronizer> synchronizer(new SecondaryClockSynchronizer(m_syTimer,
+                                                                                            this,
+                                                                                            QString(),
+                                                                                            SecondaryClockDomain::get(m_syTimer, clockDomain)));
+    if (expectedFrequencyHz > 0)
+        synchronizer->setExpectedClockFrequencyHz(expectedFrequencyHz);
+    return synchronizer;
+}
+
 uint AbstractModule::potentialNoaffinityCPUCount() const
 {
     return d->potentialNoaffinityCPUCount;
 }
 
+void AbstractModule::runInMainThread(const std::function<void()> &func)
+{
+    if (QThread::currentThread() == thread()) {
+        func();
+        return;
+    }
+
+    // the engine keeps processing events while waiting for concurrently
+    // preparing modules, so blocking here is safe
+    QMetaObject::invokeMethod(this, func, Qt::BlockingQueuedConnection);
+}
+
 void AbstractModule::setInitialized()
 {
     if (d->initialized)
@@ -825,6 +859,7 @@ void AbstractModule::setStorageGroup(std::shared_ptr<EDLGroup> edlGroup)
 void AbstractModule::resetEventCallbacks()
 {
     m_intervalEventCBList.clear();
+    m_preciseIntervalEventCBList.clear();
 }
 
 void AbstractModule::setPotentialNoaffinityCPUCount(uint coreN)
@@ -26,6 +26,7 @@
 #include <QAction>
 #include <QPixmap>
 #include <QDebug>
+#include <functional>
 
 #include "config.h"
 #include "syclock.h"
@@ -50,7 +51,8 @@ enum class ModuleFeature {
     CORE_AFFINITY = 1 << 3,  /// Pin the module's thread to a separate CPU core, if possible
     SHOW_SETTINGS = 1 << 4,  /// Module can display a settings window
     SHOW_DISPLAY  = 1 << 5,  /// Module has one or more display window(s) to show
-    SHOW_ACTIONS  = 1 << 6   /// Module supports context menu actions
+    SHOW_ACTIONS  = 1 << 6,  /// Module supports context menu actions
+    PREPARE_CONCURRENT = 1 << 7 /// Module's prepare() may run in a worker thread, concurrently with other modules
 };
 Q_DECLARE_FLAGS(ModuleFeatures, ModuleFeature)
 Q_DECLARE_OPERATORS_FOR_FLAGS(ModuleFeatures)
@@ -303,6 +305,20 @@ private:
 /// Event function type for timed callbacks
 using intervalEventFunc_t = void(AbstractModule::*)(int &);
 
+/**
+ * @brief Details about a single tick of a high-resolution timed event
+ */
+struct PreciseTimerTick
+{
+    /// Number of intervals that elapsed without the callback being run since the last tick
+    uint64_t missedTicks;
+    /// Time between the scheduled deadline of this tick and the callback being run
+    microseconds_t lateness;
+};
+
+/// Event function type for high-resolution timed callbacks
+using preciseIntervalEventFunc_t = void(AbstractModule::*)(microseconds_t &, const PreciseTimerTick &);
+
 /// Event function type for subscription new data callbacks
 using recvDataEventFunc_t = void(AbstractModule::*)();
 
@@ -591,6 +607,7 @@ public:
     std::shared_ptr<StreamOutputPort> outPortById(const QString &id) const;
 
     QList<QPair<intervalEventFunc_t, int>> intervalEventCallbacks() const;
+    QList<QPair<preciseIntervalEventFunc_t, microseconds_t>> preciseIntervalEventCallbacks() const;
     QList<QPair<recvDataEventFunc_t, std::shared_ptr<VariantStreamSubscription>>> recvDataEventCallbacks() const;
 
     QVariant serializeDisplayUiGeometry();
@@ -714,6 +731,7 @@ protected:
      * Since these functions are scheduled together with other possible events in an event
      * loop, do not expect the member function to be called in exactly the requested intervals.
      * The interval will also not be adjusted to "catch up" for lost time.
+     * If you need precise or sub-millisecond intervals, use registerPreciseTimedEvent() instead.
      *
      * Please ensure that the callback function never blocks for an extended period of time
      * to give other modules a chance to run as well. Also, you can expect this function to
@@ -729,6 +747,30 @@ protected:
         m_intervalEventCBList.append(qMakePair(amFn, interval.count()));
     }
 
+    /**
+     * @brief Request a member function of this module to be called at a precise interval
+     *
+     * This works like registerTimedEvent(), but the interval is given in microseconds and is
+     * driven by a monotonic kernel timer with absolute deadlines, so ticks do not drift and
+     * have little jitter. Use this for periodic work that needs sub-millisecond intervals.
+     * The interval must be positive.
+     *
+     * The callback receives a reference to the interval, which it may change to re-arm the timer
+     * (starting from the current tick's deadline) or set to zero or a negative value to stop it.
+     * It also receives details about the current tick: If the callback could not be run in time
+     * for one or more intervals, those ticks are reported as missed instead of being run late,
+     * and the lateness of the current tick compared to its deadline is reported as well.
+     */
+    template<typename T>
+    void registerPreciseTimedEvent(void(T::*fn)(microseconds_t &, const PreciseTimerTick &), const microseconds_t &interval)
+    {
+        static_assert(std::is_base_of<AbstractModule, T>::value,
+                "Callback needs to point to a member function of a class derived from AbstractModule");
+        assert(interval.count() > 0);
+        const auto amFn = static_cast<preciseIntervalEventFunc_t>(fn);
+        m_preciseIntervalEventCBList.append(qMakePair(amFn, interval));
+    }
+
     /**
      * @brief Request a member function of this module to be called when a subscription has new data.
      *
@@ -781,6 +823,19 @@ protected:
      */
     std::unique_ptr<SecondaryClockSynchronizer> initClockSynchronizer(double expectedFrequencyHz = 0);
 
+    /**
+     * @brief Get new secondary clock synchronizer which is part of a shared clock domain
+     *
+     * Use this instead of the function above if the device shares its clock with other devices,
+     * for example multiple cameras driven by the same hardware trigger. All synchronizers of the
+     * domain @clockDomain use one shared offset estimator and write a single timesync file, so
+     * their timestamps are adjusted consistently. If @clockDomain is empty, this function behaves
+     * exactly like the one above.
+     *
+     * Returns: A new unique clock synchronizer, or NULL if we could not create one because no master timer existed.
+     */
+    std::unique_ptr<SecondaryClockSynchronizer> initClockSynchronizer(const QString &clockDomain, double expectedFrequencyHz = 0);
+
     /**
      * @brief Potential amount of CPUs not used by other syntalos tasks.
      *
@@ -792,6 +847,16 @@ protected:
      */
     uint potentialNoaffinityCPUCount() const;
 
+    /**
+     * @brief Run function in the main (GUI) thread.
+     *
+     * Modules which have the PREPARE_CONCURRENT feature set must use this function
+     * for any UI work in their prepare() step, as they may be prepared in a worker thread.
+     * If called from the main thread, @func is run directly. This function blocks until
+     * @func has returned.
+     */
+    void runInMainThread(const std::function<void()> &func);
+
     void setInitialized();
     bool initialized() const;
 
@@ -808,6 +873,7 @@ private:
     QMap<QString, std::shared_ptr<VarStreamInputPort>> m_inPorts;
 
     QList<QPair<intervalEventFunc_t, int>> m_intervalEventCBList;
+    QList<QPair<preciseIntervalEventFunc_t, microseconds_t>> m_preciseIntervalEventCBList;
     QList<QPair<recvDataEventFunc_t,
                 std::shared_ptr<VariantStreamSubscription>>> m_recvDataEventCBList;
 
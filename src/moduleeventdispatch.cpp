@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019-2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "moduleeventdispatch.h"
+
+#include <cstring>
+#include <functional>
+#include <sys/timerfd.h>
+
+#include "sytrace.h"
+
+namespace Syntalos {
+
+// maximum amount of times a module's data callback is run in a row to drain its
+// subscription, before other modules or event sources get their turn
+static const uint RECV_DATA_DISPATCH_MAX_CALLS = 32;
+
+// maximum time spent draining a subscription in one go
+static const microseconds_t RECV_DATA_DISPATCH_BUDGET = microseconds_t(2000);
+
+nanoseconds_t monotonicTimeNow()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return std::chrono::seconds(ts.tv_sec) + nanoseconds_t(ts.tv_nsec);
+}
+
+struct timespec toTimespec(const nanoseconds_t &time)
+{
+    struct timespec ts;
+    ts.tv_sec = time.count() / 1000000000;
+    ts.tv_nsec = time.count() % 1000000000;
+    return ts;
+}
+
+/**
+ * Arm @timerFd to fire at the absolute monotonic time @firstDeadline,
+ * and then periodically with @interval.
+ */
+bool armPreciseTimerFd(int timerFd, const nanoseconds_t &firstDeadline,
+                       const microseconds_t &interval, AbstractModule *mod)
+{
+    struct itimerspec spec;
+    spec.it_value = toTimespec(firstDeadline);
+    spec.it_interval = toTimespec(interval);
+    if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &spec, nullptr) != 0) {
+        qWarning().noquote() << "Unable to arm timer for" << mod->name() << ":" << std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Modules usually only process one element per callback, so we call them until
+ * their subscription is drained. We only do that within a budget though, so a busy
+ * module can not starve others, and the caller has to dispatch us again later
+ * if data is still pending.
+ *
+ * @return true if the subscription still has data the module can consume.
+ */
+bool dispatchRecvDataBudgeted(AbstractModule *mod, recvDataEventFunc_t fn,
+                              VariantStreamSubscription *sub, const char *traceName)
+{
+    bool pending = false;
+    SY_TRACE_SPAN("recvDataEventDispatch", traceName);
+    const auto startTime = currentTimePoint();
+    for (uint i = 0; i < RECV_DATA_DISPATCH_MAX_CALLS; i++) {
+        const auto pendingBefore = sub->approxPendingCount();
+        std::invoke(fn, mod);
+        if (mod->state() == ModuleState::ERROR)
+            return false;
+
+        // stop if we are done, or if the module does not consume any data
+        const auto pendingAfter = sub->approxPendingCount();
+        pending = (pendingAfter > 0) && (pendingAfter < pendingBefore);
+        if (!pending)
+            break;
+        if (timeDiffUsec(currentTimePoint(), startTime) > RECV_DATA_DISPATCH_BUDGET)
+            break;
+    }
+
+    return pending;
+}
+
+} // end of namespace
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2019-2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <time.h>
+
+#include "syclock.h"
+#include "moduleapi.h"
+
+namespace Syntalos {
+
+/**
+ * Helpers shared by the module event thread and the module event pool,
+ * which schedule the event callbacks of modules in different ways
+ * but must dispatch them with the same semantics.
+ */
+
+nanoseconds_t monotonicTimeNow();
+struct timespec toTimespec(const nanoseconds_t &time);
+
+bool armPreciseTimerFd(int timerFd, const nanoseconds_t &firstDeadline,
+                       const microseconds_t &interval, AbstractModule *mod);
+
+bool dispatchRecvDataBudgeted(AbstractModule *mod, recvDataEventFunc_t fn,
+                              VariantStreamSubscription *sub, const char *traceName);
+
+} // end of namespace
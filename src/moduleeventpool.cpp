@@ -0,0 +1,708 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "moduleeventpool.h"
+
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <condition_variable>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include "sytrace.h"
+#include "cpuaffinity.h"
+#include "moduleeventdispatch.h"
+
+using namespace Syntalos;
+
+// time we keep processing data which is still pending once we were asked to stop
+static const milliseconds_t SHUTDOWN_DRAIN_TIMEOUT = milliseconds_t(1000);
+
+// maximum amount of events fetched by the poller at once
+static const int POLL_MAX_EVENTS = 64;
+
+enum class PoolTaskKind {
+    TIMER,
+    PRECISE_TIMER,
+    RECV_DATA
+};
+
+class ModuleStrand;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+
+/**
+ * A single event source of a module, which is run as task
+ * on the pool once its event has occured.
+ */
+class PoolTask
+{
+public:
+    PoolTask()
+        : fd(-1),
+          active(true),
+          ready(false),
+          intervalMsec(0),
+          expirations(0)
+    {}
+
+    PoolTaskKind kind;
+    ModuleStrand *strand;
+    const char *traceName;
+
+    // timerfd, or the eventfd of the subscription
+    int fd;
+    std::atomic_bool active;
+    std::atomic_bool ready;
+
+    intervalEventFunc_t timerFn;
+    int intervalMsec;
+
+    preciseIntervalEventFunc_t preciseTimerFn;
+    microseconds_t interval;
+    nanoseconds_t nextDeadline;
+    std::atomic<uint64_t> expirations;
+
+    recvDataEventFunc_t recvDataFn;
+    VariantStreamSubscription *sub;
+};
+
+/**
+ * All tasks of a module. A strand is only ever queued once
+ * and run by a single worker at a time, which serializes the
+ * execution of the module's callbacks.
+ */
+class ModuleStrand
+{
+public:
+    ModuleStrand()
+        : scheduled(false),
+          lastWorker(0)
+    {}
+
+    AbstractModule *module;
+    std::vector<PoolTask*> tasks;
+    std::atomic_bool scheduled;
+    std::atomic_uint lastWorker;
+};
+
+class PoolWorker
+{
+public:
+    QString name;
+    std::thread thread;
+
+    std::mutex mutex;
+    std::deque<ModuleStrand*> queue;
+};
+
+class ModuleEventPool::Private
+{
+public:
+    Private() { }
+    ~Private() { }
+
+    QString name;
+    uint workerCount;
+    std::vector<uint> cpuAffinity;
+
+    bool running;
+    std::atomic_bool failed;
+    bool poolActive;
+
+    int wakeFd;
+    std::thread pollThread;
+    std::atomic_bool polling;
+
+    std::vector<std::unique_ptr<PoolWorker>> workers;
+    std::atomic_bool workersActive;
+    std::mutex sleepMutex;
+    std::condition_variable sleepCond;
+    std::atomic_int queuedCount;
+
+    std::atomic_bool draining;
+    symaster_timepoint drainDeadline;
+
+    std::vector<std::unique_ptr<ModuleStrand>> strands;
+    std::vector<std::unique_ptr<PoolTask>> tasks;
+
+    void enqueue(uint index, ModuleStrand *strand);
+    void schedule(ModuleStrand *strand);
+    ModuleStrand *takeStrand(uint index);
+    void runStrand(ModuleStrand *strand, uint index);
+    void runTask(PoolTask *task);
+    bool mayContinueWork();
+};
+#pragma GCC diagnostic pop
+
+/**
+ * Arm the timer of an interval task, or disarm it if the
+ * task wants to be run continuously.
+ */
+static bool armIntervalTimer(PoolTask *task)
+{
+    struct itimerspec spec;
+    std::memset(&spec, 0, sizeof(spec));
+    if (task->intervalMsec > 0) {
+        spec.it_value = toTimespec(milliseconds_t(task->intervalMsec));
+        spec.it_interval = spec.it_value;
+    }
+    if (timerfd_settime(task->fd, 0, &spec, nullptr) != 0) {
+        qWarning().noquote() << "Unable to arm timer for" << task->strand->module->name() << ":" << std::strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+static bool armPreciseTimer(PoolTask *task, const nanoseconds_t &firstDeadline)
+{
+    task->nextDeadline = firstDeadline;
+    return armPreciseTimerFd(task->fd, firstDeadline, task->interval, task->strand->module);
+}
+
+void ModuleEventPool::Private::enqueue(uint index, ModuleStrand *strand)
+{
+    auto &worker = workers[index];
+    {
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        worker->queue.push_back(strand);
+    }
+    queuedCount++;
+
+    // any idle worker will do, it will steal the strand if it isn't its own
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    sleepCond.notify_one();
+}
+
+void ModuleEventPool::Private::schedule(ModuleStrand *strand)
+{
+    if (strand->scheduled.exchange(true))
+        return;
+    enqueue(strand->lastWorker, strand);
+}
+
+/**
+ * Get the next strand to run for worker @index. Workers take the oldest
+ * strand from their own queue, and steal the newest one from other workers
+ * if they have nothing to do.
+ */
+ModuleStrand *ModuleEventPool::Private::takeStrand(uint index)
+{
+    ModuleStrand *strand = nullptr;
+    {
+        auto &worker = workers[index];
+        std::lock_guard<std::mutex> lock(worker->mutex);
+        if (!worker->queue.empty()) {
+            strand = worker->queue.front();
+            worker->queue.pop_front();
+            queuedCount--;
+            return strand;
+        }
+    }
+
+    for (uint i = 1; i < workers.size(); i++) {
+        auto &victim = workers[(index + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim->mutex);
+        if (victim->queue.empty())
+            continue;
+        strand = victim->queue.back();
+        victim->queue.pop_back();
+        queuedCount--;
+        return strand;
+    }
+
+    return nullptr;
+}
+
+/**
+ * Check whether tasks are allowed to requeue themselves, which is
+ * true while we are running and within the drain timeout when stopping.
+ */
+bool ModuleEventPool::Private::mayContinueWork()
+{
+    if (polling)
+        return true;
+    return draining && (symaster_clock::now() < drainDeadline);
+}
+
+void ModuleEventPool::Private::runTask(PoolTask *task)
+{
+    auto mod = task->strand->module;
+
+    switch (task->kind) {
+    case PoolTaskKind::TIMER: {
+        int interval = task->intervalMsec;
+        {
+            SY_TRACE_SPAN("timerEventDispatch", task->traceName);
+            std::invoke(task->timerFn, mod, interval);
+        }
+        if (mod->state() == ModuleState::ERROR)
+            return;
+
+        if (interval != task->intervalMsec) {
+            // interval < 0 means we should stop this event source
+            if (interval < 0) {
+                task->active = false;
+                task->intervalMsec = -1;
+                armIntervalTimer(task);
+                return;
+            }
+            task->intervalMsec = interval;
+            armIntervalTimer(task);
+        }
+
+        // a zero interval means we are called whenever we can be
+        if ((task->intervalMsec == 0) && mayContinueWork())
+            task->ready = true;
+        break;
+    }
+    case PoolTaskKind::PRECISE_TIMER: {
+        const auto expirations = task->expirations.exchange(0);
+        if (expirations == 0)
+            return;
+
+        // all but the latest expiration since our last run were missed
+        const auto deadline = task->nextDeadline + static_cast<int64_t>(expirations - 1) * task->interval;
+        PreciseTimerTick tick;
+        tick.missedTicks = expirations - 1;
+        tick.lateness = std::chrono::duration_cast<microseconds_t>(monotonicTimeNow() - deadline);
+        task->nextDeadline = deadline + task->interval;
+
+        auto interval = task->interval;
+        {
+            SY_TRACE_SPAN("preciseTimerEventDispatch", task->traceName);
+            std::invoke(task->preciseTimerFn, mod, interval, tick);
+        }
+        if (mod->state() == ModuleState::ERROR)
+            return;
+
+        if (interval == task->interval)
+            return;
+        if (interval.count() <= 0) {
+            task->active = false;
+            struct itimerspec spec;
+            std::memset(&spec, 0, sizeof(spec));
+            timerfd_settime(task->fd, 0, &spec, nullptr);
+            return;
+        }
+
+        // the interval was changed, re-arm the timer in place counting from the current deadline
+        task->interval = interval;
+        armPreciseTimer(task, deadline + interval);
+        break;
+    }
+    case PoolTaskKind::RECV_DATA: {
+        // drain the subscription within a budget, and requeue the module if there
+        // is still data left so other modules queued on this worker get their turn
+        const auto pending = dispatchRecvDataBudgeted(mod, task->recvDataFn, task->sub, task->traceName);
+        if (mod->state() == ModuleState::ERROR)
+            return;
+
+        if (pending && mayContinueWork())
+            task->ready = true;
+        break;
+    }
+    }
+}
+
+void ModuleEventPool::Private::runStrand(ModuleStrand *strand, uint index)
+{
+    strand->lastWorker = index;
+
+    for (auto &task : strand->tasks) {
+        if (!task->ready.exchange(false))
+            continue;
+        if (!task->active)
+            continue;
+
+        runTask(task);
+        if (strand->module->state() == ModuleState::ERROR) {
+            // ewww, this module failed. suspend execution
+            failed = true;
+            for (auto &t : strand->tasks)
+                t->active = false;
+            qDebug().noquote().nospace() << "Module '" << strand->module->name() << "' failed in event pool. Stopping.";
+            break;
+        }
+    }
+
+    // Release the strand. Events which occured while we were running have
+    // set a ready flag but were unable to queue the strand, so we check for
+    // those afterwards and queue the strand again at the end of our queue.
+    strand->scheduled = false;
+    for (const auto &task : strand->tasks) {
+        if (!task->ready || !task->active)
+            continue;
+        if (!strand->scheduled.exchange(true))
+            enqueue(index, strand);
+        break;
+    }
+}
+
+ModuleEventPool::ModuleEventPool(uint workerCount, const std::vector<uint> &cpuAffinity, QObject *parent)
+    : QObject(parent),
+      d(new ModuleEventPool::Private)
+{
+    d->name = QStringLiteral("evpool");
+    d->workerCount = (workerCount == 0)? 1 : workerCount;
+    d->cpuAffinity = cpuAffinity;
+    d->running = false;
+    d->failed = false;
+    d->poolActive = false;
+    d->polling = false;
+    d->workersActive = false;
+    d->queuedCount = 0;
+    d->draining = false;
+
+    d->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (d->wakeFd < 0)
+        qFatal("Unable to obtain eventfd for module event pool: %s", std::strerror(errno));
+}
+
+ModuleEventPool::~ModuleEventPool()
+{
+    shutdownPool();
+    close(d->wakeFd);
+}
+
+bool ModuleEventPool::isRunning() const
+{
+    return d->running;
+}
+
+bool ModuleEventPool::isFailed() const
+{
+    return d->failed;
+}
+
+QString ModuleEventPool::name() const
+{
+    return d->name;
+}
+
+/**
+ * Names of the poller and worker threads of this pool,
+ * only available once the pool was started.
+ */
+QStringList ModuleEventPool::threadNames() const
+{
+    QStringList names;
+    if (!d->poolActive)
+        return names;
+    names.append(QStringLiteral("%1:poll").arg(d->name));
+    for (const auto &worker : d->workers)
+        names.append(worker->name);
+    return names;
+}
+
+void ModuleEventPool::setFailed(bool failed)
+{
+    d->failed = failed;
+}
+
+void ModuleEventPool::workerThreadFunc(uint index)
+{
+    pthread_setname_np(pthread_self(), qPrintable(d->workers[index]->name.mid(0, 15)));
+    if (!d->cpuAffinity.empty())
+        thread_set_affinity_from_vec(pthread_self(), d->cpuAffinity);
+
+    while (true) {
+        const auto strand = d->takeStrand(index);
+        if (strand != nullptr) {
+            d->runStrand(strand, index);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(d->sleepMutex);
+        if ((d->queuedCount <= 0) && !d->workersActive)
+            break;
+        d->sleepCond.wait(lock, [&]{ return (d->queuedCount > 0) || !d->workersActive; });
+    }
+}
+
+void ModuleEventPool::pollThreadFunc(QList<AbstractModule*> mods, OptionalWaitCondition *waitCondition)
+{
+    pthread_setname_np(pthread_self(), qPrintable(QStringLiteral("%1:poll").arg(d->name).mid(0, 15)));
+    if (!d->cpuAffinity.empty())
+        thread_set_affinity_from_vec(pthread_self(), d->cpuAffinity);
+
+    const int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0) {
+        qCritical().noquote() << "Unable to create poller for module event pool:" << std::strerror(errno);
+        d->failed = true;
+        waitCondition->wait();
+        return;
+    }
+
+    auto watchFd = [&](int fd, void *ptr) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = ptr;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+            qCritical().noquote() << "Unable to watch event source in module event pool:" << std::strerror(errno);
+            d->failed = true;
+        }
+    };
+    watchFd(d->wakeFd, nullptr);
+
+    // create a strand with tasks for every module, spread over the workers
+    for (const auto &mod : mods) {
+        auto strand = std::make_unique<ModuleStrand>();
+        strand->module = mod;
+        strand->lastWorker = d->strands.size() % d->workers.size();
+        const auto traceName = traceIntern(mod->name());
+
+        // add "timer" event sources
+        for (const auto &ev : mod->intervalEventCallbacks()) {
+            if (ev.second < 0)
+                continue;
+
+            auto task = std::make_unique<PoolTask>();
+            task->kind = PoolTaskKind::TIMER;
+            task->strand = strand.get();
+            task->traceName = traceName;
+            task->timerFn = ev.first;
+            task->intervalMsec = ev.second;
+            task->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (task->fd < 0) {
+                qCritical().noquote() << "Unable to create timer for" << mod->name() << ":" << std::strerror(errno);
+                setFailed(true);
+                continue;
+            }
+            watchFd(task->fd, task.get());
+            strand->tasks.push_back(task.get());
+            d->tasks.push_back(std::move(task));
+        }
+
+        // add high-resolution "timer" event sources
+        for (const auto &ev : mod->preciseIntervalEventCallbacks()) {
+            auto task = std::make_unique<PoolTask>();
+            task->kind = PoolTaskKind::PRECISE_TIMER;
+            task->strand = strand.get();
+            task->traceName = traceName;
+            task->preciseTimerFn = ev.first;
+            task->interval = ev.second;
+            task->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (task->fd < 0) {
+                qCritical().noquote() << "Unable to create timer for" << mod->name() << ":" << std::strerror(errno);
+                setFailed(true);
+                continue;
+            }
+            watchFd(task->fd, task.get());
+            strand->tasks.push_back(task.get());
+            d->tasks.push_back(std::move(task));
+        }
+
+        // add "received data in subscription" event sources
+        for (const auto &ev : mod->recvDataEventCallbacks()) {
+            auto task = std::make_unique<PoolTask>();
+            task->kind = PoolTaskKind::RECV_DATA;
+            task->strand = strand.get();
+            task->traceName = traceName;
+            task->recvDataFn = ev.first;
+            task->sub = ev.second.get();
+            task->fd = task->sub->enableNotify();
+            watchFd(task->fd, task.get());
+            strand->tasks.push_back(task.get());
+            d->tasks.push_back(std::move(task));
+        }
+
+        d->strands.push_back(std::move(strand));
+    }
+
+    // wait for us to start
+    waitCondition->wait();
+
+    // modules which are idle will not be doing anything, so we never run them
+    int activeStrandCount = 0;
+    for (const auto &strand : d->strands) {
+        if (strand->module->state() == ModuleState::IDLE) {
+            for (auto &task : strand->tasks)
+                task->active = false;
+        } else {
+            activeStrandCount++;
+        }
+    }
+
+    if (activeStrandCount == 0) {
+        qDebug() << "All evented modules are idle, shutting down their pool.";
+        close(epollFd);
+        return;
+    }
+
+    // immediately return in case other modules have already failed,
+    // or if we were already stopped
+    if (d->failed || !d->polling) {
+        close(epollFd);
+        return;
+    }
+
+    // start the timers
+    {
+        const auto startTime = monotonicTimeNow();
+        for (const auto &task : d->tasks) {
+            if (!task->active)
+                continue;
+            if (task->kind == PoolTaskKind::TIMER) {
+                armIntervalTimer(task.get());
+                if (task->intervalMsec == 0) {
+                    task->ready = true;
+                    d->schedule(task->strand);
+                }
+            } else if (task->kind == PoolTaskKind::PRECISE_TIMER) {
+                armPreciseTimer(task.get(), startTime + task->interval);
+            }
+        }
+    }
+
+    // dispatch events to the workers until we are stopped
+    struct epoll_event events[POLL_MAX_EVENTS];
+    while (d->polling) {
+        const auto n = epoll_wait(epollFd, events, POLL_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            qCritical().noquote() << "Polling in module event pool failed:" << std::strerror(errno);
+            d->failed = true;
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            auto task = static_cast<PoolTask*>(events[i].data.ptr);
+            if (task == nullptr) {
+                uint64_t count;
+                (void) read(d->wakeFd, &count, sizeof(count));
+                continue;
+            }
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                task->active = false;
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, task->fd, nullptr);
+                continue;
+            }
+
+            if (task->kind == PoolTaskKind::RECV_DATA) {
+                // the worker running this task will drain the subscription
+                task->sub->acknowledgeNotify();
+            } else {
+                uint64_t expirations = 0;
+                if (read(task->fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+                    continue;
+                if (task->kind == PoolTaskKind::PRECISE_TIMER)
+                    task->expirations += expirations;
+            }
+
+            if (!task->active) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, task->fd, nullptr);
+                continue;
+            }
+            task->ready = true;
+            d->schedule(task->strand);
+        }
+    }
+
+    // let the workers process data which is still pending for a little while
+    d->drainDeadline = symaster_clock::now() + SHUTDOWN_DRAIN_TIMEOUT;
+    d->draining = true;
+    for (const auto &task : d->tasks) {
+        if (task->kind != PoolTaskKind::RECV_DATA || !task->active)
+            continue;
+        if (!task->sub->hasPending())
+            continue;
+        task->ready = true;
+        d->schedule(task->strand);
+    }
+
+    close(epollFd);
+}
+
+void ModuleEventPool::run(QList<AbstractModule*> mods, OptionalWaitCondition *waitCondition)
+{
+    if (d->poolActive)
+        return;
+
+    // there is no point in having more workers than modules
+    auto workerCount = d->workerCount;
+    if (workerCount > static_cast<uint>(mods.size()))
+        workerCount = mods.isEmpty()? 1 : mods.size();
+
+    d->running = true;
+    d->polling = true;
+    d->draining = false;
+    d->workersActive = true;
+    d->queuedCount = 0;
+
+    // all workers must exist before any of them runs, as they steal from each other
+    for (uint i = 0; i < workerCount; i++) {
+        auto worker = std::make_unique<PoolWorker>();
+        worker->name = QStringLiteral("%1:w%2").arg(d->name).arg(i);
+        d->workers.push_back(std::move(worker));
+    }
+    for (uint i = 0; i < workerCount; i++)
+        d->workers[i]->thread = std::thread(&ModuleEventPool::workerThreadFunc, this, i);
+
+    d->pollThread = std::thread(&ModuleEventPool::pollThreadFunc, this,
+                                mods,
+                                waitCondition);
+    d->poolActive = true;
+}
+
+void ModuleEventPool::stop()
+{
+    shutdownPool();
+}
+
+void ModuleEventPool::shutdownPool()
+{
+    if (!d->poolActive)
+        return;
+    d->running = false;
+
+    // stop the poller first, it queues remaining work for the workers
+    d->polling = false;
+    const uint64_t one = 1;
+    if (write(d->wakeFd, &one, sizeof(one)) < 0)
+        qWarning().noquote() << "Unable to wake module event pool:" << std::strerror(errno);
+    d->pollThread.join();
+
+    // the workers finish all queued work before exiting
+    d->workersActive = false;
+    {
+        std::lock_guard<std::mutex> lock(d->sleepMutex);
+        d->sleepCond.notify_all();
+    }
+    for (auto &worker : d->workers)
+        worker->thread.join();
+
+    for (const auto &task : d->tasks) {
+        if (task->kind != PoolTaskKind::RECV_DATA && task->fd >= 0)
+            close(task->fd);
+    }
+    d->tasks.clear();
+    d->strands.clear();
+    d->workers.clear();
+    d->draining = false;
+    d->poolActive = false;
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QObject>
+#include <vector>
+#include "optionalwaitcondition.h"
+#include "moduleapi.h"
+
+namespace Syntalos {
+
+/**
+ * @brief Runs evented modules on a work-stealing pool of threads
+ *
+ * This is an alternative to statically partitioning evented modules onto
+ * ModuleEventThread instances. A single poller thread waits for timers and
+ * stream subscription notifications of all participating modules, and schedules
+ * the affected modules as tasks on a pool of worker threads. Every worker has its
+ * own task queue, and idle workers steal tasks from busy ones, so a single busy
+ * module does not leave the modules sharing its thread behind.
+ *
+ * The callbacks of an individual module are never run concurrently, a module
+ * is only ever executed by one worker at a time.
+ */
+class ModuleEventPool : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ModuleEventPool(uint workerCount,
+                             const std::vector<uint> &cpuAffinity = std::vector<uint>(),
+                             QObject *parent = nullptr);
+    ~ModuleEventPool();
+
+    bool isRunning() const;
+    bool isFailed() const;
+    QString name() const;
+    QStringList threadNames() const;
+
+    void setFailed(bool failed);
+
+    void run(QList<AbstractModule *> mods, OptionalWaitCondition *waitCondition);
+    void stop();
+
+private:
+    class Private;
+    Q_DISABLE_COPY(ModuleEventPool)
+    QScopedPointer<Private> d;
+
+    void shutdownPool();
+    void pollThreadFunc(QList<AbstractModule *> mods,
+                        OptionalWaitCondition *waitCondition);
+    void workerThreadFunc(uint index);
+};
+
+} // end of namespace
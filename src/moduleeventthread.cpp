@@ -21,7 +21,13 @@
 
 #include <glib.h>
 #include <thread>
+#include <cstring>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
 
+#include "sytrace.h"
+#include "moduleeventdispatch.h"
 #include "utils/misc.h"
 
 using namespace Syntalos;
@@ -32,17 +38,35 @@ public:
     uint interval;
     AbstractModule *module;
     intervalEventFunc_t fn;
+    const char *traceName;
 
     ModuleEventThread *self;
     GSource *source;
     GMainContext *context;
 };
 
+class PreciseTimerEventPayload
+{
+public:
+    microseconds_t interval;
+    AbstractModule *module;
+    preciseIntervalEventFunc_t fn;
+    const char *traceName;
+
+    int timerFd;
+    nanoseconds_t nextDeadline;
+
+    ModuleEventThread *self;
+    GSource *source;
+};
+
 class RecvDataEventPayload
 {
 public:
     AbstractModule *module;
     recvDataEventFunc_t fn;
+    const char *traceName;
+    VariantStreamSubscription *sub;
 
     ModuleEventThread *self;
     GSource *source;
@@ -77,7 +101,7 @@ ModuleEventThread::ModuleEventThread(const QString &threadName, QObject *parent)
     if (threadName.isEmpty())
         d->threadName = QStringLiteral("ev:%1").arg(createRandomString(9));
     else
-        d->threadName = QStringLiteral("ev:%1").arg(threadName);
+        d->threadName = threadName;
 }
 
 ModuleEventThread::~ModuleEventThread()
@@ -109,7 +133,10 @@ static gboolean timerEventDispatch(gpointer udata)
 {
     const auto pl = static_cast<TimerEventPayload*>(udata);
     int interval = pl->interval;
-    std::invoke(pl->fn, pl->module, interval);
+    {
+        SY_TRACE_SPAN("timerEventDispatch", pl->traceName);
+        std::invoke(pl->fn, pl->module, interval);
+    }
 
     if (pl->module->state() == ModuleState::ERROR) {
         // ewww, this module failed. suspend execution
@@ -142,10 +169,65 @@ static gboolean timerEventDispatch(gpointer udata)
     return FALSE;
 }
 
+/**
+ * Arm the timer of @pl to fire at the absolute time @firstDeadline, and
+ * then periodically with the payload's interval.
+ */
+static bool armPreciseTimer(PreciseTimerEventPayload *pl, const nanoseconds_t &firstDeadline)
+{
+    pl->nextDeadline = firstDeadline;
+    return armPreciseTimerFd(pl->timerFd, firstDeadline, pl->interval, pl->module);
+}
+
+static gboolean preciseTimerEventDispatch(gpointer udata)
+{
+    const auto pl = static_cast<PreciseTimerEventPayload*>(udata);
+
+    uint64_t expirations = 0;
+    if (read(pl->timerFd, &expirations, sizeof(expirations)) != sizeof(expirations) || expirations == 0)
+        return TRUE;
+
+    // all but the latest expiration since our last run were missed
+    const auto deadline = pl->nextDeadline + static_cast<int64_t>(expirations - 1) * pl->interval;
+    PreciseTimerTick tick;
+    tick.missedTicks = expirations - 1;
+    tick.lateness = std::chrono::duration_cast<microseconds_t>(monotonicTimeNow() - deadline);
+    pl->nextDeadline = deadline + pl->interval;
+
+    auto interval = pl->interval;
+    {
+        SY_TRACE_SPAN("preciseTimerEventDispatch", pl->traceName);
+        std::invoke(pl->fn, pl->module, interval, tick);
+    }
+
+    if (pl->module->state() == ModuleState::ERROR) {
+        // ewww, this module failed. suspend execution
+        pl->self->setFailed(true);
+        qDebug().noquote().nospace() << "Module '" << pl->module->name() << "' failed in event loop. Stopping.";
+        return FALSE;
+    }
+
+    if (interval == pl->interval)
+        return TRUE;
+    if (interval.count() <= 0)
+        return FALSE;
+
+    // the interval was changed, re-arm the timer in place counting from the current deadline
+    pl->interval = interval;
+    return armPreciseTimer(pl, deadline + interval)? TRUE : FALSE;
+}
+
 static gboolean recvDataEventDispatch(gpointer udata)
 {
     const auto pl = static_cast<RecvDataEventPayload*>(udata);
-    std::invoke(pl->fn, pl->module);
+
+    // drain the subscription within a budget, so a busy module can not starve other
+    // modules sharing this thread, and continue in the next main loop iteration
+    // if data is still pending
+    const auto pending = dispatchRecvDataBudgeted(pl->module, pl->fn, pl->sub, pl->traceName);
+
+    // dispatch us again right away if there is more data
+    g_source_set_ready_time(pl->source, pending? 0 : -1);
 
     if (pl->module->state() == ModuleState::ERROR) {
         // ewww, this module failed. suspend execution
@@ -161,6 +243,7 @@ typedef struct {
     GSource source;
     int event_fd;
     gpointer event_fd_tag;
+    VariantStreamSubscription *sub;
 } EFDSignalSource;
 
 gboolean efd_signal_source_prepare(GSource*, gint *timeout)
@@ -178,15 +261,17 @@ gboolean efd_signal_source_dispatch(GSource* source, GSourceFunc callback, gpoin
         return G_SOURCE_REMOVE;
     }
 
+    // reset the eventfd - the subscription may not notify us again about elements
+    // which are already queued, so the callback has to drain it and may request
+    // to be dispatched again by setting a ready time
+    g_source_set_ready_time(source, -1);
+    if (events & G_IO_IN)
+        efd_source->sub->acknowledgeNotify();
+
     gboolean result_continue = G_SOURCE_CONTINUE;
-    if (events & G_IO_IN) {
-        uint64_t buffer;
-        // just read the buffer count for now to empty it
-        // (maybe we can do something useful with the element count later?)
-        (void) read(efd_source->event_fd, &buffer, sizeof(buffer));
+    if ((events & G_IO_IN) || efd_source->sub->hasPending())
         result_continue = callback(user_data);
-    }
-    g_source_set_ready_time(source, -1);
+
     return result_continue;
 }
 
@@ -200,10 +285,48 @@ static GSourceFuncs efd_source_funcs = {
 };
 #pragma GCC diagnostic pop
 
-GSource *efd_signal_source_new(int event_fd)
+typedef struct {
+    GSource source;
+    gpointer fd_tag;
+} TimerFDSource;
+
+gboolean timerfd_source_dispatch(GSource* source, GSourceFunc callback, gpointer user_data)
+{
+    TimerFDSource* tfd_source = (TimerFDSource*) source;
+
+    unsigned events = g_source_query_unix_fd(source, tfd_source->fd_tag);
+    if (events & G_IO_HUP || events & G_IO_ERR || events & G_IO_NVAL)
+        return G_SOURCE_REMOVE;
+    if (events & G_IO_IN)
+        return callback(user_data);
+    return G_SOURCE_CONTINUE;
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
+static GSourceFuncs timerfd_source_funcs = {
+  .prepare = NULL,
+  .check = NULL,
+  .dispatch = timerfd_source_dispatch,
+  .finalize = NULL
+};
+#pragma GCC diagnostic pop
+
+GSource *timerfd_source_new(int timer_fd)
+{
+    auto source = (TimerFDSource*) g_source_new(&timerfd_source_funcs, sizeof(TimerFDSource));
+    source->fd_tag = g_source_add_unix_fd((GSource*) source,
+                                          timer_fd,
+                                          (GIOCondition) (G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL));
+    return (GSource*) source;
+}
+
+GSource *efd_signal_source_new(VariantStreamSubscription *sub)
 {
     auto source = (EFDSignalSource*) g_source_new(&efd_source_funcs, sizeof(EFDSignalSource));
+    const auto event_fd = sub->enableNotify();
     source->event_fd = event_fd;
+    source->sub = sub;
     source->event_fd_tag = g_source_add_unix_fd((GSource*) source,
                                                 event_fd,
                                                 (GIOCondition) (G_IO_IN | G_IO_ERR | G_IO_HUP | G_IO_NVAL));
@@ -220,6 +343,7 @@ void ModuleEventThread::moduleEventThreadFunc(QList<AbstractModule*> mods, Optio
 
     // add event sources
     std::vector<std::unique_ptr<TimerEventPayload>> intervalPayloads;
+    std::vector<std::unique_ptr<PreciseTimerEventPayload>> preciseIntervalPayloads;
     std::vector<std::unique_ptr<RecvDataEventPayload>> recvDataPayloads;
     for (const auto &mod : mods) {
         // add "timer" event sources
@@ -231,6 +355,7 @@ void ModuleEventThread::moduleEventThreadFunc(QList<AbstractModule*> mods, Optio
             pl->interval = ev.second;
             pl->module = mod;
             pl->fn = ev.first;
+            pl->traceName = traceIntern(mod->name());
             pl->self = this;
             pl->context = context;
             pl->source = g_timeout_source_new(pl->interval);
@@ -242,16 +367,40 @@ void ModuleEventThread::moduleEventThreadFunc(QList<AbstractModule*> mods, Optio
             intervalPayloads.push_back(std::move(pl));
         }
 
+        // add high-resolution "timer" event sources, armed once we start
+        for (const auto &ev : mod->preciseIntervalEventCallbacks()) {
+            auto pl = std::make_unique<PreciseTimerEventPayload>();
+            pl->timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (pl->timerFd < 0) {
+                qCritical().noquote() << "Unable to create timer for" << mod->name() << ":" << std::strerror(errno);
+                setFailed(true);
+                continue;
+            }
+            pl->interval = ev.second;
+            pl->module = mod;
+            pl->fn = ev.first;
+            pl->traceName = traceIntern(mod->name());
+            pl->self = this;
+            pl->source = timerfd_source_new(pl->timerFd);
+            g_source_set_callback (pl->source,
+                                   &preciseTimerEventDispatch,
+                                   pl.get(),
+                                   NULL);
+            g_source_attach(pl->source, context);
+            preciseIntervalPayloads.push_back(std::move(pl));
+        }
+
         // add "received data in subscription" event sources
         for (const auto &ev : mod->recvDataEventCallbacks()) {
             auto sub = ev.second;
-            int eventfd = sub->enableNotify();
 
             auto pl = std::make_unique<RecvDataEventPayload>();
             pl->module = mod;
             pl->fn = ev.first;
+            pl->traceName = traceIntern(mod->name());
+            pl->sub = sub.get();
             pl->self = this;
-            pl->source = efd_signal_source_new(eventfd);
+            pl->source = efd_signal_source_new(sub.get());
             g_source_set_callback (pl->source,
                                    &recvDataEventDispatch,
                                    pl.get(),
@@ -291,6 +440,13 @@ void ModuleEventThread::moduleEventThreadFunc(QList<AbstractModule*> mods, Optio
     if (!d->running)
         goto out;
 
+    // start the high-resolution timers, using absolute deadlines relative to now
+    {
+        const auto startTime = monotonicTimeNow();
+        for (const auto &pl : preciseIntervalPayloads)
+            armPreciseTimer(pl.get(), startTime + pl->interval);
+    }
+
     // run the event loop
     g_main_loop_run(loop);
 
@@ -309,6 +465,11 @@ out:
         g_source_destroy(pl->source);
         g_source_unref(pl->source);
     }
+    for (const auto &pl : preciseIntervalPayloads) {
+        g_source_destroy(pl->source);
+        g_source_unref(pl->source);
+        close(pl->timerFd);
+    }
     for (const auto &pl : recvDataPayloads) {
         g_source_destroy(pl->source);
         g_source_unref(pl->source);
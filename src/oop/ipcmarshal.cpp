@@ -19,118 +19,497 @@
 
 #include "ipcmarshal.h"
 
-#include <chrono>
+#include <new>
+#include <algorithm>
+#include <QDebug>
+
+/*
+ * Layout of a frame ring segment:
+ *   ShmFrameRingHeader, padded to SHM_FRAME_ALIGN
+ *   slotCount x [ShmFrameSlotHeader, padded to SHM_FRAME_ALIGN; frame data]
+ */
+struct ShmFrameRingHeader
+{
+    qint32 slotCount;
+    qint32 reserved;
+    quint64 slotStride;
+};
+
+static constexpr size_t SHM_FRAME_ALIGN = 64;
+static constexpr int SHM_FRAME_RING_SLOTS = 4;
+static constexpr int SHM_FRAME_RING_MAX_SLOTS = 32;
+
+static inline size_t shmAlignUp(size_t value)
+{
+    return ((value + SHM_FRAME_ALIGN - 1) / SHM_FRAME_ALIGN) * SHM_FRAME_ALIGN;
+}
+
+static inline ShmFrameRingHeader *shmRingHeader(SharedMemory *shm)
+{
+    return static_cast<ShmFrameRingHeader*>(shm->data());
+}
+
+static inline ShmFrameSlotHeader *shmSlotHeader(SharedMemory *shm, int slot)
+{
+    auto ring = shmRingHeader(shm);
+    if (slot < 0 || slot >= ring->slotCount)
+        return nullptr;
+    auto ptr = static_cast<char*>(shm->data()) + shmAlignUp(sizeof(ShmFrameRingHeader)) + ring->slotStride * static_cast<size_t>(slot);
+    return reinterpret_cast<ShmFrameSlotHeader*>(ptr);
+}
+
+static inline uchar *shmSlotData(ShmFrameSlotHeader *hdr)
+{
+    return reinterpret_cast<uchar*>(hdr) + shmAlignUp(sizeof(ShmFrameSlotHeader));
+}
 
 /**
- * @brief Write OpenCV Matrix to shared memory region.
+ * Number of slots of a segment the reader has not handed back yet.
  */
-bool cvMatToShm(std::unique_ptr<SharedMemory> &shm, const cv::Mat &frame)
+static int shmRingSlotsInUse(SharedMemory *shm)
+{
+    int count = 0;
+    const auto slotCount = shmRingHeader(shm)->slotCount;
+    for (int i = 0; i < slotCount; i++) {
+        if (shmSlotHeader(shm, i)->inUse.load(std::memory_order_acquire) != 0)
+            count++;
+    }
+    return count;
+}
+
+ShmFrameRing::ShmFrameRing(const QString &initialKey)
+    : m_initialKey(initialKey),
+      m_nextSlot(0),
+      m_exhaustedCount(0)
+{}
+
+std::shared_ptr<SharedMemory> ShmFrameRing::shm() const
 {
-    int mat_type = frame.type();
-    int mat_channels = frame.channels();
-    size_t memsize = sizeof(int) * 6;
-    if (frame.isContinuous())
-        memsize += frame.dataend - frame.datastart;
+    return m_shm;
+}
+
+QString ShmFrameRing::shmKey() const
+{
+    return m_shm? m_shm->shmKey() : QString();
+}
+
+QString ShmFrameRing::lastError() const
+{
+    return m_lastError;
+}
+
+bool ShmFrameRing::owns(const SharedMemory *shm) const
+{
+    if (shm == m_shm.get())
+        return true;
+    for (const auto &r : m_retired) {
+        if (r.get() == shm)
+            return true;
+    }
+    return false;
+}
+
+bool ShmFrameRing::recreate(int slotCount, size_t slotStride)
+{
+    auto shm = std::make_shared<SharedMemory>();
+
+    // the first segment uses the key the other side already knows,
+    // all later ones are announced with every frame
+    if (!m_shm && !m_initialKey.isEmpty())
+        shm->setShmKey(m_initialKey);
     else
-        memsize += CV_ELEM_SIZE(mat_type) * frame.cols * frame.rows;
+        shm->createShmKey();
 
-    if (shm->size() == 0) {
-        // this is a fresh shared-memory object, so create it
-        if (!shm->create(memsize))
-            return false;
-    } else {
-        if (shm->size() != memsize) {
-            // the memory segment doesn't have the right size, let's create a new one!
-            shm.reset(new SharedMemory);
-            if (!shm->create(memsize))
-                return false;
-        }
+    const auto size = shmAlignUp(sizeof(ShmFrameRingHeader)) + slotStride * static_cast<size_t>(slotCount);
+    if (!shm->create(size)) {
+        m_lastError = shm->lastError();
+        return false;
+    }
+
+    auto ring = shmRingHeader(shm.get());
+    ring->slotCount = slotCount;
+    ring->slotStride = slotStride;
+    for (int i = 0; i < slotCount; i++) {
+        auto hdr = shmSlotHeader(shm.get(), i);
+        new (&hdr->inUse) std::atomic_int(0);
+        hdr->type = 0;
+        hdr->rows = 0;
+        hdr->cols = 0;
+        hdr->step = 0;
     }
 
-    shm->lock();
-    auto shm_data = static_cast<char*>(shm->data());
+    // keep the previous segment around as long as the reader still holds any of its
+    // slots, it may still have to attach to it for frames that are in flight
+    if (m_shm)
+        m_retired.push_back(m_shm);
+    m_shm = shm;
+    releaseRetired();
+    m_nextSlot = 0;
+    return true;
+}
 
-    // write header
-    size_t pos = 0;
-    int header[4] = {mat_type, mat_channels, frame.rows, frame.cols};
+/**
+ * @brief Drop retired segments once the reader has handed back all of their slots.
+ */
+void ShmFrameRing::releaseRetired()
+{
+    m_retired.erase(std::remove_if(m_retired.begin(), m_retired.end(),
+                                   [](const std::shared_ptr<SharedMemory> &shm) {
+                                       return shmRingSlotsInUse(shm.get()) == 0;
+                                   }),
+                    m_retired.end());
+}
 
-    std::memcpy(shm_data + pos, &header, sizeof(header));
-    pos += sizeof(header);
+/**
+ * @brief Find a free slot for a frame of the given geometry and mark it as in use.
+ *
+ * This never waits for the reader to release a slot. If the ring can not grow
+ * any further, the caller has to send the frame data inline instead.
+ * @return The slot index, or -1 if no slot is available.
+ */
+int ShmFrameRing::acquireSlot(int rows, int cols, int type)
+{
+    const auto step = static_cast<size_t>(cols) * CV_ELEM_SIZE(type);
+    const auto slotStride = shmAlignUp(sizeof(ShmFrameSlotHeader)) + shmAlignUp(step * static_cast<size_t>(rows));
 
-    // write image data
-    if (frame.isContinuous()) {
-        std::memcpy(shm_data + pos, frame.ptr<char>(0), (frame.dataend - frame.datastart));
+    if (!m_retired.empty())
+        releaseRetired();
+    if (!m_shm || shmRingHeader(m_shm.get())->slotStride < slotStride) {
+        if (!recreate(SHM_FRAME_RING_SLOTS, slotStride))
+            return -1;
     }
-    else {
-        size_t rowsz = static_cast<size_t>(CV_ELEM_SIZE(mat_type) * frame.cols);
-        for (int r = 0; r < frame.rows; ++r) {
-            std::memcpy(shm_data + pos, frame.ptr<char>(r), rowsz);
+
+    while (true) {
+        auto ring = shmRingHeader(m_shm.get());
+        for (int i = 0; i < ring->slotCount; i++) {
+            const auto slot = (m_nextSlot + i) % ring->slotCount;
+            auto hdr = shmSlotHeader(m_shm.get(), slot);
+            int expected = 0;
+            if (hdr->inUse.compare_exchange_strong(expected, 1, std::memory_order_acquire)) {
+                hdr->type = type;
+                hdr->rows = rows;
+                hdr->cols = cols;
+                hdr->step = step;
+                m_nextSlot = slot + 1;
+                return slot;
+            }
+        }
+
+        // all slots are held by the reader - grow the ring if we still can
+        if (ring->slotCount < SHM_FRAME_RING_MAX_SLOTS) {
+            if (!recreate(ring->slotCount * 2, ring->slotStride))
+                return -1;
+            continue;
         }
+
+        // the receiver is far behind - don't wait for it, the frame gets copied instead
+        if (m_exhaustedCount == 0)
+            qWarning().noquote() << "Receiver holds on to all" << ring->slotCount << "shared memory frame slots, sending frames inline.";
+        m_exhaustedCount++;
+        m_lastError = QStringLiteral("No free frame slot in shared memory: The receiver holds on to all %1 frames.").arg(ring->slotCount);
+        return -1;
     }
+}
 
-    shm->unlock();
+/**
+ * @brief Amount of frames that could not be placed in a slot, because all were in use.
+ */
+size_t ShmFrameRing::exhaustedCount() const
+{
+    return m_exhaustedCount;
+}
+
+/**
+ * @brief Get a writable matrix backed by a slot of the current segment.
+ */
+cv::Mat ShmFrameRing::slotMat(int slot) const
+{
+    if (!m_shm)
+        return cv::Mat();
+    return shmFrameSlotView(m_shm.get(), slot);
+}
+
+/**
+ * @brief Copy OpenCV matrix into a free slot.
+ * @return The slot index, or -1 on error.
+ */
+int ShmFrameRing::writeMat(const cv::Mat &frame)
+{
+    const auto slot = acquireSlot(frame.rows, frame.cols, frame.type());
+    if (slot < 0)
+        return -1;
+
+    auto mat = slotMat(slot);
+    frame.copyTo(mat);
+    std::atomic_thread_fence(std::memory_order_release);
+    return slot;
+}
+
+/**
+ * @brief Ensure @shm is attached to the segment with the given key.
+ */
+bool shmAttachKey(std::shared_ptr<SharedMemory> &shm, const QString &key)
+{
+    if (shm && shm->isAttached() && shm->shmKey() == key)
+        return true;
+
+    auto newShm = std::make_shared<SharedMemory>();
+    newShm->setShmKey(key);
+    if (!newShm->attach()) {
+        qWarning().noquote() << "Unable to attach to shared memory:" << newShm->lastError();
+        return false;
+    }
+    shm = newShm;
     return true;
 }
 
 /**
- * @brief Retrieve OpenCV Matrix from shared memory segment.
+ * @brief Get a matrix backed directly by the data of a frame slot, without copying.
  */
-cv::Mat cvMatFromShm(std::unique_ptr<SharedMemory> &shm, bool copy)
+cv::Mat shmFrameSlotView(SharedMemory *shm, int slot)
 {
-    if (!shm->isAttached() && !shm->attach())
+    auto hdr = shmSlotHeader(shm, slot);
+    if (hdr == nullptr)
         return cv::Mat();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return cv::Mat(hdr->rows, hdr->cols, hdr->type, shmSlotData(hdr), hdr->step);
+}
+
+/**
+ * @brief Hand a frame slot back to the writer.
+ */
+void shmFrameSlotRelease(SharedMemory *shm, int slot)
+{
+    auto hdr = shmSlotHeader(shm, slot);
+    if (hdr != nullptr)
+        hdr->inUse.store(0, std::memory_order_release);
+}
 
-    shm->lock();
-    auto shm_data = static_cast<const char*>(shm->data());
-    size_t pos = 0;
-
-    // read header
-    int header[4]; // contains type, channels, rows, cols in that order
-    std::memcpy(&header, shm_data + pos, sizeof(header));
-    pos += sizeof(header);
-
-    // read data
-    if (copy) {
-        cv::Mat mat(header[2], header[3], header[0]);
-        std::memcpy(mat.data, shm_data + pos, shm->size() - pos);
-        shm->unlock();
-        return mat;
-    } else {
-        cv::Mat mat(header[2], header[3], header[0], (uchar*) (shm_data + pos));
-        shm->unlock();
-        return mat;
+/**
+ * @brief Retrieve a copy of an OpenCV matrix from a frame slot and release the slot.
+ */
+cv::Mat cvMatFromShmSlot(std::shared_ptr<SharedMemory> &shm, const QString &key, int slot)
+{
+    if (!shmAttachKey(shm, key))
+        return cv::Mat();
+
+    const auto mat = shmFrameSlotView(shm.get(), slot).clone();
+    shmFrameSlotRelease(shm.get(), slot);
+    return mat;
+}
+
+void ipcEncode(IpcWriter &w, const ControlCommand &obj)
+{
+    w.put<qint32>(static_cast<qint32>(obj.kind));
+    w.putString(obj.command);
+}
+
+bool ipcDecode(IpcReader &r, ControlCommand &obj)
+{
+    qint32 kind;
+    if (!r.get(kind) || !r.getString(obj.command))
+        return false;
+    obj.kind = static_cast<ControlCommandKind>(kind);
+    return true;
+}
+
+void ipcEncode(IpcWriter &w, const FirmataControl &obj)
+{
+    w.put<quint8>(static_cast<quint8>(obj.command));
+    w.put<quint8>(obj.pinId);
+    w.put<quint8>(obj.isOutput);
+    w.put<quint8>(obj.isPullUp);
+    w.put<quint32>(obj.value);
+    w.putString(obj.pinName);
+}
+
+bool ipcDecode(IpcReader &r, FirmataControl &obj)
+{
+    quint8 command, isOutput, isPullUp;
+    if (!r.get(command) || !r.get(obj.pinId) || !r.get(isOutput) || !r.get(isPullUp) ||
+        !r.get(obj.value) || !r.getString(obj.pinName))
+        return false;
+    obj.command = static_cast<FirmataCommandKind>(command);
+    obj.isOutput = isOutput;
+    obj.isPullUp = isPullUp;
+    return true;
+}
+
+void ipcEncode(IpcWriter &w, const FirmataData &obj)
+{
+    w.put<qint64>(obj.time.count());
+    w.put<quint16>(obj.value);
+    w.put<quint8>(obj.pinId);
+    w.put<quint8>(obj.isDigital);
+    w.putString(obj.pinName);
+}
+
+bool ipcDecode(IpcReader &r, FirmataData &obj)
+{
+    qint64 timeMsec;
+    quint8 isDigital;
+    if (!r.get(timeMsec) || !r.get(obj.value) || !r.get(obj.pinId) ||
+        !r.get(isDigital) || !r.getString(obj.pinName))
+        return false;
+    obj.time = milliseconds_t(timeMsec);
+    obj.isDigital = isDigital;
+    return true;
+}
+
+void ipcEncode(IpcWriter &w, const TableRow &obj)
+{
+    w.put<quint32>(static_cast<quint32>(obj.size()));
+    for (const auto &col : obj)
+        w.putString(col);
+}
+
+bool ipcDecode(IpcReader &r, TableRow &obj)
+{
+    quint32 count;
+    if (!r.get(count))
+        return false;
+    obj.clear();
+    obj.reserve(static_cast<int>(count));
+    for (quint32 i = 0; i < count; i++) {
+        QString col;
+        if (!r.getString(col))
+            return false;
+        obj.append(col);
     }
+    return true;
 }
 
-bool marshalDataElement(int typeId, const QVariant &data,
-                        QVariant &outData, std::unique_ptr<SharedMemory> &shm)
+template<typename Block>
+static void ipcEncodeSignalBlock(IpcWriter &w, const Block &obj)
 {
-    if (typeId == qMetaTypeId<Frame>()) {
-        auto frame = data.value<Frame>();
-        if (!cvMatToShm(shm, frame.mat))
+    w.putArray(obj.timestamps.data(), static_cast<size_t>(obj.timestamps.size()));
+    for (uint i = 0; i < SIGNAL_BLOCK_CHAN_COUNT; i++)
+        w.putArray(obj.data[i].data(), obj.data[i].size());
+}
+
+template<typename Block>
+static bool ipcDecodeSignalBlock(IpcReader &r, Block &obj)
+{
+    std::vector<uint> timestamps;
+    if (!r.getArray(timestamps))
+        return false;
+    obj.timestamps = Eigen::Map<VectorXu>(timestamps.data(), static_cast<Eigen::Index>(timestamps.size()));
+    for (uint i = 0; i < SIGNAL_BLOCK_CHAN_COUNT; i++) {
+        if (!r.getArray(obj.data[i]))
             return false;
+    }
+    return true;
+}
 
-        QVariantList plist;
-        plist.reserve(2);
-        plist.append(QVariant::fromValue(frame.index));
-        plist.append(QVariant::fromValue(frame.time.count()));
-        outData = plist;
+void ipcEncode(IpcWriter &w, const IntSignalBlock &obj)
+{
+    ipcEncodeSignalBlock(w, obj);
+}
+
+bool ipcDecode(IpcReader &r, IntSignalBlock &obj)
+{
+    return ipcDecodeSignalBlock(r, obj);
+}
+
+void ipcEncode(IpcWriter &w, const FloatSignalBlock &obj)
+{
+    ipcEncodeSignalBlock(w, obj);
+}
+
+bool ipcDecode(IpcReader &r, FloatSignalBlock &obj)
+{
+    return ipcDecodeSignalBlock(r, obj);
+}
+
+/**
+ * @brief Encode a reference to a frame that was placed in a shared memory slot.
+ *
+ * If @slot is negative, no slot was available and the frame data is
+ * appended to the message instead.
+ */
+void ipcEncodeFrameRef(IpcWriter &w, const Frame &frame, const QString &shmKey, int slot)
+{
+    w.put<qint64>(frame.time.count());
+    w.put<quint32>(static_cast<quint32>(frame.index));
+    w.put<qint32>(slot);
+    w.putString(shmKey);
+    if (slot >= 0)
+        return;
+
+    const auto mat = frame.mat.isContinuous()? frame.mat : frame.mat.clone();
+    w.put<qint32>(mat.rows);
+    w.put<qint32>(mat.cols);
+    w.put<qint32>(mat.type());
+    w.putArray(mat.data, mat.total() * mat.elemSize());
+}
+
+/**
+ * @brief Decode a frame reference.
+ *
+ * For frames that were sent inline, @slot is negative and the frame
+ * matrix is already set.
+ */
+bool ipcDecodeFrameRef(IpcReader &r, Frame &frame, QString &shmKey, int &slot)
+{
+    qint64 timeUsec;
+    quint32 index;
+    qint32 slotIdx;
+    if (!r.get(timeUsec) || !r.get(index) || !r.get(slotIdx) || !r.getString(shmKey))
+        return false;
+    frame.time = microseconds_t(timeUsec);
+    frame.index = index;
+    slot = slotIdx;
+    if (slot >= 0)
         return true;
-    }
 
-    if (typeId == qMetaTypeId<ControlCommand>()) {
-        auto command = data.value<ControlCommand>();
-        QVariantList plist;
-        plist.reserve(2);
-        plist.append(QVariant::fromValue(command.kind));
-        plist.append(QVariant::fromValue(command.command));
-        outData = plist;
+    qint32 rows, cols, type;
+    std::vector<uchar> data;
+    if (!r.get(rows) || !r.get(cols) || !r.get(type) || !r.getArray(data))
+        return false;
+    frame.mat = cv::Mat(rows, cols, type);
+    if (data.size() != frame.mat.total() * frame.mat.elemSize())
+        return false;
+    std::memcpy(frame.mat.data, data.data(), data.size());
+    return true;
+}
+
+template<typename T>
+static bool marshalSimple(int typeId, const QVariant &data, IpcWriter &w)
+{
+    if (typeId != qMetaTypeId<T>())
+        return false;
+    ipcEncode(w, data.value<T>());
+    return true;
+}
+
+/**
+ * @brief Append the binary representation of a stream element to @w.
+ */
+bool marshalDataElement(int typeId, const QVariant &data,
+                        IpcWriter &w, ShmFrameRing *ring)
+{
+    if (typeId == qMetaTypeId<Frame>()) {
+        const auto frame = data.value<Frame>();
+
+        // a negative slot makes the frame go out inline, so a slow receiver
+        // never stalls us
+        const auto slot = ring->writeMat(frame.mat);
+        ipcEncodeFrameRef(w, frame, ring->shmKey(), slot);
         return true;
     }
 
-    // for any other type, we just have it serialize itself
-    // and append it as first parameter
-    outData = QVariant::fromValue(data);
+    if (marshalSimple<ControlCommand>(typeId, data, w))
+        return true;
+    if (marshalSimple<FirmataControl>(typeId, data, w))
+        return true;
+    if (marshalSimple<FirmataData>(typeId, data, w))
+        return true;
+    if (marshalSimple<TableRow>(typeId, data, w))
+        return true;
+    if (marshalSimple<IntSignalBlock>(typeId, data, w))
+        return true;
+    if (marshalSimple<FloatSignalBlock>(typeId, data, w))
+        return true;
 
-    return true;
+    return false;
 }
@@ -20,7 +20,12 @@
 #pragma once
 
 #include <memory>
+#include <deque>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
 #include <QVariant>
+#include <QByteArray>
 
 #include "sharedmemory.h"
 #include "streams/datatypes.h"
@@ -30,11 +35,177 @@ namespace Syntalos {
 class StreamOutputPort;
 }
 
-cv::Mat cvMatFromShm(std::unique_ptr<SharedMemory> &shm, bool copy = true);
-bool cvMatToShm(std::unique_ptr<SharedMemory> &shm, const cv::Mat &frame);
+/**
+ * @brief Header of a single frame slot in shared memory
+ *
+ * The writer of a frame marks the slot as in use, the reader clears the flag
+ * once it does not need the frame data anymore. This way, the reading side can
+ * work directly on the shared memory without copying the frame first.
+ */
+struct ShmFrameSlotHeader
+{
+    std::atomic_int inUse;
+    qint32 type;
+    qint32 rows;
+    qint32 cols;
+    quint64 step;
+};
+static_assert(std::atomic_int::is_always_lock_free, "Atomic integers must be lock-free to be shared between processes.");
+
+/**
+ * @brief Writing side of a ring of frame slots in shared memory
+ *
+ * The ring grows if the reader holds on to all of its slots, and is recreated
+ * with a new key if the frame size changes. Once it can not grow any further,
+ * frames are sent inline with the message instead of waiting for the reader. Frames are announced to the reading
+ * side with the segment key and the slot index. Replaced segments stay alive until
+ * the reader has handed back all of their slots.
+ */
+class ShmFrameRing
+{
+public:
+    explicit ShmFrameRing(const QString &initialKey = QString());
+
+    std::shared_ptr<SharedMemory> shm() const;
+    QString shmKey() const;
+    QString lastError() const;
+
+    int acquireSlot(int rows, int cols, int type);
+    cv::Mat slotMat(int slot) const;
+    int writeMat(const cv::Mat &frame);
+
+    bool owns(const SharedMemory *shm) const;
+    size_t exhaustedCount() const;
+
+private:
+    bool recreate(int slotCount, size_t slotStride);
+    void releaseRetired();
+
+    QString m_initialKey;
+    QString m_lastError;
+    std::shared_ptr<SharedMemory> m_shm;
+    std::deque<std::shared_ptr<SharedMemory>> m_retired;
+    int m_nextSlot;
+    size_t m_exhaustedCount;
+};
+
+bool shmAttachKey(std::shared_ptr<SharedMemory> &shm, const QString &key);
+cv::Mat shmFrameSlotView(SharedMemory *shm, int slot);
+void shmFrameSlotRelease(SharedMemory *shm, int slot);
+cv::Mat cvMatFromShmSlot(std::shared_ptr<SharedMemory> &shm, const QString &key, int slot);
+
+/**
+ * @brief Writer for the binary wire format of stream elements
+ *
+ * Elements are exchanged between Syntalos and its workers on the same machine,
+ * so values are written in native byte order without any framing, and each
+ * element type has a fixed encoding (see the ipcEncode() functions).
+ */
+class IpcWriter
+{
+public:
+    explicit IpcWriter(QByteArray *buffer)
+        : m_buf(buffer)
+    {}
+
+    template<typename T>
+    void put(const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written directly.");
+        m_buf->append(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    void putArray(const T *data, size_t count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written directly.");
+        put<quint32>(static_cast<quint32>(count));
+        m_buf->append(reinterpret_cast<const char*>(data), static_cast<int>(count * sizeof(T)));
+    }
+
+    void putString(const QString &str)
+    {
+        putArray(str.utf16(), static_cast<size_t>(str.size()));
+    }
+
+private:
+    QByteArray *m_buf;
+};
+
+/**
+ * @brief Reader for the binary wire format of stream elements
+ */
+class IpcReader
+{
+public:
+    explicit IpcReader(const QByteArray &buffer)
+        : m_data(buffer.constData()),
+          m_size(static_cast<size_t>(buffer.size())),
+          m_pos(0)
+    {}
+
+    template<typename T>
+    bool get(T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read directly.");
+        if (m_pos + sizeof(T) > m_size)
+            return false;
+        std::memcpy(&value, m_data + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    bool getArray(std::vector<T> &vec)
+    {
+        quint32 count;
+        if (!get(count) || m_pos + count * sizeof(T) > m_size)
+            return false;
+        vec.resize(count);
+        std::memcpy(vec.data(), m_data + m_pos, count * sizeof(T));
+        m_pos += count * sizeof(T);
+        return true;
+    }
+
+    bool getString(QString &str)
+    {
+        quint32 count;
+        if (!get(count) || m_pos + count * sizeof(ushort) > m_size)
+            return false;
+        str = QString::fromUtf16(reinterpret_cast<const ushort*>(m_data + m_pos), static_cast<int>(count));
+        m_pos += count * sizeof(ushort);
+        return true;
+    }
+
+    bool atEnd() const
+    {
+        return m_pos >= m_size;
+    }
+
+private:
+    const char *m_data;
+    size_t m_size;
+    size_t m_pos;
+};
+
+void ipcEncode(IpcWriter &w, const ControlCommand &obj);
+bool ipcDecode(IpcReader &r, ControlCommand &obj);
+void ipcEncode(IpcWriter &w, const FirmataControl &obj);
+bool ipcDecode(IpcReader &r, FirmataControl &obj);
+void ipcEncode(IpcWriter &w, const FirmataData &obj);
+bool ipcDecode(IpcReader &r, FirmataData &obj);
+void ipcEncode(IpcWriter &w, const TableRow &obj);
+bool ipcDecode(IpcReader &r, TableRow &obj);
+void ipcEncode(IpcWriter &w, const IntSignalBlock &obj);
+bool ipcDecode(IpcReader &r, IntSignalBlock &obj);
+void ipcEncode(IpcWriter &w, const FloatSignalBlock &obj);
+bool ipcDecode(IpcReader &r, FloatSignalBlock &obj);
+
+void ipcEncodeFrameRef(IpcWriter &w, const Frame &frame, const QString &shmKey, int slot);
+bool ipcDecodeFrameRef(IpcReader &r, Frame &frame, QString &shmKey, int &slot);
 
 bool marshalDataElement(int typeId, const QVariant &data,
-                        QVariant &outData, std::unique_ptr<SharedMemory> &shm);
+                        IpcWriter &w, ShmFrameRing *ring);
 
 // NOTE: unmarshalDataAndOutput is in oopworkerconnector, as it needs access to the output ports,
 // which this common IPC marshalling file can't have at the moment.
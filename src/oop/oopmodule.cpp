@@ -20,9 +20,12 @@
 #include "oopmodule.h"
 
 #include <QEventLoop>
+#include <QThread>
 #include <QRemoteObjectNode>
+#include <atomic>
 
 #include "oopworkerconnector.h"
+#include "oopworkerpool.h"
 
 namespace Syntalos {
     Q_LOGGING_CATEGORY(logOOPMod, "oopmodule")
@@ -50,7 +53,10 @@ class OOPModule::Private
 public:
     Private()
         : captureStdout(false),
-          runData(new OOPModuleRunData)
+          workerStage(OOPWorkerReplica::IDLE),
+          failed(false),
+          runData(new OOPModuleRunData),
+          workerPid(0)
     {}
     ~Private() {}
 
@@ -64,6 +70,8 @@ public:
 
     bool failed;
     QSharedPointer<OOPModuleRunData> runData;
+    OOPWorkerInstancePtr reservedWorker;
+    std::atomic<qint64> workerPid; // read from other threads, e.g. for telemetry
 };
 #pragma GCC diagnostic pop
 
@@ -76,7 +84,11 @@ OOPModule::OOPModule(QObject *parent)
 }
 
 OOPModule::~OOPModule()
-{}
+{
+    terminateWorkerIfRunning(nullptr);
+    if (!QCoreApplication::closingDown())
+        OOPWorkerPool::instance()->releaseOwner(this);
+}
 
 ModuleFeatures OOPModule::features() const
 {
@@ -86,9 +98,20 @@ ModuleFeatures OOPModule::features() const
 
 bool OOPModule::prepare(const TestSubject &)
 {
-    // terminate worker and its interface in the current thread,
+    // release worker and its interface in the current thread,
     // in case we still have one running.
-    terminateWorkerIfRunning(nullptr);
+    releaseWorker(nullptr);
+    if (d->reservedWorker)
+        OOPWorkerPool::instance()->park(this, d->reservedWorker);
+
+    // reserve a worker process for this run from the main thread, the
+    // OOP thread will connect to it. If we ran before, this will be the
+    // warm worker we had last time.
+    d->reservedWorker = OOPWorkerPool::instance()->acquire(this, d->workerBinary, d->pyVEnv);
+    if (!d->reservedWorker) {
+        raiseError("Unable to start worker process!");
+        return false;
+    }
     return true;
 }
 
@@ -167,8 +190,8 @@ void OOPModule::oopRunEvent(QEventLoop *loop)
 
 void OOPModule::oopFinalize(QEventLoop *loop)
 {
-    statusMessage("Waiting for worker to terminate...");
-    terminateWorkerIfRunning(loop);
+    statusMessage("Waiting for worker to stop...");
+    releaseWorker(loop);
     statusMessage("");
 }
 
@@ -192,13 +215,30 @@ void OOPModule::setPythonFile(const QString &fname, const QString &wdir, const Q
 
 bool OOPModule::initAndLaunchWorker(const QVector<uint> &cpuAffinity)
 {
+    auto worker = d->reservedWorker;
+    d->reservedWorker.reset();
+    if (!worker) {
+        // we were not prepared for a run (e.g. when showing the settings UI), so we have to
+        // fetch a worker now - which is only possible in the main thread
+        if (QThread::currentThread() != QCoreApplication::instance()->thread()) {
+            raiseError("No worker process was reserved for this module. This is a bug.");
+            return false;
+        }
+        worker = OOPWorkerPool::instance()->acquire(this, d->workerBinary, d->pyVEnv);
+        if (!worker) {
+            raiseError("Unable to start worker process!");
+            return false;
+        }
+    }
+
     d->runData.reset(new OOPModuleRunData);
 
     d->runData->replica.reset(d->runData->repNode->acquire<OOPWorkerReplica>());
-    d->runData->wc.reset(new OOPWorkerConnector(d->runData->replica, d->workerBinary));
+    d->runData->wc.reset(new OOPWorkerConnector(d->runData->replica, worker));
 
     auto wc = d->runData->wc;
     d->failed = false;
+    d->workerStage = OOPWorkerReplica::IDLE;
 
     // connect some of the important signals of our replica
     connect(d->runData->replica.data(), &OOPWorkerReplica::stageChanged, this, [&](const OOPWorkerReplica::Stage &newStage) {
@@ -214,12 +254,12 @@ bool OOPModule::initAndLaunchWorker(const QVector<uint> &cpuAffinity)
         setStatusMessage(text);
     });
 
-    wc->setPythonVirtualEnv(d->pyVEnv);
     wc->setCaptureStdout(d->captureStdout);
     if (!wc->connectAndRun(cpuAffinity)) {
-        raiseError("Unable to start worker process!");
+        raiseError("Unable to connect to worker process!");
         return false;
     }
+    d->workerPid = wc->workerPid();
 
     // set port information and load Python script
     wc->setPorts(inPorts(), outPorts());
@@ -245,9 +285,54 @@ void OOPModule::terminateWorkerIfRunning(QEventLoop *loop)
     }
     qCDebug(logOOPMod).noquote() << "OOP worker terminated.";
 
+    d->workerPid = 0;
     d->runData.reset();
 }
 
+/**
+ * Stop the worker's current run and hand it back to the worker pool,
+ * so the next run can reuse the process with its already imported Python
+ * modules. Workers that failed are terminated instead.
+ */
+void OOPModule::releaseWorker(QEventLoop *loop)
+{
+    if (d->runData.isNull() || d->runData->wc.isNull())
+        return;
+
+    auto pool = OOPWorkerPool::instance();
+    if (!pool->persistentWorkers() || d->failed) {
+        terminateWorkerIfRunning(loop);
+        return;
+    }
+
+    qCDebug(logOOPMod).noquote() << "Stopping OOP worker run.";
+    auto wc = d->runData->wc;
+    if (!wc->stopRun(loop)) {
+        terminateWorkerIfRunning(loop);
+        return;
+    }
+
+    if (d->captureStdout) {
+        const auto data = wc->readProcessStdout();
+        if (!data.isEmpty())
+            emit processStdoutReceived(data);
+    }
+    pool->park(this, wc->releaseWorker());
+    qCDebug(logOOPMod).noquote() << "OOP worker returned to pool.";
+
+    d->workerPid = 0;
+    d->runData.reset();
+}
+
+/**
+ * PID of the worker process used in the current run, or 0 if no worker is running.
+ * This function may be called from any thread.
+ */
+qint64 OOPModule::workerPid() const
+{
+    return d->workerPid;
+}
+
 std::optional<QRemoteObjectPendingReply<QByteArray>> OOPModule::showSettingsChangeUi(const QByteArray &oldSettings)
 {
     if (d->runData.isNull() || d->runData->wc.isNull()) {
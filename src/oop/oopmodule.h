@@ -48,6 +48,8 @@ public:
     void oopRunEvent(QEventLoop *loop);
     void oopFinalize(QEventLoop *loop);
 
+    qint64 workerPid() const;
+
 signals:
     void processStdoutReceived(const QString &text);
 
@@ -58,6 +60,7 @@ protected:
                        const QString &wdir = QString(), const QString &venv = QString());
     bool initAndLaunchWorker(const QVector<uint> &cpuAffinity = QVector<uint>());
     void terminateWorkerIfRunning(QEventLoop *loop);
+    void releaseWorker(QEventLoop *loop);
 
     std::optional<QRemoteObjectPendingReply<QByteArray> > showSettingsChangeUi(const QByteArray &oldSettings);
 
@@ -21,21 +21,22 @@
 
 #include <thread>
 #include <QUuid>
-#include <QProcessEnvironment>
 
 #include "streams/frametype.h"
-#include "utils/misc.h"
 #include "ipcmarshal.h"
 #include "globalconfig.h"
-#include "sysinfo.h"
+#include "sytrace.h"
 
 using namespace Syntalos;
 
-OOPWorkerConnector::OOPWorkerConnector(QSharedPointer<OOPWorkerReplica> ptr, const QString &workerBin)
+// maximum number of elements we send to the worker in one go
+static constexpr int OOP_INPUT_BATCH_MAX = 16;
+
+OOPWorkerConnector::OOPWorkerConnector(QSharedPointer<OOPWorkerReplica> ptr, OOPWorkerInstancePtr worker)
     : QObject(nullptr),
       m_reptr(ptr),
-      m_proc(new QProcess(this)),
-      m_workerBinary(workerBin),
+      m_worker(worker),
+      m_failed(false),
       m_inPortsAvailable(-1),
       m_outPortsAvailable(-1)
 {
@@ -52,70 +53,107 @@ OOPWorkerConnector::~OOPWorkerConnector()
     terminate();
 }
 
-void OOPWorkerConnector::setWorkerBinary(const QString &binPath)
-{
-    m_workerBinary = binPath;
-}
-
-void OOPWorkerConnector::terminate(QEventLoop *loop)
+static inline void processWorkerEvents(QEventLoop *loop)
 {
     if (loop)
         loop->processEvents();
     else
         QCoreApplication::processEvents();
+}
+
+void OOPWorkerConnector::terminate(QEventLoop *loop)
+{
+    processWorkerEvents(loop);
 
-    if (m_proc->state() != QProcess::Running)
+    if (!m_worker)
         return;
+    auto worker = m_worker;
+    m_worker.reset();
+
+    if (worker->alive && m_reptr->isReplicaValid()) {
+        // have worker prepare for shutdown
+        m_reptr->prepareShutdown().waitForFinished(10000);
+
+        // ask the worker to shut down
+        m_reptr->shutdown();
+        processWorkerEvents(loop);
+
+        // give our worker 10sec to react
+        const auto waitStartTime = currentTimePoint();
+        while (m_reptr->isReplicaValid()) {
+            processWorkerEvents(loop);
+            if (timeDiffToNowMsec(waitStartTime).count() > 10000)
+                break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
 
-    // have worker prepare for shutdown
-    m_reptr->prepareShutdown().waitForFinished(10000);
+    // the pool will terminate and finally kill the worker process,
+    // in case it did not quit by itself
+    if (!QCoreApplication::closingDown())
+        OOPWorkerPool::instance()->discard(worker);
+}
 
-    // ask the worker to shut down
-    m_reptr->shutdown();
-    if (loop)
-        loop->processEvents();
-    else
-        QCoreApplication::processEvents();
+/**
+ * Stop the current run of the worker without terminating its process.
+ * Returns true if the worker is back in a clean idle state and can be
+ * reused for another run.
+ */
+bool OOPWorkerConnector::stopRun(QEventLoop *loop)
+{
+    processWorkerEvents(loop);
 
-    // give our worker 10sec to react
-    m_proc->waitForFinished(10000);
-    m_proc->terminate();
+    if (!m_worker || !m_worker->alive || m_failed)
+        return false;
+    if (!m_reptr->isReplicaValid())
+        return false;
 
-    // give the process 5sec to terminate
-    m_proc->waitForFinished(5000);
+    // a worker that still shows a settings dialog is busy
+    if (m_settingsReply.has_value() && !m_settingsReply->isFinished())
+        return false;
+
+    if (!m_reptr->prepareShutdown().waitForFinished(10000))
+        return false;
 
-    // finally kill the unresponsive worker
-    m_proc->kill();
+    // wait for the worker's run loop to finish
+    const auto waitStartTime = currentTimePoint();
+    while (m_reptr->stage() != OOPWorkerReplica::IDLE) {
+        processWorkerEvents(loop);
+        if (m_failed || (m_reptr->stage() == OOPWorkerReplica::ERROR))
+            return false;
+        if (!m_reptr->isReplicaValid())
+            return false;
+        if (timeDiffToNowMsec(waitStartTime).count() > 10000)
+            return false;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+/**
+ * Detach the worker process from this connector, so it will
+ * not be terminated when the connector is destroyed.
+ */
+OOPWorkerInstancePtr OOPWorkerConnector::releaseWorker()
+{
+    auto worker = m_worker;
+    m_worker.reset();
+    return worker;
 }
 
 bool OOPWorkerConnector::connectAndRun(const QVector<uint> &cpuAffinity)
 {
     m_failed = false;
     m_workerReady = false;
-    const auto address = QStringLiteral("local:maw-%1").arg(createRandomString(16));
-    m_reptr->node()->connectToNode(QUrl(address));
 
-    if (m_workerBinary.isEmpty()) {
-        qWarning().noquote() << "OOP module has not set a worker binary";
-        m_failed = true;
-        return false;
-    }
-
-    auto penv = QProcessEnvironment::systemEnvironment();
-    penv.insert("SYNTALOS_VERSION", syntalosVersionFull());
-    if (!m_pyVenvDir.isEmpty()) {
-        penv.remove("PYTHONHOME");
-        penv.insert("VIRTUAL_ENV", m_pyVenvDir);
-        penv.insert("PATH", QStringLiteral("%1/bin/:%2").arg(m_pyVenvDir).arg(penv.value("PATH", "")));
-    }
-    m_proc->setProcessChannelMode(QProcess::ForwardedChannels);
-
-    m_proc->setProcessEnvironment(penv);
-    m_proc->start(m_workerBinary, QStringList() << address);
-    if (!m_proc->waitForStarted()) {
+    if (!m_worker || !m_worker->alive) {
+        qWarning().noquote() << "OOP module has no running worker process to connect to";
         m_failed = true;
         return false;
     }
+    m_worker->captureStdout = m_captureStdout;
+    m_reptr->node()->connectToNode(QUrl(m_worker->address));
 
     if (!m_reptr->waitForSource(10000)) {
         m_failed = true;
@@ -139,9 +177,10 @@ void OOPWorkerConnector::setPorts(QList<std::shared_ptr<VarStreamInputPort>> inP
     QList<InputPortInfo> iPortInfo;
     for (int i = 0; i < inPorts.size(); i++) {
         const auto &iport = inPorts[i];
-        std::unique_ptr<SharedMemory> shm(new SharedMemory);
-        auto shmPtr = shm.get();
-        m_shmSend.push_back(std::move(shm));
+        SharedMemory keyGen;
+        keyGen.createShmKey();
+        const auto shmKey = keyGen.shmKey();
+        m_shmSend.push_back(std::make_unique<ShmFrameRing>(shmKey));
 
         InputPortInfo pi;
         pi.setId(i);
@@ -156,8 +195,7 @@ void OOPWorkerConnector::setPorts(QList<std::shared_ptr<VarStreamInputPort>> inP
         }
         pi.setDataTypeName(iport->dataTypeName());
 
-        shmPtr->createShmKey();
-        pi.setShmKeyRecv(shmPtr->shmKey());
+        pi.setShmKeyRecv(shmKey);
 
         iPortInfo.append(pi);
     }
@@ -172,9 +210,9 @@ void OOPWorkerConnector::setPorts(QList<std::shared_ptr<VarStreamInputPort>> inP
     QList<OutputPortInfo> oPortInfo;
     for (int i = 0; i < outPorts.size(); i++) {
         const auto &oport = outPorts[i];
-        std::unique_ptr<SharedMemory> shm(new SharedMemory);
-        auto shmPtr = shm.get();
-        m_shmRecv.push_back(std::move(shm));
+        auto shm = std::make_shared<SharedMemory>();
+        shm->createShmKey();
+        m_shmRecv.push_back(shm);
         m_outPorts.append(oport);
 
         OutputPortInfo pi;
@@ -185,8 +223,7 @@ void OOPWorkerConnector::setPorts(QList<std::shared_ptr<VarStreamInputPort>> inP
         pi.setMetadata(oport->streamVar()->metadata());
         pi.setDataTypeName(oport->streamVar()->dataTypeName());
 
-        shmPtr->createShmKey();
-        pi.setShmKeySend(shmPtr->shmKey());
+        pi.setShmKeySend(shm->shmKey());
 
         oPortInfo.append(pi);
     }
@@ -200,11 +237,6 @@ void OOPWorkerConnector::initWithPythonScript(const QString &script, const QStri
     m_reptr->loadPythonScript(script, wdir).waitForFinished(10000);
 }
 
-void OOPWorkerConnector::setPythonVirtualEnv(const QString &venvDir)
-{
-    m_pyVenvDir = venvDir;
-}
-
 void OOPWorkerConnector::prepareStart(const QByteArray &settings)
 {
     m_reptr->prepareStart(settings).waitForFinished(10000);
@@ -222,10 +254,17 @@ void OOPWorkerConnector::forwardInputData(QEventLoop *loop)
         if (m_failed)
             break;
 
-        // retrieve next variant, don't wait
-        auto res = sip.second->peekNextVar();
-        if (res.isValid())
-            sendInputData(sip.second->dataTypeId(), sip.first, res, loop);
+        // retrieve all pending elements (up to the batch limit) without waiting,
+        // so we only need one roundtrip to the worker for all of them
+        QVariantList batch;
+        while (batch.size() < OOP_INPUT_BATCH_MAX) {
+            auto res = sip.second->peekNextVar();
+            if (!res.isValid())
+                break;
+            batch.append(res);
+        }
+        if (!batch.isEmpty())
+            sendInputData(sip.second->dataTypeId(), sip.first, batch, loop);
     }
 }
 
@@ -236,7 +275,15 @@ bool OOPWorkerConnector::failed() const
 
 QRemoteObjectPendingReply<QByteArray> OOPWorkerConnector::changeSettings(const QByteArray &oldSettings)
 {
-    return m_reptr->changeSettings(oldSettings);
+    m_settingsReply = m_reptr->changeSettings(oldSettings);
+    return m_settingsReply.value();
+}
+
+qint64 OOPWorkerConnector::workerPid() const
+{
+    if (!m_worker)
+        return 0;
+    return m_worker->pid;
 }
 
 bool OOPWorkerConnector::captureStdout() const
@@ -247,18 +294,16 @@ bool OOPWorkerConnector::captureStdout() const
 void OOPWorkerConnector::setCaptureStdout(bool capture)
 {
     m_captureStdout = capture;
-    if (m_captureStdout)
-        m_proc->setProcessChannelMode(QProcess::MergedChannels);
-    else
-        m_proc->setProcessChannelMode(QProcess::ForwardedChannels);
+    if (m_worker)
+        m_worker->captureStdout = capture;
 }
 
 QString OOPWorkerConnector::readProcessStdout()
 {
-    if (!m_captureStdout)
+    if (!m_captureStdout || !m_worker)
         return QString();
 
-    return m_proc->readAllStandardOutput();
+    return m_worker->takeStdout();
 }
 
 void OOPWorkerConnector::receiveReadyChange(bool ready)
@@ -267,53 +312,77 @@ void OOPWorkerConnector::receiveReadyChange(bool ready)
 }
 
 template<typename T>
-static bool unmarshalAndOutputSimple(const int &typeId, const QVariant &argData, StreamOutputPort *port)
+static bool unmarshalAndOutputSimple(int typeId, IpcReader &r, StreamOutputPort *port)
 {
-    if (typeId == qMetaTypeId<T>()) {
-        port->stream<T>()->push(qvariant_cast<T>(argData));
-        return true;
-    }
-    return false;
+    if (typeId != qMetaTypeId<T>())
+        return false;
+
+    T element;
+    if (!ipcDecode(r, element))
+        return false;
+    port->stream<T>()->push(element);
+    return true;
 }
 
-static bool unmarshalDataAndOutput(int typeId, const QVariant &argData, std::unique_ptr<SharedMemory> &shm, StreamOutputPort *port)
+static bool unmarshalDataAndOutput(int typeId, IpcReader &r, std::shared_ptr<SharedMemory> &shm, StreamOutputPort *port)
 {
     if (typeId == qMetaTypeId<Frame>()) {
-        const auto plist = argData.toList();
-        if (plist.length() != 2) {
-            qCritical() << "Unable to deserialize frame argument data: Invalid number of elements";
+        Frame frame;
+        QString shmKey;
+        int slot;
+        if (!ipcDecodeFrameRef(r, frame, shmKey, slot)) {
+            qCritical() << "Unable to deserialize frame argument data: Invalid data";
             return false;
         }
-        milliseconds_t msec(plist[1].toLongLong());
-        Frame frame(plist[0].toUInt(), cvMatFromShm(shm), msec);
+
+        // we copy the frame out of the worker's slot here, as we can not know for how long
+        // the modules downstream will hold on to it (inline frames are already copied)
+        if (slot >= 0)
+            frame.mat = cvMatFromShmSlot(shm, shmKey, slot);
 
         port->stream<Frame>()->push(frame);
         return true;
     }
 
-    if (unmarshalAndOutputSimple<ControlCommand>(typeId, argData, port))
+    if (unmarshalAndOutputSimple<ControlCommand>(typeId, r, port))
         return true;
 
-    if (unmarshalAndOutputSimple<FirmataControl>(typeId, argData, port))
+    if (unmarshalAndOutputSimple<FirmataControl>(typeId, r, port))
         return true;
-    if (unmarshalAndOutputSimple<FirmataData>(typeId, argData, port))
+    if (unmarshalAndOutputSimple<FirmataData>(typeId, r, port))
         return true;
 
-    if (unmarshalAndOutputSimple<TableRow>(typeId, argData, port))
+    if (unmarshalAndOutputSimple<TableRow>(typeId, r, port))
+        return true;
+
+    if (unmarshalAndOutputSimple<IntSignalBlock>(typeId, r, port))
+        return true;
+    if (unmarshalAndOutputSimple<FloatSignalBlock>(typeId, r, port))
         return true;
 
     return false;
 }
 
-void OOPWorkerConnector::receiveOutput(int outPortId, QVariant argData)
+void OOPWorkerConnector::receiveOutput(int outPortId, const QByteArray &data)
 {
     if ((outPortId >= m_outPortsAvailable) || (m_outPortsAvailable < 0))
         return;
     auto outPort = m_outPorts[outPortId];
     const auto typeId = outPort->dataTypeId();
 
-    if (!unmarshalDataAndOutput(typeId, argData, m_shmRecv[outPortId], outPort.get()))
+    IpcReader r(data);
+    quint32 count;
+    if (!r.get(count)) {
+        qWarning().noquote() << "Received invalid data from worker on port" << outPort->id();
+        return;
+    }
+
+    for (quint32 i = 0; i < count; i++) {
+        if (!unmarshalDataAndOutput(typeId, r, m_shmRecv[outPortId], outPort.get())) {
             qWarning().noquote() << "Could not interpret data received from worker on port" << outPort->id();
+            return;
+        }
+    }
 }
 
 void OOPWorkerConnector::receiveOutputPortMetadataUpdate(int outPortId, const QVariantHash &metadata)
@@ -332,23 +401,28 @@ void OOPWorkerConnector::receiveInputThrottleRequest(int inPortId, uint itemsPer
     sub.second->setThrottleItemsPerSec(itemsPerSec, allowMore);
 }
 
-void OOPWorkerConnector::sendInputData(int typeId, int portId, const QVariant &data, QEventLoop *loop)
+void OOPWorkerConnector::sendInputData(int typeId, int portId, const QVariantList &data, QEventLoop *loop)
 {
-    QVariant outData;
-
-    auto ret = marshalDataElement(typeId, data,
-                                  outData, m_shmSend[portId]);
-    if (!ret) {
-        const auto dataTypeName = QMetaType::typeName(typeId);
-        m_failed = true;
-        if (!m_shmSend[portId]->lastError().isEmpty())
-            emit m_reptr->error(QStringLiteral("Unable to write %1 element into shared memory: %2").arg(dataTypeName).arg(m_shmSend[portId]->lastError()));
-        else
-            emit m_reptr->error(QStringLiteral("Marshalling of %1 element for subprocess submission failed. This is a bug.").arg(dataTypeName));
-        return;
+    SY_TRACE_SPAN("OOPWorkerConnector::sendInputData");
+    QByteArray buffer;
+    IpcWriter w(&buffer);
+    w.put<quint32>(static_cast<quint32>(data.size()));
+
+    for (const auto &element : data) {
+        auto ret = marshalDataElement(typeId, element,
+                                      w, m_shmSend[portId].get());
+        if (!ret) {
+            const auto dataTypeName = QMetaType::typeName(typeId);
+            m_failed = true;
+            if (!m_shmSend[portId]->lastError().isEmpty())
+                emit m_reptr->error(QStringLiteral("Unable to write %1 element into shared memory: %2").arg(dataTypeName).arg(m_shmSend[portId]->lastError()));
+            else
+                emit m_reptr->error(QStringLiteral("Marshalling of %1 element for subprocess submission failed. This is a bug.").arg(dataTypeName));
+            return;
+        }
     }
 
-    if (!m_reptr->receiveInput(portId, outData).waitForFinished(1000)) {
+    if (!m_reptr->receiveInput(portId, buffer).waitForFinished(1000)) {
         // ensure we handle potential error events before emitting our own
         if (loop != nullptr)
             loop->processEvents();
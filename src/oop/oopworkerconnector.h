@@ -21,26 +21,27 @@
 
 #include <QObject>
 #include <QSharedPointer>
-#include <QProcess>
 #include <memory>
 
 #include "moduleapi.h"
+#include "oopworkerpool.h"
 #include "rep_interface_replica.h"
 
 using namespace Syntalos;
 
 class SharedMemory;
+class ShmFrameRing;
 
 class OOPWorkerConnector : public QObject
 {
     Q_OBJECT
 public:
-    OOPWorkerConnector(QSharedPointer<OOPWorkerReplica> ptr, const QString &workerBin);
+    OOPWorkerConnector(QSharedPointer<OOPWorkerReplica> ptr, OOPWorkerInstancePtr worker);
     ~OOPWorkerConnector();
 
-    void setWorkerBinary(const QString &binPath);
-
     void terminate(QEventLoop *loop = nullptr);
+    bool stopRun(QEventLoop *loop = nullptr);
+    OOPWorkerInstancePtr releaseWorker();
 
     bool connectAndRun(const QVector<uint> &cpuAffinity);
 
@@ -48,7 +49,6 @@ public:
                   QList<std::shared_ptr<StreamOutputPort>> outPorts);
 
     void initWithPythonScript(const QString &script, const QString &wdir = QString());
-    void setPythonVirtualEnv(const QString &venvDir);
 
     void prepareStart(const QByteArray &settings = QByteArray());
     void start(const symaster_timepoint &timePoint);
@@ -64,27 +64,28 @@ public:
 
     QString readProcessStdout();
 
+    qint64 workerPid() const;
+
 private slots:
     void receiveReadyChange(bool ready);
-    void receiveOutput(int outPortId, QVariant argData);
+    void receiveOutput(int outPortId, const QByteArray &data);
     void receiveOutputPortMetadataUpdate(int outPortId, const QVariantHash &metadata);
     void receiveInputThrottleRequest(int inPortId, uint itemsPerSec, bool allowMore);
 
 private:
     QSharedPointer<OOPWorkerReplica> m_reptr;
-    QProcess *m_proc;
-    QString m_workerBinary;
-    QString m_pyVenvDir;
+    OOPWorkerInstancePtr m_worker;
+    std::optional<QRemoteObjectPendingReply<QByteArray>> m_settingsReply;
     bool m_captureStdout;
     bool m_workerReady;
     bool m_failed;
 
-    std::vector<std::unique_ptr<SharedMemory>> m_shmSend;
-    std::vector<std::unique_ptr<SharedMemory>> m_shmRecv;
+    std::vector<std::unique_ptr<ShmFrameRing>> m_shmSend;
+    std::vector<std::shared_ptr<SharedMemory>> m_shmRecv;
     std::vector<std::pair<int, std::shared_ptr<VariantStreamSubscription>>> m_subs;
     QList<std::shared_ptr<StreamOutputPort>> m_outPorts;
     int m_inPortsAvailable;
     int m_outPortsAvailable;
 
-    void sendInputData(int typeId, int portId, const QVariant &data, QEventLoop *loop = nullptr);
+    void sendInputData(int typeId, int portId, const QVariantList &data, QEventLoop *loop = nullptr);
 };
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "oopworkerpool.h"
+
+#include <iostream>
+#include <QCoreApplication>
+#include <QProcess>
+#include <QProcessEnvironment>
+#include <QThread>
+#include <QTimer>
+#include <QDebug>
+
+#include "globalconfig.h"
+#include "utils/misc.h"
+
+using namespace Syntalos;
+
+QString OOPWorkerInstance::takeStdout()
+{
+    QMutexLocker locker(&stdoutMutex);
+    const auto data = QString::fromUtf8(stdoutBuf);
+    stdoutBuf.clear();
+    return data;
+}
+
+static inline QString workerPoolKey(const QString &binary, const QString &venvDir)
+{
+    return QStringLiteral("%1\n%2").arg(binary, venvDir);
+}
+
+OOPWorkerPool *OOPWorkerPool::instance()
+{
+    static QPointer<OOPWorkerPool> pool;
+    if (pool.isNull()) {
+        Q_ASSERT(QThread::currentThread() == QCoreApplication::instance()->thread());
+        pool = new OOPWorkerPool(QCoreApplication::instance());
+    }
+    return pool;
+}
+
+OOPWorkerPool::OOPWorkerPool(QObject *parent)
+    : QObject(parent),
+      m_persistent(true)
+{}
+
+OOPWorkerPool::~OOPWorkerPool()
+{
+    // the QProcess instances are our children and will be killed
+    // when they are deleted, so we only need to drop our references here
+    QMutexLocker locker(&m_mutex);
+    m_parked.clear();
+    m_spares.clear();
+}
+
+bool OOPWorkerPool::persistentWorkers() const
+{
+    return m_persistent;
+}
+
+void OOPWorkerPool::setPersistentWorkers(bool enabled)
+{
+    m_persistent = enabled;
+    if (m_persistent)
+        return;
+
+    // drop all workers we are currently keeping warm
+    QList<OOPWorkerInstancePtr> unused;
+    {
+        QMutexLocker locker(&m_mutex);
+        unused = m_parked.values() + m_spares.values();
+        m_parked.clear();
+        m_spares.clear();
+    }
+    for (auto &worker : unused)
+        discard(worker);
+}
+
+OOPWorkerInstancePtr OOPWorkerPool::spawnWorker(const QString &binary, const QString &venvDir)
+{
+    auto worker = std::make_shared<OOPWorkerInstance>();
+    worker->address = QStringLiteral("local:maw-%1").arg(createRandomString(16));
+    worker->binary = binary;
+    worker->venvDir = venvDir;
+
+    auto penv = QProcessEnvironment::systemEnvironment();
+    penv.insert("SYNTALOS_VERSION", syntalosVersionFull());
+    if (!venvDir.isEmpty()) {
+        penv.remove("PYTHONHOME");
+        penv.insert("VIRTUAL_ENV", venvDir);
+        penv.insert("PATH", QStringLiteral("%1/bin/:%2").arg(venvDir).arg(penv.value("PATH", "")));
+    }
+
+    // we always read the worker output ourselves, and either buffer it for the
+    // module that currently uses the worker, or forward it to our own stdout
+    auto proc = new QProcess(this);
+    worker->proc = proc;
+    proc->setProcessChannelMode(QProcess::MergedChannels);
+    proc->setProcessEnvironment(penv);
+
+    std::weak_ptr<OOPWorkerInstance> wref(worker);
+    connect(proc, &QProcess::readyReadStandardOutput, this, [proc, wref]() {
+        const auto data = proc->readAllStandardOutput();
+        const auto w = wref.lock();
+        if (w && w->captureStdout) {
+            QMutexLocker locker(&w->stdoutMutex);
+            w->stdoutBuf.append(data);
+        } else {
+            std::cout.write(data.constData(), data.size());
+            std::cout.flush();
+        }
+    });
+    connect(proc, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [proc, wref](int, QProcess::ExitStatus) {
+        const auto w = wref.lock();
+        if (w)
+            w->alive = false;
+        proc->deleteLater();
+    });
+
+    proc->start(binary, QStringList() << worker->address);
+    if (!proc->waitForStarted()) {
+        qWarning().noquote() << "Unable to launch worker process" << binary << ":" << proc->errorString();
+        proc->deleteLater();
+        return nullptr;
+    }
+    worker->pid = proc->processId();
+    worker->alive = true;
+
+    return worker;
+}
+
+void OOPWorkerPool::terminateWorker(OOPWorkerInstancePtr worker)
+{
+    worker->alive = false;
+    QPointer<QProcess> proc = worker->proc;
+    if (proc.isNull())
+        return;
+    if (proc->state() == QProcess::NotRunning) {
+        proc->deleteLater();
+        return;
+    }
+
+    // give the process 5sec to terminate, then kill it
+    proc->terminate();
+    QTimer::singleShot(5000, proc, [proc]() {
+        if (proc->state() != QProcess::NotRunning)
+            proc->kill();
+    });
+}
+
+void OOPWorkerPool::refillSpares(const QString &binary, const QString &venvDir)
+{
+    if (!m_persistent)
+        return;
+
+    const auto key = workerPoolKey(binary, venvDir);
+    {
+        QMutexLocker locker(&m_mutex);
+        const auto spare = m_spares.value(key);
+        if (spare && spare->alive)
+            return;
+    }
+
+    auto worker = spawnWorker(binary, venvDir);
+    if (!worker)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    m_spares.insert(key, worker);
+}
+
+/**
+ * Get a running worker for @owner. If @owner has used a worker in a previous run
+ * which is still alive, that one is returned, otherwise a pre-started spare process
+ * or a freshly launched one is used.
+ * Must be called from the main thread.
+ */
+OOPWorkerInstancePtr OOPWorkerPool::acquire(const void *owner, const QString &binary, const QString &venvDir)
+{
+    Q_ASSERT(QThread::currentThread() == thread());
+
+    GlobalConfig gconf;
+    if (gconf.persistentOOPWorkers() != m_persistent)
+        setPersistentWorkers(gconf.persistentOOPWorkers());
+
+    OOPWorkerInstancePtr stale;
+    OOPWorkerInstancePtr worker;
+    {
+        QMutexLocker locker(&m_mutex);
+        worker = m_parked.take(owner);
+        if (worker && (!worker->alive || worker->binary != binary || worker->venvDir != venvDir)) {
+            stale = worker;
+            worker.reset();
+        }
+
+        if (!worker) {
+            const auto spare = m_spares.take(workerPoolKey(binary, venvDir));
+            if (spare && spare->alive)
+                worker = spare;
+        }
+    }
+    if (stale)
+        terminateWorker(stale);
+
+    if (!worker)
+        worker = spawnWorker(binary, venvDir);
+
+    // have a fresh worker ready for the next module of this type
+    if (m_persistent) {
+        QTimer::singleShot(0, this, [this, binary, venvDir]() {
+            refillSpares(binary, venvDir);
+        });
+    }
+
+    return worker;
+}
+
+/**
+ * Hand a worker that is in a clean, idle state back to the pool,
+ * to be reused by @owner in its next run.
+ * This function is thread-safe.
+ */
+void OOPWorkerPool::park(const void *owner, OOPWorkerInstancePtr worker)
+{
+    if (!worker)
+        return;
+    worker->captureStdout = false;
+    if (!m_persistent || !worker->alive) {
+        discard(worker);
+        return;
+    }
+
+    OOPWorkerInstancePtr previous;
+    {
+        QMutexLocker locker(&m_mutex);
+        previous = m_parked.take(owner);
+        m_parked.insert(owner, worker);
+    }
+    if (previous && previous != worker)
+        discard(previous);
+}
+
+/**
+ * Terminate a worker that can not be reused.
+ * This function is thread-safe, the process is terminated asynchronously
+ * by the main thread.
+ */
+void OOPWorkerPool::discard(OOPWorkerInstancePtr worker)
+{
+    if (!worker)
+        return;
+    worker->alive = false;
+    QMetaObject::invokeMethod(this, [this, worker]() {
+        terminateWorker(worker);
+    }, Qt::QueuedConnection);
+}
+
+/**
+ * Terminate the parked worker of @owner, if there is one.
+ * Must be called when the owner is deleted.
+ */
+void OOPWorkerPool::releaseOwner(const void *owner)
+{
+    OOPWorkerInstancePtr worker;
+    {
+        QMutexLocker locker(&m_mutex);
+        worker = m_parked.take(owner);
+    }
+    if (worker)
+        discard(worker);
+}
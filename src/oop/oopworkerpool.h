@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QMutex>
+#include <QHash>
+#include <QPointer>
+#include <QProcess>
+#include <memory>
+#include <atomic>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+/**
+ * @brief A running worker process owned by the worker pool
+ *
+ * All fields except for the process object itself may be accessed
+ * from any thread. The QProcess instance is only ever touched in the
+ * main thread, which owns it.
+ */
+class OOPWorkerInstance
+{
+public:
+    OOPWorkerInstance()
+        : pid(0),
+          alive(false),
+          captureStdout(false)
+    {}
+
+    QString address;
+    QString binary;
+    QString venvDir;
+    qint64 pid;
+
+    std::atomic_bool alive;
+    std::atomic_bool captureStdout;
+
+    QMutex stdoutMutex;
+    QByteArray stdoutBuf;
+
+    QString takeStdout();
+
+private:
+    friend class OOPWorkerPool;
+    QPointer<QProcess> proc;
+};
+#pragma GCC diagnostic pop
+
+using OOPWorkerInstancePtr = std::shared_ptr<OOPWorkerInstance>;
+
+/**
+ * @brief Pool of warm out-of-process worker processes
+ *
+ * Launching a worker and having it import its (potentially huge) Python
+ * dependencies takes a long time. This pool keeps workers alive between runs,
+ * so a module can reuse the process it had in the previous run, and keeps
+ * a pre-started spare process around for every type of worker that is in use.
+ *
+ * Workers must be acquired from the main thread, as the worker process dies
+ * with the thread that launched it. Returning workers to the pool is thread-safe.
+ */
+class OOPWorkerPool : public QObject
+{
+    Q_OBJECT
+public:
+    static OOPWorkerPool *instance();
+    ~OOPWorkerPool() override;
+
+    bool persistentWorkers() const;
+    void setPersistentWorkers(bool enabled);
+
+    OOPWorkerInstancePtr acquire(const void *owner,
+                                 const QString &binary,
+                                 const QString &venvDir = QString());
+    void park(const void *owner, OOPWorkerInstancePtr worker);
+    void discard(OOPWorkerInstancePtr worker);
+    void releaseOwner(const void *owner);
+
+private:
+    explicit OOPWorkerPool(QObject *parent = nullptr);
+    Q_DISABLE_COPY(OOPWorkerPool)
+
+    OOPWorkerInstancePtr spawnWorker(const QString &binary, const QString &venvDir);
+    void terminateWorker(OOPWorkerInstancePtr worker);
+    void refillSpares(const QString &binary, const QString &venvDir);
+
+    QMutex m_mutex;
+    std::atomic_bool m_persistent;
+    QHash<const void*, OOPWorkerInstancePtr> m_parked;
+    QHash<QString, OOPWorkerInstancePtr> m_spares;
+};
@@ -29,8 +29,12 @@
 #include <QUuid>
 #include <QDebug>
 
+// offset of the data section, after the semaphore, aligned to a cache line
+static constexpr size_t SHM_DATA_OFFSET = ((sizeof(sem_t) + 63) / 64) * 64;
+
 SharedMemory::SharedMemory()
     : m_attached(false),
+      m_owner(false),
       m_data(nullptr),
       m_dataLen(0),
       m_shmPtr(nullptr),
@@ -42,6 +46,14 @@ SharedMemory::~SharedMemory()
 {
     int res;
 
+    if (m_shmPtr != nullptr && !m_owner) {
+        // we only attached to this segment, its creator will clean it up
+        res = munmap(m_shmPtr, m_shmLen);
+        if (res == -1)
+            qWarning().noquote() << "Shared memory unmap (size:" << m_shmLen << ") failed:" << QString::fromStdString(std::strerror(errno));
+        return;
+    }
+
     if (m_shmPtr != nullptr) {
         int fd;
 
@@ -133,21 +145,23 @@ bool SharedMemory::create(size_t size)
         return false;
     }
 
-    res = ftruncate(fd, static_cast<off_t>(size));
+    m_shmLen = SHM_DATA_OFFSET + size;
+    res = ftruncate(fd, static_cast<off_t>(m_shmLen));
     if (res != 0) {
         setErrorFromErrno("create/ftruncate");
         return false;
     }
 
-    m_shmLen = size + sizeof(sem_t);
-    m_shmPtr = mmap(nullptr, m_shmLen, PROT_WRITE, MAP_SHARED, fd, 0);
+    m_shmPtr = mmap(nullptr, m_shmLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
     if (m_shmPtr == MAP_FAILED) {
+        m_shmPtr = nullptr;
         setErrorFromErrno("create/mmap");
         return false;
     }
+    m_owner = true;
 
     m_mutex = static_cast<sem_t*>(m_shmPtr);
-    m_data = static_cast<int*>(m_shmPtr) + sizeof(sem_t);
+    m_data = static_cast<char*>(m_shmPtr) + SHM_DATA_OFFSET;
     if (sem_init(m_mutex, 1, 1) < 0) {
         setErrorFromErrno("semaphore initialization");
         return false;
@@ -171,8 +185,8 @@ bool SharedMemory::attach()
         return false;
     }
 
-    const char *shmKey = qPrintable(m_shmKey);
-    int fd = shm_open(shmKey, O_RDWR, S_IRUSR | S_IWUSR);
+    const auto shmKey = m_shmKey.toLocal8Bit();
+    int fd = shm_open(shmKey.constData(), O_RDWR, S_IRUSR | S_IWUSR);
     if (fd == -1) {
         setErrorFromErrno("attach/shm_open");
         return false;
@@ -184,14 +198,23 @@ bool SharedMemory::attach()
         m_shmLen = sbuf.st_size < 0? 0 : static_cast<size_t>(sbuf.st_size);
     } else {
         setErrorFromErrno(QString("attach/stat#%1").arg(res));
+        close(fd);
         return false;
     }
 
     // we always needs to map this writable, as we may need to lock the semaphore that is in writable memory
     // NOTE: If we want to restrict access to the shared memory region more, we could use named system semaphores
     // instead in future.
-    m_shmPtr = mmap(nullptr, m_shmLen, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (m_shmLen < SHM_DATA_OFFSET) {
+        close(fd);
+        m_lastError = QStringLiteral("attach: Shared memory segment is too small.");
+        return false;
+    }
+
+    m_shmPtr = mmap(nullptr, m_shmLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
     if (m_shmPtr == MAP_FAILED) {
+        m_shmPtr = nullptr;
         setErrorFromErrno("attach/mmap");
         return false;
     }
@@ -199,8 +222,8 @@ bool SharedMemory::attach()
     // fetch pointer to semaphore
     m_mutex = static_cast<sem_t*>(m_shmPtr);
 
-    m_dataLen = m_shmLen - sizeof(sem_t);
-    m_data = static_cast<int*>(m_shmPtr) + sizeof(sem_t);
+    m_dataLen = m_shmLen - SHM_DATA_OFFSET;
+    m_data = static_cast<char*>(m_shmPtr) + SHM_DATA_OFFSET;
 
     qDebug() << "Attached shared memory:" << m_shmKey;
     m_attached = true;
@@ -222,6 +245,11 @@ bool SharedMemory::isAttached() const
     return m_attached;
 }
 
+bool SharedMemory::isOwner() const
+{
+    return m_owner;
+}
+
 void SharedMemory::setErrorFromErrno(const QString &hint)
 {
     m_lastError = QStringLiteral("%1: %2").arg(hint).arg(QString::fromStdString(std::strerror(errno)));
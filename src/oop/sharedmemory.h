@@ -44,6 +44,7 @@ public:
     void unlock();
 
     bool isAttached() const;
+    bool isOwner() const;
 
 private:
     void setErrorFromErrno(const QString& hint);
@@ -51,6 +52,7 @@ private:
     QString m_lastError;
 
     bool m_attached;
+    bool m_owner;
     void *m_data;
     size_t m_dataLen;
     void *m_shmPtr;
@@ -393,5 +393,62 @@ PyObject* NDArrayConverter::toNDArray(const cv::Mat& m)
     return o;
 }
 
+/**
+ * Create a numpy array that directly uses the memory of @m, without copying it.
+ * The array keeps @base alive for as long as it exists, so @base must own the memory
+ * that @m points to. This function steals the reference to @base.
+ * Unless @writable is set, the array is marked read-only, so Python code can not
+ * modify memory that other readers may share.
+ */
+PyObject* NDArrayConverter::toNDArrayView(const cv::Mat& m, PyObject *base, bool writable)
+{
+    if (!m.data || m.dims != 2) {
+        Py_XDECREF(base);
+        Py_RETURN_NONE;
+    }
+
+    const int depth = m.depth();
+    const int cn = m.channels();
+    const int typenum = depth == CV_8U ? NPY_UBYTE : depth == CV_8S ? NPY_BYTE :
+                                                      depth == CV_16U ? NPY_USHORT :
+                                                       depth == CV_16S ? NPY_SHORT :
+                                                        depth == CV_32S ? NPY_INT :
+                                                         depth == CV_32F ? NPY_FLOAT :
+                                                          depth == CV_64F ? NPY_DOUBLE : -1;
+    if (typenum < 0) {
+        Py_XDECREF(base);
+        PyErr_SetString(PyExc_TypeError, "Matrix data type can not be represented as numpy array.");
+        return nullptr;
+    }
+
+    npy_intp sizes[3] = {m.rows, m.cols, cn};
+    npy_intp strides[3] = {(npy_intp) m.step[0], (npy_intp) m.elemSize(), (npy_intp) m.elemSize1()};
+    const int ndims = cn > 1? 3 : 2;
+
+    PyObject *o = PyArray_New(&PyArray_Type, ndims, sizes, typenum, strides,
+                              m.data, 0, writable? NPY_ARRAY_CARRAY : NPY_ARRAY_CARRAY_RO, nullptr);
+    if (!o) {
+        Py_XDECREF(base);
+        return nullptr;
+    }
+    if (PyArray_SetBaseObject((PyArrayObject*) o, base) != 0) {
+        Py_DECREF(o);
+        return nullptr;
+    }
+
+    return o;
+}
+
+/**
+ * Return the base object of the numpy array backing @m, or nullptr if @m is not
+ * backed by a numpy array or the array owns its data. Returns a borrowed reference.
+ */
+PyObject* NDArrayConverter::ndarrayBase(const cv::Mat& m)
+{
+    if (!m.u || m.allocator != &g_numpyAllocator || !m.u->userdata)
+        return nullptr;
+    return PyArray_BASE((PyArrayObject*) m.u->userdata);
+}
+
 // warn about old-style casts again
 #pragma GCC diagnostic pop
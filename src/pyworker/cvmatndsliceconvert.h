@@ -29,6 +29,9 @@ public:
 
     static bool toMat(PyObject* o, cv::Mat &m);
     static PyObject* toNDArray(const cv::Mat& mat);
+
+    static PyObject* toNDArrayView(const cv::Mat& mat, PyObject *base, bool writable = false);
+    static PyObject* ndarrayBase(const cv::Mat& mat);
 };
 
 namespace pybind11 {
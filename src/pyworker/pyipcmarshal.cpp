@@ -25,74 +25,170 @@
 #include "ipcmarshal.h"
 #include "cvmatndsliceconvert.h"
 
+static const char *SHM_SLOT_CAPSULE_NAME = "syntalos.shmslot";
+
+/**
+ * @brief Reference to a frame slot in shared memory
+ *
+ * This is the base object of numpy arrays that directly use shared memory.
+ * The slot is handed back to its writer once the array is gone.
+ */
+struct ShmSlotRef
+{
+    std::shared_ptr<SharedMemory> shm;
+    int slot;
+    bool active;
+
+    ShmSlotRef(std::shared_ptr<SharedMemory> s, int i)
+        : shm(s),
+          slot(i),
+          active(true)
+    {}
+
+    ~ShmSlotRef()
+    {
+        release();
+    }
+
+    void release()
+    {
+        if (!active)
+            return;
+        shmFrameSlotRelease(shm.get(), slot);
+        active = false;
+    }
+
+    void detach()
+    {
+        // the receiving side is now responsible for the slot
+        active = false;
+    }
+};
+
+static void shmSlotCapsuleDestroy(PyObject *capsule)
+{
+    delete static_cast<ShmSlotRef*>(PyCapsule_GetPointer(capsule, SHM_SLOT_CAPSULE_NAME));
+}
+
+static ShmSlotRef *shmSlotRefForMat(const cv::Mat &mat)
+{
+    auto base = NDArrayConverter::ndarrayBase(mat);
+    if (base == nullptr || !PyCapsule_IsValid(base, SHM_SLOT_CAPSULE_NAME))
+        return nullptr;
+    return static_cast<ShmSlotRef*>(PyCapsule_GetPointer(base, SHM_SLOT_CAPSULE_NAME));
+}
+
+/**
+ * @brief Wrap a shared memory frame slot in a numpy array, without copying
+ *
+ * Received frames are read-only, only frames we allocate for sending are @writable.
+ */
+static bool shmSlotToFrameMat(std::shared_ptr<SharedMemory> shm, int slot, cv::Mat &mat, bool writable)
+{
+    const auto view = shmFrameSlotView(shm.get(), slot);
+    auto capsule = PyCapsule_New(new ShmSlotRef(shm, slot),
+                                 SHM_SLOT_CAPSULE_NAME,
+                                 shmSlotCapsuleDestroy);
+    if (capsule == nullptr)
+        return false;
+
+    // the array takes ownership of the capsule, and our matrix of the array
+    auto array = NDArrayConverter::toNDArrayView(view, capsule, writable);
+    if (array == nullptr) {
+        PyErr_Clear();
+        return false;
+    }
+    const auto ret = NDArrayConverter::toMat(array, mat);
+    Py_DECREF(array);
+    return ret;
+}
+
+template<typename T>
+static bool unmarshalSimple(int typeId, IpcReader &r, py::object &pyObj)
+{
+    if (typeId != qMetaTypeId<T>())
+        return false;
+
+    T element;
+    if (ipcDecode(r, element))
+        pyObj = py::cast(element);
+    return true;
+}
+
 /**
  * @brief Create a Python object from received data.
+ *
+ * @return The new object, or None if the data could not be read.
  */
-py::object unmarshalDataToPyObject(int typeId, const QVariant &argData, std::unique_ptr<SharedMemory> &shm)
+py::object unmarshalDataToPyObject(int typeId, IpcReader &r, std::shared_ptr<SharedMemory> &shm)
 {
+    py::object pyObj = py::none();
+
     /**
      ** Frame
      **/
 
     if (typeId == qMetaTypeId<Frame>()) {
-        auto floatingMat = cvMatFromShm(shm, false);
-
         Frame frame;
-        frame.mat = floatingMat;
+        QString shmKey;
+        int slot;
+        if (!ipcDecodeFrameRef(r, frame, shmKey, slot))
+            return pyObj;
+        if (slot < 0)
+            return py::cast(frame);
 
-        const auto plist = argData.toList();
-        if (plist.length() == 2) {
-            frame.index = plist[0].toUInt();
-            frame.time = milliseconds_t(plist[1].toLongLong());
+        // the frame data stays in the shared memory slot until Python drops
+        // the last reference to it, or releases it explicitly
+        if (!shmAttachKey(shm, shmKey))
+            return pyObj;
+        if (!shmSlotToFrameMat(shm, slot, frame.mat, false)) {
+            frame.mat = shmFrameSlotView(shm.get(), slot).clone();
+            shmFrameSlotRelease(shm.get(), slot);
         }
 
-        // floating mat gets copied here, for use in Python
         return py::cast(frame);
     }
 
-    if (!argData.isValid())
-        return py::none();
-
     /**
      ** Control Command
      **/
 
-    if (typeId == qMetaTypeId<ControlCommand>())
-        return py::cast(qvariant_cast<ControlCommand>(argData));
+    if (unmarshalSimple<ControlCommand>(typeId, r, pyObj))
+        return pyObj;
 
     /**
      ** Firmata
      **/
 
-    if (typeId == qMetaTypeId<FirmataControl>())
-        return py::cast(qvariant_cast<FirmataControl>(argData));
-
-    if (typeId == qMetaTypeId<FirmataData>())
-        return py::cast(qvariant_cast<FirmataData>(argData));
+    if (unmarshalSimple<FirmataControl>(typeId, r, pyObj))
+        return pyObj;
+    if (unmarshalSimple<FirmataData>(typeId, r, pyObj))
+        return pyObj;
 
     /**
      ** Table Rows
      **/
 
     if (typeId == qMetaTypeId<TableRow>()) {
-        auto rows = argData.toList();
+        TableRow row;
+        if (!ipcDecode(r, row))
+            return pyObj;
+
         py::list pyRow;
-        for (const QVariant &colVar : rows) {
-            const auto col = colVar.toString();
+        for (const auto &col : row)
             pyRow.append(col.toStdString());
-        }
         return std::move(pyRow);
     }
 
-    return py::none();
+    return pyObj;
 }
 
 template<typename T>
-static bool marshalAndAddSimple(const int &typeId, const py::object &pyObj, QVariant &argData)
+static bool marshalAndAddSimple(const int &typeId, const py::object &pyObj, IpcWriter &w)
 {
     if (typeId == qMetaTypeId<T>()) {
         const T etype = pyObj.cast<T>();
-        argData = QVariant::fromValue(etype);
+        ipcEncode(w, etype);
         return true;
     }
     return false;
@@ -102,7 +198,7 @@ static bool marshalAndAddSimple(const int &typeId, const py::object &pyObj, QVar
  * @brief Prepare data from a Python object for transmission.
  */
 bool marshalPyDataElement(int typeId, const py::object &pyObj,
-                          QVariant &argData, std::unique_ptr<SharedMemory> &shm)
+                          IpcWriter &w, ShmFrameRing *ring)
 {
     /**
      ** Frame
@@ -111,14 +207,28 @@ bool marshalPyDataElement(int typeId, const py::object &pyObj,
     if (typeId == qMetaTypeId<Frame>()) {
         const auto frame = pyObj.cast<Frame>();
 
-        if (!cvMatToShm(shm, frame.mat))
-            return false;
+        // frames allocated in our own shared memory and not modified in their
+        // geometry can be handed over as-is, anything else is copied into a free slot
+        QString shmKey;
+        int slot = -1;
+        auto ref = shmSlotRefForMat(frame.mat);
+        if (ref != nullptr && ref->active && ring->owns(ref->shm.get())) {
+            const auto view = shmFrameSlotView(ref->shm.get(), ref->slot);
+            if (view.data == frame.mat.data && view.size == frame.mat.size &&
+                view.type() == frame.mat.type() && view.step == frame.mat.step) {
+                shmKey = ref->shm->shmKey();
+                slot = ref->slot;
+                ref->detach();
+            }
+        }
+
+        // if all slots are taken, the frame data is sent inline
+        if (slot < 0) {
+            slot = ring->writeMat(frame.mat);
+            shmKey = ring->shmKey();
+        }
 
-        QVariantList plist;
-        plist.reserve(2);
-        plist.append((uint)frame.index);
-        plist.append(QVariant::fromValue(frame.time.count()));
-        argData = QVariant::fromValue(plist);
+        ipcEncodeFrameRef(w, frame, shmKey, slot);
         return true;
     }
 
@@ -126,16 +236,16 @@ bool marshalPyDataElement(int typeId, const py::object &pyObj,
      ** Control Command
      **/
 
-    if (marshalAndAddSimple<ControlCommand>(typeId, pyObj, argData))
+    if (marshalAndAddSimple<ControlCommand>(typeId, pyObj, w))
         return true;
 
     /**
      ** Firmata
      **/
 
-    if (marshalAndAddSimple<FirmataControl>(typeId, pyObj, argData))
+    if (marshalAndAddSimple<FirmataControl>(typeId, pyObj, w))
         return true;
-    if (marshalAndAddSimple<FirmataData>(typeId, pyObj, argData))
+    if (marshalAndAddSimple<FirmataData>(typeId, pyObj, w))
         return true;
 
     /**
@@ -164,9 +274,47 @@ bool marshalPyDataElement(int typeId, const py::object &pyObj,
                 }
             }
         }
-        argData = QVariant::fromValue(row);
+        ipcEncode(w, row);
         return true;
     }
 
     return false;
 }
+
+/**
+ * @brief Create a new frame whose data lives in a free slot of the output port's shared memory.
+ *
+ * Submitting such a frame hands the slot to the receiver, without copying the frame data.
+ */
+py::object allocPyFrameInShm(ShmFrameRing *ring, int rows, int cols, int type)
+{
+    Frame frame;
+    const auto slot = ring->acquireSlot(rows, cols, type);
+    if (slot < 0) {
+        // no free slot, the frame will be copied when it is submitted
+        frame.mat = cv::Mat(rows, cols, type);
+        return py::cast(frame);
+    }
+
+    if (!shmSlotToFrameMat(ring->shm(), slot, frame.mat, true)) {
+        shmFrameSlotRelease(ring->shm().get(), slot);
+        return py::none();
+    }
+
+    return py::cast(frame);
+}
+
+/**
+ * @brief Hand the shared memory slot of a frame back to its writer early.
+ *
+ * @return true if the frame was backed by shared memory.
+ */
+bool releasePyFrameShm(Frame &frame)
+{
+    auto ref = shmSlotRefForMat(frame.mat);
+    frame.mat.release();
+    if (ref == nullptr)
+        return false;
+    ref->release();
+    return true;
+}
@@ -26,10 +26,17 @@
 #include <QVariant>
 
 #include "streams/datatypes.h"
+#include "streams/frametype.h"
 
 namespace py = pybind11;
 
 class SharedMemory;
+class ShmFrameRing;
+class IpcReader;
+class IpcWriter;
 
-py::object unmarshalDataToPyObject(int typeId, const QVariant &argData, std::unique_ptr<SharedMemory> &shm);
-bool marshalPyDataElement(int typeId, const py::object &pyObj, QVariant &argData, std::unique_ptr<SharedMemory> &shm);
+py::object unmarshalDataToPyObject(int typeId, IpcReader &r, std::shared_ptr<SharedMemory> &shm);
+bool marshalPyDataElement(int typeId, const py::object &pyObj, IpcWriter &w, ShmFrameRing *ring);
+
+py::object allocPyFrameInShm(ShmFrameRing *ring, int rows, int cols, int type);
+bool releasePyFrameShm(Frame &frame);
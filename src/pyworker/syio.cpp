@@ -29,6 +29,7 @@
 #include <pybind11/pybind11.h>
 #include <pybind11/stl_bind.h>
 #include <pybind11/chrono.h>
+#include <pybind11/numpy.h>
 
 #include "qstringtopy.h"
 #include "cvmatndsliceconvert.h"
@@ -36,6 +37,7 @@
 #include "qstringtopy.h"
 #include "cvmatndsliceconvert.h"
 #include "pyipcmarshal.h"
+#include "tsyncfile.h"
 
 
 namespace py = pybind11;
@@ -104,6 +106,7 @@ static void raise_error(const std::string& message)
 
 static void wait(unsigned int msec)
 {
+    PyBridge::instance()->worker()->flushOutput();
     auto timer = QTime::currentTime().addMSecs(msec);
     while (QTime::currentTime() < timer)
         QCoreApplication::processEvents(QEventLoop::AllEvents, 10);
@@ -111,6 +114,7 @@ static void wait(unsigned int msec)
 
 static void wait_sec(unsigned int sec)
 {
+    PyBridge::instance()->worker()->flushOutput();
     auto timer = QTime::currentTime().addMSecs(sec * 1000);
     while (QTime::currentTime() < timer)
         QCoreApplication::processEvents(QEventLoop::AllEvents, 500);
@@ -149,6 +153,26 @@ struct InputPort
         return pb->incomingData[_inst_id].dequeue();
     }
 
+    py::list nextBatch(int maxItems = 0)
+    {
+        auto pb = PyBridge::instance();
+        auto &queue = pb->incomingData[_inst_id];
+
+        py::list batch;
+        while (!queue.isEmpty()) {
+            if (maxItems > 0 && static_cast<int>(batch.size()) >= maxItems)
+                break;
+            batch.append(queue.dequeue());
+        }
+        return batch;
+    }
+
+    int pendingCount()
+    {
+        auto pb = PyBridge::instance();
+        return pb->incomingData[_inst_id].size();
+    }
+
     void setThrottleItemsPerSec(uint itemsPerSec, bool allowMore = true)
     {
         auto pb = PyBridge::instance();
@@ -174,6 +198,29 @@ struct OutputPort
             throw SyntalosPyError("Could not submit data on output port.");
     }
 
+    py::object alloc_frame(int height, int width, int channels, const py::object &dtype)
+    {
+        if (height <= 0 || width <= 0 || channels <= 0 || channels > CV_CN_MAX)
+            throw SyntalosPyError("Invalid frame dimensions.");
+
+        const auto dt = py::dtype::from_args(dtype);
+        int depth = -1;
+        if (dt.kind() == 'u')
+            depth = dt.itemsize() == 1? CV_8U : dt.itemsize() == 2? CV_16U : -1;
+        else if (dt.kind() == 'i')
+            depth = dt.itemsize() == 1? CV_8S : dt.itemsize() == 2? CV_16S : dt.itemsize() == 4? CV_32S : -1;
+        else if (dt.kind() == 'f')
+            depth = dt.itemsize() == 4? CV_32F : dt.itemsize() == 8? CV_64F : -1;
+        if (depth < 0)
+            throw SyntalosPyError("Unsupported data type for frame.");
+
+        auto pb = PyBridge::instance();
+        auto frame = pb->worker()->allocOutputFrame(_inst_id, height, width, CV_MAKETYPE(depth, channels));
+        if (frame.is_none())
+            throw SyntalosPyError("Could not allocate frame on output port.");
+        return frame;
+    }
+
     void set_metadata_value(const std::string &key, const py::object &obj)
     {
         auto pb = PyBridge::instance();
@@ -257,6 +304,49 @@ static py::object get_output_port(const std::string& id)
     return py::cast(pyPort);
 }
 
+struct TSyncFile
+{
+    explicit TSyncFile(const QString &fname)
+        : reader(new TimeSyncFileReader)
+    {
+        if (!reader->open(fname))
+            throw SyntalosPyError(QStringLiteral("Unable to open timesync file: %1").arg(reader->lastError()).toStdString());
+    }
+
+    py::array_t<long long> times() const
+    {
+        const auto count = reader->count();
+        py::array_t<long long> array({static_cast<py::ssize_t>(count), static_cast<py::ssize_t>(2)});
+        auto data = array.mutable_unchecked<2>();
+        for (size_t i = 0; i < count; ++i) {
+            const auto pair = reader->timeAt(i);
+            data(i, 0) = pair.first;
+            data(i, 1) = pair.second;
+        }
+        return array;
+    }
+
+    py::object deviceToMaster(long long deviceTime) const
+    {
+        const auto res = reader->deviceToMaster(deviceTime);
+        return res.has_value()? py::cast(res.value()) : py::none();
+    }
+
+    py::object masterToDevice(long long masterTime) const
+    {
+        const auto res = reader->masterToDevice(masterTime);
+        return res.has_value()? py::cast(res.value()) : py::none();
+    }
+
+    void verifyChecksums()
+    {
+        if (!reader->verifyChecksums())
+            throw SyntalosPyError(reader->lastError().toStdString());
+    }
+
+    std::unique_ptr<TimeSyncFileReader> reader;
+};
+
 static FirmataControl new_firmatactl_with_id_name(FirmataCommandKind kind, int pinId, const std::string &name)
 {
     FirmataControl ctl;
@@ -294,6 +384,9 @@ PYBIND11_MODULE(syio, m)
     py::class_<InputPort>(m, "InputPort")
             .def(py::init<std::string, int>())
             .def("next", &InputPort::next, "Retrieve the next element, return None if no element is available.")
+            .def("next_batch", &InputPort::nextBatch, "Retrieve all pending elements (or at most max_items, if set) as list. The list is empty if no element is available.",
+                 py::arg("max_items") = 0)
+            .def("pending_count", &InputPort::pendingCount, "Get the number of elements that are waiting to be retrieved.")
             .def("set_throttle_items_per_sec", &InputPort::setThrottleItemsPerSec, "Limit the amount of input received to a set amount of elements per second.",
                  py::arg("items_per_sec"), py::arg("allow_more") = true)
             .def_readonly("name", &InputPort::_name)
@@ -302,6 +395,9 @@ PYBIND11_MODULE(syio, m)
     py::class_<OutputPort>(m, "OutputPort")
             .def(py::init<std::string, int>())
             .def("submit", &OutputPort::submit)
+            .def("alloc_frame", &OutputPort::alloc_frame,
+                 "Create a new frame in shared memory that can be submitted on this port without copying its data.",
+                 py::arg("height"), py::arg("width"), py::arg("channels") = 3, py::arg("dtype") = py::module::import("numpy").attr("uint8"))
             .def_readonly("name", &OutputPort::_name)
             .def("set_metadata_value", &OutputPort::set_metadata_value, "Set (immutable) metadata value for this port.")
             .def("set_metadata_value_size", &OutputPort::set_metadata_value_size, "Set (immutable) metadata value for a 2D size type for this port.")
@@ -321,8 +417,15 @@ PYBIND11_MODULE(syio, m)
     py::class_<Frame>(m, "Frame")
             .def(py::init<>())
             .def_readwrite("index", &Frame::index)
-            .def_readwrite("time_msec", &Frame::time)
-            .def_readwrite("mat", &Frame::mat)
+            .def_readwrite("time", &Frame::time)
+            .def_property("time_usec",
+                          [](const Frame &f) { return f.time.count(); },
+                          [](Frame &f, long long usec) { f.time = microseconds_t(usec); })
+            .def_readwrite("time_msec", &Frame::time) // compatibility alias for "time"
+            .def_readwrite("mat", &Frame::mat,
+                           "Image data. Received frames share memory with their sender and are read-only, copy them to modify the data.")
+            .def("release", [](Frame &f) { releasePyFrameShm(f); },
+                 "Drop the frame data early, handing its shared memory back to the sender. The data must not be used anymore afterwards.")
     ;
 
     /**
@@ -356,7 +459,8 @@ PYBIND11_MODULE(syio, m)
             .value("IO_MODE", FirmataCommandKind::IO_MODE)
             .value("WRITE_ANALOG", FirmataCommandKind::WRITE_ANALOG)
             .value("WRITE_DIGITAL", FirmataCommandKind::WRITE_DIGITAL)
-            .value("WRITE_DIGITAL_PULSE", FirmataCommandKind::WRITE_DIGITAL_PULSE)
+            .value("WRITE_DIGITAL_PULSE", FirmataCommandKind::WRITE_DIGITAL_PULSE,
+                   "Set a digital output pin high and low again after the pulse width given in `value`.")
             .value("SYSEX", FirmataCommandKind::SYSEX)
             .export_values()
     ;
@@ -368,7 +472,9 @@ PYBIND11_MODULE(syio, m)
             .def_readwrite("pin_name", &FirmataControl::pinName)
             .def_readwrite("is_output", &FirmataControl::isOutput)
             .def_readwrite("is_pullup", &FirmataControl::isPullUp)
-            .def_readwrite("value", &FirmataControl::value)
+            .def_readwrite("value", &FirmataControl::value,
+                           "Value to write. For WRITE_DIGITAL_PULSE, the pulse width in microseconds (at most 60 s), "
+                           "or 0 to use the default pulse width of the I/O module.")
     ;
 
     py::class_<FirmataData>(m, "FirmataData")
@@ -380,6 +486,35 @@ PYBIND11_MODULE(syio, m)
             .def_readwrite("time", &FirmataData::time)
     ;
 
+    /**
+     ** Time synchronization files
+     **/
+
+    py::class_<TSyncFile>(m, "TSyncFile")
+            .def(py::init<QString>(), "Open a timesync (.tsync) file. Its time data is only read when it is accessed.",
+                 py::arg("fname"))
+            .def_property_readonly("module_name", [](const TSyncFile &f) { return f.reader->moduleName(); })
+            .def_property_readonly("collection_id", [](const TSyncFile &f) { return f.reader->collectionId().toString(QUuid::WithoutBraces); })
+            .def_property_readonly("sync_mode", [](const TSyncFile &f) { return tsyncFileModeToString(f.reader->syncMode()); })
+            .def_property_readonly("time_names", [](const TSyncFile &f) {
+                return py::make_tuple(f.reader->timeNames().first, f.reader->timeNames().second);
+            })
+            .def_property_readonly("time_units", [](const TSyncFile &f) {
+                return py::make_tuple(tsyncFileTimeUnitToString(f.reader->timeUnits().first),
+                                      tsyncFileTimeUnitToString(f.reader->timeUnits().second));
+            })
+            .def_property_readonly("tolerance_usec", [](const TSyncFile &f) { return f.reader->tolerance().count(); })
+            .def("__len__", [](const TSyncFile &f) { return f.reader->count(); })
+            .def("times", &TSyncFile::times, "Get all time pairs as (N, 2) NumPy array.")
+            .def("device_to_master", &TSyncFile::deviceToMaster,
+                 "Convert a device time into master time, interpolating between entries. Returns None if the file is empty.",
+                 py::arg("device_time"))
+            .def("master_to_device", &TSyncFile::masterToDevice,
+                 "Convert a master time into device time, interpolating between entries. Returns None if the file is empty.",
+                 py::arg("master_time"))
+            .def("verify_checksums", &TSyncFile::verifyChecksums, "Verify the checksums of all data blocks, raise an error if the data is damaged.")
+    ;
+
     /**
      ** Additional Functions
      **/
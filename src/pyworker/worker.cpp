@@ -19,6 +19,7 @@
 
 #define QT_NO_KEYWORDS
 #include <iostream>
+#include <cstring>
 #include <QMetaType>
 #include "worker.h"
 
@@ -31,7 +32,10 @@
 OOPWorker::OOPWorker(QObject *parent)
     : OOPWorkerSource(parent),
       m_stage(OOPWorker::IDLE),
+      m_pyInitialized(false),
+      m_pyMain(nullptr),
       m_running(false),
+      m_stopRequested(false),
       m_maxRTPriority(0)
 {
     m_pyb = PyBridge::instance(this);
@@ -83,7 +87,7 @@ void OOPWorker::setInputPortInfo(const QList<InputPortInfo> &ports)
 
     // set up our incoming shared memory links
     for (int i = 0; i < m_inPortInfo.size(); i++)
-        m_shmRecv.push_back(std::unique_ptr<SharedMemory>(new SharedMemory));
+        m_shmRecv.push_back(std::shared_ptr<SharedMemory>());
 
     for (int i = 0; i < m_inPortInfo.size(); i++) {
         if (i >= m_inPortInfo.size()) {
@@ -94,7 +98,6 @@ void OOPWorker::setInputPortInfo(const QList<InputPortInfo> &ports)
         port.setWorkerDataTypeId(QMetaType::type(qPrintable(port.dataTypeName())));
         m_inPortInfo[i] = port;
 
-        m_shmRecv[port.id()]->setShmKey(port.shmKeyRecv());
         m_pyb->incomingData.append(QQueue<py::object>());
     }
 }
@@ -102,10 +105,15 @@ void OOPWorker::setInputPortInfo(const QList<InputPortInfo> &ports)
 void OOPWorker::setOutputPortInfo(const QList<OutputPortInfo> &ports)
 {
     m_outPortInfo = ports;
+    m_shmSend.clear();
+    m_outBuffers.clear();
+    m_outCounts.clear();
 
     // set up our outgoing shared memory links
     for (int i = 0; i < m_outPortInfo.size(); i++)
-        m_shmSend.push_back(std::unique_ptr<SharedMemory>(new SharedMemory));
+        m_shmSend.push_back(std::unique_ptr<ShmFrameRing>());
+    m_outBuffers.resize(m_outPortInfo.size());
+    m_outCounts.fill(0, m_outPortInfo.size());
 
     for (int i = 0; i < m_outPortInfo.size(); i++) {
         if (i >= m_outPortInfo.size()) {
@@ -116,7 +124,7 @@ void OOPWorker::setOutputPortInfo(const QList<OutputPortInfo> &ports)
         port.setWorkerDataTypeId(QMetaType::type(qPrintable(port.dataTypeName())));
         m_outPortInfo[i] = port;
 
-        m_shmSend[port.id()]->setShmKey(port.shmKeySend());
+        m_shmSend[port.id()] = std::make_unique<ShmFrameRing>(port.shmKeySend());
     }
 }
 
@@ -162,6 +170,9 @@ QByteArray OOPWorker::changeSettings(const QByteArray &oldSettings)
 
     Py_XDECREF(pFnSettings);
     Py_XDECREF(pyOldSettings);
+
+    // we may be reused for a run later, which has to wait for its start signal
+    m_running = false;
     return settings;
 }
 
@@ -176,6 +187,7 @@ void OOPWorker::start(long startTimestampUsec)
 bool OOPWorker::prepareShutdown()
 {
     m_running = false;
+    m_stopRequested = true;
     QCoreApplication::processEvents();
     return true;
 }
@@ -195,27 +207,47 @@ bool OOPWorker::loadPythonScript(const QString &script, const QString &wdir)
     if (!wdir.isEmpty())
         QDir::setCurrent(wdir);
 
-    Py_SetProgramName(QCoreApplication::arguments()[0].toStdWString().c_str());
+    const auto interpreterReused = m_pyInitialized;
+    if (!m_pyInitialized) {
+        Py_SetProgramName(QCoreApplication::arguments()[0].toStdWString().c_str());
 
-    // HACK: make Python thing *we* are the Python interpreter, so it finds
-    // all modules correctly when we are in a virtual environment.
-    const auto venvDir = QString::fromUtf8(qgetenv("VIRTUAL_ENV"));
-    if (!venvDir.isEmpty())
-        Py_SetProgramName(QDir(venvDir).filePath("bin/python").toStdWString().c_str());
+        // HACK: make Python thing *we* are the Python interpreter, so it finds
+        // all modules correctly when we are in a virtual environment.
+        const auto venvDir = QString::fromUtf8(qgetenv("VIRTUAL_ENV"));
+        if (!venvDir.isEmpty())
+            Py_SetProgramName(QDir(venvDir).filePath("bin/python").toStdWString().c_str());
 
-    // initialize Python in this process
-    Py_Initialize();
-    m_pyInitialized = true;
+        // initialize Python in this process
+        Py_Initialize();
+        m_pyInitialized = true;
+    }
 
     PyObject *mainModule = PyImport_AddModule("__main__");
     if (mainModule == nullptr) {
         raiseError("Can not execute Python code: No __main__ module.");
 
         Py_Finalize();
+        m_pyInitialized = false;
         return false;
     }
     PyObject *mainDict = PyModule_GetDict(mainModule);
 
+    // If we are reused from a previous run, the interpreter is still alive and all modules
+    // the script imported before are cached in sys.modules. We run the script again
+    // in a clean namespace, so all per-run state is reset while imports are fast.
+    if (interpreterReused) {
+        Py_XDECREF(m_pyMain);
+        m_pyMain = nullptr;
+
+        PyDict_Clear(mainDict);
+        auto pyName = PyUnicode_FromString("__main__");
+        PyDict_SetItemString(mainDict, "__name__", pyName);
+        Py_XDECREF(pyName);
+        auto pyBuiltins = PyImport_ImportModule("builtins");
+        PyDict_SetItemString(mainDict, "__builtins__", pyBuiltins);
+        Py_XDECREF(pyBuiltins);
+    }
+
     // load script
     auto res = PyRun_String(qPrintable(script), Py_file_input, mainDict, mainDict);
     if (res != nullptr) {
@@ -236,6 +268,8 @@ bool OOPWorker::loadPythonScript(const QString &script, const QString &wdir)
 bool OOPWorker::prepareStart(const QByteArray &settings)
 {
     m_settings = settings;
+    m_running = false;
+    m_stopRequested = false;
     QTimer::singleShot(0, this, &OOPWorker::prepareAndRun);
     return m_pyInitialized;
 }
@@ -308,6 +342,8 @@ void OOPWorker::emitPyError()
         Py_XDECREF(excValue);
 
         if (m_pyInitialized) {
+            Py_XDECREF(m_pyMain);
+            m_pyMain = nullptr;
             Py_Finalize();
             m_pyInitialized = false;
         }
@@ -395,7 +431,16 @@ void OOPWorker::prepareAndRun()
         }
 
         // while we are not running, wait for the start signal
-        while (!m_running) { QCoreApplication::processEvents(); }
+        while (!m_running) {
+            QCoreApplication::processEvents();
+
+            // the run may have been cancelled before it was started
+            if (m_stopRequested) {
+                Py_XDECREF(pFnStart);
+                Py_XDECREF(pFnLoop);
+                goto finalize;
+            }
+        }
         setStage(OOPWorker::RUNNING);
 
         // run the start function first, if we have it
@@ -423,6 +468,7 @@ void OOPWorker::prepareAndRun()
 
             // we are running! - loop() until we are stopped
             do {
+                flushOutput();
                 QCoreApplication::processEvents();
 
                 auto loopRes = PyObject_CallObject(pFnLoop, nullptr);
@@ -461,6 +507,9 @@ void OOPWorker::prepareAndRun()
     }
 
 finalize:
+    // send out anything the script submitted last
+    flushOutput();
+
     // we aren't ready anymore,
     // and also stopped running the loop
     setStage(OOPWorker::IDLE);
@@ -472,6 +521,7 @@ std::optional<bool> OOPWorker::waitForInput()
 {
     std::optional<bool> res = false;
 
+    flushOutput();
     while (true) {
         for (const auto &q : m_pyb->incomingData) {
             if (!q.isEmpty()) {
@@ -495,15 +545,26 @@ std::optional<bool> OOPWorker::waitForInput()
 
 bool OOPWorker::checkRunning()
 {
+    flushOutput();
     QCoreApplication::processEvents();
     return m_running;
 }
 
-bool OOPWorker::receiveInput(int inPortId, const QVariant &argData)
+bool OOPWorker::receiveInput(int inPortId, const QByteArray &data)
 {
     const auto typeId = m_inPortInfo[inPortId].workerDataTypeId();
-    auto pyObj = unmarshalDataToPyObject(typeId, argData, m_shmRecv[inPortId]);
-    m_pyb->incomingData[inPortId].append(pyObj);
+    auto &queue = m_pyb->incomingData[inPortId];
+
+    IpcReader r(data);
+    quint32 count;
+    if (!r.get(count))
+        return false;
+    for (quint32 i = 0; i < count; i++) {
+        auto pyObj = unmarshalDataToPyObject(typeId, r, m_shmRecv[inPortId]);
+        if (pyObj.is_none())
+            return false;
+        queue.append(pyObj);
+    }
 
     return true;
 }
@@ -515,11 +576,50 @@ bool OOPWorker::submitOutput(int outPortId, py::object pyObj)
         return true;
 
     const auto typeId = m_outPortInfo[outPortId].workerDataTypeId();
-    QVariant argData;
-    const auto ret = marshalPyDataElement(typeId, pyObj, argData, m_shmSend[outPortId]);
-    if (ret)
-        Q_EMIT sendOutput(outPortId, argData);
-    return ret;
+    auto &buffer = m_outBuffers[outPortId];
+    if (buffer.isEmpty())
+        buffer.append(sizeof(quint32), '\0'); // placeholder for the element count
+
+    IpcWriter w(&buffer);
+    const auto lastSize = buffer.size();
+    if (!marshalPyDataElement(typeId, pyObj, w, m_shmSend[outPortId].get())) {
+        buffer.truncate(lastSize);
+        return false;
+    }
+    m_outCounts[outPortId]++;
+
+    // Send the element right away: While the script runs, we have no way to flush
+    // a buffer later on, so holding on to elements could delay them arbitrarily.
+    flushOutput();
+
+    return true;
+}
+
+/**
+ * Send all elements that were submitted but are not yet sent.
+ */
+void OOPWorker::flushOutput()
+{
+    for (int i = 0; i < m_outBuffers.size(); i++) {
+        if (m_outCounts[i] == 0)
+            continue;
+
+        auto &buffer = m_outBuffers[i];
+        const quint32 count = m_outCounts[i];
+        std::memcpy(buffer.data(), &count, sizeof(count));
+        Q_EMIT sendOutput(i, buffer);
+
+        buffer.clear();
+        m_outCounts[i] = 0;
+    }
+}
+
+py::object OOPWorker::allocOutputFrame(int outPortId, int rows, int cols, int type)
+{
+    const auto typeId = m_outPortInfo[outPortId].workerDataTypeId();
+    if (typeId != qMetaTypeId<Frame>())
+        return py::none();
+    return allocPyFrameInShm(m_shmSend[outPortId].get(), rows, cols, type);
 }
 
 void OOPWorker::setOutPortMetadataValue(int outPortId, const QString &key, const QVariant &value)
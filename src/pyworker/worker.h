@@ -45,6 +45,8 @@ public:
     std::optional<OutputPortInfo> outputPortInfoByIdString(const QString &idstr);
 
     bool submitOutput(int outPortId, py::object pyObj);
+    py::object allocOutputFrame(int outPortId, int rows, int cols, int type);
+    void flushOutput();
     void setOutPortMetadataValue(int outPortId, const QString &key, const QVariant &value);
     void setInputThrottleItemsPerSec(int inPortId, uint itemsPerSec, bool allowMore = true);
 
@@ -73,7 +75,7 @@ public Q_SLOTS:
 
     std::optional<bool> waitForInput();
     bool checkRunning();
-    bool receiveInput(int inPortId, const QVariant &argData = QVariant()) override;
+    bool receiveInput(int inPortId, const QByteArray &data) override;
 
 protected:
     void setStage(Stage stage);
@@ -84,8 +86,11 @@ private:
     PyObject *m_pyMain;
 
     bool m_running;
-    std::vector<std::unique_ptr<SharedMemory>> m_shmSend;
-    std::vector<std::unique_ptr<SharedMemory>> m_shmRecv;
+    bool m_stopRequested;
+    std::vector<std::unique_ptr<ShmFrameRing>> m_shmSend;
+    std::vector<std::shared_ptr<SharedMemory>> m_shmRecv;
+    QVector<QByteArray> m_outBuffers;
+    QVector<quint32> m_outCounts;
     QByteArray m_settings;
 
     QList<InputPortInfo> m_inPortInfo;
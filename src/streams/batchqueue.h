@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+
+#include "readerwriterqueue.h"
+
+namespace Syntalos {
+
+/**
+ * @brief Blocking single-producer single-consumer queue with batched publishing
+ *
+ * This queue wraps moodycamel's lock-free ReaderWriterQueue, similar to its
+ * BlockingReaderWriterQueue, but with two differences:
+ * Elements are stored directly instead of being wrapped into an std::optional to mark
+ * the end of a stream. Instead, the queue can be closed, which wakes up a blocked reader.
+ * And multiple elements can be published at once, which only signals the
+ * semaphore a single time for the whole batch.
+ *
+ * The semaphore count is always the number of published elements, plus one
+ * once the queue was closed.
+ */
+template<typename T>
+class BlockingBatchQueue
+{
+public:
+    explicit BlockingBatchQueue(size_t initialSize = 15)
+        : m_inner(initialSize),
+          m_sema(new moodycamel::spsc_sema::LightweightSemaphore()),
+          m_closed(false)
+    {}
+
+    bool enqueue(const T &element)
+    {
+        if (!m_inner.enqueue(element))
+            return false;
+        m_sema->signal();
+        return true;
+    }
+
+    bool enqueue(T &&element)
+    {
+        if (!m_inner.enqueue(std::forward<T>(element)))
+            return false;
+        m_sema->signal();
+        return true;
+    }
+
+    /**
+     * @brief Publish all elements in range [first, last) at once
+     * @return The amount of elements that were enqueued
+     */
+    template<typename It>
+    size_t enqueueBatch(It first, It last)
+    {
+        ssize_t count = 0;
+        for (; first != last; ++first) {
+            if (!m_inner.enqueue(*first))
+                break;
+            count++;
+        }
+        if (count > 0)
+            m_sema->signal(count);
+        return count;
+    }
+
+    /**
+     * @brief Dequeue the next element if there is one
+     * @return true if an element was dequeued.
+     */
+    bool tryDequeue(T &result)
+    {
+        if (!m_sema->tryWait())
+            return false;
+        if (m_inner.try_dequeue(result))
+            return true;
+
+        // we consumed the close token, give it back
+        m_sema->signal();
+        return false;
+    }
+
+    /**
+     * @brief Wait until an element can be dequeued
+     * @return true if an element was dequeued, false if the queue was closed and is empty.
+     */
+    bool waitDequeue(T &result)
+    {
+        m_sema->wait();
+        if (m_inner.try_dequeue(result))
+            return true;
+
+        // we were woken up by the close token, keep it for the next reader
+        m_sema->signal();
+        return false;
+    }
+
+    /**
+     * @brief Drop the next element
+     */
+    bool pop()
+    {
+        if (!m_sema->tryWait())
+            return false;
+        if (m_inner.pop())
+            return true;
+        m_sema->signal();
+        return false;
+    }
+
+    T *peek()
+    {
+        return m_inner.peek();
+    }
+
+    size_t sizeApprox() const
+    {
+        return m_inner.size_approx();
+    }
+
+    /**
+     * @brief Wake up any blocked reader, no further elements should be enqueued
+     */
+    void close()
+    {
+        if (m_closed.exchange(true))
+            return;
+        m_sema->signal();
+    }
+
+    bool isClosed() const
+    {
+        return m_closed;
+    }
+
+    /**
+     * @brief Drop all elements and reopen a closed queue
+     * Must only be called while neither the producer nor the consumer are active.
+     */
+    void reset()
+    {
+        while (pop()) {}
+        if (m_closed.exchange(false))
+            m_sema->tryWait();
+    }
+
+private:
+    moodycamel::ReaderWriterQueue<T> m_inner;
+    std::unique_ptr<moodycamel::spsc_sema::LightweightSemaphore> m_sema;
+    std::atomic_bool m_closed;
+};
+
+} // end of namespace
@@ -129,15 +129,19 @@ Q_DECLARE_METATYPE(FirmataCommandKind)
 
 /**
  * @brief Commands to control Firmata output.
+ *
+ * For WRITE_DIGITAL_PULSE, @value is the pulse width in microseconds,
+ * or 0 to use the default pulse width of the I/O module. I/O modules may
+ * limit the maximum pulse width (Firmata I/O allows up to 60 seconds).
  */
 struct FirmataControl
 {
-    FirmataCommandKind command;
-    uint8_t pinId;
+    FirmataCommandKind command = FirmataCommandKind::UNKNOWN;
+    uint8_t pinId = 0;
     QString pinName;
-    bool isOutput;
-    bool isPullUp;
-    uint16_t value;
+    bool isOutput = false;
+    bool isPullUp = false;
+    uint32_t value = 0;
 
     friend QDataStream &operator<<(QDataStream &out, const FirmataControl &obj)
     {
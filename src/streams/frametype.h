@@ -26,26 +26,27 @@
  *
  * Describes a single frame in a stream of frames that make up
  * a complete video.
- * Each frame is timestamped for accuracy.
+ * Each frame is timestamped for accuracy, with microsecond
+ * resolution on the master clock.
  */
 class Frame
 {
 public:
     explicit Frame() {}
-    explicit Frame(const cv::Mat &m, const milliseconds_t &t)
+    explicit Frame(const cv::Mat &m, const microseconds_t &t)
         : index(0),
           time(t),
           mat(m)
     {}
 
-    explicit Frame(const size_t &i, const cv::Mat &m, const milliseconds_t &t)
+    explicit Frame(const size_t &i, const cv::Mat &m, const microseconds_t &t)
         : index(i),
           time(t),
           mat(m)
     {}
 
     size_t index;
-    milliseconds_t time;
+    microseconds_t time; /// Master timestamp of this frame, in microseconds
     cv::Mat mat;
 };
 Q_DECLARE_METATYPE(Frame)
@@ -24,6 +24,8 @@
 #include <mutex>
 #include <algorithm>
 #include <optional>
+#include <vector>
+#include <type_traits>
 #include <cmath>
 #include <QVariant>
 #include <QDebug>
@@ -31,8 +33,10 @@
 #include <unistd.h>
 
 #include "readerwriterqueue.h"
+#include "batchqueue.h"
 #include "datatypes.h"
 #include "syclock.h"
+#include "sytrace.h"
 
 using namespace moodycamel;
 using namespace Syntalos;
@@ -70,7 +74,9 @@ public:
     virtual bool active() const = 0;
     virtual bool hasPending() const = 0;
     virtual size_t approxPendingCount() const = 0;
+    virtual size_t enqueuedCount() const = 0;
     virtual int enableNotify() = 0;
+    virtual void acknowledgeNotify() = 0;
     virtual void setThrottleItemsPerSec(uint itemsPerSec,
                                         bool allowMore = true) = 0;
 
@@ -99,6 +105,34 @@ public:
                                    const QString &portTitle) = 0;
 };
 
+/**
+ * @brief Queue configuration for subscriptions of stream data type T
+ *
+ * Types with batchedPublish set use a BlockingBatchQueue, which stores elements without
+ * an std::optional wrapper and signals its semaphore only once per published batch.
+ * Their eventfd is also only written to for the first element after the consumer
+ * acknowledged the previous notification, instead of once per element.
+ * Consumers must therefore process all pending elements after a notification,
+ * which the module event loop does.
+ */
+template<typename T>
+struct StreamQueueTraits
+{
+    static constexpr bool batchedPublish = false;
+};
+
+template<>
+struct StreamQueueTraits<IntSignalBlock>
+{
+    static constexpr bool batchedPublish = true;
+};
+
+template<>
+struct StreamQueueTraits<FloatSignalBlock>
+{
+    static constexpr bool batchedPublish = true;
+};
+
 template<typename T>
 class DataStream;
 
@@ -106,16 +140,22 @@ template<typename T>
 class StreamSubscription : public VariantStreamSubscription
 {
     friend DataStream<T>;
+    static constexpr bool BatchedPublish = StreamQueueTraits<T>::batchedPublish;
+    using QueueType = typename std::conditional<BatchedPublish,
+                                                BlockingBatchQueue<T>,
+                                                BlockingReaderWriterQueue<std::optional<T>>>::type;
 public:
     StreamSubscription(DataStream<T> *stream)
         : m_stream(stream),
-          m_queue(BlockingReaderWriterQueue<std::optional<T>>(256)),
+          m_queue(256),
           m_eventfd(-1),
           m_notify(false),
+          m_notifyArmed(true),
           m_active(true),
           m_suspended(false),
           m_throttle(0),
-          m_skippedElements(0)
+          m_skippedElements(0),
+          m_enqueuedCount(0)
     {
         m_lastItemTime = currentTimePoint();
         m_eventfd = eventfd(0, EFD_NONBLOCK);
@@ -139,11 +179,19 @@ public:
      */
     std::optional<T> next()
     {
+        SY_TRACE_SPAN("StreamSubscription::next");
         if (!m_active && m_queue.peek() == nullptr)
             return std::nullopt;
-        std::optional<T> data;
-        m_queue.wait_dequeue(data);
-        return data;
+        if constexpr (BatchedPublish) {
+            T data;
+            if (!m_queue.waitDequeue(data))
+                return std::nullopt;
+            return data;
+        } else {
+            std::optional<T> data;
+            m_queue.wait_dequeue(data);
+            return data;
+        }
     }
 
     /**
@@ -155,12 +203,17 @@ public:
     {
         if (!m_active && m_queue.peek() == nullptr)
             return std::nullopt;
-        std::optional<T> data;
-
-        if (!m_queue.try_dequeue(data))
-            return std::nullopt;
-
-        return data;
+        if constexpr (BatchedPublish) {
+            T data;
+            if (!m_queue.tryDequeue(data))
+                return std::nullopt;
+            return data;
+        } else {
+            std::optional<T> data;
+            if (!m_queue.try_dequeue(data))
+                return std::nullopt;
+            return data;
+        }
     }
 
     /**
@@ -238,6 +291,23 @@ public:
         return m_eventfd;
     }
 
+    /**
+     * @brief Acknowledge a notification received via the eventfd
+     *
+     * This resets the eventfd. Afterwards, the consumer must process all pending
+     * elements, as no new notification may be sent for elements which are already
+     * queued.
+     */
+    void acknowledgeNotify() override
+    {
+        uint64_t count;
+        (void) read(m_eventfd, &count, sizeof(count));
+        if constexpr (BatchedPublish) {
+            m_notifyArmed = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+    }
+
     /**
      * @brief Disable notifications via eventFD
      *
@@ -271,12 +341,20 @@ public:
 
     size_t approxPendingCount() const override
     {
-        return m_queue.size_approx();
+        return queueSizeApprox();
+    }
+
+    /**
+     * @brief Total number of elements received since the stream was started
+     */
+    size_t enqueuedCount() const override
+    {
+        return m_enqueuedCount.load(std::memory_order_relaxed);
     }
 
     bool hasPending() const override
     {
-        return m_queue.size_approx() > 0;
+        return queueSizeApprox() > 0;
     }
 
     uint throttleValue() const
@@ -312,7 +390,7 @@ public:
         // (this prevents clients from skipping elements too much if they are overeager
         // when adjusting the throttle value)
         if (newThrottle > m_throttle) {
-            for (size_t i = 0; i < m_queue.size_approx(); ++i)
+            for (size_t i = 0; i < queueSizeApprox(); ++i)
                 m_queue.pop();
         }
 
@@ -323,13 +401,15 @@ public:
 
 private:
     DataStream<T> *m_stream;
-    BlockingReaderWriterQueue<std::optional<T>> m_queue;
+    QueueType m_queue;
     int m_eventfd;
     std::atomic_bool m_notify;
+    std::atomic_bool m_notifyArmed;
     std::atomic_bool m_active;
     std::atomic_bool m_suspended;
     std::atomic_uint m_throttle;
     std::atomic_uint m_skippedElements;
+    std::atomic_size_t m_enqueuedCount;
 
     // NOTE: These two variables are intentionally *not* threadsafe and are
     // only ever manipulated by the stream (in case of the time) or only
@@ -360,20 +440,72 @@ private:
         }
 
         // actually send the data to the subscriber
-        m_queue.enqueue(std::optional<T>(data));
+        if constexpr (BatchedPublish)
+            m_queue.enqueue(data);
+        else
+            m_queue.enqueue(std::optional<T>(data));
+        m_enqueuedCount.fetch_add(1, std::memory_order_relaxed);
 
-        // ping the eventfd, in case anyone is listening for messages
-        if (m_notify) {
-            const uint64_t buffer = 1;
-            if (write(m_eventfd, &buffer, sizeof(buffer)) == -1)
-                qWarning().noquote() << "Unable to write to eventfd in" << dataTypeName() << "data subscription. FD:" << m_eventfd << "Error:" << std::strerror(errno);
+        notifyConsumer();
+    }
+
+    void pushBatch(const std::vector<T> &batch)
+    {
+        if (m_suspended || batch.empty())
+            return;
+
+        // throttling is decided per element
+        if (m_throttle != 0) {
+            for (const auto &data : batch)
+                push(data);
+            return;
+        }
+
+        if constexpr (BatchedPublish) {
+            m_queue.enqueueBatch(batch.cbegin(), batch.cend());
+        } else {
+            for (const auto &data : batch)
+                m_queue.enqueue(std::optional<T>(data));
+        }
+        m_enqueuedCount.fetch_add(batch.size(), std::memory_order_relaxed);
+
+        notifyConsumer();
+    }
+
+    void notifyConsumer()
+    {
+        if (!m_notify)
+            return;
+
+        if constexpr (BatchedPublish) {
+            // only wake up the consumer for the first new element after it has
+            // acknowledged the previous notification, it will drain the queue anyway
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!m_notifyArmed.exchange(false))
+                return;
         }
+
+        // ping the eventfd, in case anyone is listening for messages
+        const uint64_t buffer = 1;
+        if (write(m_eventfd, &buffer, sizeof(buffer)) == -1)
+            qWarning().noquote() << "Unable to write to eventfd in" << dataTypeName() << "data subscription. FD:" << m_eventfd << "Error:" << std::strerror(errno);
+    }
+
+    size_t queueSizeApprox() const
+    {
+        if constexpr (BatchedPublish)
+            return m_queue.sizeApprox();
+        else
+            return m_queue.size_approx();
     }
 
     void stop()
     {
         m_active = false;
-        m_queue.enqueue(std::nullopt);
+        if constexpr (BatchedPublish)
+            m_queue.close();
+        else
+            m_queue.enqueue(std::nullopt);
     }
 
     void reset()
@@ -381,8 +513,15 @@ private:
         m_suspended = false;
         m_active = true;
         m_throttle = 0;
+        m_enqueuedCount = 0;
+        m_notifyArmed = true;
         m_lastItemTime = currentTimePoint();
-        while (m_queue.pop()) {}  // ensure the queue is empty
+
+        // ensure the queue is empty
+        if constexpr (BatchedPublish)
+            m_queue.reset();
+        else
+            while (m_queue.pop()) {}
     }
 };
 
@@ -501,10 +640,26 @@ public:
     {
         if (!m_active)
             return;
+        SY_TRACE_SPAN("DataStream::push");
         for(auto& sub: m_subs)
             sub->push(data);
     }
 
+    /**
+     * @brief Publish multiple elements at once
+     *
+     * Subscribers are only notified once for the whole batch, which is
+     * considerably cheaper than pushing elements individually at high rates.
+     */
+    void pushBatch(const std::vector<T> &batch)
+    {
+        if (!m_active)
+            return;
+        SY_TRACE_SPAN("DataStream::pushBatch");
+        for(auto& sub: m_subs)
+            sub->pushBatch(batch);
+    }
+
     void terminate()
     {
         stop();
@@ -521,6 +676,20 @@ public:
         return m_active;
     }
 
+    /**
+     * @brief Largest amount of elements any subscriber has not consumed yet
+     *
+     * Producers which are not bound to real time can use this to avoid
+     * queueing up more data than their consumers are able to process.
+     */
+    size_t maxPendingCount() const
+    {
+        size_t count = 0;
+        for (const auto &sub : m_subs)
+            count = std::max(count, sub->approxPendingCount());
+        return count;
+    }
+
 private:
     std::thread::id m_ownerId;
     std::atomic_bool m_active;
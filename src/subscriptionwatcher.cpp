@@ -61,7 +61,6 @@ SubscriptionWatcher::WaitResult SubscriptionWatcher::wait()
     const int timeout = 40000; // 40msec
     struct epoll_event events[10];
     int ret;
-    uint64_t count = 0;
 
     while (true) {
         ret = epoll_wait(d->epollFD, &events[0], 10, timeout);
@@ -75,11 +74,7 @@ SubscriptionWatcher::WaitResult SubscriptionWatcher::wait()
                     qWarning("Eventfd has epoll error");
                   //  return ERROR;
                 } else if (events[i].events & EPOLLIN) {
-                    auto efd = events[i].data.fd;
-                    ret = read(efd, &count, sizeof(count));
-                    if (ret < 0)
-                        qDebug("Eventfd read failed: %s", std::strerror(errno));
-
+                    static_cast<VariantStreamSubscription*>(events[i].data.ptr)->acknowledgeNotify();
                     newData = true;
                 }
             }
@@ -121,7 +116,7 @@ SubscriptionWatcher::SubscriptionWatcher(std::initializer_list<std::shared_ptr<V
 
         struct epoll_event revent;
         revent.events = EPOLLHUP | EPOLLERR | EPOLLIN;
-        revent.data.fd = efd;
+        revent.data.ptr = sub.get();
 
         if (epoll_ctl(d->epollFD, EPOLL_CTL_ADD, efd, &revent) < 0) {
             qCritical("Unable to add eventfd epoll watch: %s", std::strerror(errno));
@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sytrace.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <unordered_set>
+#include <string>
+#include <QFile>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace Syntalos {
+
+std::atomic_bool g_traceEnabled(false);
+
+// amount of events every thread keeps, older events are overwritten
+static const size_t TRACE_BUFFER_EVENTS = 1 << 16;
+
+class TraceEvent
+{
+public:
+    const char *name;
+    const char *detail;
+    int64_t startNs;
+    int64_t durationNs;
+};
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+class TraceThreadBuffer
+{
+public:
+    TraceThreadBuffer()
+        : tid(0),
+          alive(true),
+          count(0)
+    {
+        events.resize(TRACE_BUFFER_EVENTS);
+    }
+
+    pid_t tid;
+    QByteArray threadName;
+    std::atomic_bool alive;
+
+    std::vector<TraceEvent> events;
+    std::atomic<uint64_t> count;
+};
+#pragma GCC diagnostic pop
+
+class TraceRegistry
+{
+public:
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TraceThreadBuffer>> buffers;
+    std::unordered_set<std::string> internedStrings;
+};
+
+static TraceRegistry *traceRegistry()
+{
+    // intentionally leaked, threads may still record events during static destruction
+    static auto registry = new TraceRegistry;
+    return registry;
+}
+
+/**
+ * Holds the trace buffer of the current thread and marks it as
+ * finished when the thread exits.
+ */
+class TraceThreadBufferHolder
+{
+public:
+    ~TraceThreadBufferHolder()
+    {
+        if (buffer)
+            buffer->alive = false;
+    }
+
+    std::shared_ptr<TraceThreadBuffer> buffer;
+};
+
+static TraceThreadBuffer *currentThreadTraceBuffer()
+{
+    static thread_local TraceThreadBufferHolder holder;
+    if (holder.buffer)
+        return holder.buffer.get();
+
+    holder.buffer = std::make_shared<TraceThreadBuffer>();
+    holder.buffer->tid = static_cast<pid_t>(syscall(SYS_gettid));
+    char name[16] = {0};
+    pthread_getname_np(pthread_self(), name, sizeof(name));
+    holder.buffer->threadName = QByteArray(name);
+
+    auto registry = traceRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    registry->buffers.push_back(holder.buffer);
+    return holder.buffer.get();
+}
+
+void traceSetEnabled(bool enabled)
+{
+    g_traceEnabled = enabled;
+}
+
+/**
+ * Drop all recorded events, as well as the buffers of threads which have exited.
+ * This should only be called while tracing is disabled.
+ */
+void traceReset()
+{
+    auto registry = traceRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+
+    std::vector<std::shared_ptr<TraceThreadBuffer>> aliveBuffers;
+    for (auto &buffer : registry->buffers) {
+        if (!buffer->alive)
+            continue;
+        buffer->count = 0;
+        aliveBuffers.push_back(buffer);
+    }
+    registry->buffers = aliveBuffers;
+}
+
+/**
+ * Get a pointer to a copy of @str which remains valid for the lifetime of
+ * the process, for use as trace span name or detail.
+ */
+const char *traceIntern(const QString &str)
+{
+    auto registry = traceRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    const auto it = registry->internedStrings.insert(str.toStdString()).first;
+    return it->c_str();
+}
+
+void traceRecordSpan(const char *name, const char *detail, int64_t startNs, int64_t endNs) noexcept
+{
+    auto buffer = currentThreadTraceBuffer();
+
+    // only this thread ever writes to its buffer, readers only look at
+    // events up to the published count
+    const auto index = buffer->count.load(std::memory_order_relaxed);
+    auto &event = buffer->events[index % TRACE_BUFFER_EVENTS];
+    event.name = name;
+    event.detail = detail;
+    event.startNs = startNs;
+    event.durationNs = endNs - startNs;
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+static void appendJsonString(QByteArray &out, const char *str)
+{
+    out.append('"');
+    for (const char *c = str; *c != '\0'; c++) {
+        switch (*c) {
+        case '"':
+            out.append("\\\"");
+            break;
+        case '\\':
+            out.append("\\\\");
+            break;
+        default:
+            if (static_cast<unsigned char>(*c) < 0x20)
+                out.append(QByteArray("\\u00") + QByteArray::number(static_cast<int>(*c), 16).rightJustified(2, '0'));
+            else
+                out.append(*c);
+        }
+    }
+    out.append('"');
+}
+
+/**
+ * Write all recorded events into a Chrome trace event JSON file.
+ * Timestamps are written relative to @origin, usually the start of the run.
+ */
+bool traceExportChromeJson(const QString &fname, const symaster_timepoint &origin, QString *errorMessage)
+{
+    QFile file(fname);
+    if (!file.open(QFile::WriteOnly | QFile::Truncate)) {
+        if (errorMessage != nullptr)
+            *errorMessage = file.errorString();
+        return false;
+    }
+
+    const auto originNs = std::chrono::duration_cast<nanoseconds_t>(origin.time_since_epoch()).count();
+    const auto pidStr = QByteArray::number(getpid());
+
+    QByteArray out;
+    out.reserve(1024 * 1024);
+    out.append("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    out.append("{\"ph\":\"M\",\"pid\":" + pidStr + ",\"name\":\"process_name\",\"args\":{\"name\":\"Syntalos\"}}");
+
+    auto registry = traceRegistry();
+    std::lock_guard<std::mutex> lock(registry->mutex);
+    for (const auto &buffer : registry->buffers) {
+        const auto tidStr = QByteArray::number(buffer->tid);
+        out.append(",\n{\"ph\":\"M\",\"pid\":" + pidStr + ",\"tid\":" + tidStr + ",\"name\":\"thread_name\",\"args\":{\"name\":");
+        appendJsonString(out, buffer->threadName.constData());
+        out.append("}}");
+
+        const auto count = buffer->count.load(std::memory_order_acquire);
+        const auto first = (count > TRACE_BUFFER_EVENTS)? count - TRACE_BUFFER_EVENTS : 0;
+        for (auto i = first; i < count; i++) {
+            const auto &event = buffer->events[i % TRACE_BUFFER_EVENTS];
+            out.append(",\n{\"ph\":\"X\",\"cat\":\"syntalos\",\"pid\":" + pidStr + ",\"tid\":" + tidStr + ",\"name\":");
+            appendJsonString(out, event.name);
+            out.append(",\"ts\":" + QByteArray::number((event.startNs - originNs) / 1000.0, 'f', 3));
+            out.append(",\"dur\":" + QByteArray::number(event.durationNs / 1000.0, 'f', 3));
+            if (event.detail != nullptr) {
+                out.append(",\"args\":{\"detail\":");
+                appendJsonString(out, event.detail);
+                out.append('}');
+            }
+            out.append('}');
+
+            if (out.size() > 1024 * 1024) {
+                file.write(out);
+                out.clear();
+            }
+        }
+    }
+    out.append("\n]}\n");
+    file.write(out);
+
+    if (file.error() != QFile::NoError) {
+        if (errorMessage != nullptr)
+            *errorMessage = file.errorString();
+        return false;
+    }
+    return true;
+}
+
+} // end of namespace
@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU Lesser General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with this software.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <QString>
+
+#include "syclock.h"
+
+namespace Syntalos {
+
+/**
+ * Event tracing
+ *
+ * Trace points record the duration of spans of code into per-thread ring buffers,
+ * which are only ever written by their owning thread and thus need no locking.
+ * Tracing can be switched on and off at runtime. While it is disabled, a trace point
+ * costs a single relaxed atomic load.
+ * Recorded spans can be exported in the Chrome trace event JSON format, which can be
+ * viewed in Perfetto (ui.perfetto.dev) or chrome://tracing.
+ *
+ * Span names and details are stored as pointers, so they must be string literals or
+ * strings obtained from traceIntern().
+ */
+
+extern std::atomic_bool g_traceEnabled;
+
+inline bool traceEnabled() noexcept
+{
+    return g_traceEnabled.load(std::memory_order_relaxed);
+}
+
+inline int64_t traceTimestampNs() noexcept
+{
+    return std::chrono::duration_cast<nanoseconds_t>(symaster_clock::now().time_since_epoch()).count();
+}
+
+void traceSetEnabled(bool enabled);
+void traceReset();
+const char *traceIntern(const QString &str);
+void traceRecordSpan(const char *name, const char *detail, int64_t startNs, int64_t endNs) noexcept;
+bool traceExportChromeJson(const QString &fname, const symaster_timepoint &origin, QString *errorMessage = nullptr);
+
+/**
+ * @brief Record the time until the end of the current scope as a trace span
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name, const char *detail = nullptr) noexcept
+        : m_name(nullptr),
+          m_detail(detail),
+          m_startNs(0)
+    {
+        if (!traceEnabled())
+            return;
+        m_name = name;
+        m_startNs = traceTimestampNs();
+    }
+
+    ~TraceSpan()
+    {
+        if (m_name != nullptr)
+            traceRecordSpan(m_name, m_detail, m_startNs, traceTimestampNs());
+    }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+    const char *m_name;
+    const char *m_detail;
+    int64_t m_startNs;
+};
+
+} // end of namespace
+
+#define SY_TRACE_CONCAT_(a, b) a##b
+#define SY_TRACE_CONCAT(a, b) SY_TRACE_CONCAT_(a, b)
+
+/**
+ * Trace the remainder of the current scope. Takes a span name and an optional detail string.
+ */
+#define SY_TRACE_SPAN(...) Syntalos::TraceSpan SY_TRACE_CONCAT(syTraceSpan_, __LINE__)(__VA_ARGS__)
@@ -19,6 +19,9 @@
 
 #include "timesync.h"
 
+#include <algorithm>
+#include <limits>
+#include <map>
 #include <QDebug>
 #include <QDateTime>
 #include "moduleapi.h"
@@ -84,6 +87,7 @@ FreqCounterSynchronizer::FreqCounterSynchronizer(std::shared_ptr<SyncTimer> mast
       m_toleranceUsec(SECONDARY_CLOCK_TOLERANCE.count()),
       m_calibrationMaxBlockN(500),
       m_calibrationIdx(0),
+      m_linearDriftFit(false),
       m_haveExpectedOffset(false),
       m_freq(frequencyHz),
       m_tswriter(new TimeSyncFileWriter)
@@ -123,6 +127,15 @@ void FreqCounterSynchronizer::setTimeSyncBasename(const QString &fname, const QU
     m_strategies = m_strategies.setFlag(TimeSyncStrategy::WRITE_TSYNCFILE, !fname.isEmpty());
 }
 
+void FreqCounterSynchronizer::setLinearDriftFit(bool enabled)
+{
+    if (m_haveExpectedOffset) {
+        qWarning().noquote() << "Rejected drift fit mode change on active FreqCounter Synchronizer for" << m_mod->name();
+        return;
+    }
+    m_linearDriftFit = enabled;
+}
+
 bool FreqCounterSynchronizer::isCalibrated() const
 {
     return m_haveExpectedOffset;
@@ -171,6 +184,10 @@ bool FreqCounterSynchronizer::start()
     m_calibrationIdx = 0;
     m_expectedOffsetCalCount = 0;
     m_tsOffsetsUsec = VectorXl::Zero(m_calibrationMaxBlockN);
+    m_tsOffsetTimesUsec = VectorXl::Zero(m_calibrationMaxBlockN);
+    recalculateOffsetSums();
+    m_haveDriftOrigin = false;
+    m_driftOrigin = microseconds_t(0);
     m_lastTimeIndex = 0;
     m_indexOffset = 0;
     m_offsetChangeWaitBlocks = 0;
@@ -184,51 +201,123 @@ void FreqCounterSynchronizer::stop()
     m_tswriter->close();
 }
 
-void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecvTimestamp, const microseconds_t &deviceLatency,
-                                                int blockIndex, int blockCount, VectorXu &idxTimestamps)
+void FreqCounterSynchronizer::addOffsetSample(long long timeUsec, long long offsetUsec)
 {
-    // basic input value sanity checks
-    assert(blockCount >= 1);
-    assert(blockIndex >= 0);
-    assert(blockIndex < blockCount);
+    const auto oldOffset = m_tsOffsetsUsec[m_calibrationIdx];
+    const auto oldTime = m_tsOffsetTimesUsec[m_calibrationIdx];
+
+    m_offsetsSum += offsetUsec - oldOffset;
+    m_offsetsSqSum += static_cast<double>(offsetUsec) * offsetUsec - static_cast<double>(oldOffset) * oldOffset;
+    m_offsetTimesSum += timeUsec - oldTime;
+    m_offsetTimesSqSum += static_cast<double>(timeUsec) * timeUsec - static_cast<double>(oldTime) * oldTime;
+    m_offsetsTimesProdSum += static_cast<double>(timeUsec) * offsetUsec - static_cast<double>(oldTime) * oldOffset;
+
+    m_tsOffsetsUsec[m_calibrationIdx] = offsetUsec;
+    m_tsOffsetTimesUsec[m_calibrationIdx] = timeUsec;
+    m_calibrationIdx++;
+    if (m_calibrationIdx >= m_calibrationMaxBlockN) {
+        m_calibrationIdx = 0;
 
-    // get last index value of vector before we made any adjustments to it
-    const auto secondaryLastIdxUnadjusted = idxTimestamps[idxTimestamps.rows() - 1];
+        // recalculate the floating-point sums once per window, so rounding errors can not accumulate
+        recalculateOffsetSums();
+    }
+}
 
-    // adjust timestamp based on our current offset
-    if (m_applyIndexOffset && (m_indexOffset != 0))
-        idxTimestamps -= VectorXu::Ones(idxTimestamps.rows()) * m_indexOffset;
+void FreqCounterSynchronizer::recalculateOffsetSums()
+{
+    const Eigen::ArrayXd offsets = m_tsOffsetsUsec.cast<double>().array();
+    const Eigen::ArrayXd times = m_tsOffsetTimesUsec.cast<double>().array();
+    m_offsetsSum = m_tsOffsetsUsec.sum();
+    m_offsetsSqSum = offsets.square().sum();
+    m_offsetTimesSum = times.sum();
+    m_offsetTimesSqSum = times.square().sum();
+    m_offsetsTimesProdSum = (offsets * times).sum();
+}
 
+/**
+ * Estimate the offset between secondary and master clock at @timeUsec, using
+ * the values of the current calibration window.
+ */
+long long FreqCounterSynchronizer::estimateOffset(long long timeUsec) const
+{
+    const auto n = m_tsOffsetsUsec.rows();
+
+    // integer mean, identical to VectorXl::mean()
+    if (!m_linearDriftFit)
+        return m_offsetsSum / n;
+
+    const double meanTime = m_offsetTimesSum / n;
+    const double meanOffset = static_cast<double>(m_offsetsSum) / n;
+    const double sxx = m_offsetTimesSqSum - n * meanTime * meanTime;
+    if (sxx <= 0)
+        return std::llround(meanOffset);
+    const double sxy = m_offsetsTimesProdSum - n * meanTime * meanOffset;
+    return std::llround(meanOffset + (sxy / sxx) * (timeUsec - meanTime));
+}
+
+/**
+ * Variance of the offsets in the calibration window around @estimate, or around
+ * the regression line if we are fitting a linear drift.
+ */
+double FreqCounterSynchronizer::offsetsVariance(long long estimate) const
+{
+    const auto n = m_tsOffsetsUsec.rows();
+
+    if (!m_linearDriftFit) {
+        const double mean = estimate;
+        return std::max(0.0, (m_offsetsSqSum - 2.0 * mean * m_offsetsSum + n * mean * mean) / n);
+    }
+
+    const double meanTime = m_offsetTimesSum / n;
+    const double meanOffset = static_cast<double>(m_offsetsSum) / n;
+    const double sxx = m_offsetTimesSqSum - n * meanTime * meanTime;
+    const double syy = m_offsetsSqSum - n * meanOffset * meanOffset;
+    const double sxy = m_offsetsTimesProdSum - n * meanTime * meanOffset;
+    const double residual = (sxx > 0)? syy - (sxy * sxy) / sxx : syy;
+    return std::max(0.0, residual / n);
+}
+
+/**
+ * Update the offset estimate with one block of data and adjust the index offset if needed.
+ * Returns the index offset to apply as a gradient to this block, or zero if the
+ * block should not be changed beyond the index offset that was active before.
+ */
+int FreqCounterSynchronizer::updateBlockOffset(const microseconds_t &blocksRecvTimestamp, const microseconds_t &deviceLatency,
+                                               int blockIndex, int blockCount, long blockRows,
+                                               uint secondaryFirstIdxUnadjusted, uint secondaryLastIdxUnadjusted)
+{
     // timestamp when (as far and well as we can guess...) the current block was actually acquired, in microseconds
     // and based on the master clock timestamp generated upon data receival
     const microseconds_t masterAssumedAcqTS = blocksRecvTimestamp
-                                                - microseconds_t(std::lround(m_timePerPointUs * ((blockCount - 1) * idxTimestamps.rows())))
-                                                + microseconds_t(std::lround(m_timePerPointUs * (blockIndex * idxTimestamps.rows())))
+                                                - microseconds_t(std::lround(m_timePerPointUs * ((blockCount - 1) * blockRows)))
+                                                + microseconds_t(std::lround(m_timePerPointUs * (blockIndex * blockRows)))
                                                 - deviceLatency;
 
-    // value of the last entry of the current block
-    const auto secondaryLastIdx = idxTimestamps[idxTimestamps.rows() - 1];
+    // value of the last entry of the current block, after the currently active offset was applied to it
+    const uint secondaryLastIdx = (m_applyIndexOffset)? secondaryLastIdxUnadjusted - m_indexOffset : secondaryLastIdxUnadjusted;
 
     // Timestamp, in microseconds, when according to the device frequency the last datapoint of this block was acquired
     // since we assume a zero-indexed time series, we need to add one to the secondary index
-    // If the index offset has already been applied, take the value as-is, otherwise apply our current offset even if
-    // modifications to the data are not permitted (we need the corrected last timestamp here, even if we don't apply
-    // it to the output data and are just writing a tsync file)
-    const auto secondaryLastTS = m_applyIndexOffset?
-                                    microseconds_t(std::lround((secondaryLastIdx + 1) * m_timePerPointUs)) :
-                                    microseconds_t(std::lround((secondaryLastIdxUnadjusted + 1 - m_indexOffset) * m_timePerPointUs));
+    // We always apply our current offset here, even if modifications to the data are not permitted (we need the
+    // corrected last timestamp here, even if we don't apply it to the output data and are just writing a tsync file)
+    const auto secondaryLastTS = microseconds_t(std::lround((static_cast<long long>(secondaryLastIdxUnadjusted) + 1 - m_indexOffset) * m_timePerPointUs));
 
     // calculate time offset
     const long long curOffsetUsec = (secondaryLastTS - masterAssumedAcqTS).count();
 
+    // position of this offset on the time axis of the drift fit
+    if (!m_haveDriftOrigin) {
+        m_driftOrigin = masterAssumedAcqTS;
+        m_haveDriftOrigin = true;
+    }
+    const long long offsetTimeUsec = (masterAssumedAcqTS - m_driftOrigin).count();
+
     // calculate offsets without the new datapoint included
-    const auto avgOffsetUsec = m_tsOffsetsUsec.mean();
+    const auto avgOffsetUsec = estimateOffset(offsetTimeUsec);
     const auto avgOffsetDeviationUsec = avgOffsetUsec - m_expectedOffset.count();
 
     // add new datapoint to our "memory" vector
-    m_tsOffsetsUsec[m_calibrationIdx++] = curOffsetUsec;
-    if (m_calibrationIdx >= m_calibrationMaxBlockN)
-        m_calibrationIdx = 0;
+    addOffsetSample(offsetTimeUsec, curOffsetUsec);
 
     // we do nothing more until we have enought measurements to estimate the "natural" timer offset
     // of the secondary clock and master clock
@@ -239,7 +328,7 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
         // datapoint was acquired as first value
         if (m_expectedOffsetCalCount == 1) {
             if (m_strategies.testFlag(TimeSyncStrategy::WRITE_TSYNCFILE))
-                m_tswriter->writeTimes(idxTimestamps[0] * m_timePerPointUs, masterAssumedAcqTS);
+                m_tswriter->writeTimes(secondaryFirstIdxUnadjusted * m_timePerPointUs, masterAssumedAcqTS);
         }
 
         // we want a bit more values than needed for perpetual calibration, because the first
@@ -247,10 +336,12 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
         // a higher variance than actually expected during normal operation (as in the startup
         // phase, the system load is high and lots of external devices are starting up)
         if (m_expectedOffsetCalCount < (m_calibrationMaxBlockN + (m_calibrationMaxBlockN / 2)))
-            return;
+            return 0;
 
-        m_expectedSD = sqrt(vectorVariance(m_tsOffsetsUsec));
-        m_expectedOffset = microseconds_t(std::lround(vectorMedianInplace(m_tsOffsetsUsec)));
+        // the median is calculated on a copy, as the window needs to stay in order for the running sums
+        VectorXl offsetsCopy = m_tsOffsetsUsec;
+        m_expectedSD = sqrt(offsetsVariance(estimateOffset(offsetTimeUsec)));
+        m_expectedOffset = microseconds_t(std::lround(vectorMedianInplace(offsetsCopy)));
 
         qCDebug(logTimeSync).noquote().nospace() << QTime::currentTime().toString() << "[" << m_id << "] "
                 << "Determined expected time offset: " << m_expectedOffset.count() << "µs "
@@ -264,10 +355,10 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
 
         // send (possibly initial) offset info to the controller)
         if (m_mod != nullptr)
-            emit m_mod->synchronizerOffsetChanged(m_id, microseconds_t(m_tsOffsetsUsec.mean() - m_expectedOffset.count()));
+            emit m_mod->synchronizerOffsetChanged(m_id, microseconds_t(estimateOffset(offsetTimeUsec) - m_expectedOffset.count()));
 
         m_lastTimeIndex = secondaryLastIdx;
-        return;
+        return 0;
     }
 
     // do nothing if we have not enough average deviation from the norm
@@ -294,11 +385,11 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
 
         m_lastOffsetWithinTolerance = true;
         m_lastTimeIndex = secondaryLastIdx;
-        return;
+        return 0;
     }
     m_lastOffsetWithinTolerance = false;
 
-    const auto offsetsSD = sqrt(vectorVariance(m_tsOffsetsUsec, avgOffsetUsec));
+    const auto offsetsSD = sqrt(offsetsVariance(avgOffsetUsec));
     if (abs(avgOffsetUsec - curOffsetUsec) > offsetsSD) {
         // the current offset diff to the moving average offset is not within standard deviation range.
         // This means the data point we just added is likely a fluke, potentially due to a context switch
@@ -307,7 +398,7 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
         if (m_offsetChangeWaitBlocks > 0)
             m_offsetChangeWaitBlocks--;
         m_lastTimeIndex = secondaryLastIdx;
-        return;
+        return 0;
     }
 
     // Don't do even more adjustments until we have lived with the current one for a while.
@@ -316,7 +407,7 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
     if (m_offsetChangeWaitBlocks > 0) {
         m_offsetChangeWaitBlocks--;
         m_lastTimeIndex = secondaryLastIdx;
-        return;
+        return 0;
     }
 
     // Emit offset information to the main controller about every 10sec or slower
@@ -339,6 +430,7 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
     const bool initialOffset = m_indexOffset == 0;
     m_indexOffset = static_cast<int>((m_timeCorrectionOffset.count() / 1000.0 / 1000.0) * m_freq);
 
+    int gradientOffset = 0;
     if (m_indexOffset != 0) {
         m_offsetChangeWaitBlocks = ceil(m_calibrationMaxBlockN / 3);
 
@@ -352,9 +444,9 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
                 m_applyIndexOffset = true;
         }
 
-        // already apply offset as gradient to the current vector, if we are permitted to make that change
+        // already apply offset as gradient to the current block, if we are permitted to make that change
         if (initialOffset && m_applyIndexOffset)
-            idxTimestamps -= VectorXu::LinSpaced(idxTimestamps.rows(), 0, m_indexOffset);
+            gradientOffset = m_indexOffset;
     }
 
     // we're out of sync, record that fact to the tsync file if we are writing one
@@ -365,6 +457,31 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecv
                                masterAssumedAcqTS);
 
     m_lastTimeIndex = secondaryLastIdx;
+    return gradientOffset;
+}
+
+void FreqCounterSynchronizer::processTimestamps(const microseconds_t &blocksRecvTimestamp, const microseconds_t &deviceLatency,
+                                                int blockIndex, int blockCount, VectorXu &idxTimestamps)
+{
+    // basic input value sanity checks
+    assert(blockCount >= 1);
+    assert(blockIndex >= 0);
+    assert(blockIndex < blockCount);
+
+    // get index values of the vector before we made any adjustments to it
+    const auto rows = idxTimestamps.rows();
+    const uint secondaryFirstIdxUnadjusted = idxTimestamps[0];
+    const uint secondaryLastIdxUnadjusted = idxTimestamps[rows - 1];
+
+    // adjust timestamp based on our current offset
+    if (m_applyIndexOffset && (m_indexOffset != 0))
+        idxTimestamps.array() -= static_cast<uint>(m_indexOffset);
+
+    const auto gradientOffset = updateBlockOffset(blocksRecvTimestamp, deviceLatency,
+                                                  blockIndex, blockCount, rows,
+                                                  secondaryFirstIdxUnadjusted, secondaryLastIdxUnadjusted);
+    if (gradientOffset != 0)
+        idxTimestamps -= VectorXu::LinSpaced(rows, 0, gradientOffset);
 }
 
 void FreqCounterSynchronizer::processTimestamps(const microseconds_t &recvTimestamp, const double &devLatencyMs, int blockIndex, int blockCount, VectorXu &idxTimestamps)
@@ -374,27 +491,82 @@ void FreqCounterSynchronizer::processTimestamps(const microseconds_t &recvTimest
     processTimestamps(recvTimestamp, deviceLatency, blockIndex, blockCount, idxTimestamps);
 }
 
+/**
+ * Process the timestamps of @blockCount equally sized blocks that were received together
+ * and are stored consecutively in @idxTimestamps.
+ * The result is the same as calling processTimestamps() for each block, but the offset
+ * estimate is updated for all blocks first and the correction is applied to the whole
+ * batch at once.
+ */
+void FreqCounterSynchronizer::processTimestampBatch(const microseconds_t &blocksRecvTimestamp, const microseconds_t &deviceLatency,
+                                                    int blockCount, VectorXu &idxTimestamps)
+{
+    assert(blockCount >= 1);
+    assert(idxTimestamps.rows() % blockCount == 0);
+    const long blockRows = idxTimestamps.rows() / blockCount;
+
+    // update the estimate block by block, and remember which correction each block needs
+    std::vector<std::pair<int, int>> blockCorrections;
+    blockCorrections.reserve(blockCount);
+    bool uniformCorrection = true;
+    for (int b = 0; b < blockCount; b++) {
+        const auto activeOffset = (m_applyIndexOffset)? m_indexOffset : 0;
+        const auto gradientOffset = updateBlockOffset(blocksRecvTimestamp, deviceLatency,
+                                                      b, blockCount, blockRows,
+                                                      idxTimestamps[b * blockRows],
+                                                      idxTimestamps[(b + 1) * blockRows - 1]);
+        blockCorrections.push_back(std::make_pair(activeOffset, gradientOffset));
+        if (gradientOffset != 0 || activeOffset != blockCorrections.front().first)
+            uniformCorrection = false;
+    }
+
+    // usually the whole batch is shifted by the same amount
+    if (uniformCorrection) {
+        if (blockCorrections.front().first != 0)
+            idxTimestamps.array() -= static_cast<uint>(blockCorrections.front().first);
+        return;
+    }
+
+    for (int b = 0; b < blockCount; b++) {
+        auto block = idxTimestamps.segment(b * blockRows, blockRows);
+        if (blockCorrections[b].first != 0)
+            block.array() -= static_cast<uint>(blockCorrections[b].first);
+        if (blockCorrections[b].second != 0)
+            block -= VectorXu::LinSpaced(blockRows, 0, blockCorrections[b].second);
+    }
+}
+
 // --------------------------
 // SecondaryClockSynchronizer
 // --------------------------
 
 SecondaryClockSynchronizer::SecondaryClockSynchronizer(std::shared_ptr<SyncTimer> masterTimer,
                                                        AbstractModule *mod,
-                                                       const QString &id)
+                                                       const QString &id,
+                                                       std::shared_ptr<SecondaryClockDomain> domain)
     : m_mod(mod),
       m_id(id),
       m_strategies(TimeSyncStrategy::SHIFT_TIMESTAMPS_FWD | TimeSyncStrategy::SHIFT_TIMESTAMPS_BWD),
       m_lastOffsetEmission(0),
       m_syTimer(masterTimer),
       m_toleranceUsec(SECONDARY_CLOCK_TOLERANCE.count()),
+      m_expectedFrequency(0),
       m_calibrationMaxN(500),
       m_calibrationIdx(0),
       m_haveExpectedOffset(false),
-      m_tswriter(new TimeSyncFileWriter)
+      m_clockCorrectionOffset(0),
+      m_tswriter(new TimeSyncFileWriter),
+      m_domain(domain),
+      m_running(false)
 {
     if (m_id.isEmpty())
         m_id = createRandomString(4);
 
+    if (m_domain) {
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        m_domain->m_memberCount++;
+    }
+
     // make our existence known to the system
     emitSyncDetailsChanged();
 }
@@ -402,32 +574,46 @@ SecondaryClockSynchronizer::SecondaryClockSynchronizer(std::shared_ptr<SyncTimer
 SecondaryClockSynchronizer::~SecondaryClockSynchronizer()
 {
     stop();
+    if (m_domain) {
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        m_domain->m_memberCount--;
+        m_domain->removeMemberFrequency(m_expectedFrequency);
+    }
 }
 
 microseconds_t SecondaryClockSynchronizer::clockCorrectionOffset() const
 {
+    if (m_domain) {
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        return m_domain->m_estimator->m_clockCorrectionOffset;
+    }
     return m_clockCorrectionOffset;
 }
 
 void SecondaryClockSynchronizer::setCalibrationPointsCount(int timepointCount)
 {
     if (m_haveExpectedOffset) {
-        qCWarning(logTimeSync).noquote() << "Rejected calibration point count change on active Clock Synchronizer for" << m_mod->name();
+        qCWarning(logTimeSync).noquote() << "Rejected calibration point count change on active Clock Synchronizer for" << ownerName();
         return;
     }
     if (timepointCount > 10)
         m_calibrationMaxN = timepointCount;
+
+    if (m_domain) {
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        m_domain->m_calibrationPointsCount = std::max(m_domain->m_calibrationPointsCount, timepointCount);
+    }
 }
 
 void SecondaryClockSynchronizer::setExpectedClockFrequencyHz(double frequency)
 {
     if (m_haveExpectedOffset) {
-        qCWarning(logTimeSync).noquote() << "Rejected frequency change on active Clock Synchronizer for" << m_mod->name();
+        qCWarning(logTimeSync).noquote() << "Rejected frequency change on active Clock Synchronizer for" << ownerName();
         return;
     }
 
     if (frequency <= 0) {
-        qCWarning(logTimeSync).noquote() << "Rejected bogus frequency change to <= 0 for" << m_mod->name();
+        qCWarning(logTimeSync).noquote() << "Rejected bogus frequency change to <= 0 for" << ownerName();
         return;
     }
 
@@ -440,29 +626,64 @@ void SecondaryClockSynchronizer::setExpectedClockFrequencyHz(double frequency)
     // set tolerance of half the time one sample takes to be acquired
     m_toleranceUsec = std::lround(((1000.0 / frequency) / 2) * 1000.0);
     emitSyncDetailsChanged();
+
+    if (m_domain) {
+        // the shared estimator receives the datapoints of all devices, and must not
+        // tolerate more deviation than the fastest device of the domain
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        m_domain->removeMemberFrequency(m_expectedFrequency);
+        m_domain->m_frequencySum += frequency;
+        m_domain->m_toleranceUsec = std::min(m_domain->m_toleranceUsec, m_toleranceUsec);
+    }
+    m_expectedFrequency = frequency;
 }
 
 void SecondaryClockSynchronizer::setTimeSyncBasename(const QString &fname, const QUuid &collectionId)
 {
+    if (m_domain) {
+        // the domain writes one tsync file for all of its devices, the first name we get wins
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        auto estimator = m_domain->m_estimator.get();
+        if (fname.isEmpty() || estimator->m_strategies.testFlag(TimeSyncStrategy::WRITE_TSYNCFILE))
+            return;
+        estimator->m_collectionId = collectionId;
+        estimator->m_tswriter->setFileName(fname);
+        estimator->m_strategies |= TimeSyncStrategy::WRITE_TSYNCFILE;
+        return;
+    }
+
     m_collectionId = collectionId;
     m_tswriter->setFileName(fname);
     m_strategies = m_strategies.setFlag(TimeSyncStrategy::WRITE_TSYNCFILE, !fname.isEmpty());
 }
 
+std::shared_ptr<SecondaryClockDomain> SecondaryClockSynchronizer::clockDomain() const
+{
+    return m_domain;
+}
+
 bool SecondaryClockSynchronizer::isCalibrated() const
 {
+    if (m_domain) {
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        return m_domain->m_estimator->m_haveExpectedOffset;
+    }
     return m_haveExpectedOffset;
 }
 
 microseconds_t SecondaryClockSynchronizer::expectedOffsetToMaster() const
 {
+    if (m_domain) {
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        return m_domain->m_estimator->m_expectedOffset;
+    }
     return m_expectedOffset;
 }
 
 void SecondaryClockSynchronizer::setStrategies(const TimeSyncStrategies &strategies)
 {
     if (m_haveExpectedOffset) {
-        qCWarning(logTimeSync).noquote() << "Rejected strategy change on active Clock Synchronizer for" << m_mod->name();
+        qCWarning(logTimeSync).noquote() << "Rejected strategy change on active Clock Synchronizer for" << ownerName();
         return;
     }
     m_strategies = strategies;
@@ -472,30 +693,54 @@ void SecondaryClockSynchronizer::setStrategies(const TimeSyncStrategies &strateg
 void SecondaryClockSynchronizer::setTolerance(const microseconds_t &tolerance)
 {
     if (m_haveExpectedOffset) {
-        qCWarning(logTimeSync).noquote() << "Rejected tolerance change on active Clock Synchronizer for" << m_mod->name();
+        qCWarning(logTimeSync).noquote() << "Rejected tolerance change on active Clock Synchronizer for" << ownerName();
         return;
     }
     m_toleranceUsec = tolerance.count();
     emitSyncDetailsChanged();
+
+    if (m_domain) {
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        m_domain->m_toleranceUsec = std::min(m_domain->m_toleranceUsec, m_toleranceUsec);
+    }
 }
 
 bool SecondaryClockSynchronizer::start()
 {
     if (m_haveExpectedOffset) {
-        qCWarning(logTimeSync).noquote() << "Restarting a Clock Synchronizer that has already been used is not permitted. This is an issue in " << m_mod->name();
+        qCWarning(logTimeSync).noquote() << "Restarting a Clock Synchronizer that has already been used is not permitted. This is an issue in " << ownerName();
         return false;
     }
+
+    if (m_domain) {
+        // the shared estimator is only set up once the first timestamp arrives, so all
+        // devices of the domain have had a chance to register their expected frequency
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        if (m_running)
+            return true;
+        if (m_domain->m_estimatorStarted) {
+            qCWarning(logTimeSync).noquote().nospace() << "Unable to add " << ownerName() << "[" << m_id << "] to clock domain "
+                                                       << m_domain->m_name << ": The domain is already active.";
+            return false;
+        }
+        m_domain->m_runningCount++;
+        m_lastOffsetWithinTolerance = false;
+        m_lastMasterTS = m_syTimer->timeSinceStartMsec();
+        m_running = true;
+        return true;
+    }
+
     if (m_strategies.testFlag(TimeSyncStrategy::WRITE_TSYNCFILE)) {
         m_tswriter->setSyncMode(TSyncFileMode::SYNCPOINTS);
         m_tswriter->setTimeDataTypes(TSyncFileDataType::INT64, TSyncFileDataType::INT64);
-        if (!m_tswriter->open(m_mod->name(), m_collectionId, microseconds_t(m_toleranceUsec))) {
-            qCCritical(logTimeSync).noquote().nospace() << "Unable to open timesync file for " << m_mod->name() << "[" << m_id << "]: " << m_tswriter->lastError();
+        if (!m_tswriter->open(ownerName(), m_collectionId, microseconds_t(m_toleranceUsec))) {
+            qCCritical(logTimeSync).noquote().nospace() << "Unable to open timesync file for " << ownerName() << "[" << m_id << "]: " << m_tswriter->lastError();
             return false;
         }
     }
 
     if (m_calibrationMaxN <= 4)
-        qCCritical(logTimeSync).noquote().nospace() << "Clock synchronizer for " << m_mod->name() << "[" << m_id << "] uses a tiny calibration array (length <= 4)";
+        qCCritical(logTimeSync).noquote().nospace() << "Clock synchronizer for " << ownerName() << "[" << m_id << "] uses a tiny calibration array (length <= 4)";
     assert(m_calibrationMaxN > 0);
 
     m_lastOffsetWithinTolerance = false;
@@ -505,16 +750,45 @@ bool SecondaryClockSynchronizer::start()
     m_expectedOffsetCalCount = 0;
     m_clockOffsetsUsec = VectorXl::Zero(m_calibrationMaxN);
     m_lastMasterTS = m_syTimer->timeSinceStartMsec();
+    m_running = true;
 
     return true;
 }
 
 void SecondaryClockSynchronizer::stop()
 {
+    if (m_domain) {
+        if (!m_running)
+            return;
+        m_running = false;
+
+        // the last device to stop finalizes the shared tsync file
+        std::lock_guard<std::mutex> lock(m_domain->m_mutex);
+        m_domain->m_runningCount--;
+        if (m_domain->m_runningCount <= 0)
+            m_domain->m_estimator->stop();
+        return;
+    }
+
+    m_running = false;
     m_tswriter->close();
 }
 
 void SecondaryClockSynchronizer::processTimestamp(microseconds_t &masterTimestamp, const microseconds_t &secondaryAcqTimestamp)
+{
+    if (m_domain)
+        m_domain->processTimestamp(this, masterTimestamp, secondaryAcqTimestamp);
+    else
+        adjustTimestamp(this, masterTimestamp, secondaryAcqTimestamp);
+}
+
+/**
+ * Estimate the clock offset including the new datapoint and adjust the master timestamp
+ * of @device. Estimator state lives in this synchronizer, while strategies, monotonicity
+ * and offset notifications are handled per device.
+ */
+void SecondaryClockSynchronizer::adjustTimestamp(SecondaryClockSynchronizer *device, microseconds_t &masterTimestamp,
+                                                 const microseconds_t &secondaryAcqTimestamp)
 {
     const long long curOffsetUsec = (secondaryAcqTimestamp - masterTimestamp).count();
 
@@ -559,7 +833,7 @@ void SecondaryClockSynchronizer::processTimestamp(microseconds_t &masterTimestam
         if (m_strategies.testFlag(TimeSyncStrategy::WRITE_TSYNCFILE))
             m_tswriter->writeTimes(secondaryAcqTimestamp, masterTimestamp);
 
-        m_lastMasterTS = masterTimestamp;
+        device->m_lastMasterTS = masterTimestamp;
         return;
     }
 
@@ -586,31 +860,31 @@ void SecondaryClockSynchronizer::processTimestamp(microseconds_t &masterTimestam
     // ensure time doesn't run backwards - at this point, this event may
     // only happen if the secondary clock  gives us the exact same
     // timestamp twice in a row.
-    if (masterTimestamp < m_lastMasterTS)
-        masterTimestamp = m_lastMasterTS;
+    if (masterTimestamp < device->m_lastMasterTS)
+        masterTimestamp = device->m_lastMasterTS;
 
     // do nothing if we have not enough average deviation from the norm
     if (abs(avgOffsetDeviationUsec) < m_toleranceUsec) {
         // we are within tolerance range!
         // share the good news with the controller! (immediately on change, or every 30sec otherwise)
-        if ((!m_lastOffsetWithinTolerance) || (masterTimestamp.count() > (m_lastOffsetEmission.count() + (30 * 1000 * 1000)))) {
-            if (m_mod != nullptr)
-                emit m_mod->synchronizerOffsetChanged(m_id, microseconds_t(avgOffsetDeviationUsec));
-            m_lastOffsetEmission = masterTimestamp;
+        if ((!device->m_lastOffsetWithinTolerance) || (masterTimestamp.count() > (device->m_lastOffsetEmission.count() + (30 * 1000 * 1000)))) {
+            if (device->m_mod != nullptr)
+                emit device->m_mod->synchronizerOffsetChanged(device->m_id, microseconds_t(avgOffsetDeviationUsec));
+            device->m_lastOffsetEmission = masterTimestamp;
         }
-        m_lastOffsetWithinTolerance = true;
+        device->m_lastOffsetWithinTolerance = true;
         m_clockCorrectionOffset = microseconds_t(0);
-        m_lastMasterTS = masterTimestamp;
+        device->m_lastMasterTS = masterTimestamp;
         return;
     }
-    m_lastOffsetWithinTolerance = false;
+    device->m_lastOffsetWithinTolerance = false;
 
     // Emit offset information to the main controller about every 10sec or slower
     // in case we run at slower speeds
-    if (masterTimestamp.count() > (m_lastOffsetEmission.count() + (10 * 1000 * 1000))) {
-        if (m_mod != nullptr)
-            emit m_mod->synchronizerOffsetChanged(m_id, microseconds_t(avgOffsetDeviationUsec));
-        m_lastOffsetEmission = masterTimestamp;
+    if (masterTimestamp.count() > (device->m_lastOffsetEmission.count() + (10 * 1000 * 1000))) {
+        if (device->m_mod != nullptr)
+            emit device->m_mod->synchronizerOffsetChanged(device->m_id, microseconds_t(avgOffsetDeviationUsec));
+        device->m_lastOffsetEmission = masterTimestamp;
     }
 
     // try to adjust a potential external clock slowly (and also adjust our timestamps slowly)
@@ -626,11 +900,11 @@ void SecondaryClockSynchronizer::processTimestamp(microseconds_t &masterTimestam
 
     // the clock is out of sync, let's make adjustments!
 
-    if (m_strategies.testFlag(TimeSyncStrategy::SHIFT_TIMESTAMPS_BWD)) {
+    if (device->m_strategies.testFlag(TimeSyncStrategy::SHIFT_TIMESTAMPS_BWD)) {
         if (m_clockCorrectionOffset.count() > 0)
             masterTimestamp = secondaryAcqTimestamp - microseconds_t(avgOffsetUsec) - microseconds_t(m_clockCorrectionOffset);
     }
-    if (m_strategies.testFlag(TimeSyncStrategy::SHIFT_TIMESTAMPS_FWD)) {
+    if (device->m_strategies.testFlag(TimeSyncStrategy::SHIFT_TIMESTAMPS_FWD)) {
         if (m_clockCorrectionOffset.count() < 0)
             masterTimestamp = secondaryAcqTimestamp - microseconds_t(avgOffsetUsec) - microseconds_t(m_clockCorrectionOffset);
     }
@@ -645,13 +919,22 @@ void SecondaryClockSynchronizer::processTimestamp(microseconds_t &masterTimestam
 
     // ensure time doesn't run backwards - this really shouldn't happen at this
     // point, but we prevent this just in case
-    if (masterTimestamp < m_lastMasterTS) {
-        qCWarning(logTimeSync).noquote().nospace() << "[" << m_id << "] "
+    if (masterTimestamp < device->m_lastMasterTS) {
+        qCWarning(logTimeSync).noquote().nospace() << "[" << device->m_id << "] "
                 << "Timestamp moved backwards when calculating adjusted new time: "
-                << masterTimestamp.count() << " !< " << m_lastMasterTS.count() << " (mitigated by reusing previous time)";
-        masterTimestamp = m_lastMasterTS;
+                << masterTimestamp.count() << " !< " << device->m_lastMasterTS.count() << " (mitigated by reusing previous time)";
+        masterTimestamp = device->m_lastMasterTS;
     }
-    m_lastMasterTS = masterTimestamp;
+    device->m_lastMasterTS = masterTimestamp;
+}
+
+QString SecondaryClockSynchronizer::ownerName() const
+{
+    if (m_mod != nullptr)
+        return m_mod->name();
+    if (m_domain)
+        return QStringLiteral("clock domain %1").arg(m_domain->m_name);
+    return m_id;
 }
 
 void SecondaryClockSynchronizer::emitSyncDetailsChanged()
@@ -659,3 +942,112 @@ void SecondaryClockSynchronizer::emitSyncDetailsChanged()
     if (m_mod != nullptr)
         emit m_mod->synchronizerDetailsChanged(m_id, m_strategies, microseconds_t(m_toleranceUsec));
 }
+
+// --------------------
+// SecondaryClockDomain
+// --------------------
+
+SecondaryClockDomain::SecondaryClockDomain(std::shared_ptr<SyncTimer> masterTimer, const QString &name)
+    : m_name(name),
+      m_syTimer(masterTimer),
+      m_estimatorStarted(false),
+      m_memberCount(0),
+      m_runningCount(0),
+      m_frequencySum(0),
+      m_calibrationPointsCount(0),
+      m_toleranceUsec(std::numeric_limits<uint>::max())
+{
+    m_estimator.reset(new SecondaryClockSynchronizer(masterTimer, nullptr, name));
+}
+
+SecondaryClockDomain::~SecondaryClockDomain()
+{
+    m_estimator->stop();
+}
+
+std::shared_ptr<SecondaryClockDomain> SecondaryClockDomain::get(std::shared_ptr<SyncTimer> masterTimer, const QString &name)
+{
+    static std::mutex domainsMutex;
+    static std::map<std::pair<const SyncTimer*, QString>, std::weak_ptr<SecondaryClockDomain>> domains;
+
+    std::lock_guard<std::mutex> lock(domainsMutex);
+    for (auto it = domains.begin(); it != domains.end();) {
+        if (it->second.expired())
+            it = domains.erase(it);
+        else
+            ++it;
+    }
+
+    // domains keep a reference to their timer, so a timer address can not be
+    // reused by a new timer while a domain for it still exists
+    const auto key = std::make_pair(static_cast<const SyncTimer*>(masterTimer.get()), name);
+    auto domain = domains[key].lock();
+    if (!domain) {
+        domain = std::make_shared<SecondaryClockDomain>(masterTimer, name);
+        domains[key] = domain;
+    }
+    return domain;
+}
+
+QString SecondaryClockDomain::name() const
+{
+    return m_name;
+}
+
+int SecondaryClockDomain::memberCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_memberCount;
+}
+
+/**
+ * @brief Combined expected datapoint frequency of all members of this domain.
+ */
+double SecondaryClockDomain::expectedClockFrequencyHz()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_frequencySum;
+}
+
+/**
+ * Remove the expected frequency a member contributed to the domain,
+ * if it set one. Must be called with the domain mutex held.
+ */
+void SecondaryClockDomain::removeMemberFrequency(double frequency)
+{
+    if (frequency <= 0)
+        return;
+    m_frequencySum -= frequency;
+
+    // start from a clean sum once no member contributes anymore
+    if (m_frequencySum < 0 || m_memberCount <= 0)
+        m_frequencySum = 0;
+}
+
+void SecondaryClockDomain::processTimestamp(SecondaryClockSynchronizer *device, microseconds_t &masterTimestamp,
+                                            const microseconds_t &secondaryAcqTimestamp)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_estimatorStarted) {
+        // configure the estimator for the combined datapoint rate of all devices
+        if (m_frequencySum > 0)
+            m_estimator->setExpectedClockFrequencyHz(m_frequencySum);
+        if (m_calibrationPointsCount > 0)
+            m_estimator->setCalibrationPointsCount(m_calibrationPointsCount);
+        if (m_toleranceUsec != std::numeric_limits<uint>::max())
+            m_estimator->setTolerance(microseconds_t(m_toleranceUsec));
+
+        m_estimatorStarted = true;
+        if (!m_estimator->start()) {
+            qCCritical(logTimeSync).noquote() << "Unable to start shared estimator of clock domain" << m_name
+                                             << "- continuing without writing a timesync file.";
+            m_estimator->m_strategies.setFlag(TimeSyncStrategy::WRITE_TSYNCFILE, false);
+            m_estimator->start();
+        }
+        qCDebug(logTimeSync).noquote().nospace() << "Clock domain " << m_name << " started with " << m_memberCount << " devices, "
+                                                 << "calibration points: " << m_estimator->m_calibrationMaxN << " "
+                                                 << "tolerance: " << m_estimator->m_toleranceUsec << "µs";
+    }
+
+    m_estimator->adjustTimestamp(device, masterTimestamp, secondaryAcqTimestamp);
+}
@@ -20,6 +20,7 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <QLoggingCategory>
 #include <QString>
 #include <QMetaType>
@@ -106,6 +107,15 @@ public:
     void setTolerance(const std::chrono::microseconds &tolerance);
     void setTimeSyncBasename(const QString &fname, const QUuid &collectionId);
 
+    /**
+     * @brief Estimate the clock offset from a linear fit instead of the mean
+     *
+     * If enabled, the offset between the secondary and master clock is estimated
+     * by a linear regression over the calibration window, so a steady clock drift
+     * is followed without the delay of a moving average.
+     */
+    void setLinearDriftFit(bool enabled);
+
     bool isCalibrated() const;
     int indexOffset() const;
 
@@ -115,10 +125,20 @@ public:
                            int blockIndex, int blockCount, VectorXu &idxTimestamps);
     void processTimestamps(const microseconds_t &recvTimestamp, const double &devLatencyMs,
                            int blockIndex, int blockCount, VectorXu &idxTimestamps);
+    void processTimestampBatch(const microseconds_t &blocksRecvTimestamp, const microseconds_t &deviceLatency,
+                               int blockCount, VectorXu &idxTimestamps);
 
 private:
     Q_DISABLE_COPY(FreqCounterSynchronizer)
 
+    int updateBlockOffset(const microseconds_t &blocksRecvTimestamp, const microseconds_t &deviceLatency,
+                          int blockIndex, int blockCount, long blockRows,
+                          uint secondaryFirstIdxUnadjusted, uint secondaryLastIdxUnadjusted);
+    void addOffsetSample(long long timeUsec, long long offsetUsec);
+    void recalculateOffsetSums();
+    long long estimateOffset(long long timeUsec) const;
+    double offsetsVariance(long long estimate) const;
+
     AbstractModule *m_mod;
     QUuid m_collectionId;
     QString m_id;
@@ -132,6 +152,17 @@ private:
     uint m_calibrationMaxBlockN;
     uint m_calibrationIdx;
     VectorXl m_tsOffsetsUsec;
+    VectorXl m_tsOffsetTimesUsec;
+
+    // running sums over the calibration window, for O(1) estimates
+    bool m_linearDriftFit;
+    long long m_offsetsSum;
+    double m_offsetsSqSum;
+    double m_offsetTimesSum;
+    double m_offsetTimesSqSum;
+    double m_offsetsTimesProdSum;
+    bool m_haveDriftOrigin;
+    microseconds_t m_driftOrigin;
 
     bool m_haveExpectedOffset;
     uint m_expectedOffsetCalCount;
@@ -150,6 +181,54 @@ private:
     std::unique_ptr<TimeSyncFileWriter> m_tswriter;
 };
 
+class SecondaryClockSynchronizer;
+
+/**
+ * @brief A clock shared by multiple devices
+ *
+ * Devices which timestamp their data with the same clock (e.g. cameras triggered by the same
+ * hardware trigger, or cameras stamping frames with the same driver clock) can join a common
+ * clock domain. All synchronizers of a domain feed a single offset estimator and share one tsync
+ * file, while each device only applies the shared correction to its own timestamps.
+ */
+class SecondaryClockDomain
+{
+public:
+    explicit SecondaryClockDomain(std::shared_ptr<SyncTimer> masterTimer, const QString &name);
+    ~SecondaryClockDomain();
+
+    /**
+     * @brief Get the domain @name for the given master timer, creating it if necessary.
+     *
+     * A domain exists for as long as synchronizers reference it.
+     */
+    static std::shared_ptr<SecondaryClockDomain> get(std::shared_ptr<SyncTimer> masterTimer, const QString &name);
+
+    QString name() const;
+    int memberCount();
+    double expectedClockFrequencyHz();
+
+private:
+    Q_DISABLE_COPY(SecondaryClockDomain)
+    friend class SecondaryClockSynchronizer;
+
+    void processTimestamp(SecondaryClockSynchronizer *device, microseconds_t &masterTimestamp,
+                          const microseconds_t &secondaryAcqTimestamp);
+    void removeMemberFrequency(double frequency);
+
+    QString m_name;
+    std::shared_ptr<SyncTimer> m_syTimer;
+    std::mutex m_mutex;
+    std::unique_ptr<SecondaryClockSynchronizer> m_estimator;
+    bool m_estimatorStarted;
+
+    int m_memberCount;
+    int m_runningCount;
+    double m_frequencySum;
+    int m_calibrationPointsCount;
+    uint m_toleranceUsec;
+};
+
 /**
  * @brief Synchronizer for an external steady monotonic clock
  *
@@ -161,7 +240,8 @@ class SecondaryClockSynchronizer
 public:
     explicit SecondaryClockSynchronizer(std::shared_ptr<SyncTimer> masterTimer,
                                         AbstractModule *mod,
-                                        const QString &id = QString());
+                                        const QString &id = QString(),
+                                        std::shared_ptr<SecondaryClockDomain> domain = nullptr);
     ~SecondaryClockSynchronizer();
 
     /**
@@ -186,6 +266,8 @@ public:
     void setTolerance(const microseconds_t &tolerance);
     void setTimeSyncBasename(const QString &fname, const QUuid &collectionId);
 
+    std::shared_ptr<SecondaryClockDomain> clockDomain() const;
+
     bool isCalibrated() const;
     microseconds_t expectedOffsetToMaster() const;
 
@@ -195,8 +277,12 @@ public:
 
 private:
     Q_DISABLE_COPY(SecondaryClockSynchronizer)
+    friend class SecondaryClockDomain;
 
+    QString ownerName() const;
     void emitSyncDetailsChanged();
+    void adjustTimestamp(SecondaryClockSynchronizer *device, microseconds_t &masterTimestamp,
+                         const microseconds_t &secondaryAcqTimestamp);
 
     AbstractModule *m_mod;
     QUuid m_collectionId;
@@ -207,6 +293,7 @@ private:
 
     uint m_toleranceUsec;
     bool m_lastOffsetWithinTolerance;
+    double m_expectedFrequency;
 
     uint m_calibrationMaxN;
     uint m_calibrationIdx;
@@ -221,6 +308,9 @@ private:
     microseconds_t m_lastMasterTS;
 
     std::unique_ptr<TimeSyncFileWriter> m_tswriter;
+
+    std::shared_ptr<SecondaryClockDomain> m_domain;
+    bool m_running;
 };
 
 template<typename T>
@@ -19,9 +19,14 @@
 
 #include "tsyncfile.h"
 
+#include <atomic>
+#include <cmath>
+#include <algorithm>
 #include <QDebug>
 #include <QDateTime>
 #include <QFile>
+#include <QThread>
+#include <QtEndian>
 #include <QJsonObject>
 #include <QJsonDocument>
 
@@ -41,6 +46,9 @@ using namespace Syntalos;
 
 #define TSYNC_FILE_BLOCK_TERM 0x1126000000000000
 
+// maximum amount of complete blocks waiting for the asynchronous writer
+#define TSYNC_MAX_PENDING_BLOCKS 64
+
 QString Syntalos::tsyncFileTimeUnitToString(const TSyncFileTimeUnit &tsftunit)
 {
     switch (tsftunit) {
@@ -89,13 +97,36 @@ QString Syntalos::tsyncFileModeToString(const TSyncFileMode &mode)
     }
 }
 
+static size_t tsyncFileDataTypeSize(const TSyncFileDataType &dtype)
+{
+    switch (dtype) {
+    case TSyncFileDataType::INT16:
+    case TSyncFileDataType::UINT16:
+        return sizeof(qint16);
+    case TSyncFileDataType::INT32:
+    case TSyncFileDataType::UINT32:
+        return sizeof(qint32);
+    case TSyncFileDataType::INT64:
+    case TSyncFileDataType::UINT64:
+        return sizeof(qint64);
+    default:
+        return 0;
+    }
+}
+
 // ------------------
 // TimeSyncFileWriter
 // ------------------
 
 TimeSyncFileWriter::TimeSyncFileWriter()
     : m_file(new QFile()),
-      m_bIndex(0)
+      m_bIndex(0),
+      m_entrySize(0),
+      m_blockPos(nullptr),
+      m_asyncWrites(false),
+      m_writerBusy(false),
+      m_writerStop(false),
+      m_writerStalled(false)
 {
     m_xxh3State = XXH3_createState();
 
@@ -142,6 +173,7 @@ void TimeSyncFileWriter::setTimeDataTypes(TSyncFileDataType time1DType, TSyncFil
 
 void TimeSyncFileWriter::setFileName(const QString &fname)
 {
+    stopWriterThread();
     if (m_file->isOpen())
         m_file->close();
 
@@ -168,6 +200,16 @@ void TimeSyncFileWriter::setChunkSize(int size)
     m_blockSize = size;
 }
 
+/**
+ * Write completed data blocks to disk from a background thread, instead
+ * of writing them from the thread that adds the time entries.
+ * This setting takes effect the next time the file is opened.
+ */
+void TimeSyncFileWriter::setAsyncWrites(bool enabled)
+{
+    m_asyncWrites = enabled;
+}
+
 template<class T>
 void TimeSyncFileWriter::csWriteValue(const T &data)
 {
@@ -187,18 +229,32 @@ void TimeSyncFileWriter::csWriteValue<QByteArray>(const QByteArray &data)
 
 bool TimeSyncFileWriter::open(const QString &modName, const QUuid &collectionId, const QVariantHash &userData)
 {
+    stopWriterThread();
     if (m_file->isOpen())
         m_file->close();
 
+    const auto time1Size = tsyncFileDataTypeSize(m_time1DType);
+    const auto time2Size = tsyncFileDataTypeSize(m_time2DType);
+    if (time1Size == 0 || time2Size == 0) {
+        m_lastError = QStringLiteral("Invalid data type set for time values.");
+        return false;
+    }
+
     if (!m_file->open(QIODevice::WriteOnly)) {
         m_lastError = m_file->errorString();
         return false;
     }
 
     // ensure block size is not extremely small
-    if ((m_blockSize >= 0) && (m_blockSize < 128))
+    if (m_blockSize < 128)
         m_blockSize = 128;
 
+    // preallocate the buffer for one block of time entries, including its terminator and checksum
+    m_entrySize = time1Size + time2Size;
+    m_block.assign(m_blockSize * m_entrySize + 2 * sizeof(quint64), 0);
+    m_blockPos = m_block.data();
+    m_spareBlocks.clear();
+
     m_bIndex = 0;
     XXH3_64bits_reset(m_xxh3State);
     m_stream.setDevice(m_file);
@@ -244,6 +300,14 @@ bool TimeSyncFileWriter::open(const QString &modName, const QUuid &collectionId,
     writeBlockTerminator(false);
 
     m_file->flush();
+
+    if (m_asyncWrites) {
+        m_writerStop = false;
+        m_writerBusy = false;
+        m_writerStalled = false;
+        m_writerThread = std::thread(&TimeSyncFileWriter::writerThreadFunc, this);
+    }
+
     return true;
 }
 
@@ -254,22 +318,36 @@ bool TimeSyncFileWriter::open(const QString &modName, const QUuid &collectionId,
     return open(modName, collectionId, udata);
 }
 
+/**
+ * Write all time entries to disk, including the ones of the block
+ * that is currently being filled.
+ */
 void TimeSyncFileWriter::flush()
 {
-    if (m_file->isOpen())
-        m_file->flush();
+    if (!m_file->isOpen())
+        return;
+
+    if (m_writerThread.joinable()) {
+        std::unique_lock<std::mutex> lock(m_writerMutex);
+        m_writerCond.wait(lock, [&]() { return m_pendingBlocks.empty() && !m_writerBusy; });
+    }
+
+    writePartialBlock();
+    m_file->flush();
 }
 
 void TimeSyncFileWriter::close()
 {
+    stopWriterThread();
     if (m_file->isOpen()) {
         // terminate the last open block, if we have one
-        writeBlockTerminator();
+        finishDataBlock();
 
         // finish writing file to disk
         m_file->flush();
         m_file->close();
     }
+    m_blockPos = nullptr;
 }
 
 void TimeSyncFileWriter::writeTimes(const microseconds_t &deviceTime, const microseconds_t &masterTime)
@@ -297,56 +375,176 @@ void TimeSyncFileWriter::writeBlockTerminator(bool check)
     m_bIndex = 0;
 }
 
-template<class T1, class T2>
-void TimeSyncFileWriter::writeTimeEntry(const T1 &time1, const T2 &time2)
+/**
+ * Terminate the current data block and write it to disk, or hand it
+ * to the writer thread if it is complete and we are writing asynchronously.
+ */
+void TimeSyncFileWriter::finishDataBlock()
 {
-    static_assert(std::is_arithmetic<T1>::value, "T1 must be an arithmetic type.");
-    static_assert(std::is_arithmetic<T2>::value, "T2 must be an arithmetic type.");
+    if (m_bIndex == 0)
+        return;
 
-    switch (m_time1DType) {
-        case TSyncFileDataType::INT16:
-            csWriteValue<qint16>(time1); break;
-        case TSyncFileDataType::INT32:
-            csWriteValue<qint32>(time1); break;
-        case TSyncFileDataType::INT64:
-            csWriteValue<qint64>(time1); break;
-        case TSyncFileDataType::UINT16:
-            csWriteValue<quint16>(time1); break;
-        case TSyncFileDataType::UINT32:
-            csWriteValue<quint32>(time1); break;
-        case TSyncFileDataType::UINT64:
-            csWriteValue<quint64>(time1); break;
-        default:
-            qFatal("Tried to write unknown datatype to timesync file for time1: %i", (int) m_time1DType);
+    // the block data is stored in little-endian byte order already, so we can
+    // checksum it in one go and write it with a single call
+    const size_t dataLen = m_blockPos - m_block.data();
+    qToLittleEndian<quint64>(TSYNC_FILE_BLOCK_TERM, m_blockPos);
+    qToLittleEndian<quint64>(XXH3_64bits(m_block.data(), dataLen), m_blockPos + sizeof(quint64));
+
+    if (m_writerThread.joinable() && m_bIndex == m_blockSize) {
+        std::unique_lock<std::mutex> lock(m_writerMutex);
+        if (m_pendingBlocks.size() >= TSYNC_MAX_PENDING_BLOCKS) {
+            // the disk can not keep up with us, wait instead of queueing up more data
+            if (!m_writerStalled)
+                qCWarning(logTSyncFile).noquote() << "Writing" << m_file->fileName()
+                                                  << "is too slow, waiting for pending data to be written.";
+            m_writerStalled = true;
+            m_writerCond.wait(lock, [&]() { return m_pendingBlocks.size() < TSYNC_MAX_PENDING_BLOCKS; });
+        }
+
+        std::vector<char> nextBlock;
+        if (m_spareBlocks.empty()) {
+            nextBlock.resize(m_block.size());
+        } else {
+            nextBlock = std::move(m_spareBlocks.back());
+            m_spareBlocks.pop_back();
+        }
+        m_pendingBlocks.push_back(std::move(m_block));
+        m_block = std::move(nextBlock);
+        m_writerCond.notify_all();
+    } else {
+        writeBlockData(m_block.data(), dataLen + 2 * sizeof(quint64));
+    }
+
+    m_blockPos = m_block.data();
+    m_bIndex = 0;
+}
+
+/**
+ * Write the incomplete current block to disk, but keep filling it.
+ *
+ * Readers expect all blocks but the last one to be complete, so the file position
+ * is moved back to the start of the block afterwards, and the partial block is
+ * overwritten once more entries are written.
+ * Must not be called while the writer thread has pending blocks.
+ */
+void TimeSyncFileWriter::writePartialBlock()
+{
+    if (m_bIndex == 0)
+        return;
+
+    const size_t dataLen = m_blockPos - m_block.data();
+    qToLittleEndian<quint64>(TSYNC_FILE_BLOCK_TERM, m_blockPos);
+    qToLittleEndian<quint64>(XXH3_64bits(m_block.data(), dataLen), m_blockPos + sizeof(quint64));
+
+    const auto blockStart = m_file->pos();
+    writeBlockData(m_block.data(), dataLen + 2 * sizeof(quint64));
+    m_file->seek(blockStart);
+}
+
+void TimeSyncFileWriter::writeBlockData(const char *data, size_t len)
+{
+    if (m_file->write(data, len) != static_cast<qint64>(len))
+        qCWarning(logTSyncFile).noquote() << "Unable to write tsync data block to" << m_file->fileName() << ":" << m_file->errorString();
+}
+
+void TimeSyncFileWriter::stopWriterThread()
+{
+    if (!m_writerThread.joinable())
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(m_writerMutex);
+        m_writerStop = true;
+    }
+    m_writerCond.notify_all();
+    m_writerThread.join();
+}
+
+void TimeSyncFileWriter::writerThreadFunc()
+{
+    std::unique_lock<std::mutex> lock(m_writerMutex);
+    while (true) {
+        m_writerCond.wait(lock, [&]() { return m_writerStop || !m_pendingBlocks.empty(); });
+
+        // write all pending blocks before we quit
+        if (m_pendingBlocks.empty())
             break;
+
+        auto block = std::move(m_pendingBlocks.front());
+        m_pendingBlocks.pop_front();
+        m_writerBusy = true;
+        lock.unlock();
+
+        writeBlockData(block.data(), block.size());
+
+        lock.lock();
+        m_writerBusy = false;
+        m_spareBlocks.push_back(std::move(block));
+        m_writerCond.notify_all();
     }
+}
 
-    switch (m_time2DType) {
+template<class T>
+static inline char *storeTimeValue(char *dest, const TSyncFileDataType &dtype, const T &value)
+{
+    switch (dtype) {
         case TSyncFileDataType::INT16:
-            csWriteValue<qint16>(time2); break;
+            qToLittleEndian<qint16>(static_cast<qint16>(value), dest); return dest + sizeof(qint16);
         case TSyncFileDataType::INT32:
-            csWriteValue<qint32>(time2); break;
+            qToLittleEndian<qint32>(static_cast<qint32>(value), dest); return dest + sizeof(qint32);
         case TSyncFileDataType::INT64:
-            csWriteValue<qint64>(time2); break;
+            qToLittleEndian<qint64>(static_cast<qint64>(value), dest); return dest + sizeof(qint64);
         case TSyncFileDataType::UINT16:
-            csWriteValue<quint16>(time2); break;
+            qToLittleEndian<quint16>(static_cast<quint16>(value), dest); return dest + sizeof(quint16);
         case TSyncFileDataType::UINT32:
-            csWriteValue<quint32>(time2); break;
+            qToLittleEndian<quint32>(static_cast<quint32>(value), dest); return dest + sizeof(quint32);
         case TSyncFileDataType::UINT64:
-            csWriteValue<quint64>(time2); break;
+            qToLittleEndian<quint64>(static_cast<quint64>(value), dest); return dest + sizeof(quint64);
         default:
-            qFatal("Tried to write unknown datatype to timesync file for time2: %i", (int) m_time1DType);
-            break;
+            qFatal("Tried to write unknown datatype to timesync file: %i", (int) dtype);
+            return dest;
     }
+}
+
+template<class T1, class T2>
+void TimeSyncFileWriter::writeTimeEntry(const T1 &time1, const T2 &time2)
+{
+    static_assert(std::is_arithmetic<T1>::value, "T1 must be an arithmetic type.");
+    static_assert(std::is_arithmetic<T2>::value, "T2 must be an arithmetic type.");
+
+    if (Q_UNLIKELY(m_blockPos == nullptr)) {
+        qCWarning(logTSyncFile).noquote() << "Tried to write time entry to tsync file which was not opened.";
+        return;
+    }
+
+    m_blockPos = storeTimeValue(m_blockPos, m_time1DType, time1);
+    m_blockPos = storeTimeValue(m_blockPos, m_time2DType, time2);
 
     m_bIndex++;
     if (m_bIndex >= m_blockSize)
-        writeBlockTerminator();
+        finishDataBlock();
 }
 
+// ------------------
+// TimeSyncFileReader
+// ------------------
+
 TimeSyncFileReader::TimeSyncFileReader()
-    : m_lastError(QString())
+    : m_lastError(QString()),
+      m_file(new QFile()),
+      m_fileData(nullptr),
+      m_dataOffset(0),
+      m_dataSize(0),
+      m_entrySize(0),
+      m_time1Size(0),
+      m_blockBytes(0),
+      m_entryCount(0)
+{
+}
+
+TimeSyncFileReader::~TimeSyncFileReader()
 {
+    close();
 }
 
 template<class T>
@@ -369,14 +567,44 @@ inline QByteArray csReadValue(QDataStream &in, XXH3_state_t *state)
     return value;
 }
 
+static inline long long loadTimeValue(const uchar *src, const TSyncFileDataType &dtype)
+{
+    switch (dtype) {
+        case TSyncFileDataType::INT16:
+            return qFromLittleEndian<qint16>(src);
+        case TSyncFileDataType::INT32:
+            return qFromLittleEndian<qint32>(src);
+        case TSyncFileDataType::INT64:
+            return qFromLittleEndian<qint64>(src);
+        case TSyncFileDataType::UINT16:
+            return qFromLittleEndian<quint16>(src);
+        case TSyncFileDataType::UINT32:
+            return qFromLittleEndian<quint32>(src);
+        case TSyncFileDataType::UINT64:
+            return qFromLittleEndian<quint64>(src);
+        default:
+            qFatal("Tried to read unknown datatype from timesync file: %i", (int) dtype);
+            return 0;
+    }
+}
+
+/**
+ * Open a .tsync file for reading.
+ *
+ * This reads and verifies the file header and maps the time data into memory,
+ * but does not read the time entries themselves. Block checksums are only
+ * checked when verifyChecksums() is called.
+ */
 bool TimeSyncFileReader::open(const QString &fname)
 {
-    QFile file(fname);
-    if (!file.open(QIODevice::ReadOnly)) {
-        m_lastError = file.errorString();
+    close();
+
+    m_file->setFileName(fname);
+    if (!m_file->open(QIODevice::ReadOnly)) {
+        m_lastError = m_file->errorString();
         return false;
     }
-    QDataStream in(&file);
+    QDataStream in(m_file.get());
     in.setVersion(QDataStream::Qt_5_12);
     in.setByteOrder(QDataStream::LittleEndian);
 
@@ -385,6 +613,7 @@ bool TimeSyncFileReader::open(const QString &fname)
     in >> magic;
     if (magic != TSYNC_FILE_MAGIC) {
         m_lastError = QStringLiteral("Unable to read data: This file is not a valid timesync metadata file.");
+        close();
         return false;
     }
 
@@ -397,6 +626,7 @@ bool TimeSyncFileReader::open(const QString &fname)
         m_lastError = QStringLiteral("Unable to read data: This file is using an incompatible (probably newer) version of the format which we can not read (%1.%2 vs %3.%4).")
                 .arg(formatVMajor).arg(formatVMinor).arg(TSYNC_FILE_VERSION_MAJOR).arg(TSYNC_FILE_VERSION_MINOR);
         XXH3_freeState(csState);
+        close();
         return false;
     }
 
@@ -440,7 +670,7 @@ bool TimeSyncFileReader::open(const QString &fname)
     m_timeDTypes = qMakePair(timeDType1, timeDType2);
 
     // skip potential alignment bytes
-    const int padding = (file.pos() * -1) & (8 - 1); // files use 8-byte alignment
+    const int padding = (m_file->pos() * -1) & (8 - 1); // files use 8-byte alignment
     for (int i = 0; i < padding; i++)
         csReadValue<quint8>(in, csState);
 
@@ -448,102 +678,76 @@ bool TimeSyncFileReader::open(const QString &fname)
     quint64 expectedHeaderCRC;
     quint64 blockTerm;
     in >> blockTerm >> expectedHeaderCRC;
+    const auto headerCRC = XXH3_64bits_digest(csState);
+    XXH3_freeState(csState);
     if (blockTerm != TSYNC_FILE_BLOCK_TERM) {
         m_lastError = QStringLiteral("Header block terminator not found: The file is either invalid or its header block was damaged.");
-        XXH3_freeState(csState);
+        close();
         return false;
     }
-    if (expectedHeaderCRC != XXH3_64bits_digest(csState)) {
+    if (expectedHeaderCRC != headerCRC) {
         m_lastError = QStringLiteral("Header checksum mismatch: The file is either invalid or its header block was damaged.");
-        XXH3_freeState(csState);
+        close();
         return false;
     }
 
-    // read the time data
-    m_times.clear();
-    int bIndex = 0;
-    XXH3_64bits_reset(csState);
-    const auto data_sec_end = file.size() - 16;
-    while (!in.atEnd()) {
-        if (file.pos() == data_sec_end) {
-            // read last 16 bytes, which *must* be the block terminator of the final block, otherwise
-            // our file was truncated or corrupted.
-            quint64 expectedCRC;
-            in >> blockTerm >> expectedCRC;
-
-            if (blockTerm != TSYNC_FILE_BLOCK_TERM) {
-                m_lastError = QStringLiteral("Unable to read all tsync data: File was likely truncated (its last block is not complete).");
-                XXH3_freeState(csState);
-                return false;
-            }
-            if (expectedCRC != XXH3_64bits_digest(csState))
-                qCWarning(logTSyncFile).noquote() << "CRC check failed for last tsync data block: Data is likely corrupted.";
-            break;
-        }
-
-        long long timeVal1;
-        long long timeVal2;
-
-        switch (timeDType1) {
-            case TSyncFileDataType::INT16:
-                timeVal1 = csReadValue<qint16>(in, csState); break;
-            case TSyncFileDataType::INT32:
-                timeVal1 = csReadValue<qint32>(in, csState); break;
-            case TSyncFileDataType::INT64:
-                timeVal1 = csReadValue<qint64>(in, csState); break;
-            case TSyncFileDataType::UINT16:
-                timeVal1 = csReadValue<quint16>(in, csState); break;
-            case TSyncFileDataType::UINT32:
-                timeVal1 = csReadValue<quint32>(in, csState); break;
-            case TSyncFileDataType::UINT64:
-                timeVal1 = csReadValue<quint64>(in, csState); break;
-            default:
-                qFatal("Tried to read unknown datatype from timesync file for time1: %i", (int) timeDType1);
-                break;
-        }
+    m_time1Size = tsyncFileDataTypeSize(timeDType1);
+    m_entrySize = m_time1Size + tsyncFileDataTypeSize(timeDType2);
+    if (m_time1Size == 0 || m_entrySize == m_time1Size || m_blockSize <= 0) {
+        m_lastError = QStringLiteral("Unable to read data: The file header contains invalid data types or an invalid block size.");
+        close();
+        return false;
+    }
 
-        switch (timeDType2) {
-            case TSyncFileDataType::INT16:
-                timeVal2 = csReadValue<qint16>(in, csState); break;
-            case TSyncFileDataType::INT32:
-                timeVal2 = csReadValue<qint32>(in, csState); break;
-            case TSyncFileDataType::INT64:
-                timeVal2 = csReadValue<qint64>(in, csState); break;
-            case TSyncFileDataType::UINT16:
-                timeVal2 = csReadValue<quint16>(in, csState); break;
-            case TSyncFileDataType::UINT32:
-                timeVal2 = csReadValue<quint32>(in, csState); break;
-            case TSyncFileDataType::UINT64:
-                timeVal2 = csReadValue<quint64>(in, csState); break;
-            default:
-                qFatal("Tried to read unknown datatype from timesync file for time2: %i", (int) timeDType2);
-                break;
+    // all data blocks but the last one are complete, so we can determine the position of every
+    // time entry from the block size alone
+    m_dataOffset = m_file->pos();
+    m_dataSize = m_file->size() - m_dataOffset;
+    m_blockBytes = m_blockSize * m_entrySize + 2 * sizeof(quint64);
+    const auto lastBlockBytes = m_dataSize % m_blockBytes;
+    m_entryCount = (m_dataSize / m_blockBytes) * m_blockSize;
+    if (lastBlockBytes != 0) {
+        if (lastBlockBytes < 2 * sizeof(quint64) || ((lastBlockBytes - 2 * sizeof(quint64)) % m_entrySize) != 0) {
+            m_lastError = QStringLiteral("Unable to read all tsync data: File was likely truncated (its last block is not complete).");
+            close();
+            return false;
         }
+        m_entryCount += (lastBlockBytes - 2 * sizeof(quint64)) / m_entrySize;
+    }
+    if (m_dataSize == 0)
+        return true;
 
-        m_times.push_back(std::make_pair(timeVal1, timeVal2));
-
-        bIndex++;
-        if (bIndex == m_blockSize) {
-            quint64 expectedCRC;
-            in >> blockTerm >> expectedCRC;
-
-            if (blockTerm != TSYNC_FILE_BLOCK_TERM) {
-                m_lastError = QStringLiteral("Unable to read all tsync data: Block separator was invalid.");
-                XXH3_freeState(csState);
-                return false;
-            }
-            if (expectedCRC != XXH3_64bits_digest(csState))
-                qCWarning(logTSyncFile).noquote() << "CRC check failed for tsync data block: Data is likely corrupted.";
+    m_fileData = m_file->map(0, m_file->size());
+    if (m_fileData == nullptr) {
+        m_lastError = QStringLiteral("Unable to map tsync data into memory: %1").arg(m_file->errorString());
+        close();
+        return false;
+    }
 
-            XXH3_64bits_reset(csState);
-            bIndex = 0;
-        }
+    // the last 16 bytes *must* be the block terminator of the final block, otherwise
+    // our file was truncated or corrupted.
+    if (qFromLittleEndian<quint64>(m_fileData + m_dataOffset + m_dataSize - 2 * sizeof(quint64)) != TSYNC_FILE_BLOCK_TERM) {
+        m_lastError = QStringLiteral("Unable to read all tsync data: File was likely truncated (its last block is not complete).");
+        close();
+        return false;
     }
 
-    XXH3_freeState(csState);
     return true;
 }
 
+void TimeSyncFileReader::close()
+{
+    if (m_fileData != nullptr)
+        m_file->unmap(m_fileData);
+    m_fileData = nullptr;
+    m_file->close();
+
+    m_dataOffset = 0;
+    m_dataSize = 0;
+    m_entryCount = 0;
+    m_blockIndex.clear();
+}
+
 QString TimeSyncFileReader::lastError() const
 {
     return m_lastError;
@@ -594,7 +798,164 @@ QPair<TSyncFileDataType, TSyncFileDataType> TimeSyncFileReader::timeDTypes() con
     return m_timeDTypes;
 }
 
-std::vector<std::pair<long long, long long> > TimeSyncFileReader::times() const
+/**
+ * Get the amount of time entries stored in this file.
+ */
+size_t TimeSyncFileReader::count() const
+{
+    return m_entryCount;
+}
+
+int TimeSyncFileReader::blockCount() const
+{
+    if (m_blockBytes == 0)
+        return 0;
+    return (m_dataSize + m_blockBytes - 1) / m_blockBytes;
+}
+
+const uchar *TimeSyncFileReader::entryData(size_t index) const
+{
+    return m_fileData + m_dataOffset
+            + (index / m_blockSize) * m_blockBytes
+            + (index % m_blockSize) * m_entrySize;
+}
+
+/**
+ * Get the time pair at @index. The index must be smaller than count().
+ */
+std::pair<long long, long long> TimeSyncFileReader::timeAt(size_t index) const
+{
+    Q_ASSERT(index < m_entryCount);
+    const auto data = entryData(index);
+    return std::make_pair(loadTimeValue(data, m_timeDTypes.first),
+                          loadTimeValue(data + m_time1Size, m_timeDTypes.second));
+}
+
+/**
+ * Read all time pairs of this file into memory.
+ * Prefer timeAt() or the conversion functions for large files.
+ */
+std::vector<std::pair<long long, long long>> TimeSyncFileReader::times() const
+{
+    std::vector<std::pair<long long, long long>> result;
+    result.reserve(m_entryCount);
+    for (size_t i = 0; i < m_entryCount; ++i)
+        result.push_back(timeAt(i));
+    return result;
+}
+
+/**
+ * Verify the checksums of all data blocks, optionally using multiple threads.
+ * Returns false and sets an error message if any block is damaged.
+ */
+bool TimeSyncFileReader::verifyChecksums(bool parallel)
+{
+    const int nBlocks = blockCount();
+    if (nBlocks == 0)
+        return true;
+
+    std::atomic_int firstBadBlock(nBlocks);
+    const auto verifyBlocks = [&](int start, int end) {
+        for (int bi = start; bi < end; bi++) {
+            const auto blockData = m_fileData + m_dataOffset + bi * m_blockBytes;
+            const auto blockLen = std::min(m_blockBytes, static_cast<size_t>(m_dataSize - bi * m_blockBytes));
+            const auto dataLen = blockLen - 2 * sizeof(quint64);
+            if ((qFromLittleEndian<quint64>(blockData + dataLen) != TSYNC_FILE_BLOCK_TERM)
+                || (qFromLittleEndian<quint64>(blockData + dataLen + sizeof(quint64)) != XXH3_64bits(blockData, dataLen))) {
+                int current = firstBadBlock;
+                while (bi < current && !firstBadBlock.compare_exchange_weak(current, bi)) {}
+                return;
+            }
+        }
+    };
+
+    const int nThreads = parallel? std::min(std::max(1, QThread::idealThreadCount()), (nBlocks + 15) / 16) : 1;
+    if (nThreads <= 1) {
+        verifyBlocks(0, nBlocks);
+    } else {
+        std::vector<std::thread> threads;
+        const int blocksPerThread = (nBlocks + nThreads - 1) / nThreads;
+        for (int i = 0; i < nThreads; i++)
+            threads.emplace_back(verifyBlocks, i * blocksPerThread, std::min(nBlocks, (i + 1) * blocksPerThread));
+        for (auto &t : threads)
+            t.join();
+    }
+
+    if (firstBadBlock < nBlocks) {
+        m_lastError = QStringLiteral("Checksum check failed for tsync data block %1: Data is likely corrupted.").arg(firstBadBlock);
+        return false;
+    }
+    return true;
+}
+
+void TimeSyncFileReader::ensureBlockIndex() const
+{
+    if (!m_blockIndex.empty() || m_entryCount == 0)
+        return;
+
+    const size_t nBlocks = blockCount();
+    m_blockIndex.reserve(nBlocks);
+    for (size_t bi = 0; bi < nBlocks; bi++)
+        m_blockIndex.push_back(timeAt(bi * m_blockSize));
+}
+
+/**
+ * Convert a time value from one column of the file into the other. Both columns
+ * are expected to increase monotonically.
+ * Values between two entries are interpolated linearly, values outside of the
+ * recorded range are shifted by the offset of the first or last entry.
+ */
+std::optional<long long> TimeSyncFileReader::convertTime(long long value, bool fromFirst) const
+{
+    if (m_entryCount == 0)
+        return std::nullopt;
+    ensureBlockIndex();
+
+    const auto key = [fromFirst](const std::pair<long long, long long> &pair) {
+        return fromFirst? pair.first : pair.second;
+    };
+    const auto other = [fromFirst](const std::pair<long long, long long> &pair) {
+        return fromFirst? pair.second : pair.first;
+    };
+
+    // find the block which contains the value, then the first entry past the value in that block
+    const auto blockIt = std::upper_bound(m_blockIndex.cbegin(), m_blockIndex.cend(), value,
+                                          [&](long long v, const std::pair<long long, long long> &pair) { return v < key(pair); });
+    if (blockIt == m_blockIndex.cbegin()) {
+        const auto first = timeAt(0);
+        return other(first) + (value - key(first));
+    }
+    size_t low = (std::distance(m_blockIndex.cbegin(), blockIt) - 1) * m_blockSize;
+    size_t high = std::min(low + m_blockSize, m_entryCount);
+    while (low < high) {
+        const auto mid = low + (high - low) / 2;
+        if (value < key(timeAt(mid)))
+            high = mid;
+        else
+            low = mid + 1;
+    }
+
+    const auto prev = timeAt(low - 1);
+    if (key(prev) == value || low >= m_entryCount)
+        return other(prev) + (value - key(prev));
+
+    const auto next = timeAt(low);
+    const double ratio = static_cast<double>(value - key(prev)) / static_cast<double>(key(next) - key(prev));
+    return other(prev) + std::llround(ratio * (other(next) - other(prev)));
+}
+
+/**
+ * Convert a device time (the first time column) into master time.
+ */
+std::optional<long long> TimeSyncFileReader::deviceToMaster(long long deviceTime) const
+{
+    return convertTime(deviceTime, true);
+}
+
+/**
+ * Convert a master time (the second time column) into device time.
+ */
+std::optional<long long> TimeSyncFileReader::masterToDevice(long long masterTime) const
 {
-    return m_times;
+    return convertTime(masterTime, false);
 }
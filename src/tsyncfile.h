@@ -20,6 +20,12 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <QLoggingCategory>
 #include <QDataStream>
 #include <QUuid>
@@ -81,6 +87,12 @@ QString tsyncFileModeToString(const TSyncFileMode &mode);
  * format data is stored in does not support timestamp adjustments, or
  * as additional set of datapoints to ensure timestamps are really
  * synchronized.
+ *
+ * Time entries are collected in memory and written to disk one complete
+ * block at a time. If asynchronous writes are enabled, full blocks are
+ * written by a background thread, so the caller usually does not wait for I/O.
+ * Only if the disk can not keep up and too many blocks are pending, the caller
+ * is blocked until the writer has caught up again.
  */
 class TimeSyncFileWriter
 {
@@ -99,6 +111,7 @@ public:
 
     void setSyncMode(TSyncFileMode mode);
     void setChunkSize(int size);
+    void setAsyncWrites(bool enabled);
 
     bool open(const QString &modName, const QUuid &collectionId, const QVariantHash &userData = QVariantHash());
     bool open(const QString &modName, const QUuid &collectionId, const microseconds_t &tolerance, const QVariantHash &userData = QVariantHash());
@@ -123,7 +136,26 @@ private:
     TSyncFileDataType m_time1DType;
     TSyncFileDataType m_time2DType;
 
+    size_t m_entrySize;
+    std::vector<char> m_block;
+    char *m_blockPos;
+
+    bool m_asyncWrites;
+    std::thread m_writerThread;
+    std::mutex m_writerMutex;
+    std::condition_variable m_writerCond;
+    std::deque<std::vector<char>> m_pendingBlocks;
+    std::vector<std::vector<char>> m_spareBlocks;
+    bool m_writerBusy;
+    bool m_writerStop;
+    bool m_writerStalled;
+
     void writeBlockTerminator(bool check = true);
+    void finishDataBlock();
+    void writePartialBlock();
+    void writeBlockData(const char *data, size_t len);
+    void stopWriterThread();
+    void writerThreadFunc();
     template<class T> void csWriteValue(const T &data);
     template<class T1, class T2> void writeTimeEntry(const T1 &time1, const T2 &time2);
 };
@@ -131,16 +163,22 @@ private:
 /**
  * @brief Read a time-sync (.tsync) file
  *
- * Simple helper class to read the contents of a .tsync file,
+ * Helper class to read the contents of a .tsync file,
  * for adjustments of the source timestamps or simply conversion
  * into a non-binary format.
+ *
+ * The time data is mapped into memory and only decoded when it is accessed,
+ * so even very large files can be opened instantly. Time values can be converted
+ * between the two time columns of the file in O(log n).
  */
 class TimeSyncFileReader
 {
 public:
     explicit TimeSyncFileReader();
+    ~TimeSyncFileReader();
 
     bool open(const QString &fname);
+    void close();
     QString lastError() const;
 
     QString moduleName() const;
@@ -155,9 +193,18 @@ public:
     QPair<TSyncFileTimeUnit, TSyncFileTimeUnit> timeUnits() const;
     QPair<TSyncFileDataType, TSyncFileDataType> timeDTypes() const;
 
+    size_t count() const;
+    std::pair<long long, long long> timeAt(size_t index) const;
     std::vector<std::pair<long long, long long>> times() const;
 
+    bool verifyChecksums(bool parallel = true);
+
+    std::optional<long long> deviceToMaster(long long deviceTime) const;
+    std::optional<long long> masterToDevice(long long masterTime) const;
+
 private:
+    Q_DISABLE_COPY(TimeSyncFileReader)
+
     QString m_lastError;
     QString m_moduleName;
     qint64 m_creationTime;
@@ -168,10 +215,24 @@ private:
     int m_blockSize;
 
     microseconds_t m_tolerance;
-    std::vector<std::pair<long long, long long>> m_times;
     QPair<QString, QString> m_timeNames;
     QPair<TSyncFileTimeUnit, TSyncFileTimeUnit> m_timeUnits;
     QPair<TSyncFileDataType, TSyncFileDataType> m_timeDTypes;
+
+    std::unique_ptr<QFile> m_file;
+    uchar *m_fileData;
+    qint64 m_dataOffset;
+    qint64 m_dataSize;
+    size_t m_entrySize;
+    size_t m_time1Size;
+    size_t m_blockBytes;
+    size_t m_entryCount;
+    mutable std::vector<std::pair<long long, long long>> m_blockIndex;
+
+    int blockCount() const;
+    const uchar *entryData(size_t index) const;
+    void ensureBlockIndex() const;
+    std::optional<long long> convertTime(long long value, bool fromFirst) const;
 };
 
 } // end of namespace
@@ -109,6 +109,12 @@ QStringList stringListNaturalSort(QStringList &list)
     return list;
 }
 
+QString shortThreadName(const QString &name, int index)
+{
+    const auto suffix = QStringLiteral("-%1").arg(index);
+    return name.left(qMax(15 - suffix.length(), 0)) + suffix;
+}
+
 QString syntalosVersionFull()
 {
     auto syVersion = QStringLiteral(SY_VCS_TAG);
@@ -56,6 +56,14 @@ QStringList qStringSplitLimit(const QString &str,
 **/
 QStringList stringListNaturalSort(QStringList &list);
 
+/**
+ * @brief Create a thread name that fits into the 15 characters the kernel keeps.
+ *
+ * The name is cut to make room for a "-<index>" suffix, so threads with
+ * long, similar names remain distinguishable by their index.
+ */
+QString shortThreadName(const QString &name, int index);
+
 /**
  * @brief Return the complete current Syntalos version number.
  */
@@ -0,0 +1,145 @@
+// Benchmark of per-element vs. batched publishing on subscription queues,
+// including the eventfd notifications a stream subscription sends to its consumer.
+
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <optional>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "common/simplethread.h"
+#include "streams/readerwriterqueue.h"
+#include "streams/batchqueue.h"
+
+using namespace moodycamel;
+
+// roughly the size of a small signal block
+struct Block
+{
+    uint64_t index;
+    int32_t data[30];
+};
+
+static const int ELEMENT_COUNT = 2000000;
+static const int BATCH_SIZE = 16;
+
+static void notifyEventfd(int efd)
+{
+    const uint64_t one = 1;
+    if (write(efd, &one, sizeof(one)) < 0)
+        std::perror("eventfd write");
+}
+
+static void waitEventfd(int epfd, int efd)
+{
+    struct epoll_event ev;
+    if (epoll_wait(epfd, &ev, 1, 100) > 0) {
+        uint64_t count;
+        if (read(efd, &count, sizeof(count)) < 0)
+            std::perror("eventfd read");
+    }
+}
+
+static int createEpoll(int efd)
+{
+    const int epfd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = efd;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, efd, &ev);
+    return epfd;
+}
+
+/**
+ * The current subscription behavior: every element is wrapped in an std::optional,
+ * signals the semaphore and writes to the eventfd.
+ */
+static double benchPerElement()
+{
+    BlockingReaderWriterQueue<std::optional<Block>> q(256);
+    const int efd = eventfd(0, EFD_NONBLOCK);
+    const int epfd = createEpoll(efd);
+    std::atomic_int received(0);
+
+    const auto start = std::chrono::steady_clock::now();
+    SimpleThread reader([&]() {
+        std::optional<Block> item;
+        while (received < ELEMENT_COUNT) {
+            waitEventfd(epfd, efd);
+            while (q.try_dequeue(item))
+                received++;
+        }
+    });
+    SimpleThread writer([&]() {
+        Block block = {};
+        for (int i = 0; i < ELEMENT_COUNT; ++i) {
+            block.index = i;
+            q.enqueue(std::optional<Block>(block));
+            notifyEventfd(efd);
+        }
+    });
+    writer.join();
+    reader.join();
+    const auto end = std::chrono::steady_clock::now();
+
+    close(epfd);
+    close(efd);
+    return std::chrono::duration<double, std::nano>(end - start).count() / ELEMENT_COUNT;
+}
+
+/**
+ * The batched backend: elements are published in batches which signal the semaphore
+ * once, and the eventfd is only written when the consumer acknowledged the last notification.
+ */
+static double benchBatched(int batchSize)
+{
+    Syntalos::BlockingBatchQueue<Block> q(256);
+    const int efd = eventfd(0, EFD_NONBLOCK);
+    const int epfd = createEpoll(efd);
+    std::atomic_bool notifyArmed(true);
+    std::atomic_int received(0);
+
+    const auto start = std::chrono::steady_clock::now();
+    SimpleThread reader([&]() {
+        Block item;
+        while (received < ELEMENT_COUNT) {
+            waitEventfd(epfd, efd);
+            notifyArmed = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (q.tryDequeue(item))
+                received++;
+        }
+    });
+    SimpleThread writer([&]() {
+        std::vector<Block> batch(batchSize);
+        for (int i = 0; i < ELEMENT_COUNT; i += batchSize) {
+            for (int j = 0; j < batchSize; ++j)
+                batch[j].index = i + j;
+            q.enqueueBatch(batch.cbegin(), batch.cend());
+
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (notifyArmed.exchange(false))
+                notifyEventfd(efd);
+        }
+    });
+    writer.join();
+    reader.join();
+    const auto end = std::chrono::steady_clock::now();
+
+    close(epfd);
+    close(efd);
+    return std::chrono::duration<double, std::nano>(end - start).count() / ELEMENT_COUNT;
+}
+
+int main(int, char**)
+{
+    std::printf("Publishing %d elements of %zu bytes\n", ELEMENT_COUNT, sizeof(Block));
+    std::printf("  per element, optional + eventfd:     %8.1f ns/element\n", benchPerElement());
+    std::printf("  batch size 1, coalesced eventfd:     %8.1f ns/element\n", benchBatched(1));
+    std::printf("  batch size %2d, coalesced eventfd:    %8.1f ns/element\n", BATCH_SIZE, benchBatched(BATCH_SIZE));
+    return 0;
+}
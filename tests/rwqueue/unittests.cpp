@@ -7,10 +7,13 @@
 #include <string>
 #include <memory>
 #include <iostream>
+#include <vector>
+#include <algorithm>
 
 #include "minitest.h"
 #include "common/simplethread.h"
 #include "streams/readerwriterqueue.h"
+#include "streams/batchqueue.h"
 
 using namespace moodycamel;
 
@@ -75,6 +78,7 @@ public:
         REGISTER_TEST(size_approx);
         REGISTER_TEST(threaded);
         REGISTER_TEST(blocking);
+        REGISTER_TEST(batch_blocking);
         REGISTER_TEST(vector);
 #if MOODYCAMEL_HAS_EMPLACE
         REGISTER_TEST(emplace);
@@ -540,6 +544,83 @@ public:
         return true;
     }
 
+    bool batch_blocking()
+    {
+        {
+            Syntalos::BlockingBatchQueue<int> q;
+            int item;
+
+            q.enqueue(123);
+            ASSERT_OR_FAIL(q.tryDequeue(item));
+            ASSERT_OR_FAIL(item == 123);
+            ASSERT_OR_FAIL(q.sizeApprox() == 0);
+
+            const std::vector<int> batch = {1, 2, 3, 4};
+            ASSERT_OR_FAIL(q.enqueueBatch(batch.cbegin(), batch.cend()) == 4);
+            ASSERT_OR_FAIL(q.sizeApprox() == 4);
+            ASSERT_OR_FAIL(*q.peek() == 1);
+            ASSERT_OR_FAIL(q.pop());
+            for (int i = 2; i <= 4; ++i) {
+                ASSERT_OR_FAIL(q.waitDequeue(item));
+                ASSERT_OR_FAIL(item == i);
+            }
+            ASSERT_OR_FAIL(!q.tryDequeue(item));
+
+            // closing wakes up readers, but pending elements are still delivered
+            q.enqueue(5);
+            q.close();
+            ASSERT_OR_FAIL(q.waitDequeue(item));
+            ASSERT_OR_FAIL(item == 5);
+            ASSERT_OR_FAIL(!q.waitDequeue(item));
+            ASSERT_OR_FAIL(!q.waitDequeue(item));
+            ASSERT_OR_FAIL(!q.tryDequeue(item));
+
+            q.reset();
+            ASSERT_OR_FAIL(!q.isClosed());
+            ASSERT_OR_FAIL(!q.tryDequeue(item));
+            q.enqueue(6);
+            ASSERT_OR_FAIL(q.tryDequeue(item));
+            ASSERT_OR_FAIL(item == 6);
+        }
+
+        weak_atomic<int> result;
+        result = 1;
+
+        {
+            Syntalos::BlockingBatchQueue<int> q(100);
+            SimpleThread reader([&]() {
+                int item = -1;
+                int prevItem = -1;
+                int count = 0;
+                while (q.waitDequeue(item)) {
+                    if (item != prevItem + 1)
+                        result = 0;
+                    prevItem = item;
+                    count++;
+                }
+                if (count != 1000000)
+                    result = 0;
+            });
+            SimpleThread writer([&]() {
+                std::vector<int> batch(16);
+                for (int i = 0; i != 1000000; i += 16) {
+                    for (int j = 0; j < 16; ++j)
+                        batch[j] = i + j;
+                    q.enqueueBatch(batch.cbegin(), batch.cbegin() + std::min(16, 1000000 - i));
+                }
+                q.close();
+            });
+
+            writer.join();
+            reader.join();
+
+            ASSERT_OR_FAIL(q.sizeApprox() == 0);
+            ASSERT_OR_FAIL(result.load());
+        }
+
+        return true;
+    }
+
     bool vector()
     {
         {
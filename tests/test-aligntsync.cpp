@@ -0,0 +1,123 @@
+#include <QtTest>
+#include <QDebug>
+#include <QTemporaryDir>
+#include <tuple>
+#include <algorithm>
+
+#include "edlstorage.h"
+#include "tsyncfile.h"
+#include "aligntsync.h"
+
+using namespace Syntalos;
+
+using AlignRow = std::tuple<qint64, quint16, qint64>;
+
+class TestAlignTSync : public QObject
+{
+    Q_OBJECT
+private:
+    static bool writeTSyncFile(const QString &fname, TSyncFileTimeUnit masterUnit,
+                               const std::vector<std::pair<long, long>> &times)
+    {
+        TimeSyncFileWriter tswriter;
+        tswriter.setFileName(fname);
+        tswriter.setTimeUnits(TSyncFileTimeUnit::MICROSECONDS, masterUnit);
+        if (!tswriter.open(QStringLiteral("UnittestDummyModule"), QUuid("a12975f1-84b7-4350-8683-7a5fe9ed968f")))
+            return false;
+        for (const auto &pair : times)
+            tswriter.writeTimes(pair.first, pair.second);
+        tswriter.close();
+        return true;
+    }
+
+private slots:
+    void alignOverlappingFiles()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+
+        std::unique_ptr<EDLCollection> collection(new EDLCollection("align-test"));
+        collection->setRootPath(dir.path());
+
+        // two sources with overlapping master time ranges and different units,
+        // long enough to span multiple chunks of the output file
+        std::vector<std::pair<long, long>> timesA;
+        for (long i = 0; i < 100000; i++)
+            timesA.push_back({i, i * 1000 + 1});
+        std::vector<std::pair<long, long>> timesB;
+        for (long i = 0; i < 40000; i++)
+            timesB.push_back({i * 7, 20000 + i * 3});
+
+        auto dsetA = collection->datasetByName("a", true);
+        QVERIFY(writeTSyncFile(dsetA->setDataFile("a_timestamps.tsync"), TSyncFileTimeUnit::MICROSECONDS, timesA));
+        auto dsetB = collection->datasetByName("b", true);
+        QVERIFY(writeTSyncFile(dsetB->setAuxDataFile("b_timestamps.tsync"), TSyncFileTimeUnit::MILLISECONDS, timesB));
+        QVERIFY2(collection->save(), qPrintable(collection->lastError()));
+
+        const auto outFname = dir.filePath("aligned.idx");
+        QCOMPARE(alignCollectionTimestamps(collection->path(), outFname, 2), 0);
+
+        std::vector<AlignRow> expected;
+        for (const auto &pair : timesA)
+            expected.push_back({pair.second, 0, pair.first});
+        for (const auto &pair : timesB)
+            expected.push_back({pair.second * 1000, 1, pair.first});
+        std::sort(expected.begin(), expected.end());
+
+        QFile file(outFname);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QDataStream in(&file);
+        in.setVersion(QDataStream::Qt_5_12);
+        in.setByteOrder(QDataStream::LittleEndian);
+
+        char magic[8];
+        QCOMPARE(in.readRawData(magic, 8), 8);
+        QCOMPARE(QByteArray(magic, 8), QByteArray("SYEVTIDX"));
+        quint16 version;
+        quint32 sourceCount;
+        in >> version >> sourceCount;
+        QCOMPARE(version, static_cast<quint16>(1));
+        QCOMPARE(sourceCount, static_cast<quint32>(2));
+        for (uint i = 0; i < sourceCount; i++) {
+            QString datasetPath, fname, modName, timeName, timeUnit;
+            in >> datasetPath >> fname >> modName >> timeName >> timeUnit;
+            QCOMPARE(datasetPath, i == 0? QStringLiteral("a") : QStringLiteral("b"));
+            QCOMPARE(modName, QStringLiteral("UnittestDummyModule"));
+        }
+        quint32 chunkRows;
+        in >> chunkRows;
+        QVERIFY(chunkRows > 0);
+
+        std::vector<AlignRow> rows;
+        uint chunkCount = 0;
+        while (true) {
+            quint32 count;
+            in >> count;
+            QCOMPARE(in.status(), QDataStream::Ok);
+            if (count == 0)
+                break;
+            QVERIFY(count <= chunkRows);
+            chunkCount++;
+
+            std::vector<qint64> masterTimes(count);
+            std::vector<quint16> sourceIds(count);
+            std::vector<qint64> deviceTimes(count);
+            for (auto &v : masterTimes)
+                in >> v;
+            for (auto &v : sourceIds)
+                in >> v;
+            for (auto &v : deviceTimes)
+                in >> v;
+            for (uint i = 0; i < count; i++)
+                rows.push_back({masterTimes[i], sourceIds[i], deviceTimes[i]});
+        }
+        QVERIFY(in.atEnd());
+        QVERIFY(chunkCount > 1);
+
+        QCOMPARE(rows.size(), expected.size());
+        QVERIFY(rows == expected);
+    }
+};
+
+QTEST_MAIN(TestAlignTSync)
+#include "test-aligntsync.moc"
@@ -0,0 +1,148 @@
+#include <QtTest>
+#include <QDebug>
+#include <QTemporaryDir>
+#include <opencv2/core.hpp>
+
+#include "rawvideofile.h"
+
+class TestRawVideoFile : public QObject
+{
+    Q_OBJECT
+private:
+    static cv::Mat makeFrame(int rows, int cols, int type, int seed)
+    {
+        cv::Mat mat(rows, cols, type);
+        cv::randu(mat, cv::Scalar::all(seed % 7), cv::Scalar::all(200 + seed % 50));
+        return mat;
+    }
+
+    static bool matsEqual(const cv::Mat &a, const cv::Mat &b)
+    {
+        if (a.size != b.size || a.type() != b.type())
+            return false;
+        return cv::norm(a, b, cv::NORM_INF) == 0;
+    }
+
+private slots:
+    void roundTripPartialBuffers()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto rawFname = dir.filePath(QStringLiteral("video.syraw"));
+
+        // big enough frames to fill several write buffers, with a partially filled
+        // buffer at the end which has to be padded and truncated again
+        const int rows = 480;
+        const int cols = 640;
+        const int type = CV_8UC3;
+        const int frameCount = 43;
+        const auto frameBytes = static_cast<qint64>(rows) * cols * 3;
+
+        std::vector<cv::Mat> frames;
+        RawVideoWriter writer;
+        writer.initialize(dir.filePath(QStringLiteral("video")), cols, rows, 30, type);
+        QVERIFY(writer.initialized());
+        for (int i = 0; i < frameCount; i++) {
+            frames.push_back(makeFrame(rows, cols, type, i));
+            QVERIFY2(writer.encodeFrame(frames.back(), std::chrono::microseconds(i * 33333 + 7)),
+                     writer.lastError().c_str());
+        }
+        writer.finalize();
+        QVERIFY(!writer.initialized());
+        QCOMPARE(writer.writtenFiles(), QStringList() << rawFname);
+        qDebug() << "Direct I/O used:" << writer.directIO();
+
+        // no padding or preallocated space may be left behind
+        QCOMPARE(QFileInfo(rawFname).size(), 4096 + frameCount * frameBytes);
+
+        RawVideoReader reader;
+        QVERIFY2(reader.open(rawFname), reader.lastError().c_str());
+        QCOMPARE(reader.width(), cols);
+        QCOMPARE(reader.height(), rows);
+        QCOMPARE(reader.fps(), 30);
+        QCOMPARE(reader.cvType(), type);
+        QCOMPARE(reader.frameCount(), static_cast<size_t>(frameCount));
+
+        cv::Mat frame;
+        std::chrono::microseconds timestamp;
+        for (int i = 0; i < frameCount; i++) {
+            QVERIFY2(reader.readFrame(static_cast<size_t>(i), frame, timestamp), reader.lastError().c_str());
+            QCOMPARE(timestamp.count(), static_cast<long>(i * 33333 + 7));
+            QVERIFY(matsEqual(frame, frames[static_cast<size_t>(i)]));
+        }
+        QVERIFY(!reader.readFrame(static_cast<size_t>(frameCount), frame, timestamp));
+    }
+
+    void roundTripNonContinuous()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+
+        // regions of interest of a bigger matrix have gaps between their rows
+        const auto big = makeFrame(100, 120, CV_16UC1, 3);
+        const auto roiA = big(cv::Rect(10, 10, 80, 60));
+        const auto roiB = big(cv::Rect(30, 35, 80, 60));
+        QVERIFY(!roiA.isContinuous());
+
+        RawVideoWriter writer;
+        writer.initialize(dir.filePath(QStringLiteral("roi")), 80, 60, 10, CV_16UC1);
+        QVERIFY(writer.encodeFrame(roiA, std::chrono::microseconds(1000)));
+        QVERIFY(writer.encodeFrame(roiB, std::chrono::microseconds(2000)));
+
+        // frames of the wrong format are refused
+        QVERIFY(!writer.encodeFrame(big, std::chrono::microseconds(3000)));
+        QVERIFY(!writer.lastError().empty());
+        writer.finalize();
+
+        RawVideoReader reader;
+        QVERIFY2(reader.open(dir.filePath(QStringLiteral("roi.syraw"))), reader.lastError().c_str());
+        QCOMPARE(reader.frameCount(), static_cast<size_t>(2));
+
+        cv::Mat frame;
+        std::chrono::microseconds timestamp;
+        QVERIFY(reader.readFrame(0, frame, timestamp));
+        QVERIFY(matsEqual(frame, roiA));
+        QVERIFY(reader.readFrame(1, frame, timestamp));
+        QVERIFY(matsEqual(frame, roiB));
+        QCOMPARE(timestamp.count(), static_cast<long>(2000));
+    }
+
+    void truncatedIndex()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const auto rawFname = dir.filePath(QStringLiteral("crash.syraw"));
+
+        RawVideoWriter writer;
+        writer.initialize(dir.filePath(QStringLiteral("crash")), 32, 24, 20, CV_8UC1);
+        for (int i = 0; i < 10; i++)
+            QVERIFY(writer.encodeFrame(makeFrame(24, 32, CV_8UC1, i), std::chrono::microseconds(i * 50000)));
+        writer.finalize();
+
+        // cut the last index record in half, as if we crashed while writing it
+        QFile idxFile(rawVideoIndexFilename(rawFname));
+        QVERIFY(idxFile.resize(idxFile.size() - 10));
+
+        RawVideoReader reader;
+        QVERIFY2(reader.open(rawFname), reader.lastError().c_str());
+        QCOMPARE(reader.frameCount(), static_cast<size_t>(9));
+
+        // frames whose data didn't completely make it to disk are ignored as well
+        QFile rawFile(rawFname);
+        QVERIFY(rawFile.resize(rawFile.size() - 32 * 24 - 100));
+        QVERIFY2(reader.open(rawFname), reader.lastError().c_str());
+        QCOMPARE(reader.frameCount(), static_cast<size_t>(8));
+
+        cv::Mat frame;
+        std::chrono::microseconds timestamp;
+        QVERIFY(reader.readFrame(7, frame, timestamp));
+        QCOMPARE(timestamp.count(), static_cast<long>(7 * 50000));
+
+        // a file without valid header is refused
+        QVERIFY(rawFile.resize(100));
+        QVERIFY(!reader.open(rawFname));
+    }
+};
+
+QTEST_MAIN(TestRawVideoFile)
+#include "test-rawvideofile.moc"
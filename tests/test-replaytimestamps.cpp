@@ -0,0 +1,108 @@
+#include <QtTest>
+#include <QDebug>
+#include <QFile>
+
+#include "replaytimestamps.h"
+#include "utils/misc.h"
+
+using namespace Syntalos;
+
+class TestReplayTimestamps : public QObject
+{
+    Q_OBJECT
+private:
+    static QString writeTSyncFile(TSyncFileTimeUnit unit1, TSyncFileTimeUnit unit2,
+                                  const std::vector<std::pair<long, long>> &times)
+    {
+        const auto fnameBase = QStringLiteral("/tmp/replaytstest-%1").arg(createRandomString(8));
+
+        TimeSyncFileWriter tswriter;
+        tswriter.setFileName(fnameBase);
+        tswriter.setTimeUnits(unit1, unit2);
+        if (!tswriter.open(QStringLiteral("UnittestDummyModule"), QUuid("a12975f1-84b7-4350-8683-7a5fe9ed968f")))
+            return QString();
+        for (const auto &pair : times)
+            tswriter.writeTimes(pair.first, pair.second);
+        tswriter.close();
+
+        return fnameBase + QStringLiteral(".tsync");
+    }
+
+private slots:
+    void millisecondMasterTimes()
+    {
+        // frame index to master time in milliseconds, as written by older video recordings
+        std::vector<std::pair<long, long>> times;
+        for (long i = 0; i < 2500; i++)
+            times.push_back({i, i * 33 + 7});
+        const auto fname = writeTSyncFile(TSyncFileTimeUnit::INDEX, TSyncFileTimeUnit::MILLISECONDS, times);
+        QVERIFY(!fname.isEmpty());
+
+        ReplayTimestamps ts;
+        QVERIFY2(ts.open(fname, false), qPrintable(ts.lastError()));
+        QCOMPARE(ts.count(), times.size());
+        for (size_t i = 0; i < times.size(); i++)
+            QCOMPARE(ts.masterTimeAt(i), microseconds_t(times[i].second * 1000));
+
+        // the frame index can not be used as device time
+        QVERIFY(!ts.deviceToMaster(microseconds_t(1000)).has_value());
+        QVERIFY(!ts.open(fname, true));
+        QVERIFY(!ts.lastError().isEmpty());
+
+        QFile::remove(fname);
+    }
+
+    void millisecondDeviceToMaster()
+    {
+        std::vector<std::pair<long, long>> times;
+        for (long i = 0; i < 500; i++)
+            times.push_back({i * 10, i * 10 + 5});
+        const auto fname = writeTSyncFile(TSyncFileTimeUnit::MILLISECONDS, TSyncFileTimeUnit::MILLISECONDS, times);
+        QVERIFY(!fname.isEmpty());
+
+        ReplayTimestamps ts;
+        QVERIFY2(ts.open(fname, true), qPrintable(ts.lastError()));
+        QCOMPARE(ts.deviceToMaster(microseconds_t(20 * 1000)).value(), microseconds_t(25 * 1000));
+        QCOMPARE(ts.deviceToMaster(microseconds_t(25 * 1000)).value(), microseconds_t(30 * 1000));
+        QCOMPARE(ts.deviceToMaster(microseconds_t(4990 * 1000)).value(), microseconds_t(4995 * 1000));
+        QCOMPARE(ts.masterTimeAt(3), microseconds_t(35 * 1000));
+
+        QFile::remove(fname);
+    }
+
+    void mixedUnits()
+    {
+        // device time in microseconds, master time in nanoseconds
+        std::vector<std::pair<long, long>> times;
+        for (long i = 0; i < 100; i++)
+            times.push_back({i * 1000, i * 1000 * 1000 + 2000});
+        const auto fname = writeTSyncFile(TSyncFileTimeUnit::MICROSECONDS, TSyncFileTimeUnit::NANOSECONDS, times);
+        QVERIFY(!fname.isEmpty());
+
+        ReplayTimestamps ts;
+        QVERIFY2(ts.open(fname, true), qPrintable(ts.lastError()));
+        QCOMPARE(ts.masterTimeAt(10), microseconds_t(10 * 1000 + 2));
+        QCOMPARE(ts.deviceToMaster(microseconds_t(50500)).value(), microseconds_t(50502));
+
+        QFile::remove(fname);
+    }
+
+    void unsupportedUnits()
+    {
+        std::vector<std::pair<long, long>> times;
+        for (long i = 0; i < 10; i++)
+            times.push_back({i, i});
+        const auto fname = writeTSyncFile(TSyncFileTimeUnit::INDEX, TSyncFileTimeUnit::INDEX, times);
+        QVERIFY(!fname.isEmpty());
+
+        ReplayTimestamps ts;
+        QVERIFY(!ts.open(fname, false));
+        QVERIFY(!ts.lastError().isEmpty());
+        QCOMPARE(ts.count(), static_cast<size_t>(0));
+
+        QFile::remove(fname);
+    }
+};
+
+QTEST_MAIN(TestReplayTimestamps)
+#include "test-replaytimestamps.moc"
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <thread>
+#include <QtTest>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#include "syclock.h"
+#include "sytrace.h"
+#include "utils/misc.h"
+
+using namespace Syntalos;
+
+class TestTrace : public QObject
+{
+    Q_OBJECT
+private slots:
+
+    void traceRecordExport()
+    {
+        const auto origin = symaster_clock::now();
+        traceReset();
+
+        // nothing is recorded while tracing is disabled
+        {
+            SY_TRACE_SPAN("disabled-span");
+        }
+
+        traceSetEnabled(true);
+        const auto detail = traceIntern(QStringLiteral("Module \"A\""));
+        const auto recordSpans = [&](int count) {
+            for (int i = 0; i < count; i++)
+                SY_TRACE_SPAN("test-span", detail);
+        };
+        std::thread thread(recordSpans, 200);
+        recordSpans(100);
+        thread.join();
+        traceSetEnabled(false);
+
+        const auto traceFname = QStringLiteral("/tmp/sytrace-%1.json").arg(createRandomString(8));
+        QString errorMessage;
+        QVERIFY2(traceExportChromeJson(traceFname, origin, &errorMessage), qPrintable(errorMessage));
+
+        QFile file(traceFname);
+        QVERIFY(file.open(QFile::ReadOnly));
+        QJsonParseError parseError;
+        const auto doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+        file.remove();
+        QCOMPARE(parseError.error, QJsonParseError::NoError);
+
+        int spanCount = 0;
+        QSet<int> tids;
+        for (const auto &value : doc.object().value("traceEvents").toArray()) {
+            const auto event = value.toObject();
+            QVERIFY(event.value("name").toString() != QStringLiteral("disabled-span"));
+            if (event.value("ph").toString() != QStringLiteral("X"))
+                continue;
+            QCOMPARE(event.value("name").toString(), QStringLiteral("test-span"));
+            QCOMPARE(event.value("args").toObject().value("detail").toString(), QStringLiteral("Module \"A\""));
+            QVERIFY(event.value("ts").toDouble() >= 0);
+            QVERIFY(event.value("dur").toDouble() >= 0);
+            tids.insert(event.value("tid").toInt());
+            spanCount++;
+        }
+        QCOMPARE(spanCount, 300);
+        QCOMPARE(tids.size(), 2);
+    }
+};
+
+QTEST_MAIN(TestTrace)
+#include "test-sytrace.moc"
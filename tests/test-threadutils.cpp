@@ -0,0 +1,113 @@
+#include <QtTest>
+#include <QDebug>
+#include <QSet>
+#include <thread>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "cpuaffinity.h"
+#include "utils/misc.h"
+
+class TestThreadUtils : public QObject
+{
+    Q_OBJECT
+private:
+    static QString currentThreadComm()
+    {
+        QFile commFile(QStringLiteral("/proc/self/task/%1/comm").arg(syscall(SYS_gettid)));
+        if (!commFile.open(QFile::ReadOnly))
+            return QString();
+        return QString::fromUtf8(commFile.readAll()).trimmed();
+    }
+
+private slots:
+    void shortThreadNames()
+    {
+        // short names are kept intact
+        QCOMPARE(shortThreadName(QStringLiteral("camera"), 2), QStringLiteral("camera-2"));
+        QCOMPARE(shortThreadName(QStringLiteral("ev:shared_0"), 0), QStringLiteral("ev:shared_0-0"));
+
+        // long names are cut, but always keep their index
+        QCOMPARE(shortThreadName(QStringLiteral("camera-generic"), 3), QStringLiteral("camera-generi-3"));
+        QCOMPARE(shortThreadName(QStringLiteral("ev:m:camera-generic_1"), 5), QStringLiteral("ev:m:camera-g-5"));
+        QCOMPARE(shortThreadName(QString(), 7), QStringLiteral("-7"));
+
+        // threads of modules with long, similar names remain distinguishable
+        QSet<QString> names;
+        for (int i = 0; i < 200; i++) {
+            const auto name = shortThreadName(QStringLiteral("ev:m:videorecorder_%1").arg(i / 4), i);
+            QVERIFY(name.length() <= 15);
+            names.insert(name);
+        }
+        QCOMPARE(names.size(), 200);
+    }
+
+    void threadNamesKeptByKernel()
+    {
+        const auto name = shortThreadName(QStringLiteral("intan-rhx-acquisition"), 42);
+        QString comm;
+        std::thread thread([&]() {
+            pthread_setname_np(pthread_self(), qPrintable(name));
+            comm = currentThreadComm();
+        });
+        thread.join();
+
+        QCOMPARE(comm, name);
+    }
+
+    void threadAffinity()
+    {
+        const auto coreCount = get_online_cores_count();
+        QVERIFY(coreCount > 0);
+
+        cpu_set_t origSet;
+        CPU_ZERO(&origSet);
+        QCOMPARE(pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &origSet), 0);
+        std::vector<unsigned> allowedCores;
+        for (int i = 0; i < CPU_SETSIZE; i++) {
+            if (CPU_ISSET(i, &origSet))
+                allowedCores.push_back(static_cast<unsigned>(i));
+        }
+        QVERIFY(!allowedCores.empty());
+
+        std::vector<unsigned> cores;
+        cores.push_back(allowedCores.front());
+        if (allowedCores.size() > 1)
+            cores.push_back(allowedCores.back());
+
+        int ret = -1;
+        cpu_set_t threadSet;
+        CPU_ZERO(&threadSet);
+        std::thread thread([&]() {
+            ret = thread_set_affinity_from_vec(pthread_self(), cores);
+            pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &threadSet);
+        });
+        thread.join();
+
+        QCOMPARE(ret, 0);
+        QCOMPARE(CPU_COUNT(&threadSet), static_cast<int>(cores.size()));
+        for (const auto core : cores)
+            QVERIFY(CPU_ISSET(core, &threadSet));
+
+        // pinning to a single core
+        std::thread singleThread([&]() {
+            ret = thread_set_affinity(pthread_self(), cores.back());
+            pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &threadSet);
+        });
+        singleThread.join();
+
+        QCOMPARE(ret, 0);
+        QCOMPARE(CPU_COUNT(&threadSet), 1);
+        QVERIFY(CPU_ISSET(cores.back(), &threadSet));
+
+        // an empty set of cores is refused
+        std::thread invalidThread([&]() {
+            ret = thread_set_affinity_from_vec(pthread_self(), std::vector<unsigned>());
+        });
+        invalidThread.join();
+        QCOMPARE(ret, -1);
+    }
+};
+
+QTEST_MAIN(TestThreadUtils)
+#include "test-threadutils.moc"
@@ -592,6 +592,146 @@ private slots:
         }
 
     }
+
+    void runClockDomainSynchronizer()
+    {
+        std::shared_ptr<SyncTimer> syTimer(new SyncTimer());
+        auto domain = SecondaryClockDomain::get(syTimer, QStringLiteral("trigger"));
+        QCOMPARE(SecondaryClockDomain::get(syTimer, QStringLiteral("trigger")), domain);
+
+        const auto calibrationCount = 20;
+        std::unique_ptr<SecondaryClockSynchronizer> syncA(new SecondaryClockSynchronizer(syTimer, nullptr, "a", domain));
+        std::unique_ptr<SecondaryClockSynchronizer> syncB(new SecondaryClockSynchronizer(syTimer, nullptr, "b", domain));
+        QCOMPARE(domain->memberCount(), 2);
+        for (auto sync : {syncA.get(), syncB.get()}) {
+            sync->setStrategies(TimeSyncStrategy::SHIFT_TIMESTAMPS_BWD | TimeSyncStrategy::SHIFT_TIMESTAMPS_FWD);
+            sync->setCalibrationPointsCount(calibrationCount);
+            sync->setTolerance(microseconds_t(1000));
+        }
+
+        syTimer->start();
+        QVERIFY(syncA->start());
+        QVERIFY(syncB->start());
+
+        // both devices timestamp with the same secondary clock, which is 11.111ms ahead of master time
+        const auto secondaryClockOffset = microseconds_t(11111);
+        auto curMasterTS = microseconds_t(500 * 1000);
+        auto pointCount = 0;
+        while (!syncA->isCalibrated()) {
+            for (auto sync : {syncA.get(), syncB.get()}) {
+                auto syncMasterTS = curMasterTS;
+                sync->processTimestamp(syncMasterTS, curMasterTS + secondaryClockOffset);
+                QCOMPARE(syncMasterTS.count(), curMasterTS.count());
+                curMasterTS = curMasterTS + microseconds_t(500) + ((pointCount % 2)? microseconds_t(20) : microseconds_t(-20));
+                pointCount++;
+            }
+            QVERIFY(pointCount < calibrationCount * 4);
+        }
+
+        // the estimator is shared, so datapoints of both devices count towards calibration
+        QVERIFY(syncB->isCalibrated());
+        QCOMPARE(pointCount, calibrationCount + (calibrationCount / 2));
+        QCOMPARE(syncA->expectedOffsetToMaster(), syncB->expectedOffsetToMaster());
+        QCOMPARE(syncA->expectedOffsetToMaster().count(), secondaryClockOffset.count());
+
+        // the clock starts to drift, both devices must see the same correction
+        auto lastMasterTSA = microseconds_t(0);
+        auto lastMasterTSB = microseconds_t(0);
+        for (auto i = 0; i < calibrationCount * 4; ++i) {
+            curMasterTS = curMasterTS + microseconds_t(400);
+            auto masterTSA = curMasterTS;
+            syncA->processTimestamp(masterTSA, curMasterTS + secondaryClockOffset + microseconds_t(i * 100));
+            auto masterTSB = curMasterTS;
+            syncB->processTimestamp(masterTSB, curMasterTS + secondaryClockOffset + microseconds_t(i * 100));
+            QCOMPARE(syncA->clockCorrectionOffset(), syncB->clockCorrectionOffset());
+
+            // time must never run backwards for any device
+            QVERIFY(masterTSA >= lastMasterTSA);
+            QVERIFY(masterTSB >= lastMasterTSB);
+            lastMasterTSA = masterTSA;
+            lastMasterTSB = masterTSB;
+        }
+        QVERIFY(syncA->clockCorrectionOffset().count() > 0);
+
+        syncA->stop();
+        syncB->stop();
+        syncA.reset();
+        QCOMPARE(domain->memberCount(), 1);
+    }
+
+    void clockDomainFrequencySum()
+    {
+        std::shared_ptr<SyncTimer> syTimer(new SyncTimer());
+        auto domain = SecondaryClockDomain::get(syTimer, QStringLiteral("freqsum"));
+        std::unique_ptr<SecondaryClockSynchronizer> syncA(new SecondaryClockSynchronizer(syTimer, nullptr, "a", domain));
+        std::unique_ptr<SecondaryClockSynchronizer> syncB(new SecondaryClockSynchronizer(syTimer, nullptr, "b", domain));
+        QCOMPARE(domain->expectedClockFrequencyHz(), 0.0);
+
+        // changing the frequency of a member replaces its previous value
+        syncA->setExpectedClockFrequencyHz(100);
+        syncA->setExpectedClockFrequencyHz(200);
+        syncB->setExpectedClockFrequencyHz(50);
+        QCOMPARE(domain->expectedClockFrequencyHz(), 250.0);
+        syncB->setExpectedClockFrequencyHz(50);
+        QCOMPARE(domain->expectedClockFrequencyHz(), 250.0);
+
+        // members which leave don't contribute anymore
+        syncA.reset();
+        QCOMPARE(domain->expectedClockFrequencyHz(), 50.0);
+        syncB.reset();
+        QCOMPARE(domain->memberCount(), 0);
+        QCOMPARE(domain->expectedClockFrequencyHz(), 0.0);
+    }
+
+    void freqCounterBatchMatchesBlocks(bool linearDriftFit)
+    {
+        std::shared_ptr<SyncTimer> syTimer(new SyncTimer());
+        std::unique_ptr<FakeIndexDevice> idxDev(new FakeIndexDevice());
+        const int calibrationCount = 250;
+
+        std::unique_ptr<FreqCounterSynchronizer> blockSync(new FreqCounterSynchronizer(syTimer, nullptr, idxDev->freqHz()));
+        std::unique_ptr<FreqCounterSynchronizer> batchSync(new FreqCounterSynchronizer(syTimer, nullptr, idxDev->freqHz()));
+        for (auto sync : {blockSync.get(), batchSync.get()}) {
+            sync->setStrategies(TimeSyncStrategy::SHIFT_TIMESTAMPS_BWD | TimeSyncStrategy::SHIFT_TIMESTAMPS_FWD);
+            sync->setCalibrationBlocksCount(calibrationCount);
+            sync->setTolerance(microseconds_t(1000));
+            sync->setLinearDriftFit(linearDriftFit);
+        }
+        syTimer->start();
+        QVERIFY(blockSync->start());
+        QVERIFY(batchSync->start());
+
+        // secondary clock runs fast after calibration, so the synchronizers have to make adjustments
+        auto curMasterTS = microseconds_t(500 * 1000);
+        bool haveIndexOffset = false;
+        for (auto i = 0; i < calibrationCount * 12; ++i) {
+            curMasterTS = curMasterTS + milliseconds_t(1);
+            if (i > calibrationCount * 2 && i % 100 == 0)
+                curMasterTS = curMasterTS - microseconds_t(300);
+
+            auto block1 = idxDev->generateBlock();
+            auto block2 = idxDev->generateBlock();
+            VectorXu batch(block1.rows() + block2.rows());
+            batch << block1, block2;
+
+            blockSync->processTimestamps(curMasterTS, microseconds_t(0), 0, 2, block1);
+            blockSync->processTimestamps(curMasterTS, microseconds_t(0), 1, 2, block2);
+            batchSync->processTimestampBatch(curMasterTS, microseconds_t(0), 2, batch);
+
+            QCOMPARE(batchSync->indexOffset(), blockSync->indexOffset());
+            QVERIFY(batch.head(block1.rows()) == block1);
+            QVERIFY(batch.tail(block2.rows()) == block2);
+            haveIndexOffset = haveIndexOffset || (blockSync->indexOffset() != 0);
+        }
+        QVERIFY(blockSync->isCalibrated());
+        QVERIFY(haveIndexOffset);
+    }
+
+    void runFreqCounterSynchronizerBatch()
+    {
+        freqCounterBatchMatchesBlocks(false);
+        freqCounterBatchMatchesBlocks(true);
+    }
 };
 
 QTEST_MAIN(TestTimer)
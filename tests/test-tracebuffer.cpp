@@ -0,0 +1,117 @@
+#include <QtTest>
+#include <QDebug>
+#include <random>
+
+#include "tracebuffer.h"
+
+class TestTraceBuffer : public QObject
+{
+    Q_OBJECT
+private:
+    static bool bruteForceMinMax(const std::vector<float> &values, uint64_t firstAvailable,
+                                 uint64_t first, uint64_t last, TraceBuffer::MinMax &result)
+    {
+        first = std::max(first, firstAvailable);
+        last = std::min(last, static_cast<uint64_t>(values.size()));
+        if (first >= last)
+            return false;
+        result = TraceBuffer::MinMax{values[first], values[first]};
+        for (auto i = first; i < last; i++) {
+            result.min = std::min(result.min, values[i]);
+            result.max = std::max(result.max, values[i]);
+        }
+        return true;
+    }
+
+    static void verifyRandomRanges(const TraceBuffer &buffer, const std::vector<float> &values, std::mt19937 &gen)
+    {
+        std::uniform_int_distribution<uint64_t> posDist(0, values.size() + 16);
+        for (int i = 0; i < 2000; i++) {
+            auto first = posDist(gen);
+            auto last = posDist(gen);
+            if (first > last)
+                std::swap(first, last);
+
+            TraceBuffer::MinMax expected{0, 0};
+            TraceBuffer::MinMax mm{0, 0};
+            const bool expectedValid = bruteForceMinMax(values, buffer.firstIndex(), first, last, expected);
+            QCOMPARE(buffer.rangeMinMax(first, last, mm), expectedValid);
+            if (!expectedValid)
+                continue;
+            QCOMPARE(mm.min, expected.min);
+            QCOMPARE(mm.max, expected.max);
+        }
+    }
+
+private slots:
+    void emptyBuffer()
+    {
+        TraceBuffer buffer(64);
+        TraceBuffer::MinMax mm{0, 0};
+        QVERIFY(!buffer.rangeMinMax(0, 100, mm));
+
+        buffer.append(4.5f);
+        QVERIFY(buffer.rangeMinMax(0, 100, mm));
+        QCOMPARE(mm.min, 4.5f);
+        QCOMPARE(mm.max, 4.5f);
+        QVERIFY(!buffer.rangeMinMax(1, 100, mm));
+        QVERIFY(!buffer.rangeMinMax(0, 0, mm));
+
+        buffer.reset();
+        QCOMPARE(buffer.endIndex(), static_cast<uint64_t>(0));
+        QVERIFY(!buffer.rangeMinMax(0, 100, mm));
+    }
+
+    void rangeMinMaxMatchesSamples()
+    {
+        std::mt19937 gen(42);
+        std::normal_distribution<float> valueDist(0, 100);
+
+        // a range of sizes which do and don't end on pyramid bucket boundaries
+        TraceBuffer buffer(1 << 16);
+        std::vector<float> values;
+        for (const int count : {1, 7, 8, 63, 64, 513, 4096, 10000}) {
+            for (int i = 0; i < count; i++) {
+                values.push_back(valueDist(gen));
+                buffer.append(values.back());
+            }
+            QCOMPARE(buffer.endIndex(), static_cast<uint64_t>(values.size()));
+            verifyRandomRanges(buffer, values, gen);
+        }
+
+        // a single outlier must be found in any range that contains it
+        const auto spikePos = values.size() / 2;
+        values[spikePos] = 10000;
+        buffer.reset();
+        buffer.append(values.cbegin(), values.cend());
+        TraceBuffer::MinMax mm{0, 0};
+        QVERIFY(buffer.rangeMinMax(spikePos - 1000, spikePos + 1, mm));
+        QCOMPARE(mm.max, 10000.0f);
+        QVERIFY(buffer.rangeMinMax(spikePos + 1, values.size(), mm));
+        QVERIFY(mm.max < 10000.0f);
+    }
+
+    void rangeMinMaxAfterWrapAround()
+    {
+        std::mt19937 gen(7);
+        std::uniform_real_distribution<float> valueDist(-500, 500);
+
+        // once the ring buffer has wrapped around, old samples must never contribute
+        TraceBuffer buffer(1000);
+        std::vector<float> values;
+        for (int round = 0; round < 6; round++) {
+            for (int i = 0; i < 777; i++) {
+                values.push_back(valueDist(gen));
+                buffer.append(values.back());
+            }
+            QCOMPARE(buffer.firstIndex(), values.size() > buffer.capacity()? values.size() - buffer.capacity() : 0);
+            verifyRandomRanges(buffer, values, gen);
+        }
+
+        TraceBuffer::MinMax mm{0, 0};
+        QVERIFY(!buffer.rangeMinMax(0, buffer.firstIndex(), mm));
+    }
+};
+
+QTEST_MAIN(TestTraceBuffer)
+#include "test-tracebuffer.moc"
@@ -14,7 +14,7 @@ class TestTSyncFile : public QObject
     Q_OBJECT
 private slots:
 
-    void tsyncFileRWForDTypes(TSyncFileDataType dt1, TSyncFileDataType dt2, int values_n = 142000)
+    void tsyncFileRWForDTypes(TSyncFileDataType dt1, TSyncFileDataType dt2, int values_n = 142000, bool asyncWrites = false)
     {
         auto tsFilename = QStringLiteral("/tmp/tstest-%1").arg(createRandomString(8));
 
@@ -22,6 +22,7 @@ private slots:
         auto tswriter = new TimeSyncFileWriter;
         tswriter->setFileName(tsFilename);
         tswriter->setTimeDataTypes(dt1, dt2);
+        tswriter->setAsyncWrites(asyncWrites);
         auto ret = tswriter->open(QStringLiteral("UnittestDummyModule"), QUuid("a12975f1-84b7-4350-8683-7a5fe9ed968f"), microseconds_t(1500));
         QVERIFY2(ret, qPrintable(tswriter->lastError()));
 
@@ -55,6 +56,16 @@ private slots:
             QCOMPARE(pair.first, tbase);
             QCOMPARE(pair.second, tbase + (long) i * 51);
         }
+
+        // random access and time conversion
+        QVERIFY2(tsreader->verifyChecksums(), qPrintable(tsreader->lastError()));
+        QCOMPARE(tsreader->count(), (size_t) values_n);
+        QCOMPARE(tsreader->timeAt(values_n / 2).second, (long long) (values_n / 2) * 1051);
+        QCOMPARE(tsreader->deviceToMaster(7000).value(), 7LL * 1051);
+        QCOMPARE(tsreader->deviceToMaster(250).value(), 263LL);
+        QCOMPARE(tsreader->masterToDevice(4321LL * 1051).value(), 4321LL * 1000);
+        QCOMPARE(tsreader->deviceToMaster((long long) (values_n - 1) * 1000 + 10).value(),
+                 (long long) (values_n - 1) * 1051 + 10);
         delete tsreader;
 
         // delete temporary file
@@ -82,6 +93,62 @@ private slots:
         tsyncFileRWForDTypes(TSyncFileDataType::UINT32, TSyncFileDataType::UINT64);
     }
 
+    void runTestTSyncAsyncWrites()
+    {
+        tsyncFileRWForDTypes(TSyncFileDataType::INT32, TSyncFileDataType::INT64, 142000, true);
+    }
+
+    void tsyncFlushPartialBlock(bool asyncWrites)
+    {
+        auto tsFilename = QStringLiteral("/tmp/tstest-%1").arg(createRandomString(8));
+
+        TimeSyncFileWriter tswriter;
+        tswriter.setFileName(tsFilename);
+        tswriter.setTimeDataTypes(TSyncFileDataType::INT64, TSyncFileDataType::INT64);
+        tswriter.setAsyncWrites(asyncWrites);
+        QVERIFY2(tswriter.open(QStringLiteral("UnittestDummyModule"), QUuid::createUuid()),
+                 qPrintable(tswriter.lastError()));
+
+        // everything we wrote so far must be readable after a flush, while
+        // the last block is still incomplete
+        int written = 0;
+        for (const int count : {10, 5000, 1, 2790, 3000}) {
+            for (int i = 0; i < count; ++i, ++written)
+                tswriter.writeTimes(microseconds_t(written * 1000), microseconds_t(written * 1000 + 7));
+            tswriter.flush();
+
+            TimeSyncFileReader tsreader;
+            QVERIFY2(tsreader.open(tsFilename + QStringLiteral(".tsync")), qPrintable(tsreader.lastError()));
+            QVERIFY2(tsreader.verifyChecksums(), qPrintable(tsreader.lastError()));
+            QCOMPARE(tsreader.count(), (size_t) written);
+            QCOMPARE(tsreader.timeAt(written - 1).first, (long long) (written - 1) * 1000);
+        }
+
+        tswriter.writeTimes(microseconds_t(written * 1000), microseconds_t(written * 1000 + 7));
+        written++;
+        tswriter.close();
+
+        TimeSyncFileReader tsreader;
+        QVERIFY2(tsreader.open(tsFilename + QStringLiteral(".tsync")), qPrintable(tsreader.lastError()));
+        QVERIFY2(tsreader.verifyChecksums(), qPrintable(tsreader.lastError()));
+        QCOMPARE(tsreader.count(), (size_t) written);
+        for (int i = 0; i < written; ++i)
+            QCOMPARE(tsreader.timeAt(i).second, (long long) i * 1000 + 7);
+
+        QFile file (tsFilename + QStringLiteral(".tsync"));
+        file.remove();
+    }
+
+    void runTestTSyncFlush()
+    {
+        tsyncFlushPartialBlock(false);
+    }
+
+    void runTestTSyncFlushAsync()
+    {
+        tsyncFlushPartialBlock(true);
+    }
+
     void runBenchmark()
     {
         QBENCHMARK {
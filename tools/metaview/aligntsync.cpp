@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2020 Matthias Klumpp <matthias@tenstral.net>
+ *
+ * Licensed under the GNU General Public License Version 3
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the license, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "aligntsync.h"
+
+#include <memory>
+#include <vector>
+#include <limits>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <iostream>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QDataStream>
+#include <QtEndian>
+#include <QThread>
+
+#include "tsyncfile.h"
+#include "utils/tomlutils.h"
+
+using namespace Syntalos;
+
+/**
+ * Aligned event index file format
+ *
+ * The output is a little-endian binary file starting with a header:
+ *  - the magic bytes "SYEVTIDX"
+ *  - u16 format version
+ *  - u32 source count, followed by the dataset path, file name, module name and
+ *    device time name and unit of each source as QDataStream strings
+ *  - u32 maximum amount of rows per chunk
+ *
+ * The header is followed by chunks of rows ordered by master time. Each chunk starts with
+ * its u32 row count, followed by the columns of all rows in this chunk:
+ *  - i64 master time in µs
+ *  - u16 source index
+ *  - i64 device time, in the unit of the respective source
+ * A chunk with a row count of zero terminates the file.
+ */
+
+static const char ALIGN_FILE_MAGIC[] = "SYEVTIDX";
+static const quint16 ALIGN_FILE_VERSION = 1;
+static const size_t ALIGN_CHUNK_ROWS = 64 * 1024;
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpadded"
+struct AlignSource
+{
+    QString datasetPath;
+    QString fname;
+    std::unique_ptr<TimeSyncFileReader> reader;
+    long long usecMultiplier;
+    long long usecDivisor;
+    QString error;
+};
+
+struct AlignChunk
+{
+    std::vector<qint64> masterTimes;
+    std::vector<quint16> sourceIds;
+    std::vector<qint64> deviceTimes;
+
+    void clear()
+    {
+        masterTimes.clear();
+        sourceIds.clear();
+        deviceTimes.clear();
+    }
+};
+#pragma GCC diagnostic pop
+
+static bool masterUnitToUsec(TSyncFileTimeUnit unit, long long &multiplier, long long &divisor)
+{
+    multiplier = 1;
+    divisor = 1;
+    switch (unit) {
+    case TSyncFileTimeUnit::NANOSECONDS:
+        divisor = 1000;
+        return true;
+    case TSyncFileTimeUnit::MICROSECONDS:
+        return true;
+    case TSyncFileTimeUnit::MILLISECONDS:
+        multiplier = 1000;
+        return true;
+    case TSyncFileTimeUnit::SECONDS:
+        multiplier = 1000 * 1000;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * Find all .tsync files that are registered as data of a dataset in the collection
+ * at @rootDir, by reading the EDL manifests of the collection.
+ */
+static std::vector<std::unique_ptr<AlignSource>> findCollectionTSyncFiles(const QString &rootDir, QString &errorMessage)
+{
+    std::vector<std::unique_ptr<AlignSource>> sources;
+    const QDir root(rootDir);
+
+    const auto rootManifest = parseTomlFile(root.filePath(QStringLiteral("manifest.toml")), errorMessage);
+    if (!errorMessage.isEmpty())
+        return sources;
+    if (rootManifest.value(QStringLiteral("type")).toString() != QStringLiteral("collection")) {
+        errorMessage = QStringLiteral("Directory '%1' does not contain an EDL collection.").arg(rootDir);
+        return sources;
+    }
+
+    QStringList manifestFiles;
+    QDirIterator it(rootDir, QStringList() << QStringLiteral("manifest.toml"), QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext())
+        manifestFiles.append(it.next());
+    manifestFiles.sort();
+
+    for (const auto &manifestFname : manifestFiles) {
+        QString error;
+        const auto manifest = parseTomlFile(manifestFname, error);
+        if (!error.isEmpty()) {
+            std::cerr << "Unable to read manifest '" << manifestFname.toStdString() << "': " << error.toStdString() << std::endl;
+            continue;
+        }
+        if (manifest.value(QStringLiteral("type")).toString() != QStringLiteral("dataset"))
+            continue;
+
+        const auto dsetDir = QFileInfo(manifestFname).absoluteDir();
+        for (const auto &section : {QStringLiteral("data"), QStringLiteral("data_aux")}) {
+            const auto parts = manifest.value(section).toHash().value(QStringLiteral("parts")).toList();
+            for (const auto &part : parts) {
+                const auto partFname = part.toHash().value(QStringLiteral("fname")).toString();
+                if (!partFname.endsWith(QStringLiteral(".tsync")))
+                    continue;
+                auto src = std::make_unique<AlignSource>();
+                src->datasetPath = root.relativeFilePath(dsetDir.absolutePath());
+                src->fname = dsetDir.filePath(partFname);
+                sources.push_back(std::move(src));
+            }
+        }
+    }
+
+    return sources;
+}
+
+template<typename T>
+static void writeAlignColumn(QDataStream &out, QByteArray &buffer, const std::vector<T> &column)
+{
+    // columns are written in bulk, converted to little endian on big-endian hosts
+    buffer.resize(static_cast<int>(column.size() * sizeof(T)));
+    qToLittleEndian<T>(column.data(), column.size(), buffer.data());
+    out.writeRawData(buffer.constData(), buffer.size());
+}
+
+static void writeAlignChunk(QDataStream &out, const AlignChunk &chunk)
+{
+    QByteArray buffer;
+    out << static_cast<quint32>(chunk.masterTimes.size());
+    writeAlignColumn(out, buffer, chunk.masterTimes);
+    writeAlignColumn(out, buffer, chunk.sourceIds);
+    writeAlignColumn(out, buffer, chunk.deviceTimes);
+}
+
+int alignCollectionTimestamps(const QString &collectionDir, const QString &outFname, int jobs)
+{
+    QString errorMessage;
+    auto sources = findCollectionTSyncFiles(collectionDir, errorMessage);
+    if (!errorMessage.isEmpty()) {
+        std::cerr << "Unable to read collection: " << errorMessage.toStdString() << std::endl;
+        return 1;
+    }
+    if (sources.empty()) {
+        std::cerr << "No timesync files found in collection." << std::endl;
+        return 1;
+    }
+    if (sources.size() > std::numeric_limits<quint16>::max()) {
+        std::cerr << "Too many timesync files in collection." << std::endl;
+        return 1;
+    }
+
+    // open and verify all files in parallel
+    if (jobs <= 0)
+        jobs = QThread::idealThreadCount();
+    std::atomic_size_t nextSource(0);
+    std::vector<std::thread> openThreads;
+    for (int i = 0; i < std::min(jobs, static_cast<int>(sources.size())); i++) {
+        openThreads.emplace_back([&]() {
+            for (auto si = nextSource++; si < sources.size(); si = nextSource++) {
+                auto &src = sources[si];
+                src->reader = std::make_unique<TimeSyncFileReader>();
+                if (!src->reader->open(src->fname)) {
+                    src->error = src->reader->lastError();
+                    continue;
+                }
+                if (!masterUnitToUsec(src->reader->timeUnits().second, src->usecMultiplier, src->usecDivisor)) {
+                    src->error = QStringLiteral("Second time column is not a time.");
+                    continue;
+                }
+                if (!src->reader->verifyChecksums(false))
+                    src->error = src->reader->lastError();
+            }
+        });
+    }
+    for (auto &t : openThreads)
+        t.join();
+
+    for (const auto &src : sources) {
+        if (src->error.isEmpty())
+            continue;
+        std::cerr << "Unable to use '" << src->fname.toStdString() << "': " << src->error.toStdString() << std::endl;
+        return 1;
+    }
+
+    QFile file(outFname);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::cerr << "Unable to open output file '" << outFname.toStdString() << "': " << file.errorString().toStdString() << std::endl;
+        return 1;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_12);
+    out.setByteOrder(QDataStream::LittleEndian);
+
+    out.writeRawData(ALIGN_FILE_MAGIC, 8);
+    out << ALIGN_FILE_VERSION;
+    out << static_cast<quint32>(sources.size());
+    for (const auto &src : sources) {
+        out << src->datasetPath
+            << QFileInfo(src->fname).fileName()
+            << src->reader->moduleName()
+            << src->reader->timeNames().first
+            << tsyncFileTimeUnitToString(src->reader->timeUnits().first);
+    }
+    out << static_cast<quint32>(ALIGN_CHUNK_ROWS);
+
+    // chunks are written by a separate thread while we merge the next one,
+    // at most two chunks are ever held in memory
+    AlignChunk mergeChunk;
+    AlignChunk writeChunk;
+    bool writePending = false;
+    bool mergeDone = false;
+    std::mutex writeMutex;
+    std::condition_variable writeCond;
+    std::thread writeThread([&]() {
+        std::unique_lock<std::mutex> lock(writeMutex);
+        while (true) {
+            writeCond.wait(lock, [&]() { return writePending || mergeDone; });
+            if (!writePending)
+                break;
+            lock.unlock();
+            writeAlignChunk(out, writeChunk);
+            lock.lock();
+            writePending = false;
+            writeCond.notify_all();
+        }
+    });
+    const auto submitChunk = [&]() {
+        std::unique_lock<std::mutex> lock(writeMutex);
+        writeCond.wait(lock, [&]() { return !writePending; });
+        std::swap(mergeChunk, writeChunk);
+        writePending = true;
+        writeCond.notify_all();
+        mergeChunk.clear();
+    };
+
+    // k-way merge of all files by master time, each file is assumed to be sorted already
+    using HeapEntry = std::pair<qint64, size_t>;
+    std::vector<size_t> positions(sources.size(), 0);
+    std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+    const auto masterTimeAt = [&](size_t si, size_t pos) {
+        const auto &src = sources[si];
+        return src->reader->timeAt(pos).second * src->usecMultiplier / src->usecDivisor;
+    };
+    for (size_t si = 0; si < sources.size(); si++) {
+        if (sources[si]->reader->count() > 0)
+            heap.push(std::make_pair(masterTimeAt(si, 0), si));
+    }
+
+    mergeChunk.masterTimes.reserve(ALIGN_CHUNK_ROWS);
+    mergeChunk.sourceIds.reserve(ALIGN_CHUNK_ROWS);
+    mergeChunk.deviceTimes.reserve(ALIGN_CHUNK_ROWS);
+    size_t rowCount = 0;
+    while (!heap.empty()) {
+        const auto top = heap.top();
+        heap.pop();
+        const auto si = top.second;
+        const auto &src = sources[si];
+
+        mergeChunk.masterTimes.push_back(top.first);
+        mergeChunk.sourceIds.push_back(static_cast<quint16>(si));
+        mergeChunk.deviceTimes.push_back(src->reader->timeAt(positions[si]).first);
+        rowCount++;
+
+        positions[si]++;
+        if (positions[si] < src->reader->count())
+            heap.push(std::make_pair(masterTimeAt(si, positions[si]), si));
+
+        if (mergeChunk.masterTimes.size() >= ALIGN_CHUNK_ROWS)
+            submitChunk();
+    }
+    if (!mergeChunk.masterTimes.empty())
+        submitChunk();
+
+    {
+        std::unique_lock<std::mutex> lock(writeMutex);
+        writeCond.wait(lock, [&]() { return !writePending; });
+        mergeDone = true;
+        writeCond.notify_all();
+    }
+    writeThread.join();
+
+    // terminating empty chunk
+    out << static_cast<quint32>(0);
+    file.close();
+    if (file.error() != QFile::NoError) {
+        std::cerr << "Unable to write output file: " << file.errorString().toStdString() << std::endl;
+        return 1;
+    }
+
+    std::cout << "Aligned " << rowCount << " timestamps from " << sources.size() << " files." << std::endl;
+    return 0;
+}
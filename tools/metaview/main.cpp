@@ -24,6 +24,7 @@
 #include <iostream>
 
 #include "readtsync.h"
+#include "aligntsync.h"
 
 int main(int argc, char *argv[])
 {
@@ -42,12 +43,32 @@ int main(int argc, char *argv[])
                                    QStringLiteral("file"));
     parser.addOption(tsyncOption);
 
+    QCommandLineOption alignOption(QStringLiteral("align-collection"),
+                                   QStringLiteral("Merge the timestamps of all time-sync files in an EDL collection into one index ordered by master time"),
+                                   QStringLiteral("dir"));
+    parser.addOption(alignOption);
+    QCommandLineOption outputOption(QStringList() << QStringLiteral("o") << QStringLiteral("output"),
+                                    QStringLiteral("Output file for the aligned timestamp index"),
+                                    QStringLiteral("file"));
+    parser.addOption(outputOption);
+    QCommandLineOption jobsOption(QStringList() << QStringLiteral("j") << QStringLiteral("jobs"),
+                                  QStringLiteral("Number of files to read in parallel (defaults to the number of CPUs)"),
+                                  QStringLiteral("n"));
+    parser.addOption(jobsOption);
+
     parser.process(a);
 
     QString tsyncFile = parser.value(tsyncOption);
+    QString alignDir = parser.value(alignOption);
     if (!tsyncFile.isEmpty())
         return displayTSyncMetadata(tsyncFile);
-    else {
+    else if (!alignDir.isEmpty()) {
+        if (!parser.isSet(outputOption)) {
+            std::cerr << "No output file set for the aligned timestamps." << std::endl;
+            return 1;
+        }
+        return alignCollectionTimestamps(alignDir, parser.value(outputOption), parser.value(jobsOption).toInt());
+    } else {
         std::cout << parser.helpText().toStdString() << std::endl;
         return 0;
     }
@@ -51,8 +51,12 @@ int displayTSyncMetadata(const QString &fname)
         for (const auto key : userData.keys())
             std::cout << "    " << key.toStdString() << ": " << userData[key].toString().toStdString() << "\n";
     }
+    std::cout << "Entries: " << tsr->count() << "\n";
     std::cout << std::endl;
 
+    if (!tsr->verifyChecksums())
+        std::cerr << "Warning: " << tsr->lastError().toStdString() << std::endl;
+
     auto timeNames = tsr->timeNames();
     if (timeNames.first.isEmpty())
         timeNames.first = QStringLiteral("time-a");
@@ -60,7 +64,8 @@ int displayTSyncMetadata(const QString &fname)
         timeNames.second = QStringLiteral("time-b");
 
     std::cout << timeNames.first.toStdString() << ";" << timeNames.second.toStdString() << "\n";
-    for (const auto &pair : tsr->times()) {
+    for (size_t i = 0; i < tsr->count(); ++i) {
+        const auto pair = tsr->timeAt(i);
         std::cout << pair.first << ";" << pair.second << "\n";
     }
 